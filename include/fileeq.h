@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 #if defined(__linux__) && defined(HAVE_LINUX_IF_ALG_H)
 # define USE_FILEEQ_CRYPTOAPI 1
@@ -53,5 +54,19 @@ extern size_t ul_fileeq_set_size(struct ul_fileeq *eq, uint64_t filesiz,
 
 extern int ul_fileeq(struct ul_fileeq *eq,
               struct ul_fileeq_data *a, struct ul_fileeq_data *b);
+extern int ul_fileeq_data_prefetch(struct ul_fileeq *eq,
+              struct ul_fileeq_data *data, size_t nblocks);
+
+struct ul_fileeq_cache;
+
+extern struct ul_fileeq_cache *ul_fileeq_cache_open(struct ul_fileeq *eq,
+              const char *filename);
+extern int ul_fileeq_cache_load(struct ul_fileeq_cache *cache,
+              struct ul_fileeq *eq, struct ul_fileeq_data *data,
+              const struct stat *st);
+extern int ul_fileeq_cache_store(struct ul_fileeq_cache *cache,
+              struct ul_fileeq *eq, struct ul_fileeq_data *data,
+              const struct stat *st);
+extern int ul_fileeq_cache_close(struct ul_fileeq_cache *cache);
 
 #endif /* UTIL_LINUX_FILEEQ */
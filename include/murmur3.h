@@ -0,0 +1,12 @@
+#ifndef UTIL_LINUX_MURMUR3_H
+#define UTIL_LINUX_MURMUR3_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UL_MURMUR3_128LENGTH	16
+
+extern void ul_murmur3_128(const void *data, size_t len, uint32_t seed,
+			   unsigned char digest[UL_MURMUR3_128LENGTH]);
+
+#endif /* UTIL_LINUX_MURMUR3_H */
@@ -24,6 +24,11 @@
  *  send to the kernel hash functions (sha1, ...), and only hash digest is read
  *  and cached in usersapce. Fast for large set of (large) files.
  *
+ *  * userspace checksums: the same as crypto API, but data blocks are read to
+ *  userspace and the digest is calculated by crc32c() (SSE4.2 if available)
+ *  or MurmurHash3. Does not depend on the crypto API (often not available in
+ *  containers), but the checksums are not cryptographic.
+ *
  *
  * No copyright is claimed.  This code is in the public domain; do with
  * it what you wish.
@@ -35,6 +40,9 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 /* Linux crypto */
@@ -49,6 +57,10 @@
 #include "all-io.h"
 #include "fileeq.h"
 #include "debug.h"
+#include "crc32c.h"
+#include "murmur3.h"
+#include "closestream.h"
+#include "strutils.h"
 
 static UL_DEBUG_DEFINE_MASK(ulfileeq);
 UL_DEBUG_DEFINE_MASKNAMES(ulfileeq) = UL_DEBUG_EMPTY_MASKNAMES;
@@ -57,6 +69,7 @@ UL_DEBUG_DEFINE_MASKNAMES(ulfileeq) = UL_DEBUG_EMPTY_MASKNAMES;
 #define ULFILEEQ_DEBUG_CRYPTO	(1 << 2)
 #define ULFILEEQ_DEBUG_DATA	(1 << 3)
 #define ULFILEEQ_DEBUG_EQ	(1 << 4)
+#define ULFILEEQ_DEBUG_CACHE	(1 << 5)
 
 #define DBG(m, x)       __UL_DBG(ulfileeq, ULFILEEQ_DEBUG_, m, x)
 #define ON_DBG(m, x)    __UL_DBG_CALL(ulfileeq, ULFILEEQ_DEBUG_, m, x)
@@ -75,7 +88,9 @@ enum {
 	UL_FILEEQ_MEMCMP,
 	UL_FILEEQ_SHA1,
 	UL_FILEEQ_SHA256,
-	UL_FILEEQ_CRC32
+	UL_FILEEQ_CRC32,
+	UL_FILEEQ_CRC32C,
+	UL_FILEEQ_MURMUR3
 };
 
 struct ul_fileeq_method {
@@ -83,8 +98,23 @@ struct ul_fileeq_method {
 	const char *name;	/* name used by applications */
 	const char *kname;	/* name used by kernel crypto */
 	short digsiz;
+
+	/* userspace digest calculation */
+	void (*digest)(const unsigned char *buf, size_t sz, unsigned char *dig);
 };
 
+static void digest_crc32c(const unsigned char *buf, size_t sz, unsigned char *dig)
+{
+	uint32_t crc = crc32c(~0U, buf, sz) ^ ~0U;
+
+	memcpy(dig, &crc, sizeof(crc));
+}
+
+static void digest_murmur3(const unsigned char *buf, size_t sz, unsigned char *dig)
+{
+	ul_murmur3_128(buf, sz, 0, dig);
+}
+
 static const struct ul_fileeq_method ul_eq_methods[] = {
 	[UL_FILEEQ_MEMCMP] = {
 		.id = UL_FILEEQ_MEMCMP, .name = "memcmp"
@@ -102,8 +132,16 @@ static const struct ul_fileeq_method ul_eq_methods[] = {
 	[UL_FILEEQ_CRC32] = {
 		.id = UL_FILEEQ_CRC32, .name = "crc32",
 		.digsiz = 4, .kname = "crc32c"
-	}
+	},
 #endif
+	[UL_FILEEQ_CRC32C] = {
+		.id = UL_FILEEQ_CRC32C, .name = "crc32c",
+		.digsiz = 4, .digest = digest_crc32c
+	},
+	[UL_FILEEQ_MURMUR3] = {
+		.id = UL_FILEEQ_MURMUR3, .name = "murmur3",
+		.digsiz = UL_MURMUR3_128LENGTH, .digest = digest_murmur3
+	}
 };
 
 #ifdef USE_FILEEQ_CRYPTOAPI
@@ -167,7 +205,7 @@ int ul_fileeq_init(struct ul_fileeq *eq, const char *method)
 	for (i = 0; i < ARRAY_SIZE(ul_eq_methods); i++) {
 		const struct ul_fileeq_method *m = &ul_eq_methods[i];
 
-		if (strcmp(m->name, method) == 0) {
+		if (m->name && strcmp(m->name, method) == 0) {
 			eq->method = m;
 			break;
 		}
@@ -175,11 +213,14 @@ int ul_fileeq_init(struct ul_fileeq *eq, const char *method)
 
 	if (!eq->method)
 		return -1;
+	if (eq->method->kname) {
 #ifdef USE_FILEEQ_CRYPTOAPI
-	if (eq->method->id != UL_FILEEQ_MEMCMP
-	    && init_crypto_api(eq) != 0)
+		if (init_crypto_api(eq) != 0)
+			return -1;
+#else
 		return -1;
 #endif
+	}
 	return 0;
 }
 
@@ -388,7 +429,6 @@ static ssize_t read_block(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 	return rsz;
 }
 
-#ifdef USE_FILEEQ_CRYPTOAPI
 static ssize_t get_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 				size_t n, unsigned char **block)
 {
@@ -431,17 +471,36 @@ static ssize_t get_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 
 	assert(n <= eq->blocksmax);
 
-	rsz = sendfile(eq->fd_cip, data->fd, NULL, eq->readsiz);
-	DBG(DATA, ul_debugobj(data, "  sent %zu [%zu wanted] to cipher", rsz, eq->readsiz));
+	/* get block digest (note 1st block is data->intro */
+	*block = data->blocks + (n * eq->method->digsiz);
 
-	if (rsz < 0)
-		return rsz;
+	if (eq->method->digest) {
+		unsigned char *buf = get_buffer(eq);
 
-	off += rsz;
+		if (!buf)
+			return -ENOMEM;
+		rsz = read_all(data->fd, (char *) buf, eq->readsiz);
+		DBG(DATA, ul_debugobj(data, "  read %zd [%zu wanted] to digest", rsz, eq->readsiz));
+		if (rsz < 0)
+			return rsz;
+
+		off += rsz;
+		eq->method->digest(buf, rsz, *block);
+		rsz = sz;
+	} else {
+#ifdef USE_FILEEQ_CRYPTOAPI
+		rsz = sendfile(eq->fd_cip, data->fd, NULL, eq->readsiz);
+		DBG(DATA, ul_debugobj(data, "  sent %zu [%zu wanted] to cipher", rsz, eq->readsiz));
 
-	/* get block digest (note 1st block is data->intro */
-	*block = data->blocks + (n * eq->method->digsiz);
-	rsz = read_all(eq->fd_cip, (char *) *block, sz);
+		if (rsz < 0)
+			return rsz;
+
+		off += rsz;
+		rsz = read_all(eq->fd_cip, (char *) *block, sz);
+#else
+		return -1;
+#endif
+	}
 
 	if (rsz > 0)
 		data->nblocks++;
@@ -452,7 +511,6 @@ static ssize_t get_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 	DBG(DATA, ul_debugobj(data, "  get %zuB digest", rsz));
 	return rsz;
 }
-#endif
 
 static ssize_t get_intro(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 				unsigned char **block)
@@ -489,11 +547,7 @@ static ssize_t get_cmp_data(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 	default:
 		break;
 	}
-#ifdef USE_FILEEQ_CRYPTOAPI
 	return get_digest(eq, data, blockno, block);
-#else
-	return -1;
-#endif
 }
 
 #define CMP(a, b) ((a) > (b) ? 1 : ((a) < (b) ? -1 : 0))
@@ -545,9 +599,622 @@ done:
 	return 0;
 }
 
+/*
+ * Reads the intro and up to @nblocks next blocks of the file to the @data
+ * cache, so the later ul_fileeq() calls don't need to read the file. Only
+ * checksums are cached, the memcmp method reads the intro only. The file is
+ * closed when done.
+ *
+ * The @eq sizes have to be the same as used for ul_fileeq() later. It's
+ * possible to use a different @eq (e.g. in another thread) for the same
+ * method, but never the same @data in more threads at the same time.
+ *
+ * Returns: 0 on success, <0 on error.
+ */
+int ul_fileeq_data_prefetch(struct ul_fileeq *eq, struct ul_fileeq_data *data,
+			    size_t nblocks)
+{
+	unsigned char *block;
+	ssize_t rc;
+	size_t n;
+
+	DBG(DATA, ul_debugobj(data, "prefetch %zu blocks", nblocks));
+
+	rc = get_intro(eq, data, &block);
+
+	if (eq->method->id != UL_FILEEQ_MEMCMP) {
+		for (n = 1; rc > 0 && n <= nblocks; n++)
+			rc = get_cmp_data(eq, data, n, &block);
+	}
+
+	ul_fileeq_data_close_file(data);
+	return rc < 0 ? (int) rc : 0;
+}
+
+/*
+ * Persistent cache
+ *
+ * The intros and digests of the files are saved in a file, so the next run
+ * (e.g. hardlink over the same tree) does not need to read the files which
+ * have not been changed. The file is identified by (dev, ino, size, mtime,
+ * ctime); any change of the file content changes mtime or ctime.
+ *
+ * The cache file is mmap'ed read-only when opened, and it's replaced by a new
+ * file (written to a temporary file and renamed) when closed. The new file
+ * contains the stored entries and the old entries which have not been stored
+ * again and which have been used in the last UL_FILEEQ_CACHE_MAXAGE seconds.
+ * The file is in native byte order, it's not expected to be shared between
+ * different machines.
+ *
+ * ul_fileeq_cache_load() is thread-safe (it reads only the old file), but
+ * ul_fileeq_cache_store() and ul_fileeq_cache_close() have to be called by
+ * the same thread.
+ */
+#define UL_FILEEQ_CACHE_MAGIC	"ULFEQC01"
+#define UL_FILEEQ_CACHE_BOM	0x01020304
+#define UL_FILEEQ_CACHE_MAXAGE	(30 * 24 * 60 * 60)
+
+struct ul_fileeq_cache_header {
+	char		magic[8];
+	char		method[16];
+	uint32_t	bom;		/* byte order mark */
+	uint32_t	digsiz;
+	uint64_t	nents;
+};
+
+#define UL_FILEEQ_CACHE_EOF	(1 << 0)
+
+struct ul_fileeq_cache_entry {
+	uint64_t	dev;
+	uint64_t	ino;
+	uint64_t	size;
+	int64_t		mtime;
+	int64_t		ctime;
+	uint32_t	mtime_nsec;
+	uint32_t	ctime_nsec;
+	uint64_t	readsiz;	/* digests are valid for this read size only */
+	int64_t		used;		/* last time stored */
+	uint32_t	nblocks;	/* as ul_fileeq_data, intro is the 1st block */
+	uint32_t	flags;
+	unsigned char	intro[UL_FILEEQ_INTROSIZ];
+	unsigned char	digests[];	/* (nblocks - 1) digests, 8-byte aligned size */
+};
+
+struct ul_fileeq_cache {
+	char		*filename;
+	const struct ul_fileeq_method *method;
+	time_t		now;
+
+	/* the old file */
+	void		*map;
+	size_t		mapsiz;
+	struct ul_fileeq_cache_entry **ents;	/* hash table (open addressing) */
+	size_t		nbuckets;		/* power of two */
+	unsigned char	*replaced;		/* bucket -> stored again */
+
+	/* the new entries */
+	struct ul_fileeq_cache_entry **news;
+	size_t		nnews;
+};
+
+static inline size_t cache_entry_size(const struct ul_fileeq_method *m, uint32_t nblocks)
+{
+	size_t sz = sizeof(struct ul_fileeq_cache_entry)
+			+ (nblocks ? nblocks - 1 : 0) * m->digsiz;
+
+	return (sz + 7) & ~((size_t) 7);
+}
+
+static inline size_t cache_bucket(const struct ul_fileeq_cache *cache,
+				  uint64_t dev, uint64_t ino)
+{
+	uint64_t h = (ino ^ (dev << 32 | dev >> 32)) * 0x9e3779b97f4a7c15ULL;
+
+	return (h >> 32) & (cache->nbuckets - 1);
+}
+
+static int cache_entry_match(const struct ul_fileeq_cache_entry *e,
+			     const struct stat *st)
+{
+	return e->dev == (uint64_t) st->st_dev
+	    && e->ino == (uint64_t) st->st_ino
+	    && e->size == (uint64_t) st->st_size
+	    && e->mtime == (int64_t) st->st_mtim.tv_sec
+	    && e->mtime_nsec == (uint32_t) st->st_mtim.tv_nsec
+	    && e->ctime == (int64_t) st->st_ctim.tv_sec
+	    && e->ctime_nsec == (uint32_t) st->st_ctim.tv_nsec;
+}
+
+static void cache_map_file(struct ul_fileeq_cache *cache)
+{
+	const struct ul_fileeq_cache_header *hdr;
+	const unsigned char *p, *end;
+	struct stat st;
+	uint64_t i;
+	int fd;
+
+	fd = open(cache->filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*hdr))
+		goto done;
+
+	cache->mapsiz = st.st_size;
+	cache->map = mmap(NULL, cache->mapsiz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (cache->map == MAP_FAILED) {
+		cache->map = NULL;
+		goto done;
+	}
+
+	hdr = cache->map;
+	if (memcmp(hdr->magic, UL_FILEEQ_CACHE_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->bom != UL_FILEEQ_CACHE_BOM
+	    || hdr->digsiz != (uint32_t) cache->method->digsiz
+	    || strncmp(hdr->method, cache->method->name, sizeof(hdr->method)) != 0) {
+		DBG(CACHE, ul_debugobj(cache, "%s: incompatible, ignore", cache->filename));
+		goto done;
+	}
+	/* every entry is at least sizeof(struct ul_fileeq_cache_entry) bytes */
+	if (hdr->nents > (cache->mapsiz - sizeof(*hdr))
+				/ sizeof(struct ul_fileeq_cache_entry)) {
+		DBG(CACHE, ul_debugobj(cache, "%s: corrupted, ignore", cache->filename));
+		goto done;
+	}
+
+	cache->nbuckets = 1024;
+	while (cache->nbuckets < hdr->nents * 2)
+		cache->nbuckets <<= 1;
+	cache->ents = calloc(cache->nbuckets, sizeof(struct ul_fileeq_cache_entry *));
+	cache->replaced = calloc(cache->nbuckets, sizeof(unsigned char));
+	if (!cache->ents || !cache->replaced)
+		goto done;
+
+	p = (const unsigned char *) (hdr + 1);
+	end = (const unsigned char *) cache->map + cache->mapsiz;
+
+	for (i = 0; i < hdr->nents; i++) {
+		struct ul_fileeq_cache_entry *e = (struct ul_fileeq_cache_entry *) p;
+		size_t b;
+
+		if ((size_t) (end - p) < sizeof(*e)
+		    || e->nblocks == 0
+		    || (size_t) (end - p) < cache_entry_size(cache->method, e->nblocks)) {
+			DBG(CACHE, ul_debugobj(cache, "%s: truncated", cache->filename));
+			break;
+		}
+		p += cache_entry_size(cache->method, e->nblocks);
+
+		for (b = cache_bucket(cache, e->dev, e->ino); cache->ents[b];
+		     b = (b + 1) & (cache->nbuckets - 1))
+			;
+		cache->ents[b] = e;
+	}
+	DBG(CACHE, ul_debugobj(cache, "%s: %" PRIu64 " entries", cache->filename, i));
+done:
+	close(fd);
+}
+
+/**
+ * ul_fileeq_cache_open:
+ * @eq: comparator (defines the method)
+ * @filename: the cache file
+ *
+ * Opens the persistent cache. The file does not have to exist, and it's
+ * ignored if it's for another method. The memcmp method is not supported.
+ *
+ * Returns: new cache or NULL on error.
+ */
+struct ul_fileeq_cache *ul_fileeq_cache_open(struct ul_fileeq *eq, const char *filename)
+{
+	struct ul_fileeq_cache *cache;
+
+	assert(eq);
+	assert(filename);
+
+	if (!eq->method || eq->method->id == UL_FILEEQ_MEMCMP) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->filename = strdup(filename);
+	if (!cache->filename) {
+		free(cache);
+		return NULL;
+	}
+	cache->method = eq->method;
+	cache->now = time(NULL);
+
+	DBG(CACHE, ul_debugobj(cache, "open %s", filename));
+	cache_map_file(cache);
+	return cache;
+}
+
+/**
+ * ul_fileeq_cache_load:
+ * @cache: persistent cache
+ * @eq: comparator, ul_fileeq_set_size() has to be already called
+ * @data: file data, the file has to be set but not read yet
+ * @st: stat of the file
+ *
+ * Fills @data by the cached intro and digests of the file, if the file has
+ * not been changed since stored. The digests are used only if they have been
+ * calculated for the current read size.
+ *
+ * Returns: 1 if loaded, 0 if not in the cache.
+ */
+int ul_fileeq_cache_load(struct ul_fileeq_cache *cache, struct ul_fileeq *eq,
+			 struct ul_fileeq_data *data, const struct stat *st)
+{
+	const struct ul_fileeq_cache_entry *e = NULL;
+	size_t b;
+
+	if (!cache || !cache->ents || data->nblocks)
+		return 0;
+
+	for (b = cache_bucket(cache, st->st_dev, st->st_ino); cache->ents[b];
+	     b = (b + 1) & (cache->nbuckets - 1)) {
+		if (cache_entry_match(cache->ents[b], st)) {
+			e = cache->ents[b];
+			break;
+		}
+	}
+	if (!e)
+		return 0;
+
+	memcpy(data->intro, e->intro, sizeof(data->intro));
+	data->nblocks = 1;
+
+	if (e->nblocks > 1 && e->readsiz == eq->readsiz
+	    && e->nblocks - 1 <= eq->blocksmax) {
+		size_t sz = (e->nblocks - 1) * eq->method->digsiz;
+
+		if (!data->blocks)
+			data->blocks = malloc(eq->blocksmax * eq->method->digsiz);
+		if (data->blocks) {
+			memcpy(data->blocks, e->digests, sz);
+			data->nblocks = e->nblocks;
+			data->is_eof = (e->flags & UL_FILEEQ_CACHE_EOF) ? 1 : 0;
+		}
+	}
+
+	DBG(CACHE, ul_debugobj(cache, "loaded %s [%zu blocks%s]", data->name,
+				data->nblocks, data->is_eof ? ", EOF" : ""));
+	return 1;
+}
+
+/**
+ * ul_fileeq_cache_store:
+ * @cache: persistent cache
+ * @eq: comparator, the same sizes as used for @data
+ * @data: file data
+ * @st: stat of the file
+ *
+ * Saves the intro and digests from @data to the cache. It's expected to be
+ * called before ul_fileeq_data_deinit(). The data are written to the file
+ * by ul_fileeq_cache_close().
+ *
+ * Returns: 0 on success, <0 on error.
+ */
+int ul_fileeq_cache_store(struct ul_fileeq_cache *cache, struct ul_fileeq *eq,
+			  struct ul_fileeq_data *data, const struct stat *st)
+{
+	struct ul_fileeq_cache_entry *e;
+	uint32_t nblocks;
+	size_t b;
+
+	if (!cache || !data->nblocks)
+		return 0;
+
+	nblocks = eq->method->id == UL_FILEEQ_MEMCMP || !data->blocks ? 1 : data->nblocks;
+
+	if (cache->nnews % 1024 == 0) {
+		void *tmp = realloc(cache->news, (cache->nnews + 1024) * sizeof(e));
+		if (!tmp)
+			return -ENOMEM;
+		cache->news = tmp;
+	}
+	e = calloc(1, cache_entry_size(cache->method, nblocks));
+	if (!e)
+		return -ENOMEM;
+
+	e->dev = st->st_dev;
+	e->ino = st->st_ino;
+	e->size = st->st_size;
+	e->mtime = st->st_mtim.tv_sec;
+	e->mtime_nsec = st->st_mtim.tv_nsec;
+	e->ctime = st->st_ctim.tv_sec;
+	e->ctime_nsec = st->st_ctim.tv_nsec;
+	e->readsiz = eq->readsiz;
+	e->used = cache->now;
+	e->nblocks = nblocks;
+	if (nblocks == data->nblocks && data->is_eof)
+		e->flags |= UL_FILEEQ_CACHE_EOF;
+	memcpy(e->intro, data->intro, sizeof(e->intro));
+	if (nblocks > 1)
+		memcpy(e->digests, data->blocks, (nblocks - 1) * eq->method->digsiz);
+
+	cache->news[cache->nnews++] = e;
+
+	/* don't write the old entry */
+	if (cache->ents) {
+		for (b = cache_bucket(cache, e->dev, e->ino); cache->ents[b];
+		     b = (b + 1) & (cache->nbuckets - 1)) {
+			if (cache->ents[b]->dev == e->dev && cache->ents[b]->ino == e->ino)
+				cache->replaced[b] = 1;
+		}
+	}
+	return 0;
+}
+
+static int cache_write(struct ul_fileeq_cache *cache)
+{
+	struct ul_fileeq_cache_header hdr = {
+		.magic = UL_FILEEQ_CACHE_MAGIC,
+		.bom = UL_FILEEQ_CACHE_BOM,
+		.digsiz = cache->method->digsiz
+	};
+	char *tmpname = NULL;
+	size_t i;
+	FILE *f;
+	int fd, rc = 0;
+
+	if (asprintf(&tmpname, "%s.XXXXXX", cache->filename) < 0)
+		return -ENOMEM;
+	fd = mkstemp(tmpname);
+	if (fd < 0 || !(f = fdopen(fd, "w"))) {
+		rc = -errno;
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpname);
+		}
+		free(tmpname);
+		return rc;
+	}
+	xstrncpy(hdr.method, cache->method->name, sizeof(hdr.method));
+
+	for (i = 0; i < cache->nbuckets; i++) {
+		struct ul_fileeq_cache_entry *e = cache->ents[i];
+
+		if (e && !cache->replaced[i]
+		    && cache->now - e->used < UL_FILEEQ_CACHE_MAXAGE)
+			hdr.nents++;
+		else
+			cache->ents[i] = NULL;
+	}
+	hdr.nents += cache->nnews;
+
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	for (i = 0; i < cache->nnews; i++)
+		fwrite(cache->news[i], cache_entry_size(cache->method,
+					cache->news[i]->nblocks), 1, f);
+	for (i = 0; i < cache->nbuckets; i++) {
+		if (cache->ents[i])
+			fwrite(cache->ents[i], cache_entry_size(cache->method,
+					cache->ents[i]->nblocks), 1, f);
+	}
+
+	if (close_stream(f) != 0)
+		rc = -errno;
+	else if (rename(tmpname, cache->filename) != 0)
+		rc = -errno;
+	if (rc)
+		unlink(tmpname);
+
+	DBG(CACHE, ul_debugobj(cache, "written %" PRIu64 " entries [rc=%d]", hdr.nents, rc));
+	free(tmpname);
+	return rc;
+}
+
+/**
+ * ul_fileeq_cache_close:
+ * @cache: persistent cache
+ *
+ * Writes the cache file and deallocates the cache. The file is written only
+ * if something has been stored.
+ *
+ * Returns: 0 on success, <0 on write error.
+ */
+int ul_fileeq_cache_close(struct ul_fileeq_cache *cache)
+{
+	size_t i;
+	int rc = 0;
+
+	if (!cache)
+		return 0;
+
+	DBG(CACHE, ul_debugobj(cache, "close"));
+	if (cache->nnews)
+		rc = cache_write(cache);
+
+	for (i = 0; i < cache->nnews; i++)
+		free(cache->news[i]);
+	free(cache->news);
+	free(cache->ents);
+	free(cache->replaced);
+	if (cache->map)
+		munmap(cache->map, cache->mapsiz);
+	free(cache->filename);
+	free(cache);
+	return rc;
+}
+
 #ifdef TEST_PROGRAM_FILEEQ
 # include <getopt.h>
 # include <err.h>
+# include "xalloc.h"
+
+/*
+ * Benchmark: creates a tree with groups of files of the same size (some of
+ * them equal, some different at the beginning or at the end) and compares
+ * the files in each group by all available methods the same way as hardlink
+ * does (each file with all next files, the cache is shared).
+ */
+#define BENCH_GROUPSIZ	8
+
+static void bench_fill(unsigned char *buf, size_t sz, uint64_t seed)
+{
+	uint64_t x = seed * 0x9e3779b97f4a7c15ULL + 1;
+	size_t i;
+
+	for (i = 0; i < sz; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		buf[i] = x;
+	}
+}
+
+/* Returns path to the file @n, or to the directory of the file */
+static char *bench_path(const char *dir, size_t n, int file)
+{
+	char *path;
+
+	if (file)
+		xasprintf(&path, "%s/g%03zu/f%zu", dir, n / BENCH_GROUPSIZ,
+					n % BENCH_GROUPSIZ);
+	else
+		xasprintf(&path, "%s/g%03zu", dir, n / BENCH_GROUPSIZ);
+	return path;
+}
+
+static void bench_create(const char *dir, size_t nfiles, size_t filesiz)
+{
+	unsigned char *buf = xmalloc(filesiz);
+	size_t i;
+
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+		err(EXIT_FAILURE, "cannot create %s", dir);
+
+	for (i = 0; i < nfiles; i++) {
+		char *path = bench_path(dir, i, 0);
+		int fd;
+
+		if (mkdir(path, 0700) != 0 && errno != EEXIST)
+			err(EXIT_FAILURE, "cannot create %s", path);
+		free(path);
+		path = bench_path(dir, i, 1);
+
+		/* f0..f3 equal, f4..f5 differ at the end, f6..f7 after intro */
+		bench_fill(buf, filesiz, i / BENCH_GROUPSIZ);
+		switch (i % BENCH_GROUPSIZ) {
+		case 4:
+		case 5:
+			buf[filesiz - 1] ^= i % BENCH_GROUPSIZ;
+			break;
+		case 6:
+		case 7:
+			if (filesiz > UL_FILEEQ_INTROSIZ)
+				buf[UL_FILEEQ_INTROSIZ] ^= i % BENCH_GROUPSIZ;
+			break;
+		}
+
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0 || write_all(fd, buf, filesiz) != 0 || close(fd) != 0)
+			err(EXIT_FAILURE, "cannot write %s", path);
+		free(path);
+	}
+	free(buf);
+}
+
+static void bench_remove(const char *dir, size_t nfiles)
+{
+	size_t i;
+
+	for (i = 0; i < nfiles; i++) {
+		char *path = bench_path(dir, i, 1);
+
+		unlink(path);
+		free(path);
+		if (i % BENCH_GROUPSIZ == BENCH_GROUPSIZ - 1 || i + 1 == nfiles) {
+			path = bench_path(dir, i, 0);
+			rmdir(path);
+			free(path);
+		}
+	}
+	rmdir(dir);
+}
+
+static double bench_method(const char *method, const char *dir, size_t nfiles,
+			   size_t filesiz, size_t readsiz, size_t *nequal)
+{
+	struct ul_fileeq eq;
+	struct ul_fileeq_data *data;
+	struct timespec start, end;
+	char **paths;
+	size_t i, j, g;
+
+	if (ul_fileeq_init(&eq, method) != 0)
+		return -1;
+
+	data = xcalloc(nfiles, sizeof(*data));
+	paths = xcalloc(nfiles, sizeof(char *));
+	for (i = 0; i < nfiles; i++)
+		paths[i] = bench_path(dir, i, 1);
+
+	*nequal = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (g = 0; g < nfiles; g += BENCH_GROUPSIZ) {
+		size_t n = min((size_t) BENCH_GROUPSIZ, nfiles - g);
+
+		/*                 filesiz, readsiz, memsiz */
+		ul_fileeq_set_size(&eq, filesiz, readsiz, 10*1024*1024 / n);
+
+		for (i = g; i < g + n; i++)
+			ul_fileeq_data_set_file(&data[i], paths[i]);
+		for (i = g; i < g + n; i++) {
+			for (j = i + 1; j < g + n; j++) {
+				*nequal += ul_fileeq(&eq, &data[i], &data[j]);
+				ul_fileeq_data_close_file(&data[j]);
+			}
+			ul_fileeq_data_deinit(&data[i]);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (i = 0; i < nfiles; i++)
+		free(paths[i]);
+	free(paths);
+	free(data);
+	ul_fileeq_deinit(&eq);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int benchmark(const char *dir, size_t nfiles, size_t filesiz, size_t readsiz)
+{
+	size_t i, nequal;
+
+	fprintf(stderr, "creating %zu files of %zu bytes in %s\n", nfiles, filesiz, dir);
+	bench_create(dir, nfiles, filesiz);
+
+	/* the first method should not pay for the page cache */
+	bench_method("memcmp", dir, nfiles, filesiz, readsiz, &nequal);
+
+	printf("%-10s %10s %10s %8s\n", "METHOD", "TIME", "MiB/s", "EQUAL");
+	for (i = 0; i < ARRAY_SIZE(ul_eq_methods); i++) {
+		const char *name = ul_eq_methods[i].name;
+		double sec;
+
+		if (!name)
+			continue;
+		sec = bench_method(name, dir, nfiles, filesiz,
+				   ul_eq_methods[i].id == UL_FILEEQ_MEMCMP ?
+						8 * 1024 : readsiz, &nequal);
+		if (sec < 0)
+			printf("%-10s %10s\n", name, "unavailable");
+		else
+			printf("%-10s %10.3f %10.1f %8zu\n", name, sec,
+				(double) nfiles * filesiz / (1024 * 1024) / sec, nequal);
+	}
+
+	bench_remove(dir, nfiles);
+	return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[])
 {
@@ -556,26 +1223,53 @@ int main(int argc, char *argv[])
 	const char *method = "sha1";
 	static const struct option longopts[] = {
 		{ "method", required_argument, NULL, 'm' },
+		{ "benchmark", required_argument, NULL, 'B' },
+		{ "files", required_argument, NULL, 'n' },
+		{ "size", required_argument, NULL, 's' },
+		{ "io-size", required_argument, NULL, 'b' },
 		{ "help", no_argument, NULL, 'h' },
 		{ NULL, 0, NULL, 0 }
 	};
 	int ch, rc;
 	const char *file_a = NULL, *file_b = NULL, *file_c = NULL;
+	const char *bench_dir = NULL;
+	size_t bench_files = 256, bench_size = 1024 * 1024, bench_io = 1024 * 1024;
 	struct stat st_a, st_b, st_c;
 
-	while ((ch = getopt_long(argc, argv, "m:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "m:B:n:s:b:", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'm':
 			method = optarg;
 			break;
+		case 'B':
+			bench_dir = optarg;
+			break;
+		case 'n':
+			bench_files = strtosize_or_err(optarg, "failed to parse number of files");
+			break;
+		case 's':
+			bench_size = strtosize_or_err(optarg, "failed to parse size");
+			break;
+		case 'b':
+			bench_io = strtosize_or_err(optarg, "failed to parse I/O size");
+			break;
 		case 'h':
 			printf("usage: %s [options] <file> <file>\n"
-				" -m, --method <memcmp|sha1|crc32>    compare method\n",
+			       "       %s --benchmark <dir> [options]\n"
+				" -m, --method <memcmp|sha1|crc32|crc32c|murmur3>  compare method\n"
+				" -B, --benchmark <dir>  compare files in a new tree by all methods\n"
+				" -n, --files <num>      number of benchmark files (default 256)\n"
+				" -s, --size <size>      size of benchmark files (default 1MiB)\n"
+				" -b, --io-size <size>   I/O size for checksums (default 1MiB)\n",
+				program_invocation_short_name,
 				program_invocation_short_name);
 			return EXIT_FAILURE;
 		}
 	}
 
+	if (bench_dir)
+		return benchmark(bench_dir, bench_files, bench_size, bench_io);
+
 	if (optind < argc)
 		file_a = argv[optind++];
 	if (optind < argc)
@@ -0,0 +1,99 @@
+/*
+ * MurmurHash3 x64 128-bit variant, a fast non-cryptographic hash function.
+ *
+ * Based on MurmurHash3_x64_128() by Austin Appleby; the original code is in
+ * the public domain. The input is read as little-endian, so the result is
+ * the same on all architectures, and it's stored as two little-endian
+ * 64-bit numbers (the same bytes as the reference implementation produces
+ * on x86).
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#include <string.h>
+
+#include "bitops.h"
+#include "murmur3.h"
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t getblock64(const unsigned char *p)
+{
+	uint64_t x;
+
+	memcpy(&x, p, sizeof(x));
+	return le64_to_cpu(x);
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+void ul_murmur3_128(const void *data, size_t len, uint32_t seed,
+		    unsigned char digest[UL_MURMUR3_128LENGTH])
+{
+	const unsigned char *p = data, *tail;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = seed, h2 = seed, k1, k2;
+	size_t i, nblocks = len / 16;
+
+	for (i = 0; i < nblocks; i++, p += 16) {
+		k1 = getblock64(p);
+		k2 = getblock64(p + 8);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	tail = p;
+	k1 = k2 = 0;
+
+	switch (len & 15) {
+	case 15: k2 ^= (uint64_t) tail[14] << 48;	/* fallthrough */
+	case 14: k2 ^= (uint64_t) tail[13] << 40;	/* fallthrough */
+	case 13: k2 ^= (uint64_t) tail[12] << 32;	/* fallthrough */
+	case 12: k2 ^= (uint64_t) tail[11] << 24;	/* fallthrough */
+	case 11: k2 ^= (uint64_t) tail[10] << 16;	/* fallthrough */
+	case 10: k2 ^= (uint64_t) tail[9] << 8;		/* fallthrough */
+	case 9:  k2 ^= (uint64_t) tail[8];
+		 k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		 /* fallthrough */
+	case 8:  k1 ^= (uint64_t) tail[7] << 56;	/* fallthrough */
+	case 7:  k1 ^= (uint64_t) tail[6] << 48;	/* fallthrough */
+	case 6:  k1 ^= (uint64_t) tail[5] << 40;	/* fallthrough */
+	case 5:  k1 ^= (uint64_t) tail[4] << 32;	/* fallthrough */
+	case 4:  k1 ^= (uint64_t) tail[3] << 24;	/* fallthrough */
+	case 3:  k1 ^= (uint64_t) tail[2] << 16;	/* fallthrough */
+	case 2:  k1 ^= (uint64_t) tail[1] << 8;		/* fallthrough */
+	case 1:  k1 ^= (uint64_t) tail[0];
+		 k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= (uint64_t) len;
+	h2 ^= (uint64_t) len;
+
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	h1 = cpu_to_le64(h1);
+	h2 = cpu_to_le64(h2);
+	memcpy(digest, &h1, sizeof(h1));
+	memcpy(digest + 8, &h2, sizeof(h2));
+}
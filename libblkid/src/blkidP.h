@@ -185,9 +185,37 @@ struct blkid_bufinfo {
 	unsigned char		*data;
 	uint64_t		off;
 	uint64_t		len;
-	struct list_head	bufs;	/* list of buffers */
+	uint64_t		seq;	/* order in which the buffers have been read */
+	uint64_t		used;	/* last access (for LRU) */
 };
 
+/*
+ * In-memory buffers for data from the device, sorted by offset
+ */
+struct blkid_bufcache {
+	struct blkid_bufinfo	**bufs;
+	size_t			nbufs;
+	size_t			nalloc;
+
+	uint64_t		maxlen;		/* size of the largest buffer */
+	uint64_t		size;		/* size of all buffers */
+	uint64_t		tick;		/* access counter for LRU */
+
+	/* statistic for debug messages */
+	uint64_t		hits;		/* requests from memory */
+	uint64_t		misses;		/* requests read from the device */
+	uint64_t		nreads;		/* number of read() calls */
+	uint64_t		nbytes;		/* read bytes */
+	uint64_t		nevicted;	/* buffers removed by LRU */
+};
+
+/*
+ * Buffers are removed (LRU) when they occupy more memory than this limit.
+ * This is evaluated between probing chains only, the probing functions may
+ * still use pointers to the buffers.
+ */
+#define BLKID_BUFCACHE_LIMIT	(8 * 1024 * 1024)
+
 /*
  * Probing hint
  */
@@ -219,7 +247,7 @@ struct blkid_struct_probe
 	uint64_t		wipe_size;	/* size of the wiped area */
 	struct blkid_chain	*wipe_chain;	/* superblock, partition, ... */
 
-	struct list_head	buffers;	/* list of buffers */
+	struct blkid_bufcache	buffers;	/* data from the device */
 	struct list_head	hints;
 
 	struct blkid_chain	chains[BLKID_NCHAINS];	/* array of chains */
@@ -297,6 +325,7 @@ struct blkid_struct_cache
 	unsigned int		bic_flags;	/* Status flags of the cache */
 	char			*bic_filename;	/* filename of cache */
 	blkid_probe		probe;		/* low-level probing stuff */
+	blkid_dev		bic_prefetched;	/* result from parallel probing */
 };
 
 #define BLKID_BIC_FL_PROBED	0x0002	/* We probed /proc/partition devices */
@@ -313,6 +342,39 @@ struct blkid_struct_cache
 /* old systems */
 #define BLKID_CACHE_FILE_OLD	"/etc/blkid.tab"
 
+/*
+ * Binary cache file. It's stored next to the text cache file (the text file
+ * is still the primary source for other libblkid versions) and contains the
+ * same devices and tags. It's used only if it has been written together with
+ * the current text cache file. All numbers are in native byte order, strings
+ * are zero terminated and tags are stored as NAME\0VALUE\0 pairs in the
+ * strings area.
+ */
+#define BLKID_BINCACHE_SUFFIX	".bin"
+#define BLKID_BINCACHE_MAGIC	"BLKIDBC"	/* including terminating zero */
+#define BLKID_BINCACHE_VERSION	2
+
+struct blkid_bincache_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	ndevs;		/* number of entries */
+	uint64_t	tab_mtime;	/* text cache file mtime (seconds) */
+	uint64_t	tab_mtime_nsec;	/* text cache file mtime (nanoseconds) */
+	uint64_t	tab_size;	/* text cache file size */
+	uint32_t	strings_off;	/* offset of the strings area */
+	uint32_t	strings_size;	/* size of the strings area */
+};
+
+struct blkid_bincache_entry {
+	uint64_t	devno;
+	int64_t		time;
+	uint32_t	utime;
+	int32_t		pri;
+	uint32_t	name;		/* offset of the device name in strings */
+	uint32_t	tags;		/* offset of the first tag in strings */
+	uint32_t	ntags;
+};
+
 #define BLKID_PROBE_OK	 0
 #define BLKID_PROBE_NONE 1
 
@@ -384,6 +446,9 @@ extern char *blkid_safe_getenv(const char *arg)
 
 extern char *blkid_get_cache_filename(struct blkid_config *conf)
 			__attribute__((warn_unused_result));
+extern char *blkid_get_bincache_filename(const char *filename)
+			__attribute__((nonnull))
+			__attribute__((warn_unused_result));
 /*
  * Functions to create and find a specific tag type: tag.c
  */
@@ -403,6 +468,12 @@ extern blkid_dev blkid_new_dev(void)
 			__attribute__((warn_unused_result));
 extern void blkid_free_dev(blkid_dev dev);
 
+/* verify.c */
+extern blkid_dev blkid_probe_detached(blkid_probe pr, const char *devname,
+			dev_t devno)
+			__attribute__((nonnull(1, 2)))
+			__attribute__((warn_unused_result));
+
 /* probe.c */
 extern int blkid_probe_is_tiny(blkid_probe pr)
 			__attribute__((nonnull))
@@ -416,6 +487,9 @@ extern unsigned char *blkid_probe_get_buffer(blkid_probe pr,
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
 
+extern int blkid_probe_prefetch_buffer(blkid_probe pr, uint64_t off, uint64_t len)
+			__attribute__((nonnull));
+
 extern unsigned char *blkid_probe_get_sector(blkid_probe pr, unsigned int sector)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
@@ -81,6 +81,17 @@ char *blkid_get_cache_filename(struct blkid_config *conf)
 	return filename;
 }
 
+/* Returns path to the binary cache file for the text cache @filename */
+char *blkid_get_bincache_filename(const char *filename)
+{
+	size_t len = strlen(filename) + sizeof(BLKID_BINCACHE_SUFFIX);
+	char *bin = malloc(len);
+
+	if (bin)
+		snprintf(bin, len, "%s" BLKID_BINCACHE_SUFFIX, filename);
+	return bin;
+}
+
 /**
  * blkid_get_cache:
  * @cache: pointer to return cache handler
@@ -33,6 +33,7 @@
 #include <errno.h>
 #endif
 #include <time.h>
+#include <pthread.h>
 
 #include "blkidP.h"
 
@@ -270,6 +271,215 @@ set_pri:
 	}
 }
 
+/*
+ * Parallel probing -- the scanners below collect the devices to the queue,
+ * the expensive on-disk probing is done by worker threads (every thread with
+ * its own blkid_probe) and the results are merged to the cache by the caller
+ * thread in the original order. The cache is never accessed by the workers.
+ */
+struct probe_job {
+	char		*ptname;	/* name as used in /sys/block */
+	char		*devname;	/* device node for the worker */
+	dev_t		devno;
+	int		pri;
+	int		removable;
+
+	blkid_dev	result;		/* detached device with probed tags */
+	unsigned int	done : 1;
+};
+
+struct probe_queue {
+	struct probe_job	*jobs;
+	size_t			njobs;
+	size_t			nalloc;
+	size_t			next;		/* first job not taken by worker */
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
+
+static void probe_or_queue(blkid_cache cache, struct probe_queue *queue,
+			   const char *ptname, dev_t devno, int pri,
+			   int only_if_new, int removable)
+{
+	struct probe_job *job;
+	struct list_head *p;
+
+	if (!queue) {
+		probe_one(cache, ptname, devno, pri, only_if_new, removable);
+		return;
+	}
+
+	if (queue->njobs == queue->nalloc) {
+		size_t sz = queue->nalloc ? queue->nalloc * 2 : 64;
+		struct probe_job *tmp = realloc(queue->jobs, sz * sizeof(*tmp));
+
+		if (!tmp) {
+			/* fallback to serial probing */
+			probe_one(cache, ptname, devno, pri, only_if_new, removable);
+			return;
+		}
+		queue->jobs = tmp;
+		queue->nalloc = sz;
+	}
+
+	job = &queue->jobs[queue->njobs];
+	memset(job, 0, sizeof(*job));
+
+	job->ptname = strdup(ptname);
+	if (!job->ptname) {
+		probe_one(cache, ptname, devno, pri, only_if_new, removable);
+		return;
+	}
+	job->devno = devno;
+	job->pri = pri;
+	job->removable = removable;
+
+	/* the device node name from cache, workers cannot read the cache */
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
+		if (tmp->bid_devno == devno) {
+			job->devname = strdup(tmp->bid_name);
+			break;
+		}
+	}
+	queue->njobs++;
+}
+
+/*
+ * Cache-less variant of the device name lookup from probe_one().
+ */
+static char *ptname_to_devname(const char *ptname, dev_t devno)
+{
+	const char **dir;
+	char *devname = NULL;
+
+	if (!strncmp(ptname, "dm-", 3) && isdigit(ptname[3])) {
+		devname = canonicalize_dm_name(ptname);
+		if (devname)
+			return devname;
+	}
+
+	for (dir = dirlist; *dir; dir++) {
+		struct stat st;
+		char device[256];
+
+		snprintf(device, sizeof(device), "%s/%s", *dir, ptname);
+		if (stat(device, &st) == 0 &&
+		    (S_ISBLK(st.st_mode) ||
+		     (S_ISCHR(st.st_mode) && !strncmp(ptname, "ubi", 3))) &&
+		    st.st_rdev == devno)
+			return strdup(device);
+	}
+
+	blkid__scan_dir("/dev/mapper", devno, NULL, &devname);
+	if (!devname)
+		devname = blkid_devno_to_devname(devno);
+	return devname;
+}
+
+static void *probe_worker(void *data)
+{
+	struct probe_queue *queue = (struct probe_queue *) data;
+	blkid_probe pr = blkid_new_probe();
+
+	for (;;) {
+		struct probe_job *job;
+
+		pthread_mutex_lock(&queue->lock);
+		if (queue->next >= queue->njobs) {
+			pthread_mutex_unlock(&queue->lock);
+			break;
+		}
+		job = &queue->jobs[queue->next++];
+		pthread_mutex_unlock(&queue->lock);
+
+		if (pr) {
+			if (!job->devname)
+				job->devname = ptname_to_devname(job->ptname, job->devno);
+			if (job->devname)
+				job->result = blkid_probe_detached(pr, job->devname, job->devno);
+		}
+
+		DBG(DEVNAME, ul_debug(" prefetched %s [%s]", job->ptname,
+				job->result ? job->result->bid_type : "none"));
+
+		pthread_mutex_lock(&queue->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	blkid_free_probe(pr);
+	return NULL;
+}
+
+/*
+ * Start workers and merge results to the cache in the queue order.
+ */
+static void run_probe_queue(blkid_cache cache, struct probe_queue *queue,
+			    int nthreads, int only_if_new)
+{
+	pthread_t *threads;
+	size_t i;
+	int n, nstarted = 0;
+
+	if (nthreads <= 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus > 0 ? ncpus : 1;
+	}
+	if ((size_t) nthreads > queue->njobs)
+		nthreads = queue->njobs;
+
+	DBG(DEVNAME, ul_debug("probing %zu devices by %d threads",
+				queue->njobs, nthreads));
+
+	threads = nthreads > 0 ? calloc(nthreads, sizeof(pthread_t)) : NULL;
+	for (n = 0; threads && n < nthreads; n++) {
+		if (pthread_create(&threads[nstarted], NULL,
+				   probe_worker, queue) == 0)
+			nstarted++;
+	}
+
+	for (i = 0; i < queue->njobs; i++) {
+		struct probe_job *job = &queue->jobs[i];
+
+		if (nstarted) {
+			pthread_mutex_lock(&queue->lock);
+			while (!job->done)
+				pthread_cond_wait(&queue->cond, &queue->lock);
+			pthread_mutex_unlock(&queue->lock);
+		}
+
+		/* blkid_verify() uses the result rather than read the device */
+		cache->bic_prefetched = job->result;
+		probe_one(cache, job->ptname, job->devno, job->pri,
+			  only_if_new, job->removable);
+		cache->bic_prefetched = NULL;
+	}
+
+	for (n = 0; n < nstarted; n++)
+		pthread_join(threads[n], NULL);
+	free(threads);
+}
+
+static void free_probe_queue(struct probe_queue *queue)
+{
+	size_t i;
+
+	for (i = 0; i < queue->njobs; i++) {
+		struct probe_job *job = &queue->jobs[i];
+
+		free(job->ptname);
+		free(job->devname);
+		if (job->result)
+			blkid_free_dev(job->result);
+	}
+	free(queue->jobs);
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->cond);
+}
+
 #define PROC_PARTITIONS "/proc/partitions"
 #define VG_DIR		"/proc/lvm/VGs"
 
@@ -304,7 +514,8 @@ static dev_t lvm_get_devno(const char *lvm_device)
 	return ret;
 }
 
-static void lvm_probe_all(blkid_cache cache, int only_if_new)
+static void lvm_probe_all(blkid_cache cache, struct probe_queue *queue,
+			  int only_if_new)
 {
 	DIR		*vg_list;
 	struct dirent	*vg_iter;
@@ -357,8 +568,8 @@ static void lvm_probe_all(blkid_cache cache, int only_if_new)
 			DBG(DEVNAME, ul_debug("Probe LVM dev %s: devno 0x%04X",
 						  lvm_device,
 						  (unsigned int) dev));
-			probe_one(cache, lvm_device, dev, BLKID_PRI_LVM,
-				  only_if_new, 0);
+			probe_or_queue(cache, queue, lvm_device, dev,
+				       BLKID_PRI_LVM, only_if_new, 0);
 			free(lvm_device);
 		}
 		closedir(lv_list);
@@ -369,7 +580,7 @@ exit:
 #endif
 
 static void
-ubi_probe_all(blkid_cache cache, int only_if_new)
+ubi_probe_all(blkid_cache cache, struct probe_queue *queue, int only_if_new)
 {
 	const char **dirname;
 
@@ -409,7 +620,8 @@ ubi_probe_all(blkid_cache cache, int only_if_new)
 				continue;
 			DBG(DEVNAME, ul_debug("Probe UBI vol %s/%s: devno 0x%04X",
 				  *dirname, name, (int) dev));
-			probe_one(cache, name, dev, BLKID_PRI_UBI, only_if_new, 0);
+			probe_or_queue(cache, queue, name, dev, BLKID_PRI_UBI,
+				       only_if_new, 0);
 		}
 		closedir(dir);
 	}
@@ -420,7 +632,8 @@ ubi_probe_all(blkid_cache cache, int only_if_new)
  * /proc/partitions (like the original libblkid implementation)
  */
 static int
-sysfs_probe_all(blkid_cache cache, int only_if_new, int only_removable)
+sysfs_probe_all(blkid_cache cache, struct probe_queue *queue,
+		int only_if_new, int only_removable)
 {
 	DIR *sysfs;
 	struct dirent *dev;
@@ -498,14 +711,16 @@ sysfs_probe_all(blkid_cache cache, int only_if_new, int only_removable)
 			DBG(DEVNAME, ul_debug(" Probe partition dev %s, devno 0x%04X",
                                    part->d_name, (unsigned int) partno));
 			nparts++;
-			probe_one(cache, part->d_name, partno, 0, only_if_new, 0);
+			probe_or_queue(cache, queue, part->d_name, partno, 0,
+				       only_if_new, 0);
 		}
 
 		if (!nparts) {
 			/* add non-partitioned whole disk to cache */
 			DBG(DEVNAME, ul_debug(" Probe whole dev %s, devno 0x%04X",
 				   dev->d_name, (unsigned int) devno));
-			probe_one(cache, dev->d_name, devno, 0, only_if_new, 0);
+			probe_or_queue(cache, queue, dev->d_name, devno, 0,
+				       only_if_new, 0);
 		} else {
 			/* remove partitioned whole-disk from cache */
 			struct list_head *p, *pnext;
@@ -534,9 +749,13 @@ sysfs_probe_all(blkid_cache cache, int only_if_new, int only_removable)
 
 /*
  * Read the device data for all available block devices in the system.
+ *
+ * The @nthreads > 1 (or 0 for number of CPUs) enables parallel probing.
  */
-static int probe_all(blkid_cache cache, int only_if_new, int update_interval)
+static int probe_all(blkid_cache cache, int only_if_new, int update_interval,
+		     int nthreads)
 {
+	struct probe_queue queue = { .njobs = 0 }, *q = NULL;
 	int rc;
 
 	if (!cache)
@@ -549,12 +768,23 @@ static int probe_all(blkid_cache cache, int only_if_new, int update_interval)
 	}
 
 	blkid_read_cache(cache);
+
+	if (nthreads != 1) {
+		pthread_mutex_init(&queue.lock, NULL);
+		pthread_cond_init(&queue.cond, NULL);
+		q = &queue;
+	}
 #ifdef VG_DIR
-	lvm_probe_all(cache, only_if_new);
+	lvm_probe_all(cache, q, only_if_new);
 #endif
-	ubi_probe_all(cache, only_if_new);
+	ubi_probe_all(cache, q, only_if_new);
 
-	rc = sysfs_probe_all(cache, only_if_new, 0);
+	rc = sysfs_probe_all(cache, q, only_if_new, 0);
+
+	if (q) {
+		run_probe_queue(cache, q, nthreads, only_if_new);
+		free_probe_queue(q);
+	}
 
 	/* Don't mark the change as "probed" if /sys not avalable */
 	if (update_interval && rc == 0) {
@@ -579,11 +809,38 @@ int blkid_probe_all(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, ul_debug("Begin blkid_probe_all()"));
-	ret = probe_all(cache, 0, 1);
+	ret = probe_all(cache, 0, 1, 1);
 	DBG(PROBE, ul_debug("End blkid_probe_all() [rc=%d]", ret));
 	return ret;
 }
 
+/**
+ * blkid_probe_all_parallel:
+ * @cache: cache handler
+ * @nthreads: number of probing threads, or 0 for number of online CPUs
+ *
+ * The same as blkid_probe_all(), but the devices are probed by @nthreads
+ * threads. It's useful on systems with many (slow) devices where the
+ * probing is mostly waiting for I/O. The order of the devices in the @cache
+ * is the same as for blkid_probe_all().
+ *
+ * Returns: 0 on success, or number less than zero in case of error.
+ *
+ * Since: 2.39
+ */
+int blkid_probe_all_parallel(blkid_cache cache, int nthreads)
+{
+	int ret;
+
+	if (nthreads < 0)
+		return -BLKID_ERR_PARAM;
+
+	DBG(PROBE, ul_debug("Begin blkid_probe_all_parallel() [threads=%d]", nthreads));
+	ret = probe_all(cache, 0, 1, nthreads);
+	DBG(PROBE, ul_debug("End blkid_probe_all_parallel() [rc=%d]", ret));
+	return ret;
+}
+
 /**
  * blkid_probe_all_new:
  * @cache: cache handler
@@ -597,7 +854,7 @@ int blkid_probe_all_new(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, ul_debug("Begin blkid_probe_all_new()"));
-	ret = probe_all(cache, 1, 0);
+	ret = probe_all(cache, 1, 0, 1);
 	DBG(PROBE, ul_debug("End blkid_probe_all_new() [rc=%d]", ret));
 	return ret;
 }
@@ -625,7 +882,7 @@ int blkid_probe_all_removable(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, ul_debug("Begin blkid_probe_all_removable()"));
-	ret = sysfs_probe_all(cache, 0, 1);
+	ret = sysfs_probe_all(cache, NULL, 0, 1);
 	DBG(PROBE, ul_debug("End blkid_probe_all_removable() [rc=%d]", ret));
 	return ret;
 }
@@ -634,20 +891,22 @@ int blkid_probe_all_removable(blkid_cache cache)
 int main(int argc, char **argv)
 {
 	blkid_cache cache = NULL;
-	int ret;
+	int ret, nthreads = 1;
 
 	blkid_init_debug(BLKID_DEBUG_ALL);
-	if (argc != 1) {
-		fprintf(stderr, "Usage: %s\n"
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [<threads>]\n"
 			"Probe all devices and exit\n", argv[0]);
 		exit(1);
 	}
+	if (argc == 2)
+		nthreads = atoi(argv[1]);
 	if ((ret = blkid_get_cache(&cache, "/dev/null")) != 0) {
 		fprintf(stderr, "%s: error creating cache (%d)\n",
 			argv[0], ret);
 		exit(1);
 	}
-	if (blkid_probe_all(cache) < 0)
+	if (blkid_probe_all_parallel(cache, nthreads) < 0)
 		printf("%s: error probing devices\n", argv[0]);
 
 	if (blkid_probe_all_removable(cache) < 0)
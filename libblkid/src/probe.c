@@ -152,7 +152,6 @@ blkid_probe blkid_new_probe(void)
 		pr->chains[i].flags = chains_drvs[i]->dflt_flags;
 		pr->chains[i].enabled = chains_drvs[i]->dflt_enabled;
 	}
-	INIT_LIST_HEAD(&pr->buffers);
 	INIT_LIST_HEAD(&pr->values);
 	INIT_LIST_HEAD(&pr->hints);
 	return pr;
@@ -541,10 +540,16 @@ int __blkid_probe_filter_types(blkid_probe pr, int chain, int flag, char *names[
 	return 0;
 }
 
-static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint64_t len)
+/*
+ * The @align (if not zero) is alignment of the data in memory, it has to be
+ * power of 2 and greater than sizeof(struct blkid_bufinfo).
+ */
+static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off,
+					 uint64_t len, size_t align)
 {
 	ssize_t ret;
 	struct blkid_bufinfo *bf = NULL;
+	size_t hdrsz = align ? align : sizeof(struct blkid_bufinfo);
 
 	if (lseek(pr->fd, real_off, SEEK_SET) == (off_t) -1) {
 		errno = 0;
@@ -552,27 +557,40 @@ static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint
 	}
 
 	/* someone trying to overflow some buffers? */
-	if (len > ULONG_MAX - sizeof(struct blkid_bufinfo)) {
+	if (len > ULONG_MAX - hdrsz) {
 		errno = ENOMEM;
 		return NULL;
 	}
 
 	/* allocate info and space for data by one malloc call */
-	bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
-	if (!bf) {
-		errno = ENOMEM;
-		return NULL;
+	if (align) {
+		void *mem = NULL;
+
+		if (posix_memalign(&mem, align, hdrsz + len) != 0) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		memset(mem, 0, hdrsz + len);
+		bf = mem;
+	} else {
+		bf = calloc(1, hdrsz + len);
+		if (!bf) {
+			errno = ENOMEM;
+			return NULL;
+		}
 	}
 
-	bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
+	bf->data = ((unsigned char *) bf) + hdrsz;
 	bf->len = len;
 	bf->off = real_off;
-	INIT_LIST_HEAD(&bf->bufs);
 
 	DBG(LOWPROBE, ul_debug("\tread: off=%"PRIu64" len=%"PRIu64"",
 	                       real_off, len));
 
 	ret = read(pr->fd, bf->data, len);
+	pr->buffers.nreads++;
+	if (ret > 0)
+		pr->buffers.nbytes += ret;
 	if (ret != (ssize_t) len) {
 		DBG(LOWPROBE, ul_debug("\tread failed: %m"));
 		free(bf);
@@ -588,24 +606,86 @@ static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint
 }
 
 /*
- * Search in buffers we already have in memory
+ * Returns index of the first buffer with offset greater than @real_off.
+ */
+static size_t bufcache_upper_bound(struct blkid_bufcache *bc, uint64_t real_off)
+{
+	size_t lo = 0, hi = bc->nbufs;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (bc->bufs[mid]->off <= real_off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int add_buffer(blkid_probe pr, struct blkid_bufinfo *bf)
+{
+	struct blkid_bufcache *bc = &pr->buffers;
+	size_t idx;
+
+	if (bc->nbufs == bc->nalloc) {
+		size_t sz = bc->nalloc ? bc->nalloc * 2 : 16;
+		struct blkid_bufinfo **tmp = realloc(bc->bufs, sz * sizeof(*tmp));
+
+		if (!tmp)
+			return -ENOMEM;
+		bc->bufs = tmp;
+		bc->nalloc = sz;
+	}
+
+	idx = bufcache_upper_bound(bc, bf->off);
+	if (idx < bc->nbufs)
+		memmove(&bc->bufs[idx + 1], &bc->bufs[idx],
+			(bc->nbufs - idx) * sizeof(struct blkid_bufinfo *));
+	bc->bufs[idx] = bf;
+	bc->nbufs++;
+
+	bf->seq = bf->used = ++bc->tick;
+	bc->size += bf->len;
+	if (bf->len > bc->maxlen)
+		bc->maxlen = bf->len;
+	return 0;
+}
+
+/*
+ * Search in buffers we already have in memory. The buffers are sorted by
+ * offset, so it's enough to check the buffers which start before @off, but
+ * not more than the largest buffer size before @off.
+ *
+ * If the buffers have been modified by blkid_probe_hide_range(), then the
+ * oldest (and so the modified) buffer is returned.
  */
 static struct blkid_bufinfo *get_cached_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 {
+	struct blkid_bufcache *bc = &pr->buffers;
+	struct blkid_bufinfo *bf = NULL;
 	uint64_t real_off = pr->off + off;
-	struct list_head *p;
+	size_t i;
 
-	list_for_each(p, &pr->buffers) {
-		struct blkid_bufinfo *x =
-				list_entry(p, struct blkid_bufinfo, bufs);
+	for (i = bufcache_upper_bound(bc, real_off); i > 0; i--) {
+		struct blkid_bufinfo *x = bc->bufs[i - 1];
 
-		if (real_off >= x->off && real_off + len <= x->off + x->len) {
-			DBG(BUFFER, ul_debug("\treuse: off=%"PRIu64" len=%"PRIu64" (for off=%"PRIu64" len=%"PRIu64")",
-						x->off, x->len, real_off, len));
-			return x;
-		}
+		if (x->off + bc->maxlen < real_off + len)
+			break;		/* all the next buffers are too far */
+		if (real_off + len > x->off + x->len)
+			continue;
+		if (!bf || x->seq < bf->seq)
+			bf = x;
+		if (!(pr->flags & BLKID_FL_MODIF_BUFF))
+			break;
 	}
-	return NULL;
+
+	if (bf) {
+		DBG(BUFFER, ul_debug("\treuse: off=%"PRIu64" len=%"PRIu64" (for off=%"PRIu64" len=%"PRIu64")",
+					bf->off, bf->len, real_off, len));
+		bf->used = ++bc->tick;
+	}
+	return bf;
 }
 
 /*
@@ -617,8 +697,9 @@ static struct blkid_bufinfo *get_cached_buffer(blkid_probe pr, uint64_t off, uin
  */
 static int hide_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 {
+	struct blkid_bufcache *bc = &pr->buffers;
 	uint64_t real_off = pr->off + off;
-	struct list_head *p;
+	size_t i;
 	int ct = 0;
 
 	if (UINT64_MAX - len < off) {
@@ -626,12 +707,13 @@ static int hide_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 		return -EINVAL;
 	}
 
-	list_for_each(p, &pr->buffers) {
-		struct blkid_bufinfo *x =
-			list_entry(p, struct blkid_bufinfo, bufs);
+	for (i = bufcache_upper_bound(bc, real_off); i > 0; i--) {
+		struct blkid_bufinfo *x = bc->bufs[i - 1];
 		unsigned char *data;
 
-		if (real_off >= x->off && real_off + len <= x->off + x->len) {
+		if (x->off + bc->maxlen < real_off + len)
+			break;
+		if (real_off + len <= x->off + x->len) {
 
 			assert(x->off <= real_off);
 			assert(x->off + x->len >= real_off + len);
@@ -647,6 +729,40 @@ static int hide_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 	return ct == 0 ? -EINVAL : 0;
 }
 
+/*
+ * Remove the least recently used buffers if the buffers occupy more than
+ * BLKID_BUFCACHE_LIMIT bytes. Don't call it when any probing function may
+ * use a pointer to the buffers.
+ */
+static void shrink_buffers(blkid_probe pr)
+{
+	struct blkid_bufcache *bc = &pr->buffers;
+
+	/* the modified buffers cannot be read again */
+	if (pr->flags & BLKID_FL_MODIF_BUFF)
+		return;
+
+	while (bc->size > BLKID_BUFCACHE_LIMIT && bc->nbufs > 1) {
+		struct blkid_bufinfo *bf;
+		size_t i, lru = 0;
+
+		for (i = 1; i < bc->nbufs; i++) {
+			if (bc->bufs[i]->used < bc->bufs[lru]->used)
+				lru = i;
+		}
+		bf = bc->bufs[lru];
+
+		DBG(BUFFER, ul_debug(" evict buffer: [off=%"PRIu64", len=%"PRIu64"]",
+				bf->off, bf->len));
+		bc->size -= bf->len;
+		bc->nevicted++;
+		free(bf);
+
+		memmove(&bc->bufs[lru], &bc->bufs[lru + 1],
+			(bc->nbufs - lru - 1) * sizeof(struct blkid_bufinfo *));
+		bc->nbufs--;
+	}
+}
 
 /*
  * Note that @off is offset within probing area, the probing area is defined by
@@ -696,12 +812,18 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 
 	/* try buffers we already have in memory or read from device */
 	bf = get_cached_buffer(pr, off, len);
-	if (!bf) {
-		bf = read_buffer(pr, real_off, len);
+	if (bf)
+		pr->buffers.hits++;
+	else {
+		pr->buffers.misses++;
+		bf = read_buffer(pr, real_off, len, 0);
 		if (!bf)
 			return NULL;
-
-		list_add_tail(&bf->bufs, &pr->buffers);
+		if (add_buffer(pr, bf) != 0) {
+			free(bf);
+			errno = ENOMEM;
+			return NULL;
+		}
 	}
 
 	assert(bf->off <= real_off);
@@ -711,6 +833,60 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 	return real_off ? bf->data + (real_off - bf->off) : bf->data;
 }
 
+/*
+ * Read the area @off..@off+@len (offset within probing area) by one read()
+ * call. The buffer is later used by blkid_probe_get_buffer() for all requests
+ * within the area, so it's possible to replace many small reads by one large
+ * read. The area is aligned to the sector size and the buffer to the page
+ * size, so it's also usable for devices opened with O_DIRECT.
+ *
+ * Returns: <0 in case of failure, or 0 on success.
+ */
+int blkid_probe_prefetch_buffer(blkid_probe pr, uint64_t off, uint64_t len)
+{
+	struct blkid_bufinfo *bf;
+	uint64_t real_off, end, area_end;
+	unsigned int ssz;
+
+	if (pr->size == 0 || len == 0 || off >= pr->size || S_ISCHR(pr->mode))
+		return -EINVAL;
+
+	/* don't read data again, the in-memory data has been modified */
+	if (pr->flags & BLKID_FL_MODIF_BUFF)
+		return -EINVAL;
+	if (pr->parent)
+		return -EINVAL;
+
+	if (len > pr->size - off)
+		len = pr->size - off;
+
+	ssz = blkid_probe_get_sectorsize(pr);
+	area_end = pr->off + pr->size;
+	real_off = pr->off + off;
+	end = real_off + len;
+
+	real_off -= real_off % ssz;
+	if (end % ssz)
+		end += ssz - (end % ssz);
+	if (end > area_end)
+		end = area_end;
+
+	if (get_cached_buffer(pr, off, len))
+		return 0;
+
+	DBG(BUFFER, ul_debug("\tprefetch: off=%"PRIu64" len=%"PRIu64,
+				real_off, end - real_off));
+
+	bf = read_buffer(pr, real_off, end - real_off, getpagesize());
+	if (!bf)
+		return errno ? -errno : -EIO;
+	if (add_buffer(pr, bf) != 0) {
+		free(bf);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
 /**
  * blkid_probe_reset_buffers:
  * @pr: prober
@@ -726,21 +902,18 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
  */
 int blkid_probe_reset_buffers(blkid_probe pr)
 {
-	uint64_t ct = 0, len = 0;
+	struct blkid_bufcache *bc = &pr->buffers;
+	size_t i;
 
 	pr->flags &= ~BLKID_FL_MODIF_BUFF;
 
-	if (list_empty(&pr->buffers))
+	if (!bc->nbufs && !bc->nreads)
 		return 0;
 
 	DBG(BUFFER, ul_debug("Resetting probing buffers"));
 
-	while (!list_empty(&pr->buffers)) {
-		struct blkid_bufinfo *bf = list_entry(pr->buffers.next,
-						struct blkid_bufinfo, bufs);
-		ct++;
-		len += bf->len;
-		list_del(&bf->bufs);
+	for (i = 0; i < bc->nbufs; i++) {
+		struct blkid_bufinfo *bf = bc->bufs[i];
 
 		DBG(BUFFER, ul_debug(" remove buffer: [off=%"PRIu64", len=%"PRIu64"]",
 		                     bf->off, bf->len));
@@ -748,9 +921,13 @@ int blkid_probe_reset_buffers(blkid_probe pr)
 	}
 
 	DBG(LOWPROBE, ul_debug(" buffers summary: %"PRIu64" bytes by %"PRIu64" read() calls",
-			len, ct));
+			bc->nbytes, bc->nreads));
+	DBG(LOWPROBE, ul_debug(" buffers cache: %"PRIu64" hits, %"PRIu64" misses, "
+			       "%"PRIu64" evicted",
+			bc->hits, bc->misses, bc->nevicted));
 
-	INIT_LIST_HEAD(&pr->buffers);
+	free(bc->bufs);
+	memset(bc, 0, sizeof(*bc));
 
 	return 0;
 }
@@ -1286,6 +1463,9 @@ int blkid_do_probe(blkid_probe pr)
 		if (!chn->enabled)
 			continue;
 
+		if (chn->idx == -1)
+			shrink_buffers(pr);
+
 		/* rc: -1 = error, 0 = success, 1 = no result */
 		rc = chn->driver->probe(pr, chn);
 
@@ -1589,6 +1769,7 @@ int blkid_do_safeprobe(blkid_probe pr)
 			continue;
 
 		blkid_probe_chain_reset_position(chn);
+		shrink_buffers(pr);
 
 		rc = chn->driver->safeprobe(pr, chn);
 
@@ -1643,6 +1824,7 @@ int blkid_do_fullprobe(blkid_probe pr)
 			continue;
 
 		blkid_probe_chain_reset_position(chn);
+		shrink_buffers(pr);
 
 		rc = chn->driver->probe(pr, chn);
 
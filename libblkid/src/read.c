@@ -17,6 +17,7 @@
 #include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #ifdef HAVE_ERRNO_H
@@ -364,6 +365,135 @@ done:
 	return ret;
 }
 
+/*
+ * Returns zero terminated string from @off in the binary cache strings area,
+ * and offset of the next string in @next.
+ */
+static const char *bincache_get_string(const char *strs, size_t size,
+				       size_t off, size_t *next)
+{
+	const char *end;
+
+	if (off >= size)
+		return NULL;
+	end = memchr(strs + off, '\0', size - off);
+	if (!end)
+		return NULL;
+	if (next)
+		*next = end - strs + 1;
+	return strs + off;
+}
+
+/*
+ * Read the binary cache file which belongs to the text cache file described
+ * by @tab (see save_bincache() and blkidP.h for more details). Returns 0 on
+ * success, or 1 if the binary file does not exist or is not usable.
+ */
+static int read_bincache(blkid_cache cache, struct stat *tab)
+{
+	const struct blkid_bincache_header *hdr;
+	const struct blkid_bincache_entry *ents;
+	const char *strs;
+	void *map = MAP_FAILED;
+	char *binname;
+	struct stat st;
+	size_t i;
+	int fd, rc = 1;
+
+	binname = blkid_get_bincache_filename(cache->bic_filename);
+	if (!binname)
+		return 1;
+
+	fd = open(binname, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		goto done;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+	    || (uint64_t) st.st_size < sizeof(*hdr))
+		goto done;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto done;
+
+	hdr = map;
+	if (memcmp(hdr->magic, BLKID_BINCACHE_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->version != BLKID_BINCACHE_VERSION
+	    || hdr->tab_mtime != (uint64_t) tab->st_mtime
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	    || hdr->tab_mtime_nsec != (uint64_t) tab->st_mtim.tv_nsec
+#endif
+	    || hdr->tab_size != (uint64_t) tab->st_size
+	    || hdr->strings_off != sizeof(*hdr) + (uint64_t) hdr->ndevs * sizeof(*ents)
+	    || (uint64_t) hdr->strings_off + hdr->strings_size != (uint64_t) st.st_size) {
+		DBG(CACHE, ul_debug("binary cache %s does not match %s, ignore",
+					binname, cache->bic_filename));
+		goto done;
+	}
+
+	DBG(CACHE, ul_debug("reading binary cache file %s", binname));
+
+	ents = (const struct blkid_bincache_entry *) (hdr + 1);
+	strs = (const char *) map + hdr->strings_off;
+
+	for (i = 0; i < hdr->ndevs; i++) {
+		const struct blkid_bincache_entry *e = &ents[i];
+		const char *name;
+		size_t off = e->tags;
+		uint32_t n;
+		blkid_dev dev;
+
+		name = bincache_get_string(strs, hdr->strings_size, e->name, NULL);
+		if (!name || *name != '/') {
+			DBG(READ, ul_debug("blkid: bad binary cache entry %zu", i));
+			continue;
+		}
+		/* the same as blkid_get_dev(BLKID_DEV_CREATE), the name is
+		 * already canonical */
+		if (access(name, F_OK) < 0)
+			continue;
+
+		dev = blkid_new_dev();
+		if (!dev)
+			break;
+		dev->bid_name = strdup(name);
+		if (!dev->bid_name) {
+			blkid_free_dev(dev);
+			break;
+		}
+		dev->bid_cache = cache;
+		list_add_tail(&dev->bid_devs, &cache->bic_devs);
+
+		dev->bid_devno = e->devno;
+		dev->bid_time = e->time;
+		dev->bid_utime = e->utime;
+		dev->bid_pri = e->pri;
+
+		for (n = 0; n < e->ntags; n++) {
+			const char *tn, *tv = NULL;
+
+			tn = bincache_get_string(strs, hdr->strings_size, off, &off);
+			if (tn)
+				tv = bincache_get_string(strs, hdr->strings_size, off, &off);
+			if (!tv || blkid_set_tag(dev, tn, tv, strlen(tv)) < 0)
+				break;
+		}
+		if (n < e->ntags || !dev->bid_type) {
+			DBG(READ, ul_debug("blkid: bad binary cache entry for %s", name));
+			blkid_free_dev(dev);
+			continue;
+		}
+		DBG(READ, ul_debug("found dev %s", dev->bid_name));
+	}
+	rc = 0;
+done:
+	if (map != MAP_FAILED)
+		munmap(map, st.st_size);
+	if (fd >= 0)
+		close(fd);
+	free(binname);
+	return rc;
+}
+
 /*
  * Parse the specified filename, and return the data in the supplied or
  * a newly allocated cache struct.  If the file doesn't exist, return a
@@ -391,6 +521,11 @@ void blkid_read_cache(blkid_cache cache)
 		goto errout;
 	}
 
+	if (S_ISREG(st.st_mode) && read_bincache(cache, &st) == 0) {
+		close(fd);
+		goto done;
+	}
+
 	DBG(CACHE, ul_debug("reading cache file %s",
 				cache->bic_filename));
 
@@ -419,7 +554,7 @@ void blkid_read_cache(blkid_cache cache)
 		}
 	}
 	fclose(file);
-
+done:
 	/*
 	 * Initially we do not need to write out the cache file.
 	 */
@@ -24,6 +24,7 @@
 
 #include "closestream.h"
 #include "fileutils.h"
+#include "all-io.h"
 
 #include "blkidP.h"
 
@@ -73,6 +74,152 @@ static int save_dev(blkid_dev dev, FILE *file)
 	return 0;
 }
 
+struct bincache_strings {
+	char	*data;
+	size_t	len;
+	size_t	alloc;
+};
+
+static int bincache_add_string(struct bincache_strings *strs,
+			       const char *str, uint32_t *off)
+{
+	size_t sz = strlen(str) + 1;
+
+	if (strs->len + sz > UINT32_MAX)
+		return -BLKID_ERR_MEM;
+
+	if (strs->len + sz > strs->alloc) {
+		size_t alloc = max(strs->alloc * 2, strs->len + sz + 4096);
+		char *data = realloc(strs->data, alloc);
+
+		if (!data)
+			return -BLKID_ERR_MEM;
+		strs->data = data;
+		strs->alloc = alloc;
+	}
+	memcpy(strs->data + strs->len, str, sz);
+	if (off)
+		*off = strs->len;
+	strs->len += sz;
+	return 0;
+}
+
+/*
+ * Write binary version of the cache next to the already written text cache
+ * @filename. The binary file is bound to the text file by its mtime and
+ * size, so any change to the text file (e.g. by another libblkid version)
+ * invalidates the binary file.
+ */
+static int save_bincache(blkid_cache cache, const char *filename)
+{
+	struct blkid_bincache_header hdr = {
+		.magic = BLKID_BINCACHE_MAGIC,
+		.version = BLKID_BINCACHE_VERSION
+	};
+	struct blkid_bincache_entry *ents = NULL;
+	struct bincache_strings strs = { NULL };
+	struct list_head *p;
+	char *binname, *tmp = NULL;
+	size_t ndevs = 0, n = 0, len;
+	struct stat st;
+	int fd = -1, rc = -BLKID_ERR_MEM;
+
+	/* ignore /dev/null and so */
+	if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+		return -BLKID_ERR_PARAM;
+
+	binname = blkid_get_bincache_filename(filename);
+	if (!binname)
+		return -BLKID_ERR_MEM;
+
+	list_for_each(p, &cache->bic_devs)
+		ndevs++;
+	ents = calloc(ndevs ? ndevs : 1, sizeof(*ents));
+	if (!ents)
+		goto done;
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		struct blkid_bincache_entry *e = &ents[n];
+		struct list_head *t;
+
+		if (!dev->bid_type || (dev->bid_flags & BLKID_BID_FL_REMOVABLE)
+		    || dev->bid_name[0] != '/')
+			continue;
+
+		e->devno = dev->bid_devno;
+		e->time = dev->bid_time;
+		e->utime = dev->bid_utime;
+		e->pri = dev->bid_pri;
+		if (bincache_add_string(&strs, dev->bid_name, &e->name))
+			goto done;
+		e->tags = strs.len;
+
+		list_for_each(t, &dev->bid_tags) {
+			blkid_tag tag = list_entry(t, struct blkid_struct_tag, bit_tags);
+
+			if (bincache_add_string(&strs, tag->bit_name, NULL) ||
+			    bincache_add_string(&strs, tag->bit_val, NULL))
+				goto done;
+			e->ntags++;
+		}
+		n++;
+	}
+
+	hdr.ndevs = n;
+	hdr.tab_mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	hdr.tab_mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+	hdr.tab_size = st.st_size;
+	hdr.strings_off = sizeof(hdr) + n * sizeof(*ents);
+	hdr.strings_size = strs.len;
+
+	len = strlen(binname) + 8;
+	tmp = malloc(len);
+	if (!tmp)
+		goto done;
+	snprintf(tmp, len, "%s-XXXXXX", binname);
+
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0) {
+		rc = -errno;
+		goto done;
+	}
+	if (fchmod(fd, 0644) != 0
+	    || write_all(fd, &hdr, sizeof(hdr)) != 0
+	    || write_all(fd, ents, n * sizeof(*ents)) != 0
+	    || (strs.len && write_all(fd, strs.data, strs.len) != 0)) {
+		rc = -errno;
+		unlink(tmp);
+		goto done;
+	}
+	if (close(fd) != 0 || rename(tmp, binname) != 0) {
+		fd = -1;
+		rc = -errno;
+		unlink(tmp);
+		goto done;
+	}
+	fd = -1;
+	rc = 0;
+	DBG(SAVE, ul_debug("wrote binary cache %s (%zu devices, %zu bytes of strings)",
+				binname, n, strs.len));
+done:
+	if (fd >= 0)
+		close(fd);
+	if (rc) {
+		/* don't keep the old version */
+		unlink(binname);
+		DBG(SAVE, ul_debug("failed to write binary cache %s [rc=%d]",
+				binname, rc));
+	}
+	free(tmp);
+	free(ents);
+	free(strs.data);
+	free(binname);
+	return rc;
+}
+
 /*
  * Write out the cache struct to the cache file on disk.
  */
@@ -173,7 +320,10 @@ int blkid_flush_cache(blkid_cache cache)
 	if (close_stream(file) != 0)
 		DBG(SAVE, ul_debug("write failed: %s", filename));
 
-	if (opened != filename) {
+	if (opened == filename) {
+		if (ret >= 0)
+			save_bincache(cache, filename);
+	} else {
 		if (ret < 0) {
 			unlink(opened);
 			DBG(SAVE, ul_debug("unlinked temp cache %s", opened));
@@ -197,6 +347,7 @@ int blkid_flush_cache(blkid_cache cache)
 						opened, filename));
 			} else {
 				DBG(SAVE, ul_debug("moved temp cache %s", opened));
+				save_bincache(cache, filename);
 			}
 		}
 	}
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "superblocks.h"
 
@@ -85,6 +86,7 @@
 
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn);
 static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn);
+static void superblocks_free_data(blkid_probe pr, void *data);
 
 static int blkid_probe_set_usage(blkid_probe pr, int usage);
 
@@ -190,6 +192,7 @@ const struct blkid_chaindrv superblocks_drv = {
 	.has_fltr     = TRUE,
 	.probe        = superblocks_probe,
 	.safeprobe    = superblocks_safeprobe,
+	.free_data    = superblocks_free_data
 };
 
 /**
@@ -344,6 +347,233 @@ int blkid_superblocks_get_name(size_t idx, const char **name, int *usage)
 /*
  * The blkid_do_probe() backend.
  */
+/*
+ * The magic strings areas closer than SUPERBLOCKS_PREFETCH_GAP are read by
+ * one read() call, but one read is never larger than SUPERBLOCKS_PREFETCH_MAX.
+ */
+#define SUPERBLOCKS_PREFETCH_GAP	(64 * 1024)
+#define SUPERBLOCKS_PREFETCH_MAX	(256 * 1024)
+
+static int cmp_offsets(const void *a, const void *b)
+{
+	uint64_t x = *((const uint64_t *) a), y = *((const uint64_t *) b);
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* returns 1 if the prober is not used for the device */
+static int superblocks_skip_idinfo(blkid_probe pr, struct blkid_chain *chn,
+				   size_t i)
+{
+	const struct blkid_idinfo *id = idinfos[i];
+
+	if (chn->fltr && blkid_bmp_get_item(chn->fltr, i))
+		return 1;
+	if (id->minsz && (unsigned)id->minsz > pr->size)
+		return 1;
+	/* don't probe for RAIDs, swap or journal on CD/DVDs */
+	if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
+	    blkid_probe_is_cdrom(pr))
+		return 1;
+	/* don't probe for RAIDs on floppies */
+	if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr))
+		return 1;
+	return 0;
+}
+
+/*
+ * Plan reads for all magic strings of the enabled probers -- the areas are
+ * sorted and merged to a few large reads, and blkid_probe_get_idmag() later
+ * gets the data from the already read buffers. This is important for devices
+ * where the latency is more expensive than the amount of data.
+ */
+static void superblocks_prefetch(blkid_probe pr, struct blkid_chain *chn)
+{
+	uint64_t *offs, start = 0, end = 0;
+	size_t i, n = 0, nmags = 0, inarea = 0;
+
+	/* CDROMs may contain unreadable areas (audio tracks) */
+	if (blkid_probe_is_cdrom(pr) || S_ISCHR(pr->mode))
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++)
+			nmags++;
+	}
+
+	offs = malloc(nmags * sizeof(uint64_t));
+	if (!offs)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		if (superblocks_skip_idinfo(pr, chn, i))
+			continue;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++) {
+			uint64_t hint_offset, off;
+
+			if (mag->is_zoned)
+				continue;
+			if (!mag->hoff || blkid_probe_get_hint(pr, mag->hoff, &hint_offset) < 0)
+				hint_offset = 0;
+
+			off = hint_offset + ((mag->kboff + (mag->sboff >> 10)) << 10);
+			if (off + 1024 <= (uint64_t) pr->size)
+				offs[n++] = off;
+		}
+	}
+
+	qsort(offs, n, sizeof(uint64_t), cmp_offsets);
+
+	for (i = 0; i <= n; i++) {
+		if (i < n && inarea &&
+		    offs[i] <= end + SUPERBLOCKS_PREFETCH_GAP &&
+		    offs[i] + 1024 - start <= SUPERBLOCKS_PREFETCH_MAX) {
+			/* extend the current area */
+			if (offs[i] + 1024 > end)
+				end = offs[i] + 1024;
+			inarea++;
+			continue;
+		}
+
+		/* single magic string is read later on demand */
+		if (inarea > 1)
+			blkid_probe_prefetch_buffer(pr, start, end - start);
+
+		if (i < n) {
+			start = offs[i];
+			end = start + 1024;
+			inarea = 1;
+		}
+	}
+
+	free(offs);
+}
+
+/*
+ * Magic strings dispatch table -- all magic strings with a fixed location,
+ * sorted by the 1KiB block where the magic is stored. It's built only once
+ * and it's read-only then.
+ */
+struct sb_magic {
+	uint64_t		blkoff;		/* offset of the 1KiB block */
+	const struct blkid_idmag *mag;
+	size_t			idx;		/* index in idinfos[] */
+};
+
+static struct sb_magic *sb_magics;
+static size_t sb_nmagics;
+static unsigned long sb_dynamic[blkid_bmp_nwords(ARRAY_SIZE(idinfos))];
+static pthread_once_t sb_magics_once = PTHREAD_ONCE_INIT;
+
+static int cmp_sb_magics(const void *a, const void *b)
+{
+	const struct sb_magic *x = a, *y = b;
+
+	if (x->blkoff != y->blkoff)
+		return x->blkoff < y->blkoff ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx ? 1 : 0;
+}
+
+static void init_sb_magics(void)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++)
+			n++;
+	}
+
+	sb_magics = calloc(n, sizeof(struct sb_magic));
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag = &idinfos[i]->magics[0];
+		int dynamic = sb_magics == NULL || mag->magic == NULL;
+
+		/* the location depends on hints or on zone size */
+		for (; !dynamic && mag->magic; mag++) {
+			if (mag->hoff || mag->is_zoned)
+				dynamic = 1;
+		}
+		if (dynamic) {
+			blkid_bmp_set_item(sb_dynamic, i);
+			continue;
+		}
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++) {
+			struct sb_magic *m = &sb_magics[sb_nmagics++];
+
+			m->blkoff = (mag->kboff + (mag->sboff >> 10)) << 10;
+			m->mag = mag;
+			m->idx = i;
+		}
+	}
+
+	if (sb_magics)
+		qsort(sb_magics, sb_nmagics, sizeof(struct sb_magic), cmp_sb_magics);
+
+	DBG(LOWPROBE, ul_debug("superblocks magic table: %zu magics", sb_nmagics));
+}
+
+static void superblocks_free_data(blkid_probe pr __attribute__((__unused__)),
+				  void *data)
+{
+	free(data);
+}
+
+/*
+ * Check all magic strings with a fixed location at once -- every 1KiB block is
+ * requested only once and the magic strings are compared against the block.
+ * The result is bitmap of the probers which have to be called (as chn->data),
+ * the probers without magic strings or with variable location are always
+ * called. I/O errors are not reported here, the affected probers are called
+ * and the error is returned by the probing loop as usually.
+ */
+static void superblocks_prematch(blkid_probe pr, struct blkid_chain *chn)
+{
+	unsigned long *cands = chn->data;
+	size_t i = 0;
+
+	pthread_once(&sb_magics_once, init_sb_magics);
+
+	if (!cands) {
+		cands = malloc(sizeof(sb_dynamic));
+		if (!cands)
+			return;
+		chn->data = cands;
+	}
+	memcpy(cands, sb_dynamic, sizeof(sb_dynamic));
+
+	while (i < sb_nmagics) {
+		uint64_t blkoff = sb_magics[i].blkoff;
+		unsigned char *buf = NULL;
+		int fetched = 0, err = 0;
+
+		for (; i < sb_nmagics && sb_magics[i].blkoff == blkoff; i++) {
+			const struct sb_magic *m = &sb_magics[i];
+			const struct blkid_idmag *mag = m->mag;
+
+			if (blkid_bmp_get_item(cands, m->idx)
+			    || superblocks_skip_idinfo(pr, chn, m->idx))
+				continue;
+			if (!fetched) {
+				buf = blkid_probe_get_buffer(pr, blkoff, 1024);
+				err = !buf && errno;
+				fetched = 1;
+			}
+			if (err || (buf &&
+			    buf[mag->sboff & 0x3ff] == (unsigned char) mag->magic[0] &&
+			    !memcmp(mag->magic, buf + (mag->sboff & 0x3ff), mag->len)))
+				blkid_bmp_set_item(cands, m->idx);
+		}
+	}
+}
+
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 {
 	size_t i;
@@ -370,6 +600,11 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 	DBG(LOWPROBE, ul_debug("--> starting probing loop [SUBLKS idx=%d]",
 		chn->idx));
 
+	if (chn->idx < 0) {
+		superblocks_prefetch(pr, chn);
+		superblocks_prematch(pr, chn);
+	}
+
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
@@ -380,26 +615,16 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 		chn->idx = i;
 		id = idinfos[i];
 
-		if (chn->fltr && blkid_bmp_get_item(chn->fltr, i)) {
+		if (superblocks_skip_idinfo(pr, chn, i)) {
 			DBG(LOWPROBE, ul_debug("filter out: %s", id->name));
 			rc = BLKID_PROBE_NONE;
 			continue;
 		}
 
-		if (id->minsz && (unsigned)id->minsz > pr->size) {
-			rc = BLKID_PROBE_NONE;
-			continue;	/* the device is too small */
-		}
-
-		/* don't probe for RAIDs, swap or journal on CD/DVDs */
-		if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
-		    blkid_probe_is_cdrom(pr)) {
-			rc = BLKID_PROBE_NONE;
-			continue;
-		}
-
-		/* don't probe for RAIDs on floppies */
-		if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr)) {
+		/* no magic string found by superblocks_prematch(), the
+		 * in-memory data may be modified by blkid_probe_hide_range() */
+		if (chn->data && !blkid_bmp_get_item((unsigned long *) chn->data, i)
+		    && !(pr->flags & BLKID_FL_MODIF_BUFF)) {
 			rc = BLKID_PROBE_NONE;
 			continue;
 		}
@@ -49,6 +49,112 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
 	}
 }
 
+static void remove_tags(blkid_dev dev)
+{
+	blkid_tag_iterate iter;
+	const char *type, *value;
+
+	iter = blkid_tag_iterate_begin(dev);
+	while (blkid_tag_next(iter, &type, &value) == 0)
+		blkid_set_tag(dev, type, NULL, 0);
+	blkid_tag_iterate_end(iter);
+}
+
+/*
+ * Probe @fd and store the result as tags to @dev. Returns 0 if anything has
+ * been detected, 1 if nothing, and <0 on error.
+ */
+static int probe_to_tags(blkid_probe pr, int fd, blkid_dev dev)
+{
+	int rc;
+
+	rc = blkid_probe_set_device(pr, fd, 0, 0);
+	if (rc)
+		return rc < 0 ? rc : -1;
+
+	/* enable superblocks probing */
+	blkid_probe_enable_superblocks(pr, TRUE);
+	blkid_probe_set_superblocks_flags(pr,
+		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
+		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
+
+	/* enable partitions probing */
+	blkid_probe_enable_partitions(pr, TRUE);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+
+	/* probe */
+	rc = blkid_do_safeprobe(pr);
+	if (rc == 0)
+		blkid_probe_to_tags(pr, dev);
+
+	/* reset prober */
+	blkid_probe_reset_superblocks_filter(pr);
+	blkid_probe_set_device(pr, -1, 0, 0);
+
+	return rc;
+}
+
+/*
+ * Replace tags of @dev by tags from the @probed result (see
+ * blkid_probe_detached()). Returns 0 on success, 1 if nothing has been
+ * detected on the device.
+ */
+static int copy_probed_tags(blkid_dev probed, blkid_dev dev)
+{
+	blkid_tag_iterate iter;
+	const char *type, *value;
+
+	remove_tags(dev);
+
+	if (!(probed->bid_flags & BLKID_BID_FL_VERIFIED))
+		return 1;
+
+	iter = blkid_tag_iterate_begin(probed);
+	while (blkid_tag_next(iter, &type, &value) == 0)
+		blkid_set_tag(dev, type, value, strlen(value));
+	blkid_tag_iterate_end(iter);
+	return 0;
+}
+
+/*
+ * Returns 1 if @a and @b have the same tags.
+ */
+static int same_tags(blkid_dev a, blkid_dev b)
+{
+	blkid_tag_iterate iter;
+	const char *type, *value;
+	int na = 0, nb = 0, rc = 1;
+
+	iter = blkid_tag_iterate_begin(a);
+	while (rc && blkid_tag_next(iter, &type, &value) == 0) {
+		blkid_tag tag = blkid_find_tag_dev(b, type);
+
+		rc = tag && strcmp(tag->bit_val, value) == 0;
+		na++;
+	}
+	blkid_tag_iterate_end(iter);
+
+	if (rc) {
+		iter = blkid_tag_iterate_begin(b);
+		while (blkid_tag_next(iter, &type, &value) == 0)
+			nb++;
+		blkid_tag_iterate_end(iter);
+	}
+	return rc && na == nb;
+}
+
+static void set_time(blkid_dev dev)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	struct timeval tv;
+	if (!gettimeofday(&tv, NULL)) {
+		dev->bid_time = tv.tv_sec;
+		dev->bid_utime = tv.tv_usec;
+	} else
+#endif
+		dev->bid_time = time(NULL);
+}
+
 /*
  * Verify that the data in dev is consistent with what is on the actual
  * block device (using the devname field only).  Normally this will be
@@ -60,8 +166,7 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
  */
 blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 {
-	blkid_tag_iterate iter;
-	const char *type, *value;
+	blkid_dev probed, tmp = NULL;
 	struct stat st;
 	time_t diff, now;
 	int fd;
@@ -118,6 +223,14 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		blkid_free_dev(dev);
 		return NULL;
 	}
+	if (cache->bic_prefetched &&
+	    cache->bic_prefetched->bid_devno == st.st_rdev) {
+		/* already probed by blkid_probe_all_parallel() */
+		DBG(PROBE, ul_debug("using prefetched result for %s", dev->bid_name));
+		probed = cache->bic_prefetched;
+		goto update;
+	}
+
 	if (!cache->probe) {
 		cache->probe = blkid_new_probe();
 		if (!cache->probe) {
@@ -134,61 +247,76 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		goto open_err;
 	}
 
-	if (blkid_probe_set_device(cache->probe, fd, 0, 0)) {
-		/* failed to read the device */
-		close(fd);
+	tmp = probed = blkid_new_dev();
+	if (probed && probe_to_tags(cache->probe, fd, probed) == 0)
+		probed->bid_flags |= BLKID_BID_FL_VERIFIED;
+	close(fd);
+	if (!probed) {
 		blkid_free_dev(dev);
 		return NULL;
 	}
+update:
+	if ((probed->bid_flags & BLKID_BID_FL_VERIFIED)
+	    && dev->bid_devno == st.st_rdev
+	    && same_tags(probed, dev)) {
+		/* don't set BLKID_BIC_FL_CHANGED, nothing new to save */
+		DBG(PROBE, ul_debug("%s: unchanged", dev->bid_name));
+		set_time(dev);
+		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
+		goto done;
+	}
 
-	/* remove old cache info */
-	iter = blkid_tag_iterate_begin(dev);
-	while (blkid_tag_next(iter, &type, &value) == 0)
-		blkid_set_tag(dev, type, NULL, 0);
-	blkid_tag_iterate_end(iter);
-
-	/* enable superblocks probing */
-	blkid_probe_enable_superblocks(cache->probe, TRUE);
-	blkid_probe_set_superblocks_flags(cache->probe,
-		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
-		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
-
-	/* enable partitions probing */
-	blkid_probe_enable_partitions(cache->probe, TRUE);
-	blkid_probe_set_partitions_flags(cache->probe, BLKID_PARTS_ENTRY_DETAILS);
-
-	/* probe */
-	if (blkid_do_safeprobe(cache->probe)) {
-		/* found nothing or error */
+	/* replace old cache info */
+	if (copy_probed_tags(probed, dev) != 0) {
+		/* failed to read the device, or found nothing */
 		blkid_free_dev(dev);
 		dev = NULL;
 	}
-
 	if (dev) {
-#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-		struct timeval tv;
-		if (!gettimeofday(&tv, NULL)) {
-			dev->bid_time = tv.tv_sec;
-			dev->bid_utime = tv.tv_usec;
-		} else
-#endif
-			dev->bid_time = time(NULL);
-
+		set_time(dev);
 		dev->bid_devno = st.st_rdev;
 		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
 		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
 
-		blkid_probe_to_tags(cache->probe, dev);
-
 		DBG(PROBE, ul_debug("%s: devno 0x%04llx, type %s",
 			   dev->bid_name, (long long)st.st_rdev, dev->bid_type));
 	}
+done:
+	blkid_free_dev(tmp);
+	return dev;
+}
 
-	/* reset prober */
-	blkid_probe_reset_superblocks_filter(cache->probe);
-	blkid_probe_set_device(cache->probe, -1, 0, 0);
-	close(fd);
+/*
+ * Probe @devname by @pr and return a new device (not linked to any cache)
+ * with the result. The returned device is marked as verified if anything has
+ * been detected on the device. Returns NULL if the device cannot be opened
+ * or it does not match @devno.
+ *
+ * This function does not touch any cache, so it's possible to call it from
+ * more threads, every thread with its own @pr.
+ */
+blkid_dev blkid_probe_detached(blkid_probe pr, const char *devname, dev_t devno)
+{
+	blkid_dev dev;
+	struct stat st;
+	int fd;
+
+	fd = open(devname, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_rdev != devno
+	    || sysfs_devno_is_dm_private(st.st_rdev, NULL)) {
+		close(fd);
+		return NULL;
+	}
 
+	dev = blkid_new_dev();
+	if (dev) {
+		dev->bid_devno = devno;
+		if (probe_to_tags(pr, fd, dev) == 0)
+			dev->bid_flags |= BLKID_BID_FL_VERIFIED;
+	}
+	close(fd);
 	return dev;
 }
 
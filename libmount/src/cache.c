@@ -37,8 +37,13 @@
 
 /*
  * Canonicalized (resolved) paths & tags cache
+ *
+ * The entries are hashed by key (path or "TAG_NAME\0TAG_VALUE") and tags also
+ * by value (device name). The list of the entries is in LRU order if the cache
+ * size is limited by mnt_cache_set_limit(), otherwise in the insertion order.
  */
-#define MNT_CACHE_CHUNKSZ	128
+#define MNT_CACHE_MINBUCKETS	64
+#define MNT_CACHE_MINLIMIT	16	/* see mnt_cache_set_limit() */
 
 #define MNT_CACHE_ISTAG		(1 << 1) /* entry is TAG */
 #define MNT_CACHE_ISPATH	(1 << 2) /* entry is path */
@@ -49,14 +54,28 @@ struct mnt_cache_entry {
 	char			*key;	/* search key (e.g. uncanonicalized path) */
 	char			*value;	/* value (e.g. canonicalized path) */
 	int			flag;
+
+	struct list_head	ents;	/* cache entries */
+	struct mnt_cache_entry	*knext;	/* next in the key hash bucket */
+	struct mnt_cache_entry	*vnext;	/* next in the value hash bucket (tags only) */
+	uint32_t		khash;
+	uint32_t		vhash;
 };
 
 struct libmnt_cache {
-	struct mnt_cache_entry	*ents;
+	struct list_head	ents;
 	size_t			nents;
-	size_t			nallocs;
+	size_t			maxents;	/* zero for unlimited */
 	int			refcount;
 
+	struct mnt_cache_entry	**keys;		/* hash buckets by key */
+	struct mnt_cache_entry	**values;	/* hash buckets by value (tags only) */
+	size_t			nbuckets;	/* power of two */
+
+	size_t			nhits;		/* statistics for debug */
+	size_t			nmisses;
+	size_t			nevicted;
+
 	/* blkid_evaluate_tag() works in two ways:
 	 *
 	 * 1/ all tags are evaluated by udev /dev/disk/by-* symlinks,
@@ -83,9 +102,19 @@ struct libmnt_cache *mnt_new_cache(void)
 		return NULL;
 	DBG(CACHE, ul_debugobj(cache, "alloc"));
 	cache->refcount = 1;
+	INIT_LIST_HEAD(&cache->ents);
 	return cache;
 }
 
+static void free_cache_entry(struct mnt_cache_entry *e)
+{
+	list_del(&e->ents);
+	if (e->value != e->key)
+		free(e->value);
+	free(e->key);
+	free(e);
+}
+
 /**
  * mnt_free_cache:
  * @cache: pointer to struct libmnt_cache instance
@@ -95,20 +124,21 @@ struct libmnt_cache *mnt_new_cache(void)
  */
 void mnt_free_cache(struct libmnt_cache *cache)
 {
-	size_t i;
-
 	if (!cache)
 		return;
 
-	DBG(CACHE, ul_debugobj(cache, "free [refcount=%d]", cache->refcount));
+	DBG(CACHE, ul_debugobj(cache, "free [refcount=%d, entries=%zu, "
+				"hits=%zu, misses=%zu, evicted=%zu]",
+				cache->refcount, cache->nents, cache->nhits,
+				cache->nmisses, cache->nevicted));
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (e->value != e->key)
-			free(e->value);
-		free(e->key);
+	while (!list_empty(&cache->ents)) {
+		struct mnt_cache_entry *e = list_entry(cache->ents.next,
+					struct mnt_cache_entry, ents);
+		free_cache_entry(e);
 	}
-	free(cache->ents);
+	free(cache->keys);
+	free(cache->values);
 	if (cache->bc)
 		blkid_put_cache(cache->bc);
 	free(cache);
@@ -170,6 +200,97 @@ int mnt_cache_set_targets(struct libmnt_cache *cache,
 	return 0;
 }
 
+static inline const char *tag_value(const struct mnt_cache_entry *e)
+{
+	return e->key + strlen(e->key) + 1;
+}
+
+static void cache_link_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	size_t mask = cache->nbuckets - 1;
+
+	e->knext = cache->keys[e->khash & mask];
+	cache->keys[e->khash & mask] = e;
+
+	if (e->flag & MNT_CACHE_ISTAG) {
+		e->vnext = cache->values[e->vhash & mask];
+		cache->values[e->vhash & mask] = e;
+	}
+}
+
+static void cache_unlink_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	size_t mask = cache->nbuckets - 1;
+	struct mnt_cache_entry **x;
+
+	for (x = &cache->keys[e->khash & mask]; *x; x = &(*x)->knext) {
+		if (*x == e) {
+			*x = e->knext;
+			break;
+		}
+	}
+	if (!(e->flag & MNT_CACHE_ISTAG))
+		return;
+	for (x = &cache->values[e->vhash & mask]; *x; x = &(*x)->vnext) {
+		if (*x == e) {
+			*x = e->vnext;
+			break;
+		}
+	}
+}
+
+/* resize the hash buckets to keep the load factor <= 1 */
+static int cache_rehash(struct libmnt_cache *cache, size_t nbuckets)
+{
+	struct mnt_cache_entry **keys, **values;
+	struct list_head *p;
+
+	keys = calloc(nbuckets, sizeof(*keys));
+	values = calloc(nbuckets, sizeof(*values));
+	if (!keys || !values) {
+		free(keys);
+		free(values);
+		return -ENOMEM;
+	}
+
+	free(cache->keys);
+	free(cache->values);
+	cache->keys = keys;
+	cache->values = values;
+	cache->nbuckets = nbuckets;
+
+	list_for_each(p, &cache->ents)
+		cache_link_entry(cache, list_entry(p, struct mnt_cache_entry, ents));
+
+	DBG(CACHE, ul_debugobj(cache, "rehashed to %zu buckets", nbuckets));
+	return 0;
+}
+
+/* removes the least recently used entries to keep the cache in the limit */
+static void cache_evict(struct libmnt_cache *cache, size_t maxents)
+{
+	while (cache->nents > maxents && !list_empty(&cache->ents)) {
+		struct mnt_cache_entry *e = list_entry(cache->ents.next,
+					struct mnt_cache_entry, ents);
+
+		DBG(CACHE, ul_debugobj(cache, "evict entry: %s", e->key));
+		cache_unlink_entry(cache, e);
+		free_cache_entry(e);
+		cache->nents--;
+		cache->nevicted++;
+	}
+}
+
+/* cache hit -- the entry is the most recently used now */
+static inline void cache_touch_entry(struct libmnt_cache *cache,
+				     struct mnt_cache_entry *e)
+{
+	cache->nhits++;
+	if (cache->maxents) {
+		list_del(&e->ents);
+		list_add_tail(&e->ents, &cache->ents);
+	}
+}
 
 /* note that the @key could be the same pointer as @value */
 static int cache_add_entry(struct libmnt_cache *cache, char *key,
@@ -181,20 +302,31 @@ static int cache_add_entry(struct libmnt_cache *cache, char *key,
 	assert(value);
 	assert(key);
 
-	if (cache->nents == cache->nallocs) {
-		size_t sz = cache->nallocs + MNT_CACHE_CHUNKSZ;
+	if (cache->maxents)
+		cache_evict(cache, cache->maxents - 1);
 
-		e = realloc(cache->ents, sz * sizeof(struct mnt_cache_entry));
-		if (!e)
-			return -ENOMEM;
-		cache->ents = e;
-		cache->nallocs = sz;
-	}
+	if (cache->nents >= cache->nbuckets &&
+	    cache_rehash(cache, cache->nbuckets ?
+				cache->nbuckets << 1 : MNT_CACHE_MINBUCKETS))
+		return -ENOMEM;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
 
-	e = &cache->ents[cache->nents];
 	e->key = key;
 	e->value = value;
 	e->flag = flag;
+
+	if (flag & MNT_CACHE_ISTAG) {
+		e->khash = mnt_index_hash_tag(key, tag_value(e));
+		e->vhash = mnt_index_hash_path(value);
+	} else
+		e->khash = mnt_index_hash_path(key);
+
+	INIT_LIST_HEAD(&e->ents);
+	list_add_tail(&e->ents, &cache->ents);
+	cache_link_entry(cache, e);
 	cache->nents++;
 
 	DBG(CACHE, ul_debugobj(cache, "add entry [%2zd] (%s): %s: %s",
@@ -245,18 +377,26 @@ static int cache_add_tag(struct libmnt_cache *cache, const char *tagname,
  */
 static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
+	uint32_t hash;
 
 	if (!cache || !path)
 		return NULL;
+	if (!cache->nents)
+		goto miss;
+
+	hash = mnt_index_hash_path(path);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISPATH))
+	for (e = cache->keys[hash & (cache->nbuckets - 1)]; e; e = e->knext) {
+		if (e->khash != hash || !(e->flag & MNT_CACHE_ISPATH))
 			continue;
-		if (streq_paths(path, e->key))
+		if (streq_paths(path, e->key)) {
+			cache_touch_entry(cache, e);
 			return e->value;
+		}
 	}
+miss:
+	cache->nmisses++;
 	return NULL;
 }
 
@@ -266,21 +406,51 @@ static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 static const char *cache_find_tag(struct libmnt_cache *cache,
 			const char *token, const char *value)
 {
-	size_t i;
-	size_t tksz;
+	struct mnt_cache_entry *e;
+	uint32_t hash;
 
 	if (!cache || !token || !value)
 		return NULL;
+	if (!cache->nents)
+		goto miss;
 
-	tksz = strlen(token);
+	hash = mnt_index_hash_tag(token, value);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
+	for (e = cache->keys[hash & (cache->nbuckets - 1)]; e; e = e->knext) {
+		if (e->khash != hash || !(e->flag & MNT_CACHE_ISTAG))
 			continue;
 		if (strcmp(token, e->key) == 0 &&
-		    strcmp(value, e->key + tksz + 1) == 0)
+		    strcmp(value, tag_value(e)) == 0) {
+			cache_touch_entry(cache, e);
 			return e->value;
+		}
+	}
+miss:
+	cache->nmisses++;
+	return NULL;
+}
+
+/*
+ * Returns the first tag entry for @devname with any of @flag, and with
+ * @token tag name if @token is not NULL.
+ */
+static struct mnt_cache_entry *cache_find_devname(struct libmnt_cache *cache,
+			const char *devname, const char *token, int flag)
+{
+	struct mnt_cache_entry *e;
+	uint32_t hash;
+
+	if (!cache->nents)
+		return NULL;
+
+	hash = mnt_index_hash_path(devname);
+
+	for (e = cache->values[hash & (cache->nbuckets - 1)]; e; e = e->vnext) {
+		if (e->vhash != hash || !(e->flag & flag))
+			continue;
+		if (strcmp(e->value, devname) == 0 &&		/* dev name */
+		    (!token || strcmp(token, e->key) == 0))	/* tag name */
+			return e;
 	}
 	return NULL;
 }
@@ -288,22 +458,54 @@ static const char *cache_find_tag(struct libmnt_cache *cache,
 static char *cache_find_tag_value(struct libmnt_cache *cache,
 			const char *devname, const char *token)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 
 	assert(cache);
 	assert(devname);
 	assert(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
-			continue;
-		if (strcmp(e->value, devname) == 0 &&	/* dev name */
-		    strcmp(token, e->key) == 0)	/* tag name */
-			return e->key + strlen(token) + 1;	/* tag value */
+	e = cache_find_devname(cache, devname, token, MNT_CACHE_ISTAG);
+	if (!e) {
+		cache->nmisses++;
+		return NULL;
 	}
+	cache_touch_entry(cache, e);
+	return e->key + strlen(token) + 1;	/* tag value */
+}
 
-	return NULL;
+/**
+ * mnt_cache_set_limit:
+ * @cache: pointer to struct libmnt_cache instance
+ * @nents: maximal number of entries or zero for unlimited cache
+ *
+ * Limits the number of cached paths and tags; the least recently used entries
+ * are removed from the cache if the limit is exceeded. This is useful for
+ * long-running processes which resolve many paths and tags. The limit is
+ * silently increased to 16 entries if smaller, so the tags read for one
+ * device do not evict each other.
+ *
+ * Note that by default the strings returned by mnt_resolve_path(),
+ * mnt_resolve_tag() and the other functions are valid as long as the cache
+ * exists. If the limit is set, the strings are valid only until the next call
+ * that adds something to the cache; use strdup() to keep the result.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_cache_set_limit(struct libmnt_cache *cache, size_t nents)
+{
+	if (!cache)
+		return -EINVAL;
+
+	if (nents && nents < MNT_CACHE_MINLIMIT)
+		nents = MNT_CACHE_MINLIMIT;
+
+	DBG(CACHE, ul_debugobj(cache, "set limit to %zu entries", nents));
+	cache->maxents = nents;
+	if (nents)
+		cache_evict(cache, nents);
+	return 0;
 }
 
 /**
@@ -330,14 +532,9 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 	DBG(CACHE, ul_debugobj(cache, "tags for %s requested", devname));
 
 	/* check if device is already cached */
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_TAGREAD))
-			continue;
-		if (strcmp(e->value, devname) == 0)
-			/* tags have already been read */
-			return 0;
-	}
+	if (cache_find_devname(cache, devname, NULL, MNT_CACHE_TAGREAD))
+		/* tags have already been read */
+		return 0;
 
 	pr =  blkid_new_probe_from_filename(devname);
 	if (!pr)
@@ -777,7 +974,7 @@ static int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char line[BUFSIZ];
 	struct libmnt_cache *cache;
-	size_t i;
+	struct list_head *p;
 
 	cache = mnt_new_cache();
 	if (!cache)
@@ -812,13 +1009,12 @@ static int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 		}
 	}
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	list_for_each(p, &cache->ents) {
+		struct mnt_cache_entry *e = list_entry(p, struct mnt_cache_entry, ents);
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 
-		printf("%15s : %5s : %s\n", e->value, e->key,
-				e->key + strlen(e->key) + 1);
+		printf("%15s : %5s : %s\n", e->value, e->key, tag_value(e));
 	}
 
 	mnt_unref_cache(cache);
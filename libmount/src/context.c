@@ -928,9 +928,16 @@ int mnt_context_is_loopdel(struct libmnt_context *cxt)
  */
 int mnt_context_set_fs(struct libmnt_context *cxt, struct libmnt_fs *fs)
 {
+	int rc;
+
 	if (!cxt)
 		return -EINVAL;
 
+	/* the context modifies fs strings in place */
+	rc = mnt_fs_detach_arena(fs);
+	if (rc)
+		return rc;
+
 	DBG(CXT, ul_debugobj(cxt, "setting new FS"));
 	mnt_ref_fs(fs);			/* new */
 	mnt_unref_fs(cxt->fs);		/* old */
@@ -1396,6 +1403,9 @@ int mnt_context_get_mountinfo_for_target(struct libmnt_context *cxt,
 	else if (mnt_stat_mountpoint(tgt, &st) == 0 && S_ISDIR(st.st_mode)) {
 		cache = mnt_context_get_cache(cxt);
 		cn_tgt = mnt_resolve_path(tgt, cache);
+		/* the cache entry may be evicted while mountinfo is parsed */
+		if (cn_tgt && cache)
+			cn_tgt = strdup(cn_tgt);
 		if (cn_tgt)
 			mnt_context_set_tabfilter(cxt, mountinfo_filter, cn_tgt);
 	}
@@ -1406,9 +1416,7 @@ int mnt_context_get_mountinfo_for_target(struct libmnt_context *cxt,
 	if (!mnt_context_switch_ns(cxt, ns_old))
 		return -MNT_ERR_NAMESPACE;
 
-	if (cn_tgt && !cache)
-		free(cn_tgt);
-
+	free(cn_tgt);
 	return rc;
 }
 
@@ -93,6 +93,7 @@ is_mounted_same_loopfile(struct libmnt_context *cxt,
 	struct libmnt_fs *fs;
 	struct libmnt_cache *cache;
 	const char *bf;
+	char *bf_copy = NULL;
 	int rc = 0;
 	struct libmnt_ns *ns_old;
 
@@ -113,7 +114,13 @@ is_mounted_same_loopfile(struct libmnt_context *cxt,
 	cache = mnt_context_get_cache(cxt);
 	mnt_reset_iter(&itr, MNT_ITER_BACKWARD);
 
-	bf = cache ? mnt_resolve_path(backing_file, cache) : backing_file;
+	if (cache) {
+		/* the cache entry may be evicted by mnt_fs_match_target() */
+		const char *p = mnt_resolve_path(backing_file, cache);
+
+		bf = bf_copy = p ? strdup(p) : NULL;
+	} else
+		bf = backing_file;
 
 	/* Search for a mountpoint node in mountinfo, proceed if any of these have the
 	 * loop option set or the device is a loop device
@@ -143,6 +150,7 @@ is_mounted_same_loopfile(struct libmnt_context *cxt,
 	if (rc)
 		DBG(LOOP, ul_debugobj(cxt, "%s already mounted", backing_file));
 
+	free(bf_copy);
 	if (!mnt_context_switch_ns(cxt, ns_old))
 		return -MNT_ERR_NAMESPACE;
 	return rc;
@@ -43,6 +43,111 @@ struct libmnt_fs *mnt_new_fs(void)
 	return fs;
 }
 
+struct libmnt_arena *mnt_new_arena(void)
+{
+	struct libmnt_arena *ar = calloc(1, sizeof(*ar));
+
+	if (!ar)
+		return NULL;
+	ar->refcount = 1;
+	return ar;
+}
+
+void mnt_ref_arena(struct libmnt_arena *ar)
+{
+	if (ar)
+		ar->refcount++;
+}
+
+void mnt_unref_arena(struct libmnt_arena *ar)
+{
+	if (ar) {
+		ar->refcount--;
+		if (ar->refcount <= 0) {
+			free(ar->data);
+			free(ar);
+		}
+	}
+}
+
+/* Strings in @ar may be used by @fs (used by the mountinfo parser only) */
+void mnt_fs_set_arena(struct libmnt_fs *fs, struct libmnt_arena *ar)
+{
+	mnt_ref_arena(ar);
+	mnt_unref_arena(fs->arena);
+	fs->arena = ar;
+}
+
+static inline int is_arena_str(const struct libmnt_fs *fs, const char *str)
+{
+	return fs->arena && str
+		&& str >= fs->arena->data
+		&& str <= fs->arena->data + fs->arena->size;
+}
+
+/* free() for strings which may point to the arena */
+static inline void free_fs_str(struct libmnt_fs *fs, char *str)
+{
+	if (!is_arena_str(fs, str))
+		free(str);
+}
+
+/* strdup_to_struct_member() for strings which may point to the arena */
+static int fs_strdup_str(struct libmnt_fs *fs, char **dest, const char *str)
+{
+	char *p = NULL;
+
+	if (str) {
+		p = strdup(str);
+		if (!p)
+			return -ENOMEM;
+	}
+	free_fs_str(fs, *dest);
+	*dest = p;
+	return 0;
+}
+
+/* copy-on-write, replaces string in the arena with a private copy */
+static int fs_unshare_str(struct libmnt_fs *fs, char **str)
+{
+	char *p;
+
+	if (!is_arena_str(fs, *str))
+		return 0;
+	p = strdup(*str);
+	if (!p)
+		return -ENOMEM;
+	*str = p;
+	return 0;
+}
+
+/*
+ * Replaces all strings in the arena with private copies and drops the arena
+ * reference. This is necessary before the strings are modified in place
+ * (e.g. by mnt_optstr_* functions).
+ */
+int mnt_fs_detach_arena(struct libmnt_fs *fs)
+{
+	int rc;
+
+	if (!fs || !fs->arena)
+		return 0;
+
+	if ((rc = fs_unshare_str(fs, &fs->source)) ||
+	    (rc = fs_unshare_str(fs, &fs->root)) ||
+	    (rc = fs_unshare_str(fs, &fs->target)) ||
+	    (rc = fs_unshare_str(fs, &fs->fstype)) ||
+	    (rc = fs_unshare_str(fs, &fs->vfs_optstr)) ||
+	    (rc = fs_unshare_str(fs, &fs->opt_fields)) ||
+	    (rc = fs_unshare_str(fs, &fs->fs_optstr)))
+		return rc;
+
+	DBG(FS, ul_debugobj(fs, "detached from arena"));
+	mnt_unref_arena(fs->arena);
+	fs->arena = NULL;
+	return 0;
+}
+
 /**
  * mnt_free_fs:
  * @fs: fs pointer
@@ -79,21 +184,22 @@ void mnt_reset_fs(struct libmnt_fs *fs)
 	ref = fs->refcount;
 
 	list_del(&fs->ents);
-	free(fs->source);
+	free_fs_str(fs, fs->source);
 	free(fs->bindsrc);
 	free(fs->tagname);
 	free(fs->tagval);
-	free(fs->root);
+	free_fs_str(fs, fs->root);
 	free(fs->swaptype);
-	free(fs->target);
-	free(fs->fstype);
+	free_fs_str(fs, fs->target);
+	free_fs_str(fs, fs->fstype);
 	free(fs->optstr);
-	free(fs->vfs_optstr);
-	free(fs->fs_optstr);
+	free_fs_str(fs, fs->vfs_optstr);
+	free_fs_str(fs, fs->fs_optstr);
 	free(fs->user_optstr);
 	free(fs->attrs);
-	free(fs->opt_fields);
+	free_fs_str(fs, fs->opt_fields);
 	free(fs->comment);
+	mnt_unref_arena(fs->arena);
 
 	memset(fs, 0, sizeof(*fs));
 	INIT_LIST_HEAD(&fs->ents);
@@ -233,6 +339,8 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 	dest->usedsize   = src->usedsize;
 	dest->priority   = src->priority;
 
+	if (dest->tab)
+		mnt_table_reset_index(dest->tab);
 	return dest;
 err:
 	if (!org)
@@ -380,7 +488,7 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 	}
 
 	if (fs->source != source)
-		free(fs->source);
+		free_fs_str(fs, fs->source);
 
 	free(fs->tagname);
 	free(fs->tagval);
@@ -388,6 +496,9 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 	fs->source = source;
 	fs->tagname = t;
 	fs->tagval = v;
+
+	if (fs->tab)
+		mnt_table_reset_index(fs->tab);
 	return 0;
 }
 
@@ -549,7 +660,15 @@ const char *mnt_fs_get_target(struct libmnt_fs *fs)
  */
 int mnt_fs_set_target(struct libmnt_fs *fs, const char *tgt)
 {
-	return strdup_to_struct_member(fs, target, tgt);
+	int rc;
+
+	if (!fs)
+		return -EINVAL;
+
+	rc = fs_strdup_str(fs, &fs->target, tgt);
+	if (rc == 0 && fs->tab)
+		mnt_table_reset_index(fs->tab);
+	return rc;
 }
 
 static int mnt_fs_get_flags(struct libmnt_fs *fs)
@@ -668,7 +787,7 @@ int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 	assert(fs);
 
 	if (fstype != fs->fstype)
-		free(fs->fstype);
+		free_fs_str(fs, fs->fstype);
 
 	fs->fstype = fstype;
 	fs->flags &= ~MNT_FS_PSEUDO;
@@ -847,8 +966,8 @@ int mnt_fs_set_options(struct libmnt_fs *fs, const char *optstr)
 		}
 	}
 
-	free(fs->fs_optstr);
-	free(fs->vfs_optstr);
+	free_fs_str(fs, fs->fs_optstr);
+	free_fs_str(fs, fs->vfs_optstr);
 	free(fs->user_optstr);
 	free(fs->optstr);
 
@@ -886,6 +1005,10 @@ int mnt_fs_append_options(struct libmnt_fs *fs, const char *optstr)
 	if (rc)
 		return rc;
 
+	if (v)
+		rc = fs_unshare_str(fs, &fs->vfs_optstr);
+	if (!rc && f)
+		rc = fs_unshare_str(fs, &fs->fs_optstr);
 	if (!rc && v)
 		rc = mnt_optstr_append_option(&fs->vfs_optstr, v, NULL);
 	if (!rc && f)
@@ -928,6 +1051,10 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
 	if (rc)
 		return rc;
 
+	if (v)
+		rc = fs_unshare_str(fs, &fs->vfs_optstr);
+	if (!rc && f)
+		rc = fs_unshare_str(fs, &fs->fs_optstr);
 	if (!rc && v)
 		rc = mnt_optstr_prepend_option(&fs->vfs_optstr, v, NULL);
 	if (!rc && f)
@@ -1149,7 +1276,9 @@ const char *mnt_fs_get_root(struct libmnt_fs *fs)
  */
 int mnt_fs_set_root(struct libmnt_fs *fs, const char *path)
 {
-	return strdup_to_struct_member(fs, root, path);
+	if (!fs)
+		return -EINVAL;
+	return fs_strdup_str(fs, &fs->root, path);
 }
 
 /**
@@ -1412,8 +1541,15 @@ int mnt_fs_match_target(struct libmnt_fs *fs, const char *target,
 
 		/* 3) - canonicalized and canonicalized */
 		if (!rc && cn && !mnt_fs_is_kernel(fs) && !mnt_fs_is_swaparea(fs)) {
-			char *tcn = mnt_resolve_target(fs->target, cache);
+			char *tcn;
+
+			/* the cache entry may be evicted by the next lookup */
+			cn = strdup(cn);
+			if (!cn)
+				return 0;
+			tcn = mnt_resolve_target(fs->target, cache);
 			rc = (tcn && strcmp(cn, tcn) == 0);
+			free(cn);
 		}
 	}
 
@@ -1442,6 +1578,7 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 {
 	char *cn;
 	const char *src, *t, *v;
+	int rc = 0;
 
 	if (!fs)
 		return 0;
@@ -1466,20 +1603,30 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 	if (!cn)
 		return 0;
 
+	/* the cache entry may be evicted by the next mnt_resolve_*() or
+	 * mnt_cache_read_tags() calls */
+	cn = strdup(cn);
+	if (!cn)
+		return 0;
+
 	/* 2) canonicalized and native */
 	src = mnt_fs_get_srcpath(fs);
-	if (src && mnt_fs_streq_srcpath(fs, cn))
-		return 1;
+	if (src && mnt_fs_streq_srcpath(fs, cn)) {
+		rc = 1;
+		goto done;
+	}
 
 	/* 3) canonicalized and canonicalized */
 	if (src) {
 		src = mnt_resolve_path(src, cache);
-		if (src && !strcmp(cn, src))
-			return 1;
+		if (src && !strcmp(cn, src)) {
+			rc = 1;
+			goto done;
+		}
 	}
 	if (src || mnt_fs_get_tag(fs, &t, &v))
 		/* src path does not match and the tag is not defined */
-		return 0;
+		goto done;
 
 	/* read @source's tags to the cache */
 	if (mnt_cache_read_tags(cache, cn) < 0) {
@@ -1492,16 +1639,17 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 			 */
 			char *x = mnt_resolve_tag(t, v, cache);
 			if (x && !strcmp(x, cn))
-				return 1;
+				rc = 1;
 		}
-		return 0;
+		goto done;
 	}
 
 	/* 4) has the @source a tag that matches with the tag from @fs ? */
 	if (mnt_cache_device_has_tag(cache, cn, t, v))
-		return 1;
-
-	return 0;
+		rc = 1;
+done:
+	free(cn);
+	return rc;
 }
 
 /**
@@ -144,6 +144,30 @@ extern struct libmnt_fs *mnt_table_get_fs_root(struct libmnt_table *tb,
 					unsigned long mountflags,
 					char **fsroot);
 
+/* tab_index.c */
+enum {
+	MNT_INDEX_TARGET = 0,
+	MNT_INDEX_SRCPATH,
+	MNT_INDEX_TAG,
+	MNT_INDEX_DEVNO,
+	MNT_INDEX_ID,
+
+	__MNT_INDEX_MAX
+};
+
+extern uint32_t mnt_index_hash_path(const char *path);
+extern uint32_t mnt_index_hash_tag(const char *name, const char *value);
+extern uint32_t mnt_index_hash_num(uint64_t num);
+
+extern void mnt_table_reset_index(struct libmnt_table *tb);
+extern void mnt_table_free_index(struct libmnt_table *tb);
+extern int mnt_table_index_lookup(struct libmnt_table *tb, int type, uint32_t hash,
+			int direction,
+			int (*match)(struct libmnt_fs *, const void *),
+			const void *data,
+			struct libmnt_fs **fs);
+extern int mnt_table_index_count(struct libmnt_table *tb, int type);
+
 extern int __mnt_table_is_fs_mounted(	struct libmnt_table *tb,
 					struct libmnt_fs *fstab_fs,
 					const char *tgt_prefix);
@@ -175,6 +199,18 @@ struct libmnt_iter {
 	} while(0)
 
 
+/*
+ * Buffer with the whole mountinfo file. The mountinfo parser unmangles the
+ * fields in place and libmnt_fs strings point to this buffer; setters replace
+ * the strings with private copies (see fs.c). The buffer is deallocated when
+ * the last fs is deallocated.
+ */
+struct libmnt_arena {
+	int		refcount;
+	size_t		size;		/* data size (without terminating zero) */
+	char		*data;
+};
+
 /*
  * This struct represents one entry in a fstab/mountinfo file.
  * (note that fstab[1] means the first column from fstab, and so on...)
@@ -221,6 +257,8 @@ struct libmnt_fs {
 	char		*comment;	/* fstab comment */
 
 	void		*userdata;	/* library independent data */
+
+	struct libmnt_arena *arena;	/* strings storage or NULL */
 };
 
 /*
@@ -231,6 +269,7 @@ struct libmnt_fs {
 #define MNT_FS_SWAP	(1 << 3) /* swap device */
 #define MNT_FS_KERNEL	(1 << 4) /* data from /proc/{mounts,self/mountinfo} */
 #define MNT_FS_MERGED	(1 << 5) /* already merged data from /run/mount/utab */
+#define MNT_FS_REFRESHED (1 << 6) /* matched by mnt_table_refresh() */
 
 /*
  * fstab/mountinfo file
@@ -254,6 +293,10 @@ struct libmnt_table {
 
 	struct list_head	ents;	/* list of entries (libmnt_fs) */
 	void		*userdata;
+
+	struct libmnt_tabidx	*idx;	/* lookup hash indexes (tab_index.c) */
+	unsigned int	idx_enabled : 1;
+	unsigned int	noarena : 1;	/* don't use arena for mountinfo */
 };
 
 extern struct libmnt_table *__mnt_new_table_from_file(const char *filename, int fmt, int empty_for_enoent);
@@ -416,6 +459,11 @@ extern int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 			__attribute__((nonnull(1)));
 extern int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 			__attribute__((nonnull(1)));
+extern struct libmnt_arena *mnt_new_arena(void);
+extern void mnt_ref_arena(struct libmnt_arena *ar);
+extern void mnt_unref_arena(struct libmnt_arena *ar);
+extern void mnt_fs_set_arena(struct libmnt_fs *fs, struct libmnt_arena *ar);
+extern int mnt_fs_detach_arena(struct libmnt_fs *fs);
 
 /* context.c */
 extern struct libmnt_context *mnt_copy_context(struct libmnt_context *o);
@@ -170,6 +170,7 @@ void mnt_free_table(struct libmnt_table *tb)
 	DBG(TAB, ul_debugobj(tb, "free [refcount=%d]", tb->refcount));
 
 	mnt_unref_cache(tb->cache);
+	mnt_table_free_index(tb);
 	free(tb->comm_intro);
 	free(tb->comm_tail);
 	free(tb);
@@ -395,6 +396,35 @@ struct libmnt_cache *mnt_table_get_cache(struct libmnt_table *tb)
 	return tb ? tb->cache : NULL;
 }
 
+/**
+ * mnt_table_enable_index:
+ * @tb: pointer to tab
+ * @enable: TRUE or FALSE
+ *
+ * Enables hash indexes for mnt_table_find_target(), mnt_table_find_srcpath(),
+ * mnt_table_find_tag(), mnt_table_find_devno() and for the lookups by mount
+ * ID (e.g. mnt_table_get_root_fs()). The indexes are built on the first lookup
+ * after any change in the table, so they are useful for large tables (e.g.
+ * mountinfo with thousands of entries) where many lookups are done without
+ * modifying the table. Only the first (non-canonicalized) iteration of the
+ * lookup functions uses the indexes.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_enable_index(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "index: %s", enable ? "ENABLED" : "DISABLED"));
+	tb->idx_enabled = enable ? 1 : 0;
+	if (!enable)
+		mnt_table_free_index(tb);
+	return 0;
+}
+
 /**
  * mnt_table_find_fs:
  * @tb: tab pointer
@@ -452,6 +482,7 @@ int mnt_table_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 	list_add_tail(&fs->ents, &tb->ents);
 	fs->tab = tb;
 	tb->nents++;
+	mnt_table_reset_index(tb);
 
 	DBG(TAB, ul_debugobj(tb, "add entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -471,6 +502,7 @@ static int __table_insert_fs(
 
 	fs->tab = tb;
 	tb->nents++;
+	mnt_table_reset_index(tb);
 
 	DBG(TAB, ul_debugobj(tb, "insert entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -542,6 +574,7 @@ int mnt_table_move_fs(struct libmnt_table *src, struct libmnt_table *dst,
 	/* remove from source */
 	list_del_init(&fs->ents);
 	src->nents--;
+	mnt_table_reset_index(src);
 
 	/* insert to the destination */
 	return __table_insert_fs(dst, before, pos, fs);
@@ -566,18 +599,29 @@ int mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 
 	fs->tab = NULL;
 	list_del_init(&fs->ents);
+	mnt_table_reset_index(tb);
 
 	mnt_unref_fs(fs);
 	tb->nents--;
 	return 0;
 }
 
+static int match_id(struct libmnt_fs *fs, const void *data)
+{
+	return mnt_fs_get_id(fs) == *((const int *) data);
+}
+
 static inline struct libmnt_fs *get_parent_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 {
 	struct libmnt_iter itr;
 	struct libmnt_fs *x;
 	int parent_id = mnt_fs_get_parent_id(fs);
 
+	if (mnt_table_index_lookup(tb, MNT_INDEX_ID,
+				mnt_index_hash_num(parent_id), MNT_ITER_FORWARD,
+				match_id, &parent_id, &x) >= 0)
+		return x;
+
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 	while (mnt_table_next_fs(tb, &itr, &x) == 0) {
 		if (mnt_fs_get_id(x) == parent_id)
@@ -982,6 +1026,33 @@ int mnt_table_set_iter(struct libmnt_table *tb, struct libmnt_iter *itr, struct
 	return 0;
 }
 
+static int match_target(struct libmnt_fs *fs, const void *data)
+{
+	return mnt_fs_streq_target(fs, (const char *) data);
+}
+
+/* Returns the first entry with the (non-canonicalized) target @path */
+static struct libmnt_fs *find_target(struct libmnt_table *tb, const char *path,
+				     int direction)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs = NULL;
+	int rc;
+
+	rc = mnt_table_index_lookup(tb, MNT_INDEX_TARGET,
+				mnt_index_hash_path(path), direction,
+				match_target, path, &fs);
+	if (rc >= 0)
+		return fs;
+
+	mnt_reset_iter(&itr, direction);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (mnt_fs_streq_target(fs, path))
+			return fs;
+	}
+	return NULL;
+}
+
 /**
  * mnt_table_find_mountpoint:
  * @tb: tab pointer
@@ -1062,36 +1133,33 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	DBG(TAB, ul_debugobj(tb, "lookup TARGET: '%s'", path));
 
 	/* native @target */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, path))
-			return fs;
-	}
+	fs = find_target(tb, path, direction);
+	if (fs)
+		return fs;
 
 	/* try absolute path */
 	if (is_relative_path(path) && (cn = absolute_path(path))) {
 		DBG(TAB, ul_debugobj(tb, "lookup absolute TARGET: '%s'", cn));
-		mnt_reset_iter(&itr, direction);
-		while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_target(fs, cn)) {
-				free(cn);
-				return fs;
-			}
-		}
+		fs = find_target(tb, cn, direction);
 		free(cn);
+		if (fs)
+			return fs;
 	}
 
 	if (!tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
 		return NULL;
 
+	/* the cache entry may be evicted by mnt_resolve_target() below */
+	cn = strdup(cn);
+	if (!cn)
+		return NULL;
+
 	DBG(TAB, ul_debugobj(tb, "lookup canonical TARGET: '%s'", cn));
 
 	/* canonicalized paths in struct libmnt_table */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, cn))
-			return fs;
-	}
+	fs = find_target(tb, cn, direction);
+	if (fs)
+		goto done;
 
 	/* non-canonical path in struct libmnt_table
 	 * -- note that mountpoint in /proc/self/mountinfo is already
@@ -1110,9 +1178,54 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 		p = mnt_resolve_target(fs->target, tb->cache);
 		/* both canonicalized, strcmp() is fine here */
 		if (p && strcmp(cn, p) == 0)
-			return fs;
+			goto done;
 	}
-	return NULL;
+	fs = NULL;
+done:
+	free(cn);
+	return fs;
+}
+
+#ifdef HAVE_BTRFS_SUPPORT
+/* Returns 0 if @fs is btrfs with subvolume other than the default one */
+static int is_btrfs_default_subvol(struct libmnt_fs *fs)
+{
+	uint64_t default_id;
+	char *val;
+	size_t len;
+
+	if (!fs->fstype || strcmp(fs->fstype, "btrfs") != 0)
+		return 1;
+
+	default_id = btrfs_get_default_subvol_id(mnt_fs_get_target(fs));
+	if (default_id == UINT64_MAX)
+		DBG(TAB, ul_debug("not found btrfs volume setting"));
+
+	else if (mnt_fs_get_option(fs, "subvolid", &val, &len) == 0) {
+		uint64_t subvol_id;
+
+		if (mnt_parse_offset(val, len, &subvol_id)) {
+			DBG(TAB, ul_debugobj(fs->tab, "failed to parse subvolid="));
+			return 0;
+		}
+		if (subvol_id != default_id)
+			return 0;
+	}
+	return 1;
+}
+#else
+# define is_btrfs_default_subvol(fs)	1
+#endif /* HAVE_BTRFS_SUPPORT */
+
+static int match_srcpath(struct libmnt_fs *fs, const void *data)
+{
+	return mnt_fs_streq_srcpath(fs, (const char *) data);
+}
+
+static int match_srcpath_subvol(struct libmnt_fs *fs, const void *data)
+{
+	return mnt_fs_streq_srcpath(fs, (const char *) data)
+		&& is_btrfs_default_subvol(fs);
 }
 
 /**
@@ -1139,7 +1252,7 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 {
 	struct libmnt_iter itr;
 	struct libmnt_fs *fs = NULL;
-	int ntags = 0, nents;
+	int ntags = 0, nents, rc;
 	char *cn;
 	const char *p;
 
@@ -1151,51 +1264,50 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 	DBG(TAB, ul_debugobj(tb, "lookup SRCPATH: '%s'", path));
 
 	/* native paths */
-	mnt_reset_iter(&itr, direction);
-
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-
-		if (mnt_fs_streq_srcpath(fs, path)) {
-#ifdef HAVE_BTRFS_SUPPORT
-			if (fs->fstype && !strcmp(fs->fstype, "btrfs")) {
-				uint64_t default_id = btrfs_get_default_subvol_id(mnt_fs_get_target(fs));
-				char *val;
-				size_t len;
-
-				if (default_id == UINT64_MAX)
-					DBG(TAB, ul_debug("not found btrfs volume setting"));
-
-				else if (mnt_fs_get_option(fs, "subvolid", &val, &len) == 0) {
-					uint64_t subvol_id;
+	rc = mnt_table_index_lookup(tb, MNT_INDEX_SRCPATH,
+				mnt_index_hash_path(path), direction,
+				match_srcpath_subvol, path, &fs);
+	if (rc == 0)
+		return fs;
+	if (rc > 0)
+		ntags = mnt_table_index_count(tb, MNT_INDEX_TAG);
+	else {
+		mnt_reset_iter(&itr, direction);
 
-					if (mnt_parse_offset(val, len, &subvol_id)) {
-						DBG(TAB, ul_debugobj(tb, "failed to parse subvolid="));
-						continue;
-					}
-					if (subvol_id != default_id)
-						continue;
-				}
-			}
-#endif /* HAVE_BTRFS_SUPPORT */
-			return fs;
+		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+			if (match_srcpath_subvol(fs, path))
+				return fs;
+			if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
+				ntags++;
 		}
-		if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
-			ntags++;
 	}
 
 	if (!path || !tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
 		return NULL;
 
+	/* the cache entry may be evicted by the next mnt_resolve_*() or
+	 * mnt_cache_read_tags() calls */
+	cn = strdup(cn);
+	if (!cn)
+		return NULL;
+
 	DBG(TAB, ul_debugobj(tb, "lookup canonical SRCPATH: '%s'", cn));
 
 	nents = mnt_table_get_nents(tb);
 
 	/* canonicalized paths in struct libmnt_table */
 	if (ntags < nents) {
-		mnt_reset_iter(&itr, direction);
-		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_srcpath(fs, cn))
-				return fs;
+		rc = mnt_table_index_lookup(tb, MNT_INDEX_SRCPATH,
+				mnt_index_hash_path(cn), direction,
+				match_srcpath, cn, &fs);
+		if (rc == 0)
+			goto done;
+		if (rc < 0) {
+			mnt_reset_iter(&itr, direction);
+			while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+				if (mnt_fs_streq_srcpath(fs, cn))
+					goto done;
+			}
 		}
 	}
 
@@ -1214,7 +1326,7 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 					continue;
 
 				if (mnt_cache_device_has_tag(tb->cache, cn, t, v))
-					return fs;
+					goto done;
 			}
 		} else if (rc < 0 && errno == EACCES) {
 			/* @path is inaccessible, try evaluating all TAGs in @tb
@@ -1228,7 +1340,7 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 
 				 /* both canonicalized, strcmp() is fine here */
 				 if (x && strcmp(x, cn) == 0)
-					 return fs;
+					 goto done;
 			 }
 		}
 	}
@@ -1245,14 +1357,27 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 
 			/* both canonicalized, strcmp() is fine here */
 			if (p && strcmp(p, cn) == 0)
-				return fs;
+				goto done;
 		}
 	}
 
-	return NULL;
+	fs = NULL;
+done:
+	free(cn);
+	return fs;
 }
 
 
+/* @data is array with tag name and value */
+static int match_tag(struct libmnt_fs *fs, const void *data)
+{
+	const char * const *tagval = data;
+
+	return fs->tagname && fs->tagval &&
+	       strcmp(fs->tagname, tagval[0]) == 0 &&
+	       strcmp(fs->tagval, tagval[1]) == 0;
+}
+
 /**
  * mnt_table_find_tag:
  * @tb: tab pointer
@@ -1272,6 +1397,8 @@ struct libmnt_fs *mnt_table_find_tag(struct libmnt_table *tb, const char *tag,
 {
 	struct libmnt_iter itr;
 	struct libmnt_fs *fs = NULL;
+	const char *tagval[] = { tag, val };
+	int rc;
 
 	if (!tb || !tag || !*tag || !val)
 		return NULL;
@@ -1281,12 +1408,17 @@ struct libmnt_fs *mnt_table_find_tag(struct libmnt_table *tb, const char *tag,
 	DBG(TAB, ul_debugobj(tb, "lookup by TAG: %s %s", tag, val));
 
 	/* look up by TAG */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (fs->tagname && fs->tagval &&
-		    strcmp(fs->tagname, tag) == 0 &&
-		    strcmp(fs->tagval, val) == 0)
-			return fs;
+	rc = mnt_table_index_lookup(tb, MNT_INDEX_TAG,
+				mnt_index_hash_tag(tag, val), direction,
+				match_tag, tagval, &fs);
+	if (rc == 0)
+		return fs;
+	if (rc < 0) {
+		mnt_reset_iter(&itr, direction);
+		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+			if (match_tag(fs, tagval))
+				return fs;
+		}
 	}
 
 	if (tb->cache) {
@@ -1378,6 +1510,14 @@ struct libmnt_fs *mnt_table_find_source(struct libmnt_table *tb,
 	return fs;
 }
 
+static int match_pair(struct libmnt_fs *fs, const void *data)
+{
+	const char * const *pair = data;
+
+	return mnt_fs_match_target(fs, pair[1], NULL) &&
+	       mnt_fs_match_source(fs, pair[0], NULL);
+}
+
 /**
  * mnt_table_find_pair
  * @tb: tab pointer
@@ -1404,6 +1544,16 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 
 	DBG(TAB, ul_debugobj(tb, "lookup SOURCE: %s TARGET: %s", source, target));
 
+	/* without cache only the same (non-canonicalized) targets match */
+	if (!tb->cache) {
+		const char *data[] = { source, target };
+
+		if (mnt_table_index_lookup(tb, MNT_INDEX_TARGET,
+				mnt_index_hash_path(target), direction,
+				match_pair, data, &fs) >= 0)
+			return fs;
+	}
+
 	mnt_reset_iter(&itr, direction);
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
 
@@ -1415,6 +1565,11 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 	return NULL;
 }
 
+static int match_devno(struct libmnt_fs *fs, const void *data)
+{
+	return mnt_fs_get_devno(fs) == *((const dev_t *) data);
+}
+
 /**
  * mnt_table_find_devno
  * @tb: /proc/self/mountinfo
@@ -1439,6 +1594,11 @@ struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 
 	DBG(TAB, ul_debugobj(tb, "lookup DEVNO: %d", (int) devno));
 
+	if (mnt_table_index_lookup(tb, MNT_INDEX_DEVNO,
+				mnt_index_hash_num(devno), direction,
+				match_devno, &devno, &fs) >= 0)
+		return fs;
+
 	mnt_reset_iter(&itr, direction);
 
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
@@ -1628,6 +1788,10 @@ struct libmnt_fs *mnt_table_get_fs_root(struct libmnt_table *tb,
 		DBG(TAB, ul_debug("fs-root for bind"));
 
 		src = xsrc = mnt_resolve_spec(mnt_fs_get_source(fs), tb->cache);
+
+		/* the cache entry may be evicted by mnt_table_find_mountpoint() */
+		if (xsrc && tb->cache)
+			src = xsrc = strdup(xsrc);
 		if (src) {
 			struct libmnt_fs *f = mnt_table_find_mountpoint(tb,
 							src, MNT_ITER_BACKWARD);
@@ -1637,10 +1801,8 @@ struct libmnt_fs *mnt_table_get_fs_root(struct libmnt_table *tb,
 		if (mnt)
 			root = remove_mountpoint_from_path(src, mnt);
 
-		if (xsrc && !tb->cache) {
-			free(xsrc);
-			src = NULL;
-		}
+		free(xsrc);
+		src = NULL;
 		if (!mnt)
 			goto err;
 
@@ -1718,7 +1880,7 @@ int __mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_f
 	char *root = NULL;
 	char *src2 = NULL;
 	const char *src = NULL, *tgt = NULL;
-	char *xtgt = NULL, *tgt_buf = NULL;
+	char *xsrc = NULL, *xtgt = NULL, *tgt_buf = NULL;
 	int rc = 0;
 	dev_t devno = 0;
 
@@ -1757,8 +1919,12 @@ int __mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_f
 	if (!src)
 		src = mnt_fs_get_source(fstab_fs);
 
-	if (src && tb->cache && !mnt_fs_is_pseudofs(fstab_fs))
+	if (src && tb->cache && !mnt_fs_is_pseudofs(fstab_fs)) {
+		/* the cache entry may be evicted by mnt_resolve_path() below */
 		src = mnt_resolve_spec(src, tb->cache);
+		if (src)
+			src = xsrc = strdup(src);
+	}
 
 	if (src && root) {
 		struct stat st;
@@ -1870,6 +2036,7 @@ done:
 
 	DBG(TAB, ul_debugobj(tb, "mnt_table_is_fs_mounted: %s [rc=%d]", src, rc));
 	free(src2);
+	free(xsrc);
 	return rc;
 }
 
@@ -1900,6 +2067,8 @@ int mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_fs)
 
 
 #ifdef TEST_PROGRAM
+#include <sys/time.h>
+
 #include "pathnames.h"
 
 static int parser_errcb(struct libmnt_table *tb, const char *filename, int line)
@@ -2233,6 +2402,218 @@ done:
 	return rc;
 }
 
+/* synthetic mountinfo with many container-like mounts */
+static FILE *create_synthetic_mountinfo(int nents)
+{
+	FILE *f;
+	int i;
+
+	f = tmpfile();
+	if (!f)
+		return NULL;
+
+	fprintf(f, "1 0 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n");
+	for (i = 2; i <= nents; i++)
+		fprintf(f, "%d %d 0:%d / /var/lib/kubelet/pods/%08x/volumes/vol%d "
+			   "rw,nosuid,nodev,relatime shared:%d - tmpfs tmpfs-%d rw,size=1024k\n",
+			   i, 1, i, i * 2654435761U, i, i, i);
+	rewind(f);
+	return f;
+}
+
+static struct libmnt_table *create_synthetic_table(int nents)
+{
+	struct libmnt_table *tb;
+	FILE *f;
+
+	f = create_synthetic_mountinfo(nents);
+	if (!f)
+		return NULL;
+
+	tb = mnt_new_table();
+	if (tb && mnt_table_parse_stream(tb, f, "synthetic") != 0) {
+		mnt_unref_table(tb);
+		tb = NULL;
+	}
+	fclose(f);
+	return tb;
+}
+
+static double bench_lookups(struct libmnt_table *tb, struct libmnt_fs **ents,
+			    int nents, int nloops, struct libmnt_fs **res)
+{
+	struct timeval start, end;
+	int i, n = 0;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nloops; i++) {
+		struct libmnt_fs *fs = ents[(i * 7919) % nents];
+
+		switch (i % 3) {
+		case 0:
+			res[n++] = mnt_table_find_target(tb,
+					mnt_fs_get_target(fs), MNT_ITER_BACKWARD);
+			break;
+		case 1:
+			res[n++] = mnt_table_find_srcpath(tb,
+					mnt_fs_get_srcpath(fs), MNT_ITER_BACKWARD);
+			break;
+		case 2:
+			res[n++] = mnt_table_find_devno(tb,
+					mnt_fs_get_devno(fs), MNT_ITER_FORWARD);
+			break;
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1E6;
+}
+
+static int test_find_benchmark(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	struct libmnt_fs **ents = NULL, **res_lin = NULL, **res_idx = NULL;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	int nents = 20000, nloops = 3000, i, rc = -1;
+	double lin, idx;
+
+	if (argc > 1)
+		nents = strtos32_or_err(argv[1], "failed to parse number of entries");
+	if (argc > 2)
+		nloops = strtos32_or_err(argv[2], "failed to parse number of lookups");
+	if (nents < 1 || nloops < 1)
+		return -EINVAL;
+
+	tb = create_synthetic_table(nents);
+	if (!tb)
+		return -1;
+
+	ents = calloc(nents, sizeof(*ents));
+	res_lin = calloc(nloops, sizeof(*res_lin));
+	res_idx = calloc(nloops, sizeof(*res_idx));
+	if (!ents || !res_lin || !res_idx)
+		goto done;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	for (i = 0; i < nents && mnt_table_next_fs(tb, &itr, &fs) == 0; i++)
+		ents[i] = fs;
+
+	lin = bench_lookups(tb, ents, nents, nloops, res_lin);
+
+	mnt_table_enable_index(tb, TRUE);
+	idx = bench_lookups(tb, ents, nents, nloops, res_idx);
+
+	if (memcmp(res_lin, res_idx, nloops * sizeof(*res_lin)) != 0) {
+		fprintf(stderr, "indexed lookups returned different entries\n");
+		goto done;
+	}
+
+	printf("entries:  %d\n", nents);
+	printf("lookups:  %d\n", nloops);
+	printf("linear:   %.6f sec\n", lin);
+	printf("indexed:  %.6f sec (including index build)\n", idx);
+	if (idx > 0)
+		printf("speedup:  %.1fx\n", lin / idx);
+	rc = 0;
+done:
+	free(ents);
+	free(res_lin);
+	free(res_idx);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+static double bench_parse(FILE *f, int nloops, int noarena, struct libmnt_table **res)
+{
+	struct timeval start, end;
+	int i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nloops; i++) {
+		struct libmnt_table *tb = mnt_new_table();
+
+		if (!tb)
+			break;
+		tb->noarena = noarena;
+		rewind(f);
+		mnt_table_parse_stream(tb, f, "synthetic");
+
+		if (i + 1 < nloops)
+			mnt_unref_table(tb);
+		else
+			*res = tb;
+	}
+	gettimeofday(&end, NULL);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1E6;
+}
+
+static int fs_equal(struct libmnt_fs *a, struct libmnt_fs *b)
+{
+	return mnt_fs_get_id(a) == mnt_fs_get_id(b)
+	    && mnt_fs_get_devno(a) == mnt_fs_get_devno(b)
+	    && strcmp(mnt_fs_get_source(a), mnt_fs_get_source(b)) == 0
+	    && strcmp(mnt_fs_get_target(a), mnt_fs_get_target(b)) == 0
+	    && strcmp(mnt_fs_get_root(a), mnt_fs_get_root(b)) == 0
+	    && strcmp(mnt_fs_get_fstype(a), mnt_fs_get_fstype(b)) == 0
+	    && strcmp(mnt_fs_get_options(a), mnt_fs_get_options(b)) == 0
+	    && strcmp(mnt_fs_get_optional_fields(a), mnt_fs_get_optional_fields(b)) == 0;
+}
+
+static int test_parse_benchmark(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb_line = NULL, *tb_arena = NULL;
+	struct libmnt_iter itr_line, itr_arena;
+	struct libmnt_fs *a, *b;
+	int nents = 20000, nloops = 10, rc = -1;
+	double line, arena;
+	FILE *f;
+
+	if (argc > 1)
+		nents = strtos32_or_err(argv[1], "failed to parse number of entries");
+	if (argc > 2)
+		nloops = strtos32_or_err(argv[2], "failed to parse number of loops");
+	if (nents < 1 || nloops < 1)
+		return -EINVAL;
+
+	f = create_synthetic_mountinfo(nents);
+	if (!f)
+		return -1;
+
+	line = bench_parse(f, nloops, 1, &tb_line);
+	arena = bench_parse(f, nloops, 0, &tb_arena);
+	fclose(f);
+
+	if (!tb_line || !tb_arena
+	    || mnt_table_get_nents(tb_line) != nents
+	    || mnt_table_get_nents(tb_arena) != nents) {
+		fprintf(stderr, "failed to parse synthetic mountinfo\n");
+		goto done;
+	}
+
+	mnt_reset_iter(&itr_line, MNT_ITER_FORWARD);
+	mnt_reset_iter(&itr_arena, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb_line, &itr_line, &a) == 0
+	       && mnt_table_next_fs(tb_arena, &itr_arena, &b) == 0) {
+		if (!fs_equal(a, b)) {
+			fprintf(stderr, "arena parser returned different entries\n");
+			goto done;
+		}
+	}
+
+	printf("entries:  %d\n", nents);
+	printf("loops:    %d\n", nloops);
+	printf("getline:  %.6f sec\n", line);
+	printf("arena:    %.6f sec\n", arena);
+	if (arena > 0)
+		printf("speedup:  %.1fx\n", line / arena);
+	rc = 0;
+done:
+	mnt_unref_table(tb_line);
+	mnt_unref_table(tb_arena);
+	return rc;
+}
 
 int main(int argc, char *argv[])
 {
@@ -2246,6 +2627,8 @@ int main(int argc, char *argv[])
 	{ "--find-mountpoint", test_find_mountpoint, "<path>" },
 	{ "--copy-fs",       test_copy_fs, "<file>  copy root FS from the file" },
 	{ "--is-mounted",    test_is_mounted, "<fstab> check what from fstab is already mounted" },
+	{ "--find-benchmark", test_find_benchmark, "[<entries> [<lookups>]]  compare linear and indexed lookups" },
+	{ "--parse-benchmark", test_parse_benchmark, "[<entries> [<loops>]]  compare getline and arena mountinfo parsers" },
 	{ NULL }
 	};
 
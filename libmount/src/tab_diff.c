@@ -16,6 +16,7 @@
  * @short_description: compare changes in the list of the mounted filesystems
  */
 #include "mountP.h"
+#include "pathnames.h"
 
 struct tabdiff_entry {
 	int	oper;			/* MNT_TABDIFF_* flags; */
@@ -31,6 +32,9 @@ struct libmnt_tabdiff {
 
 	struct list_head changes;	/* list with modified entries */
 	struct list_head unused;	/* list with unused entries */
+
+	struct tabdiff_entry **mounts;	/* MNT_TABDIFF_MOUNT entries hashed by ID */
+	size_t mounts_sz;		/* size of the hash (power of two) */
 };
 
 /**
@@ -83,6 +87,7 @@ void mnt_free_tabdiff(struct libmnt_tabdiff *df)
 		free_tabdiff_entry(de);
 	}
 
+	free(df->mounts);
 	free(df);
 }
 
@@ -186,33 +191,95 @@ static int tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
 	return 0;
 }
 
-static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
-					       const char *src,
-					       int id)
+static inline int streq_source(struct libmnt_fs *a, struct libmnt_fs *b)
+{
+	const char *s1 = mnt_fs_get_source(a),
+		   *s2 = mnt_fs_get_source(b);
+
+	if (s1 == NULL && s2 == NULL)
+		return 1;
+	return s1 && s2 && strcmp(s1, s2) == 0;
+}
+
+/* Hashes all MNT_TABDIFF_MOUNT entries by mount ID for tabdiff_get_mount() */
+static int tabdiff_hash_mounts(struct libmnt_tabdiff *df)
 {
 	struct list_head *p;
+	size_t sz = 16;
 
 	assert(df);
 
+	while (sz < (size_t) df->nchanges * 2)
+		sz <<= 1;
+	if (sz != df->mounts_sz) {
+		struct tabdiff_entry **x = realloc(df->mounts, sz * sizeof(*x));
+
+		if (!x)
+			return -ENOMEM;
+		df->mounts = x;
+		df->mounts_sz = sz;
+	}
+	memset(df->mounts, 0, sz * sizeof(*df->mounts));
+
 	list_for_each(p, &df->changes) {
 		struct tabdiff_entry *de;
+		size_t i;
 
 		de = list_entry(p, struct tabdiff_entry, changes);
+		if (de->oper != MNT_TABDIFF_MOUNT || !de->new_fs)
+			continue;
+
+		/* linear probing; the first entry in the list is found first */
+		i = mnt_index_hash_num(mnt_fs_get_id(de->new_fs)) & (sz - 1);
+		while (df->mounts[i])
+			i = (i + 1) & (sz - 1);
+		df->mounts[i] = de;
+	}
+	return 0;
+}
+
+static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
+					       struct libmnt_fs *fs)
+{
+	int id = mnt_fs_get_id(fs);
+	size_t i;
 
-		if (de->oper == MNT_TABDIFF_MOUNT && de->new_fs &&
-		    mnt_fs_get_id(de->new_fs) == id) {
+	assert(df);
 
-			const char *s = mnt_fs_get_source(de->new_fs);
+	if (!df->mounts_sz)
+		return NULL;
 
-			if (s == NULL && src == NULL)
-				return de;
-			if (s && src && strcmp(s, src) == 0)
-				return de;
-		}
+	i = mnt_index_hash_num(id) & (df->mounts_sz - 1);
+	for (; df->mounts[i]; i = (i + 1) & (df->mounts_sz - 1)) {
+		struct tabdiff_entry *de = df->mounts[i];
+
+		if (de->oper == MNT_TABDIFF_MOUNT &&
+		    mnt_fs_get_id(de->new_fs) == id &&
+		    streq_source(de->new_fs, fs))
+			return de;
 	}
 	return NULL;
 }
 
+/*
+ * The hash indexes are used for lookups in the tables during the diff (only
+ * without cache, the canonicalized paths are not indexed).
+ */
+static int table_index_begin(struct libmnt_table *tb)
+{
+	int old = tb->idx_enabled;
+
+	tb->idx_enabled = 1;
+	return old;
+}
+
+static void table_index_end(struct libmnt_table *tb, int old)
+{
+	tb->idx_enabled = old;
+	if (!old)
+		mnt_table_free_index(tb);
+}
+
 /**
  * mnt_diff_tables:
  * @df: diff handler
@@ -229,7 +296,7 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 {
 	struct libmnt_fs *fs;
 	struct libmnt_iter itr;
-	int no, nn;
+	int no, nn, idx_old, idx_new, rc = 0;
 
 	if (!df || !old_tab || !new_tab)
 		return -EINVAL;
@@ -260,6 +327,9 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 		goto done;
 	}
 
+	idx_old = table_index_begin(old_tab);
+	idx_new = table_index_begin(new_tab);
+
 	/* search newly mounted or modified */
 	while(mnt_table_next_fs(new_tab, &itr, &fs) == 0) {
 		struct libmnt_fs *o_fs;
@@ -283,6 +353,10 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 	}
 
 	/* search umounted or moved */
+	rc = tabdiff_hash_mounts(df);
+	if (rc)
+		goto end;
+
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 	while(mnt_table_next_fs(old_tab, &itr, &fs) == 0) {
 		const char *src = mnt_fs_get_source(fs),
@@ -291,7 +365,7 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 		if (!mnt_table_find_pair(new_tab, src, tgt, MNT_ITER_FORWARD)) {
 			struct tabdiff_entry *de;
 
-			de = tabdiff_get_mount(df, src,	mnt_fs_get_id(fs));
+			de = tabdiff_get_mount(df, fs);
 			if (de) {
 				mnt_ref_fs(fs);
 				mnt_unref_fs(de->old_fs);
@@ -301,13 +375,285 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 				tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
 		}
 	}
+end:
+	table_index_end(old_tab, idx_old);
+	table_index_end(new_tab, idx_new);
+	if (rc)
+		return rc;
 done:
 	DBG(DIFF, ul_debugobj(df, "%d changes detected", df->nchanges));
 	return df->nchanges;
 }
 
+static int match_id(struct libmnt_fs *fs, const void *data)
+{
+	return mnt_fs_get_id(fs) == *((const int *) data);
+}
+
+static inline int streq_str(const char *a, const char *b)
+{
+	return (!a && !b) || (a && b && strcmp(a, b) == 0);
+}
+
+/* returns 1 if the mountinfo entries describe the same mount */
+static int fs_unchanged(struct libmnt_fs *o, struct libmnt_fs *n)
+{
+	return mnt_fs_get_parent_id(o) == mnt_fs_get_parent_id(n)
+	    && mnt_fs_get_devno(o) == mnt_fs_get_devno(n)
+	    && streq_source(o, n)
+	    && streq_str(mnt_fs_get_target(o), mnt_fs_get_target(n))
+	    && streq_str(mnt_fs_get_root(o), mnt_fs_get_root(n))
+	    && streq_str(mnt_fs_get_fstype(o), mnt_fs_get_fstype(n))
+	    && streq_str(mnt_fs_get_vfs_options(o), mnt_fs_get_vfs_options(n))
+	    && streq_str(mnt_fs_get_fs_options(o), mnt_fs_get_fs_options(n))
+	    && streq_str(mnt_fs_get_optional_fields(o), mnt_fs_get_optional_fields(n));
+}
+
+/*
+ * Compares entries matched by mount ID, @o is the old entry or NULL. Returns
+ * MNT_TABDIFF_* or 0 if the entry is not moved, (re)mounted.
+ */
+static int refresh_oper(struct libmnt_fs *o, struct libmnt_fs *n)
+{
+	const char *v1, *v2, *f1, *f2;
+
+	if (!o)
+		return MNT_TABDIFF_MOUNT;
+	if (!mnt_fs_streq_target(o, mnt_fs_get_target(n)))
+		return MNT_TABDIFF_MOVE;
+
+	v1 = mnt_fs_get_vfs_options(o);
+	v2 = mnt_fs_get_vfs_options(n);
+	f1 = mnt_fs_get_fs_options(o);
+	f2 = mnt_fs_get_fs_options(n);
+
+	if ((v1 && v2 && strcmp(v1, v2) != 0) || (f1 && f2 && strcmp(f1, f2) != 0))
+		return MNT_TABDIFF_REMOUNT;
+	return 0;
+}
+
+/* Replaces all entries in @tb with entries from @new_tab in the same order */
+static void refresh_table(struct libmnt_table *tb, struct libmnt_table *new_tab,
+			  struct libmnt_fs **ents, int nents)
+{
+	struct libmnt_fs *fs;
+	struct libmnt_iter itr;
+	int i;
+
+	/* unlink the entries to keep */
+	for (i = 0; i < nents; i++) {
+		if (ents[i]->tab != tb)
+			continue;
+		list_del_init(&ents[i]->ents);
+		tb->nents--;
+	}
+
+	/* remove the rest */
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		fs->flags &= ~MNT_FS_REFRESHED;
+		mnt_table_remove_fs(tb, fs);
+	}
+
+	/* add all in the new order */
+	for (i = 0; i < nents; i++) {
+		fs = ents[i];
+		fs->flags &= ~MNT_FS_REFRESHED;
+
+		if (fs->tab == tb) {
+			list_add_tail(&fs->ents, &tb->ents);
+			tb->nents++;
+		} else {
+			mnt_ref_fs(fs);
+			mnt_table_remove_fs(new_tab, fs);
+			mnt_table_add_fs(tb, fs);
+			mnt_unref_fs(fs);
+		}
+	}
+	mnt_table_reset_index(tb);
+}
+
+/*
+ * Matches @new_tab entries with @tb entries by mount ID, the result is stored
+ * in @ents[] (the old entry if unchanged, otherwise the new entry) and the
+ * changes are added to @df.
+ */
+static int refresh_match_ids(struct libmnt_tabdiff *df,
+			     struct libmnt_table *tb, struct libmnt_table *new_tab,
+			     struct libmnt_fs **ents)
+{
+	struct libmnt_fs *fs;
+	struct libmnt_iter itr;
+	int i = 0, rc = 0, idx;
+
+	idx = table_index_begin(tb);
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (rc == 0 && mnt_table_next_fs(new_tab, &itr, &fs) == 0) {
+		struct libmnt_fs *o = NULL;
+		int id = mnt_fs_get_id(fs), oper;
+
+		rc = mnt_table_index_lookup(tb, MNT_INDEX_ID, mnt_index_hash_num(id),
+					MNT_ITER_FORWARD, match_id, &id, &o);
+		if (rc < 0)
+			break;
+		rc = 0;
+
+		/* the ID has been reused by another filesystem */
+		if (o && ((o->flags & MNT_FS_REFRESHED) || !streq_source(o, fs)))
+			o = NULL;
+		if (o)
+			o->flags |= MNT_FS_REFRESHED;
+
+		oper = refresh_oper(o, fs);
+		if (oper)
+			rc = tabdiff_add_entry(df, o, fs, oper);
+
+		ents[i++] = !oper && fs_unchanged(o, fs) ? o : fs;
+	}
+
+	/* umounted */
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (rc == 0 && mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (!(fs->flags & MNT_FS_REFRESHED))
+			rc = tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
+	}
+
+	table_index_end(tb, idx);
+	return rc;
+}
+
+/**
+ * mnt_table_refresh:
+ * @tb: mountinfo table
+ * @filename: mountinfo file or NULL for /proc/self/mountinfo
+ * @df: diff handler or NULL
+ *
+ * Reads @filename and updates @tb in place. The mountinfo entries are matched
+ * by mount ID; unchanged entries are kept in @tb (so the pointers and userdata
+ * remain valid), new entries are added, umounted entries are removed and
+ * modified entries are replaced. The entries are in the same order as in
+ * @filename.
+ *
+ * The changes are stored in @df and accessible by mnt_tabdiff_next_change()
+ * in the same way as after mnt_diff_tables(). The entries are compared
+ * by source and target if @filename is not in mountinfo format.
+ *
+ * The cache, filter and parser error callbacks of @tb are used for the new
+ * entries; the userspace mount options from utab are not merged (see
+ * mnt_table_parse_mtab()).
+ *
+ * Returns: number of changes, negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_refresh(struct libmnt_table *tb, const char *filename,
+		      struct libmnt_tabdiff *df)
+{
+	struct libmnt_table *new_tab;
+	struct libmnt_tabdiff *mydf = NULL;
+	struct libmnt_fs **ents = NULL;
+	int rc, nents;
+
+	if (!tb)
+		return -EINVAL;
+	if (!filename)
+		filename = _PATH_PROC_MOUNTINFO;
+	if (!df) {
+		df = mydf = mnt_new_tabdiff();
+		if (!df)
+			return -ENOMEM;
+	}
+
+	DBG(DIFF, ul_debugobj(df, "refreshing %s", filename));
+
+	tabdiff_reset(df);
+
+	new_tab = mnt_new_table();
+	if (!new_tab) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	mnt_table_set_cache(new_tab, mnt_table_get_cache(tb));
+	mnt_table_set_parser_errcb(new_tab, tb->errcb);
+	mnt_table_set_parser_fltrcb(new_tab, tb->fltrcb, tb->fltrcb_data);
+
+	rc = mnt_table_parse_file(new_tab, filename);
+	if (rc)
+		goto done;
+
+	nents = mnt_table_get_nents(new_tab);
+	ents = calloc(nents ? nents : 1, sizeof(*ents));
+	if (!ents) {
+		rc = -ENOMEM;
+		goto done;
+	}
+
+	if (is_mountinfo(new_tab)) {
+		rc = refresh_match_ids(df, tb, new_tab, ents);
+		if (rc) {
+			struct libmnt_iter itr;
+			struct libmnt_fs *fs;
+
+			mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+			while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+				fs->flags &= ~MNT_FS_REFRESHED;
+			tabdiff_reset(df);
+			goto done;
+		}
+	} else {
+		struct libmnt_iter itr;
+		struct libmnt_fs *fs;
+		int i = 0;
+
+		rc = mnt_diff_tables(df, tb, new_tab);
+		if (rc < 0)
+			goto done;
+
+		mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(new_tab, &itr, &fs) == 0)
+			ents[i++] = fs;
+	}
+
+	refresh_table(tb, new_tab, ents, nents);
+	tb->fmt = new_tab->fmt;
+	rc = df->nchanges;
+
+	DBG(DIFF, ul_debugobj(df, "refresh: %d changes", rc));
+done:
+	free(ents);
+	mnt_unref_table(new_tab);
+	mnt_free_tabdiff(mydf);
+	return rc;
+}
+
 #ifdef TEST_PROGRAM
 
+static void print_change(struct libmnt_fs *old, struct libmnt_fs *new, int change)
+{
+	printf("%s on %s: ", mnt_fs_get_source(new ? new : old),
+			     mnt_fs_get_target(new ? new : old));
+
+	switch(change) {
+	case MNT_TABDIFF_MOVE:
+		printf("MOVED to %s\n", mnt_fs_get_target(new));
+		break;
+	case MNT_TABDIFF_UMOUNT:
+		printf("UMOUNTED\n");
+		break;
+	case MNT_TABDIFF_REMOUNT:
+		printf("REMOUNTED from '%s' to '%s'\n",
+				mnt_fs_get_options(old),
+				mnt_fs_get_options(new));
+		break;
+	case MNT_TABDIFF_MOUNT:
+		printf("MOUNTED\n");
+		break;
+	default:
+		printf("unknown change!\n");
+	}
+}
+
 static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
 {
 	struct libmnt_table *tb_old, *tb_new;
@@ -330,37 +676,67 @@ static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
 	if (rc < 0)
 		goto done;
 
-	while(mnt_tabdiff_next_change(diff, itr, &old, &new, &change) == 0) {
+	while(mnt_tabdiff_next_change(diff, itr, &old, &new, &change) == 0)
+		print_change(old, new, change);
 
-		printf("%s on %s: ", mnt_fs_get_source(new ? new : old),
-				     mnt_fs_get_target(new ? new : old));
+	rc = 0;
+done:
+	mnt_unref_table(tb_old);
+	mnt_unref_table(tb_new);
+	mnt_free_tabdiff(diff);
+	mnt_free_iter(itr);
+	return rc;
+}
 
-		switch(change) {
-		case MNT_TABDIFF_MOVE:
-			printf("MOVED to %s\n", mnt_fs_get_target(new));
-			break;
-		case MNT_TABDIFF_UMOUNT:
-			printf("UMOUNTED\n");
-			break;
-		case MNT_TABDIFF_REMOUNT:
-			printf("REMOUNTED from '%s' to '%s'\n",
-					mnt_fs_get_options(old),
-					mnt_fs_get_options(new));
-			break;
-		case MNT_TABDIFF_MOUNT:
-			printf("MOUNTED\n");
-			break;
-		default:
-			printf("unknown change!\n");
-		}
+static int test_refresh(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb, *tb_new;
+	struct libmnt_tabdiff *diff;
+	struct libmnt_iter *itr, *itr_new;
+	struct libmnt_fs *old, *new;
+	int rc = -1, change;
+
+	tb = mnt_new_table_from_file(argv[1]);
+	tb_new = mnt_new_table_from_file(argv[2]);
+	diff = mnt_new_tabdiff();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	itr_new = mnt_new_iter(MNT_ITER_FORWARD);
+
+	if (!tb || !tb_new || !diff || !itr || !itr_new) {
+		warnx("failed to allocate resources");
+		goto done;
 	}
 
+	rc = mnt_table_refresh(tb, argv[2], diff);
+	if (rc < 0)
+		goto done;
+
+	while(mnt_tabdiff_next_change(diff, itr, &old, &new, &change) == 0)
+		print_change(old, new, change);
+
+	/* the refreshed table has to be the same as the new table */
+	rc = -1;
+	if (mnt_table_get_nents(tb) != mnt_table_get_nents(tb_new)) {
+		warnx("refreshed table has a different number of entries");
+		goto done;
+	}
+	mnt_reset_iter(itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, itr, &old) == 0 &&
+	       mnt_table_next_fs(tb_new, itr_new, &new) == 0) {
+		if (mnt_fs_get_id(old) != mnt_fs_get_id(new) ||
+		    !mnt_fs_streq_target(old, mnt_fs_get_target(new)) ||
+		    strcmp(mnt_fs_get_options(old), mnt_fs_get_options(new)) != 0) {
+			warnx("refreshed table does not match %s", argv[2]);
+			goto done;
+		}
+	}
 	rc = 0;
 done:
-	mnt_unref_table(tb_old);
+	mnt_unref_table(tb);
 	mnt_unref_table(tb_new);
 	mnt_free_tabdiff(diff);
 	mnt_free_iter(itr);
+	mnt_free_iter(itr_new);
 	return rc;
 }
 
@@ -368,6 +744,7 @@ int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
 		{ "--diff", test_diff, "<old> <new> prints change" },
+		{ "--refresh", test_refresh, "<old> <new> refreshes old table, prints change" },
 		{ NULL }
 	};
 
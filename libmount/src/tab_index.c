@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * Hash indexes for libmnt_table lookups (see mnt_table_enable_index()).
+ *
+ * The index is built on the first lookup after any table change, and it's
+ * invalidated by mnt_table_reset_index() when an entry is added, removed or
+ * moved, or when a key field of an entry in the table is modified.
+ *
+ * The hash is used to select candidates only; the final decision is always
+ * done by the caller's match function, so the hash has to be stable for all
+ * strings the match function considers equal (see mnt_index_hash_path()).
+ */
+#include "mountP.h"
+
+struct libmnt_tabidx {
+	size_t		nents;
+	size_t		nbuckets;		/* power of two */
+	struct libmnt_fs **ents;		/* entries in the table order */
+
+	unsigned int	*heads[__MNT_INDEX_MAX];	/* bucket -> first entry + 1 */
+	unsigned int	*next[__MNT_INDEX_MAX];		/* entry -> next entry + 1 */
+	size_t		counts[__MNT_INDEX_MAX];	/* number of indexed entries */
+
+	unsigned int	valid : 1;
+};
+
+#define FNV_OFFSET	2166136261U
+#define FNV_PRIME	16777619U
+
+static inline uint32_t fnv_add(uint32_t h, unsigned char c)
+{
+	return (h ^ c) * FNV_PRIME;
+}
+
+/*
+ * The same normalization as streq_paths() does -- repeated slashes are
+ * ignored, as well as the trailing slash.
+ */
+uint32_t mnt_index_hash_path(const char *path)
+{
+	uint32_t h = FNV_OFFSET;
+	int slash = 0;
+
+	for (; path && *path; path++) {
+		if (*path == '/') {
+			slash = 1;
+			continue;
+		}
+		if (slash)
+			h = fnv_add(h, '/');
+		slash = 0;
+		h = fnv_add(h, *path);
+	}
+	return h;
+}
+
+uint32_t mnt_index_hash_tag(const char *name, const char *value)
+{
+	uint32_t h = FNV_OFFSET;
+
+	for (; name && *name; name++)
+		h = fnv_add(h, *name);
+	h = fnv_add(h, '=');
+	for (; value && *value; value++)
+		h = fnv_add(h, *value);
+	return h;
+}
+
+uint32_t mnt_index_hash_num(uint64_t num)
+{
+	uint32_t h = FNV_OFFSET;
+	size_t i;
+
+	for (i = 0; i < sizeof(num); i++, num >>= 8)
+		h = fnv_add(h, num & 0xff);
+	return h;
+}
+
+/* Returns 0 and the @fs key hash for the index @type, or 1 if there is no key. */
+static int get_key_hash(struct libmnt_fs *fs, int type, uint32_t *hash)
+{
+	const char *t, *v;
+
+	switch (type) {
+	case MNT_INDEX_TARGET:
+		if (!fs->target)
+			return 1;
+		*hash = mnt_index_hash_path(fs->target);
+		break;
+	case MNT_INDEX_SRCPATH:
+		t = mnt_fs_get_srcpath(fs);
+		if (!t)
+			return 1;
+		*hash = mnt_index_hash_path(t);
+		break;
+	case MNT_INDEX_TAG:
+		if (mnt_fs_get_tag(fs, &t, &v) != 0)
+			return 1;
+		*hash = mnt_index_hash_tag(t, v);
+		break;
+	case MNT_INDEX_DEVNO:
+		*hash = mnt_index_hash_num(fs->devno);
+		break;
+	case MNT_INDEX_ID:
+		*hash = mnt_index_hash_num(fs->id);
+		break;
+	default:
+		return 1;
+	}
+	return 0;
+}
+
+static void free_index_data(struct libmnt_tabidx *idx)
+{
+	int i;
+
+	for (i = 0; i < __MNT_INDEX_MAX; i++) {
+		free(idx->heads[i]);
+		free(idx->next[i]);
+		idx->heads[i] = idx->next[i] = NULL;
+		idx->counts[i] = 0;
+	}
+	free(idx->ents);
+	idx->ents = NULL;
+	idx->nents = idx->nbuckets = 0;
+	idx->valid = 0;
+}
+
+static int build_index(struct libmnt_table *tb, struct libmnt_tabidx *idx)
+{
+	struct list_head *p;
+	size_t i, n = 0;
+	int type;
+
+	free_index_data(idx);
+
+	if (tb->nents <= 0)
+		goto done;
+
+	idx->nbuckets = 16;
+	while (idx->nbuckets < (size_t) tb->nents * 2)
+		idx->nbuckets <<= 1;
+
+	idx->ents = malloc(tb->nents * sizeof(struct libmnt_fs *));
+	if (!idx->ents)
+		goto err;
+
+	list_for_each(p, &tb->ents) {
+		if (n == (size_t) tb->nents)
+			break;
+		idx->ents[n++] = list_entry(p, struct libmnt_fs, ents);
+	}
+	idx->nents = n;
+
+	for (type = 0; type < __MNT_INDEX_MAX; type++) {
+		idx->heads[type] = calloc(idx->nbuckets, sizeof(unsigned int));
+		idx->next[type] = calloc(n, sizeof(unsigned int));
+		if (!idx->heads[type] || !idx->next[type])
+			goto err;
+
+		/* backwardly, so the chains are in the table order */
+		for (i = n; i > 0; i--) {
+			uint32_t hash, b;
+
+			if (get_key_hash(idx->ents[i - 1], type, &hash) != 0)
+				continue;
+			b = hash & (idx->nbuckets - 1);
+			idx->next[type][i - 1] = idx->heads[type][b];
+			idx->heads[type][b] = i;
+			idx->counts[type]++;
+		}
+	}
+done:
+	idx->valid = 1;
+	DBG(TAB, ul_debugobj(tb, "index: built for %zu entries (%zu buckets)",
+				idx->nents, idx->nbuckets));
+	return 0;
+err:
+	free_index_data(idx);
+	return -ENOMEM;
+}
+
+/* Returns valid index or NULL if the index is disabled or unavailable */
+static struct libmnt_tabidx *get_index(struct libmnt_table *tb)
+{
+	if (!tb->idx_enabled)
+		return NULL;
+	if (!tb->idx) {
+		tb->idx = calloc(1, sizeof(*tb->idx));
+		if (!tb->idx)
+			return NULL;
+	}
+	if (!tb->idx->valid && build_index(tb, tb->idx) != 0)
+		return NULL;
+	return tb->idx;
+}
+
+/*
+ * Invalidates the index; it's rebuilt on the next lookup.
+ */
+void mnt_table_reset_index(struct libmnt_table *tb)
+{
+	if (tb && tb->idx && tb->idx->valid) {
+		DBG(TAB, ul_debugobj(tb, "index: reset"));
+		tb->idx->valid = 0;
+	}
+}
+
+void mnt_table_free_index(struct libmnt_table *tb)
+{
+	if (!tb || !tb->idx)
+		return;
+	free_index_data(tb->idx);
+	free(tb->idx);
+	tb->idx = NULL;
+}
+
+/*
+ * Looks up the first entry (according to @direction) where the key has
+ * @hash and @match returns true.
+ *
+ * Returns: 0 if found, 1 if not found, or <0 if the index is not available
+ *          (the caller is expected to use a linear search in this case).
+ */
+int mnt_table_index_lookup(struct libmnt_table *tb, int type, uint32_t hash,
+			   int direction,
+			   int (*match)(struct libmnt_fs *, const void *),
+			   const void *data,
+			   struct libmnt_fs **fs)
+{
+	struct libmnt_tabidx *idx;
+	unsigned int i;
+
+	if (!tb || type < 0 || type >= __MNT_INDEX_MAX)
+		return -EINVAL;
+
+	idx = get_index(tb);
+	if (!idx)
+		return -ENOENT;
+
+	*fs = NULL;
+	if (!idx->nents)
+		return 1;
+
+	for (i = idx->heads[type][hash & (idx->nbuckets - 1)]; i;
+	     i = idx->next[type][i - 1]) {
+		struct libmnt_fs *x = idx->ents[i - 1];
+
+		if (!match(x, data))
+			continue;
+		*fs = x;
+		if (direction == MNT_ITER_FORWARD)
+			break;
+	}
+	return *fs ? 0 : 1;
+}
+
+/*
+ * Returns number of entries with key for the index @type, or <0 if the index
+ * is not available.
+ */
+int mnt_table_index_count(struct libmnt_table *tb, int type)
+{
+	struct libmnt_tabidx *idx;
+
+	if (!tb || type < 0 || type >= __MNT_INDEX_MAX)
+		return -EINVAL;
+
+	idx = get_index(tb);
+	if (!idx)
+		return -ENOENT;
+	return idx->counts[type];
+}
@@ -174,13 +174,12 @@ fail:
 
 
 /*
- * Parses one line from a mountinfo file
+ * Parses mountinfo fields (1) to (3), returns pointer to field (4) or NULL
  */
-static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
+static const char *parse_mountinfo_ids(struct libmnt_fs *fs, const char *s)
 {
 	int rc = 0;
 	unsigned int maj, min;
-	char *p;
 
 	fs->flags |= MNT_FS_KERNEL;
 
@@ -188,7 +187,7 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = next_s32(s, &fs->id, &rc);
 	if (!s || !*s || rc) {
 		DBG(TAB, ul_debug("tab parse error: [id]"));
-		goto fail;
+		return NULL;
 	}
 
 	s = skip_separator(s);
@@ -197,7 +196,7 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = next_s32(s, &fs->parent, &rc);
 	if (!s || !*s || rc) {
 		DBG(TAB, ul_debug("tab parse error: [parent]"));
-		goto fail;
+		return NULL;
 	}
 
 	s = skip_separator(s);
@@ -205,11 +204,24 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	/* (3) maj:min */
 	if (sscanf(s, "%u:%u", &maj, &min) != 2) {
 		DBG(TAB, ul_debug("tab parse error: [maj:min]"));
-		goto fail;
+		return NULL;
 	}
 	fs->devno = makedev(maj, min);
 	s = skip_nonspearator(s);
-	s = skip_separator(s);
+	return skip_separator(s);
+}
+
+/*
+ * Parses one line from a mountinfo file
+ */
+static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
+{
+	int rc = 0;
+	char *p;
+
+	s = parse_mountinfo_ids(fs, s);
+	if (!s)
+		return -EINVAL;
 
 	/* (4) mountroot */
 	fs->root = unmangle(s, &s);
@@ -299,6 +311,127 @@ fail:
 	return rc;
 }
 
+/*
+ * In-place variant of unmangle() -- terminates and decodes the field at @s
+ * and returns pointer to the next field in @next.
+ */
+static char *unmangle_inplace(char *s, char **next)
+{
+	char *e = (char *) skip_nonspearator(s);
+
+	if (e == s)
+		return NULL;		/* empty string */
+
+	*next = *e ? e + 1 : e;
+	*e = '\0';
+	if (memchr(s, '\\', e - s))
+		unmangle_string(s);
+	return s;
+}
+
+/*
+ * Parses one line from a mountinfo file in the arena, the strings in @fs
+ * point to the (modified) line.
+ */
+static int mnt_parse_mountinfo_line_inplace(struct libmnt_fs *fs, char *s)
+{
+	int rc = 0;
+	char *p;
+
+	s = (char *) parse_mountinfo_ids(fs, s);
+	if (!s)
+		return -EINVAL;
+
+	/* (4) mountroot */
+	fs->root = unmangle_inplace(s, &s);
+	if (!fs->root) {
+		DBG(TAB, ul_debug("tab parse error: [mountroot]"));
+		goto fail;
+	}
+
+	s = (char *) skip_separator(s);
+
+	/* (5) target */
+	fs->target = unmangle_inplace(s, &s);
+	if (!fs->target) {
+		DBG(TAB, ul_debug("tab parse error: [target]"));
+		goto fail;
+	}
+
+	s = (char *) skip_separator(s);
+
+	/* (6) vfs options (fs-independent) */
+	fs->vfs_optstr = unmangle_inplace(s, &s);
+	if (!fs->vfs_optstr) {
+		DBG(TAB, ul_debug("tab parse error: [VFS options]"));
+		goto fail;
+	}
+
+	/* (7) optional fields, terminated by " - " */
+	if (*s == '-' && (*(s + 1) == ' ' || *(s + 1) == '\t'))
+		p = s;
+	else {
+		p = strstr(s, " - ");
+		if (!p) {
+			DBG(TAB, ul_debug("mountinfo parse error: separator not found"));
+			return -EINVAL;
+		}
+		if (p > s)
+			fs->opt_fields = s;
+		*p++ = '\0';
+	}
+
+	s = (char *) skip_separator(p + 1);
+
+	/* (8) FS type */
+	p = unmangle_inplace(s, &s);
+	if (!p || (rc = __mnt_fs_set_fstype_ptr(fs, p))) {
+		DBG(TAB, ul_debug("tab parse error: [fstype]"));
+		goto fail;
+	}
+
+	/* (9) source -- maybe empty string */
+	if (!*s) {
+		DBG(TAB, ul_debug("tab parse error: [source]"));
+		goto fail;
+	} else if (*s == ' ' || *s == '\t') {
+		if ((rc = mnt_fs_set_source(fs, ""))) {
+			DBG(TAB, ul_debug("tab parse error: [empty source]"));
+			goto fail;
+		}
+	} else {
+		p = unmangle_inplace(s, &s);
+		if (!p || (rc = __mnt_fs_set_source_ptr(fs, p))) {
+			DBG(TAB, ul_debug("tab parse error: [regular source]"));
+			goto fail;
+		}
+	}
+
+	s = (char *) skip_separator(s);
+
+	/* (10) fs options (fs specific) */
+	fs->fs_optstr = unmangle_inplace(s, &s);
+	if (!fs->fs_optstr) {
+		DBG(TAB, ul_debug("tab parse error: [FS options]"));
+		goto fail;
+	}
+
+	/* merge VFS and FS options to one string */
+	fs->optstr = mnt_fs_strdup_options(fs);
+	if (!fs->optstr) {
+		rc = -ENOMEM;
+		DBG(TAB, ul_debug("tab parse error: [merge VFS and FS options]"));
+		goto fail;
+	}
+
+	return 0;
+fail:
+	if (rc == 0)
+		rc = -EINVAL;
+	DBG(TAB, ul_debug("tab parse error [rc=%d]", rc));
+	return rc;
+}
+
 /*
  * Parses one line from utab file
  */
@@ -691,6 +824,160 @@ static int kernel_fs_postparse(struct libmnt_table *tb,
 	return rc;
 }
 
+/*
+ * Adds parsed @fs to @tb and drops the @fs reference; @rc is the parser
+ * result. Returns 0 on success, 1 on recoverable error and <0 on fatal error.
+ */
+static int table_add_parsed_fs(struct libmnt_table *tb, struct libmnt_fs *fs,
+			       int rc, int flags, pid_t *tid, const char *filename)
+{
+	if (rc == 0 && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
+		rc = 1;	/* filtered out by callback... */
+
+	/* add to the table */
+	if (rc == 0) {
+		rc = mnt_table_add_fs(tb, fs);
+		fs->flags |= flags;
+
+		if (rc == 0 && tb->fmt == MNT_FMT_MOUNTINFO) {
+			rc = kernel_fs_postparse(tb, fs, tid, filename);
+			if (rc)
+				mnt_table_remove_fs(tb, fs);
+		}
+	}
+
+	/* remove reference (or deallocate on error) */
+	mnt_unref_fs(fs);
+	return rc;
+}
+
+/*
+ * Reads the rest of the stream to a new arena.
+ */
+static struct libmnt_arena *read_arena(FILE *f)
+{
+	struct libmnt_arena *ar;
+	size_t bufsz = 0, n;
+
+	ar = mnt_new_arena();
+	if (!ar)
+		return NULL;
+	do {
+		if (bufsz - ar->size <= BUFSIZ) {
+			char *x;
+
+			bufsz = bufsz ? bufsz * 2 : 16 * 1024;
+			x = realloc(ar->data, bufsz);
+			if (!x)
+				goto err;
+			ar->data = x;
+		}
+		n = fread(ar->data + ar->size, 1, bufsz - ar->size - 1, f);
+		ar->size += n;
+	} while (n > 0);
+
+	if (ferror(f))
+		goto err;
+
+	ar->data[ar->size] = '\0';
+	return ar;
+err:
+	mnt_unref_arena(ar);
+	return NULL;
+}
+
+/*
+ * Returns the next non-blank non-comment line from the arena or NULL. The line
+ * is terminated in place, @next is set to the begin of the following line.
+ */
+static char *next_arena_line(struct libmnt_arena *ar, char **next, size_t *line)
+{
+	char *end = ar->data + ar->size;
+	char *s = *next;
+
+	while (s < end) {
+		char *p = memchr(s, '\n', end - s);
+
+		(*line)++;
+		if (p) {
+			*p = '\0';
+			*next = p + 1;
+		} else {
+			p = end;
+			*next = end;
+		}
+		if (p > s && *(p - 1) == '\r')
+			*(--p) = '\0';
+
+		s = (char *) skip_blank(s);
+		if (*s != '\0' && *s != '#')
+			return s;
+		s = *next;
+	}
+	return NULL;
+}
+
+/*
+ * Returns MNT_FMT_* according to the first non-blank non-comment line in the
+ * arena, the arena is not modified.
+ */
+static int guess_arena_format(struct libmnt_arena *ar)
+{
+	const char *s = ar->data;
+
+	while (s && *s) {
+		const char *p = skip_blank(s);
+
+		if (*p && *p != '\n' && *p != '\r' && *p != '#')
+			return guess_table_format(p);
+		s = strchr(p, '\n');
+		if (s)
+			s++;
+	}
+	return MNT_FMT_GUESS;
+}
+
+/*
+ * Parses mountinfo from the arena; strings in the new entries point to the
+ * arena, so there is no allocation per field.
+ */
+static int parse_mountinfo_arena(struct libmnt_table *tb,
+				 struct libmnt_arena *ar,
+				 const char *filename)
+{
+	char *s, *next = ar->data;
+	size_t line = 0;
+	pid_t tid = -1;
+	int rc;
+
+	while ((s = next_arena_line(ar, &next, &line))) {
+		struct libmnt_fs *fs = mnt_new_fs();
+
+		if (!fs)
+			return -ENOMEM;
+
+		mnt_fs_set_arena(fs, ar);
+
+		rc = mnt_parse_mountinfo_line_inplace(fs, s);
+		if (rc != 0) {
+			DBG(TAB, ul_debugobj(tb, "%s:%zu: mountinfo parse error",
+						filename, line));
+			rc = tb->errcb ? tb->errcb(tb, filename, line) : 1;
+		}
+
+		rc = table_add_parsed_fs(tb, fs, rc, 0, &tid, filename);
+		if (rc > 0) {
+			DBG(TAB, ul_debugobj(tb, "recoverable error (continue)"));
+			continue;
+		}
+		if (rc < 0) {
+			DBG(TAB, ul_debugobj(tb, "fatal error"));
+			return rc;
+		}
+	}
+	return 0;
+}
+
 /**
  * mnt_table_parse_stream:
  * @tb: tab pointer
@@ -705,6 +992,8 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	int flags = 0;
 	pid_t tid = -1;
 	struct libmnt_parser pa = { .line = 0 };
+	struct libmnt_arena *ar = NULL;
+	FILE *memf = NULL;
 
 	assert(tb);
 	assert(f);
@@ -714,6 +1003,39 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 				filename, mnt_table_get_nents(tb),
 				tb->fltrcb ? "yes" : "not"));
 
+	/*
+	 * Read mountinfo (or maybe mountinfo) to one buffer and parse it in
+	 * place. Other formats are parsed by the line parser from the buffer.
+	 */
+	if (!tb->noarena && !tb->comms
+	    && (tb->fmt == MNT_FMT_MOUNTINFO || tb->fmt == MNT_FMT_GUESS)) {
+		ar = read_arena(f);
+		if (!ar) {
+			rc = errno ? -errno : -ENOMEM;
+			goto err;
+		}
+		if (tb->fmt == MNT_FMT_GUESS
+		    && guess_arena_format(ar) == MNT_FMT_MOUNTINFO)
+			tb->fmt = MNT_FMT_MOUNTINFO;
+
+		if (tb->fmt == MNT_FMT_MOUNTINFO) {
+			DBG(TAB, ul_debugobj(tb, "parsing %zu bytes in arena", ar->size));
+			rc = parse_mountinfo_arena(tb, ar, filename);
+			if (rc)
+				goto err;
+			goto done;
+		}
+		if (!ar->size)
+			goto done;
+
+		memf = fmemopen(ar->data, ar->size, "r");
+		if (!memf) {
+			rc = errno ? -errno : -ENOMEM;
+			goto err;
+		}
+		f = memf;
+	}
+
 	pa.filename = filename;
 	pa.f = f;
 
@@ -738,24 +1060,7 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 
 		/* parse */
 		rc = mnt_table_parse_next(&pa, tb, fs);
-
-		if (rc == 0 && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
-			rc = 1;	/* filtered out by callback... */
-
-		/* add to the table */
-		if (rc == 0) {
-			rc = mnt_table_add_fs(tb, fs);
-			fs->flags |= flags;
-
-			if (rc == 0 && tb->fmt == MNT_FMT_MOUNTINFO) {
-				rc = kernel_fs_postparse(tb, fs, &tid, filename);
-				if (rc)
-					mnt_table_remove_fs(tb, fs);
-			}
-		}
-
-		/* remove reference (or deallocate on error) */
-		mnt_unref_fs(fs);
+		rc = table_add_parsed_fs(tb, fs, rc, flags, &tid, filename);
 
 		/* recoverable error */
 		if (rc > 0) {
@@ -769,14 +1074,17 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 			goto err;
 		}
 	} while (1);
-
+done:
 	DBG(TAB, ul_debugobj(tb, "%s: stop parsing (%d entries)",
 				filename, mnt_table_get_nents(tb)));
-	parser_cleanup(&pa);
-	return 0;
+	rc = 0;
 err:
-	DBG(TAB, ul_debugobj(tb, "%s: parse error (rc=%d)", filename, rc));
+	if (rc)
+		DBG(TAB, ul_debugobj(tb, "%s: parse error (rc=%d)", filename, rc));
 	parser_cleanup(&pa);
+	if (memf)
+		fclose(memf);
+	mnt_unref_arena(ar);
 	return rc;
 }
 
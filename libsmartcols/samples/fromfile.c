@@ -125,25 +125,33 @@ fail:
 	return NULL;
 }
 
-static int parse_column_data(FILE *f, struct libscols_table *tb, int col)
+static int read_data(FILE *f, char **str, size_t *len)
 {
-	size_t len = 0, nlines = 0;
 	int i;
-	char *str = NULL;
+	char *p;
 
-	while ((i = getline(&str, &len, f)) != -1) {
+	if ((i = getline(str, len, f)) == -1)
+		return -1;
 
-		struct libscols_line *ln;
-		char *p = strrchr(str, '\n');
-		if (p)
-			*p = '\0';
+	p = strrchr(*str, '\n');
+	if (p)
+		*p = '\0';
 
-		while ((p = strrchr(str, '\\')) && *(p + 1) == 'n') {
-			*p = '\n';
-			memmove(p + 1, p + 2, i - (p + 2 - str));
-		}
+	while ((p = strrchr(*str, '\\')) && *(p + 1) == 'n') {
+		*p = '\n';
+		memmove(p + 1, p + 2, i - (p + 2 - *str));
+	}
+	return 0;
+}
 
-		ln = scols_table_get_line(tb, nlines++);
+static int parse_column_data(FILE *f, struct libscols_table *tb, int col)
+{
+	size_t len = 0, nlines = 0;
+	char *str = NULL;
+
+	while (read_data(f, &str, &len) == 0) {
+
+		struct libscols_line *ln = scols_table_get_line(tb, nlines++);
 		if (!ln)
 			break;
 
@@ -156,6 +164,41 @@ static int parse_column_data(FILE *f, struct libscols_table *tb, int col)
 
 }
 
+/* streaming mode -- reads all columns files line by line */
+static void parse_stream_data(struct libscols_table *tb, int nlines,
+			      char **files, int nfiles)
+{
+	FILE **fs = xcalloc(nfiles, sizeof(FILE *));
+	size_t len = 0;
+	char *str = NULL;
+	int n, i;
+
+	for (i = 0; i < nfiles; i++) {
+		fs[i] = fopen(files[i], "r");
+		if (!fs[i])
+			err(EXIT_FAILURE, "%s: open failed", files[i]);
+	}
+
+	for (n = 0; n < nlines; n++) {
+		struct libscols_line *ln = scols_table_new_line(tb, NULL);
+
+		if (!ln)
+			err(EXIT_FAILURE, "failed to add a new line");
+
+		for (i = 0; i < nfiles; i++) {
+			if (read_data(fs[i], &str, &len) != 0)
+				continue;
+			if (*str && scols_line_set_data(ln, i, str) != 0)
+				err(EXIT_FAILURE, "failed to add output data");
+		}
+	}
+
+	for (i = 0; i < nfiles; i++)
+		fclose(fs[i]);
+	free(fs);
+	free(str);
+}
+
 static struct libscols_line *get_line_with_id(struct libscols_table *tb,
 						int col_id, const char *id)
 {
@@ -208,6 +251,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(" -r, --raw                      RAW output format\n", out);
 	fputs(" -E, --export                   use key=\"value\" output format\n", out);
 	fputs(" -C, --colsep <str>             set columns separator\n", out);
+	fputs(" -s, --stream                   print lines as soon as complete\n", out);
 	fputs(" -w, --width <num>              hardcode terminal width\n", out);
 	fputs(" -p, --tree-parent-column <n>   parent column\n", out);
 	fputs(" -i, --tree-id-column <n>       id column\n", out);
@@ -221,7 +265,7 @@ int main(int argc, char *argv[])
 {
 	struct libscols_table *tb;
 	int c, n, nlines = 0;
-	int parent_col = -1, id_col = -1;
+	int parent_col = -1, id_col = -1, stream = 0;
 
 	static const struct option longopts[] = {
 		{ "maxout", 0, NULL, 'm' },
@@ -235,6 +279,7 @@ int main(int argc, char *argv[])
 		{ "raw",    0, NULL, 'r' },
 		{ "export", 0, NULL, 'E' },
 		{ "colsep",  1, NULL, 'C' },
+		{ "stream", 0, NULL, 's' },
 		{ "help",   0, NULL, 'h' },
 		{ NULL, 0, NULL, 0 },
 	};
@@ -253,7 +298,7 @@ int main(int argc, char *argv[])
 	if (!tb)
 		err(EXIT_FAILURE, "failed to create output table");
 
-	while((c = getopt_long(argc, argv, "hCc:Ei:JMmn:p:rw:", longopts, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "hCc:Ei:JMmn:p:rsw:", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -297,6 +342,9 @@ int main(int argc, char *argv[])
 		case 'C':
 			scols_table_set_column_separator(tb, optarg);
 			break;
+		case 's':
+			stream = 1;
+			break;
 		case 'n':
 			nlines = strtou32_or_err(optarg, "failed to parse number of lines");
 			break;
@@ -314,6 +362,14 @@ int main(int argc, char *argv[])
 	if (nlines <= 0)
 		errx(EXIT_FAILURE, "--nlines not set");
 
+	if (stream) {
+		scols_table_enable_streaming(tb, 1);
+		scols_table_enable_colors(tb, isatty(STDOUT_FILENO));
+
+		parse_stream_data(tb, nlines, argv + optind, argc - optind);
+		goto done;
+	}
+
 	for (n = 0; n < nlines; n++) {
 		struct libscols_line *ln = scols_new_line();
 
@@ -340,7 +396,7 @@ int main(int argc, char *argv[])
 		compose_tree(tb, parent_col, id_col);
 
 	scols_table_enable_colors(tb, isatty(STDOUT_FILENO));
-
+done:
 	scols_print_table(tb);
 	scols_unref_table(tb);
 	return EXIT_SUCCESS;
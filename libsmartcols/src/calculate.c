@@ -452,3 +452,45 @@ done:
 
 	return rc;
 }
+
+/*
+ * Stream mode -- the lines are printed as soon as they are complete, so it's
+ * impossible to count the width from data. The column width is the width
+ * hint (relative to the terminal width if the hint is < 1), but at least the
+ * width of the column header. Data wider than the column are truncated for
+ * SCOLS_FL_TRUNC columns, wrapped for SCOLS_FL_WRAP columns, and shift the
+ * rest of the line otherwise.
+ */
+int __scols_calculate_stream(struct libscols_table *tb)
+{
+	struct libscols_column *cl;
+	struct libscols_iter itr;
+
+	DBG(TAB, ul_debugobj(tb, "-----calculate stream-(termwidth=%zu)-----", tb->termwidth));
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		const char *data;
+		size_t width = 0;
+
+		if (scols_column_is_hidden(cl))
+			continue;
+
+		if (cl->width_hint >= 1)
+			width = (size_t) cl->width_hint;
+		else if (tb->is_term)
+			width = (size_t) (cl->width_hint * tb->termwidth);
+
+		data = scols_cell_get_data(&cl->header);
+		if (data) {
+			size_t len = scols_table_is_noencoding(tb) ?
+					mbs_width(data) : mbs_safe_width(data);
+			cl->width_min = len;
+			width = max(width, len);
+		}
+		cl->width = max(width, (size_t) 1);
+	}
+
+	ON_DBG(TAB, dbg_columns(tb));
+	return 0;
+}
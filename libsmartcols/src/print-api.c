@@ -169,13 +169,47 @@ done:
 int scols_print_table(struct libscols_table *tb)
 {
 	int empty = 0;
-	int rc = do_print_table(tb, &empty);
+	int rc;
+
+	if (tb && is_stream_table(tb)
+	    && (tb->stream_started || !list_empty(&tb->tb_lines))) {
+		DBG(TAB, ul_debugobj(tb, "printing stream"));
+		return __scols_finish_stream(tb);
+	}
+
+	rc = do_print_table(tb, &empty);
 
 	if (rc == 0 && !empty && !scols_table_is_json(tb))
 		fputc('\n', tb->out);
 	return rc;
 }
 
+/**
+ * scols_flush_table:
+ * @tb: table
+ *
+ * Prints all lines in the table and removes them from the table. This is
+ * supported in the streaming mode only (see scols_table_enable_streaming()),
+ * the output has to be terminated by scols_print_table().
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_flush_table(struct libscols_table *tb)
+{
+	int rc;
+
+	if (!tb || !is_stream_table(tb))
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "flushing stream"));
+	rc = __scols_print_stream(tb);
+	if (rc == 0)
+		fflush(tb->out);
+	return rc;
+}
+
 /**
  * scols_print_table_to_string:
  * @tb: table
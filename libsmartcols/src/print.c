@@ -722,7 +722,7 @@ static int print_data(struct libscols_table *tb,
 
 	fputs_color_cell_close(tb, cl, ln, ce);
 
-	if (len > width && !scols_column_is_trunc(cl)) {
+	if (len > width && !scols_column_is_trunc(cl) && !is_stream_table(tb)) {
 		DBG(COL, ul_debugobj(cl, "*** data len=%zu > column width=%zu", len, width));
 		print_newline_padding(tb, cl, ln, ce, ul_buffer_get_bufsiz(buf));	/* next column starts on next line */
 
@@ -1042,6 +1042,89 @@ int __scols_print_table(struct libscols_table *tb, struct ul_buffer *buf)
 	return __scols_print_range(tb, buf, &itr, NULL);
 }
 
+/*
+ * Stream mode -- prints all lines in the table and removes them from the
+ * table. The title and header (or JSON prologue) are printed before the first
+ * line.
+ */
+int __scols_print_stream(struct libscols_table *tb)
+{
+	struct ul_buffer *buf = &tb->stream_buf;
+	int rc = 0;
+
+	assert(is_stream_table(tb));
+
+	if (list_empty(&tb->tb_lines))
+		return 0;
+
+	if (!tb->stream_started) {
+		DBG(TAB, ul_debugobj(tb, "starting stream"));
+
+		tb->header_printed = 0;
+		tb->stream_nlines = 0;
+		rc = __scols_initialize_printing(tb, buf);
+		if (rc)
+			return rc;
+		tb->stream_started = 1;
+
+		if (scols_table_is_json(tb)) {
+			ul_jsonwrt_root_open(&tb->json);
+			ul_jsonwrt_array_open(&tb->json, tb->name ? tb->name : "");
+		}
+		if (tb->format == SCOLS_FMT_HUMAN)
+			__scols_print_title(tb);
+
+		rc = __scols_print_header(tb, buf);
+	}
+
+	while (rc == 0 && !list_empty(&tb->tb_lines)) {
+		struct libscols_line *ln = list_entry(tb->tb_lines.next,
+					struct libscols_line, ln_lines);
+
+		if (scols_table_is_json(tb))
+			ul_jsonwrt_object_open(&tb->json, NULL);
+		else if (tb->stream_nlines && tb->no_linesep == 0) {
+			fputs(linesep(tb), tb->out);
+			tb->termlines_used++;
+
+			if (want_repeat_header(tb))
+				__scols_print_header(tb, buf);
+		}
+
+		rc = print_line(tb, ln, buf);
+
+		if (scols_table_is_json(tb))
+			ul_jsonwrt_object_close(&tb->json);
+
+		tb->stream_nlines++;
+		scols_table_remove_line(tb, ln);
+	}
+
+	return rc;
+}
+
+/*
+ * Stream mode -- prints the rest of the lines and terminates the output.
+ */
+int __scols_finish_stream(struct libscols_table *tb)
+{
+	int rc;
+
+	rc = __scols_print_stream(tb);
+
+	if (scols_table_is_json(tb)) {
+		ul_jsonwrt_array_close(&tb->json);
+		ul_jsonwrt_root_close(&tb->json);
+	} else
+		fputc('\n', tb->out);
+
+	DBG(TAB, ul_debugobj(tb, "stream finished [%zu lines]", tb->stream_nlines));
+
+	__scols_cleanup_printing(tb, &tb->stream_buf);
+	tb->stream_started = 0;
+	return rc;
+}
+
 /* scols_walk_tree() callback to print tree line */
 static int print_tree_line(struct libscols_table *tb,
 			   struct libscols_line *ln,
@@ -1230,7 +1313,9 @@ int __scols_initialize_printing(struct libscols_table *tb, struct ul_buffer *buf
 		scols_groups_fix_members_order(tb);
 
 	if (tb->format == SCOLS_FMT_HUMAN) {
-		rc = __scols_calculate(tb, buf);
+		rc = is_stream_table(tb) ?
+			__scols_calculate_stream(tb) :
+			__scols_calculate(tb, buf);
 		if (rc != 0)
 			goto err;
 	}
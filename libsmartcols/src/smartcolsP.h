@@ -241,6 +241,9 @@ struct libscols_table {
 
 	const char *cur_color;	/* current active color when printing */
 
+	struct ul_buffer stream_buf;	/* stream mode printing buffer */
+	size_t	stream_nlines;	/* number of lines printed in stream mode */
+
 	/* flags */
 	unsigned int	ascii		:1,	/* don't use unicode */
 			colors_wanted	:1,	/* enable colors */
@@ -257,7 +260,9 @@ struct libscols_table {
 			no_headings	:1,	/* don't print header */
 			no_encode	:1,	/* don't care about control and non-printable chars */
 			no_linesep	:1,	/* don't print line separator */
-			no_wrap		:1;	/* never wrap lines */
+			no_wrap		:1,	/* never wrap lines */
+			is_stream	:1,	/* print lines as soon as complete */
+			stream_started	:1;	/* stream header already printed */
 };
 
 #define IS_ITER_FORWARD(_i)	((_i)->direction == SCOLS_ITER_FORWARD)
@@ -329,6 +334,7 @@ extern int scols_walk_is_last(struct libscols_table *tb, struct libscols_line *l
  * calculate.c
  */
 extern int __scols_calculate(struct libscols_table *tb, struct ul_buffer *buf);
+extern int __scols_calculate_stream(struct libscols_table *tb);
 
 /*
  * print.c
@@ -348,6 +354,8 @@ int __scols_print_range(struct libscols_table *tb,
                         struct ul_buffer *buf,
                         struct libscols_iter *itr,
                         struct libscols_line *end);
+int __scols_print_stream(struct libscols_table *tb);
+int __scols_finish_stream(struct libscols_table *tb);
 
 static inline int is_tree_root(struct libscols_line *ln)
 {
@@ -436,6 +444,15 @@ static inline int has_groups(struct libscols_table *tb)
 	return tb && !list_empty(&tb->tb_groups);
 }
 
+/*
+ * Trees and groups need all lines to draw the ASCII art, such tables are
+ * printed in the standard way although the stream mode is enabled.
+ */
+static inline int is_stream_table(struct libscols_table *tb)
+{
+	return tb->is_stream && !scols_table_is_tree(tb) && !has_groups(tb);
+}
+
 static inline int has_children(struct libscols_line *ln)
 {
 	return ln && !list_empty(&ln->ln_branch);
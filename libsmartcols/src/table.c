@@ -134,6 +134,7 @@ void scols_unref_table(struct libscols_table *tb)
 		free(tb->linesep);
 		free(tb->colsep);
 		free(tb->name);
+		ul_buffer_free_data(&tb->stream_buf);
 		free(tb);
 		DBG(TAB, ul_debug("<- done"));
 	}
@@ -644,6 +645,10 @@ struct libscols_column *scols_table_get_column_by_name(
  * Note that this function calls scols_line_alloc_cells() if number
  * of the cells in the line is too small for @tb.
  *
+ * If the streaming mode is enabled (see scols_table_enable_streaming()) then all
+ * lines already in the table are printed and removed from the table before
+ * @ln is added.
+ *
  * Returns: 0, a negative value in case of an error.
  */
 int scols_table_add_line(struct libscols_table *tb, struct libscols_line *ln)
@@ -654,6 +659,12 @@ int scols_table_add_line(struct libscols_table *tb, struct libscols_line *ln)
 	if (!list_empty(&ln->ln_lines))
 		return -EINVAL;
 
+	if (is_stream_table(tb)) {
+		int rc = __scols_print_stream(tb);
+		if (rc)
+			return rc;
+	}
+
 	if (tb->ncols > ln->ncells) {
 		int rc = scols_line_alloc_cells(ln, tb->ncols);
 		if (rc)
@@ -1290,6 +1301,53 @@ int scols_table_is_nowrap(const struct libscols_table *tb)
 	return tb->no_wrap;
 }
 
+/**
+ * scols_table_enable_streaming:
+ * @tb: table
+ * @enable: 1 or 0
+ *
+ * Enables streaming mode. In this mode the table does not keep the lines;
+ * every line is printed (and removed from the table) as soon as the next line
+ * is added by scols_table_new_line() or scols_table_add_line(), and the rest
+ * of the lines is printed by scols_print_table(). The memory used by the table
+ * does not depend on the number of lines and the output is available
+ * immediately. Use scols_flush_table() to print all lines already in the
+ * table.
+ *
+ * The column widths are not calculated from the data, but defined by the
+ * width hints (see scols_column_set_whint()) and the column headers. All
+ * output formats are supported, but trees and groups need all lines and
+ * such tables are printed in the standard way.
+ *
+ * Note that the lines printed in the streaming mode are deallocated unless
+ * referenced by scols_ref_line(), and it is impossible to sort the table.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_enable_streaming(struct libscols_table *tb, int enable)
+{
+	if (!tb || tb->stream_started)
+		return -EINVAL;
+	DBG(TAB, ul_debugobj(tb, "streaming: %s", enable ? "ENABLE" : "DISABLE"));
+	tb->is_stream = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * scols_table_is_streaming:
+ * @tb: a pointer to a struct libscols_table instance
+ *
+ * Returns: 1 if streaming mode is enabled.
+ *
+ * Since: 2.39
+ */
+int scols_table_is_streaming(const struct libscols_table *tb)
+{
+	return tb->is_stream;
+}
+
 /**
  * scols_table_enable_noencoding:
  * @tb: table
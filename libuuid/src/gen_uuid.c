@@ -432,6 +432,94 @@ int __uuid_generate_time(uuid_t out, int *num)
 	return ret;
 }
 
+/*
+ * Reserve a block of @num time-based UUIDs and store the first one to @out.
+ *
+ * The block is reserved by uuidd or by one locked write to the global clock
+ * state counter (see get_clock()), so the UUIDs are unique although they are
+ * handed out later without any locking.
+ *
+ * Returns 0 if the block is reserved in a safe manner, -1 otherwise.
+ */
+static int reserve_time_uuids(uuid_t out, int *num)
+{
+	if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID, out, num) == 0)
+		return 0;
+
+	return __uuid_generate_time(out, num);
+}
+
+/* The maximal number of the reserved time-based UUIDs (0.1 second) */
+#define TIME_CACHE_MAX	1000000
+
+/* Move to the next UUID in the reserved block */
+static inline void next_time_uuid(struct uuid *uu)
+{
+	uu->time_low++;
+	if (uu->time_low == 0) {
+		uu->time_mid++;
+		if (uu->time_mid == 0)
+			uu->time_hi_and_version++;
+	}
+}
+
+#ifdef HAVE_TLS
+
+/*
+ * The reserved time-based UUIDs, the cache is per thread and it's used
+ * without locks.
+ */
+struct uuid_time_cache {
+	int		num;		/* number of remaining UUIDs */
+	int		cache_size;	/* size of the next reservation */
+	int		ret;		/* reserve_time_uuids() return code */
+	struct uuid	uu;		/* the last UUID */
+	time_t		last_time;	/* time of the reservation */
+	pid_t		pid;		/* the cache is not shared with children */
+};
+
+THREAD_LOCAL struct uuid_time_cache time_cache = { .cache_size = 1 };
+
+/*
+ * Get time-based UUID from the thread cache, the cache is refilled by
+ * reserve_time_uuids() if empty. The @want is the number of the UUIDs
+ * the caller is going to request.
+ */
+static int uuid_generate_time_cached(uuid_t out, size_t want)
+{
+	struct uuid_time_cache *c = &time_cache;
+
+	if (c->num > 0) {
+		time_t now = time(NULL);
+
+		if (now > c->last_time + 1 || c->pid != getpid())
+			c->num = 0;
+	}
+	if (c->num <= 0) {
+		/*
+		 * Start with a small cache size to cover short running
+		 * applications and increment the cache size over the runtime.
+		 */
+		if (c->cache_size < TIME_CACHE_MAX)
+			c->cache_size *= 10;
+		c->num = max((size_t) c->cache_size,
+			     min(want, (size_t) TIME_CACHE_MAX));
+
+		c->ret = reserve_time_uuids(out, &c->num);
+		c->last_time = time(NULL);
+		c->pid = getpid();
+		uuid_unpack(out, &c->uu);
+		c->num--;
+		return c->ret;
+	}
+
+	next_time_uuid(&c->uu);
+	c->num--;
+	uuid_pack(&c->uu, out);
+	return c->ret;
+}
+#endif /* HAVE_TLS */
+
 /*
  * Generate time-based UUID and store it to @out
  *
@@ -439,56 +527,19 @@ int __uuid_generate_time(uuid_t out, int *num)
  * or, if uuidd is not usable, by using the global clock state counter (see get_clock()).
  * If neither of these is possible (e.g. because of insufficient permissions), it generates
  * the UUID anyway, but returns -1. Otherwise, returns 0.
+ *
+ * The UUIDs are reserved in blocks and handed out from a thread-local cache
+ * if TLS is available.
  */
 static int uuid_generate_time_generic(uuid_t out) {
 #ifdef HAVE_TLS
-	THREAD_LOCAL int		num = 0;
-	THREAD_LOCAL int		cache_size = 1;
-	THREAD_LOCAL struct uuid	uu;
-	THREAD_LOCAL time_t		last_time = 0;
-	time_t				now;
-
-	if (num > 0) {
-		now = time(NULL);
-		if (now > last_time+1)
-			num = 0;
-	}
-	if (num <= 0) {
-		/*
-		 * num + OP_BULK provides a local cache in each application.
-		 * Start with a small cache size to cover short running applications
-		 * and increment the cache size over the runntime.
-		 */
-		if (cache_size < 1000000)
-			cache_size *= 10;
-		num = cache_size;
-
-		if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
-					out, &num) == 0) {
-			last_time = time(NULL);
-			uuid_unpack(out, &uu);
-			num--;
-			return 0;
-		}
-		num = 0;
-	}
-	if (num > 0) {
-		uu.time_low++;
-		if (uu.time_low == 0) {
-			uu.time_mid++;
-			if (uu.time_mid == 0)
-				uu.time_hi_and_version++;
-		}
-		num--;
-		uuid_pack(&uu, out);
-		return 0;
-	}
+	return uuid_generate_time_cached(out, 1);
 #else
 	if (get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0)
 		return 0;
-#endif
 
 	return __uuid_generate_time(out, NULL);
+#endif
 }
 
 /*
@@ -507,6 +558,43 @@ int uuid_generate_time_safe(uuid_t out)
 	return uuid_generate_time_generic(out);
 }
 
+/*
+ * Generate @count time-based UUIDs and store them to @out.
+ *
+ * The UUIDs are reserved by one request to uuidd or by one locked write to
+ * the clock state counter for the whole array (up to 1000000 UUIDs).
+ *
+ * Returns 0 if all the UUIDs have been generated in a safe manner, -1
+ * otherwise.
+ */
+int uuid_generate_time_bulk(uuid_t *out, size_t count)
+{
+	size_t i = 0;
+	int ret = 0;
+
+#ifdef HAVE_TLS
+	for (; i < count; i++) {
+		if (uuid_generate_time_cached(out[i], count - i) != 0)
+			ret = -1;
+	}
+#else
+	while (i < count) {
+		struct uuid uu;
+		int num = min(count - i, (size_t) TIME_CACHE_MAX);
+
+		if (reserve_time_uuids(out[i], &num) != 0)
+			ret = -1;
+		uuid_unpack(out[i++], &uu);
+
+		for (; num > 1 && i < count; num--) {
+			next_time_uuid(&uu);
+			uuid_pack(&uu, out[i++]);
+		}
+	}
+#endif
+	return ret;
+}
+
 
 int __uuid_generate_random(uuid_t out, int *num)
 {
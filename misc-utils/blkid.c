@@ -80,6 +80,7 @@ static void __attribute__((__noreturn__)) usage(void)
 			"                              cache file (-c /dev/null means no cache)\n"), out);
 	fputs(_(	" -d, --no-encoding          don't encode non-printing characters\n"), out);
 	fputs(_(	" -g, --garbage-collect      garbage collect the blkid cache\n"), out);
+	fputs(_(	" -j, --jobs <num>           probe devices by <num> threads (0 means all CPUs)\n"), out);
 	fputs(_(	" -o, --output <format>      output format; can be one of:\n"
 			"                              value, device, export or full; (default: full)\n"), out);
 	fputs(_(	" -k, --list-filesystems     list all known filesystems/RAIDs and exit\n"), out);
@@ -675,6 +676,7 @@ int main(int argc, char **argv)
 	int fltr_usage = 0;
 	char **fltr_type = NULL;
 	int fltr_flag = BLKID_FLTR_ONLYIN;
+	int nthreads = 1;
 	unsigned int numdev = 0, numtag = 0;
 	int err = BLKID_EXIT_OTHER;
 	unsigned int i;
@@ -685,6 +687,7 @@ int main(int argc, char **argv)
 		{ "no-encoding",      no_argument,	 NULL, 'd' },
 		{ "no-part-details",  no_argument,       NULL, 'D' },
 		{ "garbage-collect",  no_argument,	 NULL, 'g' },
+		{ "jobs",	      required_argument, NULL, 'j' },
 		{ "output",	      required_argument, NULL, 'o' },
 		{ "list-filesystems", no_argument,	 NULL, 'k' },
 		{ "match-tag",	      required_argument, NULL, 's' },
@@ -718,7 +721,7 @@ int main(int argc, char **argv)
 	strutils_set_exitcode(BLKID_EXIT_OTHER);
 
 	while ((c = getopt_long (argc, argv,
-			    "c:DdgH:hilL:n:ko:O:ps:S:t:u:U:w:Vv", longopts, NULL)) != -1) {
+			    "c:DdgH:hij:lL:n:ko:O:ps:S:t:u:U:w:Vv", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, NULL, excl, excl_st);
 
@@ -754,6 +757,10 @@ int main(int argc, char **argv)
 		case 'i':
 			ctl.lowprobe_topology = 1;
 			break;
+		case 'j':
+			nthreads = (int) str2unum_or_err(optarg, 10,
+					_("invalid jobs argument"), INT_MAX);
+			break;
 		case 'l':
 			ctl.lookup = 1;
 			break;
@@ -972,7 +979,10 @@ int main(int argc, char **argv)
 		blkid_dev_iterate	iter;
 		blkid_dev		dev;
 
-		blkid_probe_all(cache);
+		if (nthreads == 1)
+			blkid_probe_all(cache);
+		else
+			blkid_probe_all_parallel(cache, nthreads);
 
 		iter = blkid_dev_iterate_begin(cache);
 		blkid_dev_set_search(iter, search_type, search_value);
@@ -1196,16 +1196,9 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 	FILE *f = NULL;
 	int rc = -1;
 	struct libmnt_iter *itr = NULL;
-	struct libmnt_table *tb_new;
 	struct libmnt_tabdiff *diff = NULL;
 	struct pollfd fds[1];
 
-	tb_new = mnt_new_table();
-	if (!tb_new) {
-		warn(_("failed to initialize libmount table"));
-		goto done;
-	}
-
 	itr = mnt_new_iter(direction);
 	if (!itr) {
 		warn(_("failed to initialize libmount iterator"));
@@ -1220,7 +1213,6 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	/* cache is unnecessary to detect changes */
 	mnt_table_set_cache(tb, NULL);
-	mnt_table_set_cache(tb_new, NULL);
 
 	f = fopen(tabfile, "r");
 	if (!f) {
@@ -1228,13 +1220,10 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 		goto done;
 	}
 
-	mnt_table_set_parser_errcb(tb_new, parser_errcb);
-
 	fds[0].fd = fileno(f);
 	fds[0].events = POLLPRI;
 
 	while (1) {
-		struct libmnt_table *tmp;
 		struct libmnt_fs *old, *new;
 		int change, count;
 
@@ -1246,10 +1235,8 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 			goto done;
 		}
 
-		rewind(f);
-		rc = mnt_table_parse_stream(tb_new, f, tabfile);
-		if (!rc)
-			rc = mnt_diff_tables(diff, tb, tb_new);
+		/* update @tb in place, only the changes are stored in @diff */
+		rc = mnt_table_refresh(tb, tabfile, diff);
 		if (rc < 0)
 			goto done;
 
@@ -1279,14 +1266,8 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 				goto done;
 		}
 
-		/* swap tables */
-		tmp = tb;
-		tb = tb_new;
-		tb_new = tmp;
-
 		/* remove already printed lines to reduce memory usage */
 		scols_table_remove_lines(table);
-		mnt_reset_table(tb_new);
 
 		if (count && (flags & FL_FIRSTONLY))
 			break;
@@ -1294,7 +1275,6 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	rc = 0;
 done:
-	mnt_unref_table(tb_new);
 	mnt_free_tabdiff(diff);
 	mnt_free_iter(itr);
 	if (f)
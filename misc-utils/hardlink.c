@@ -32,10 +32,11 @@
 #include <sys/resource.h>	/* getrlimit, getrusage */
 #include <fcntl.h>		/* posix_fadvise */
 #include <ftw.h>		/* ftw */
-#include <search.h>		/* tsearch() and friends */
 #include <signal.h>		/* SIG*, sigaction */
 #include <getopt.h>		/* getopt_long() */
 #include <ctype.h>		/* tolower() */
+#include <dirent.h>		/* opendir(), readdir() */
+#include <pthread.h>		/* pthread_create() and friends */
 #include <sys/ioctl.h>
 
 #if defined(HAVE_LINUX_FIEMAP_H) && defined(HAVE_SYS_VFS_H)
@@ -78,32 +79,54 @@ static int reflinks_skip;
 #endif
 
 static struct ul_fileeq fileeq;
+static struct ul_fileeq_cache *digest_cache;	/* --cache-file */
+
+/**
+ * struct link - A path of the file
+ * @next: Next link of the same file
+ * @dir:  The directory part of the path (with the trailing slash), shared
+ *        by all the links in the directory, see get_dirname()
+ * @name: The basename
+ */
+struct link {
+	struct link *next;
+	const char *dir;
+#if __STDC_VERSION__ >= 199901L
+	char name[];
+#elif __GNUC__
+	char name[0];
+#else
+	char name[1];
+#endif
+};
 
 /**
  * struct file - Information about a file
- * @st:       The stat buffer associated with the file
- * @next:     Next file with the same size
- * @basename: The offset off the basename in the filename
- * @path:     The path of the file
+ * @dev, @ino, ...: The stat() information we need about the file
+ * @data:  The content comparison data, allocated only for link_group()
+ * @path:  The path of the first link, allocated only for link_group()
+ * @next:  Next file in the same size group
+ * @links: The paths of the file
  *
- * This contains all information we need about a file.
+ * This contains all information we need about a file. The files are
+ * allocated from the arena (see arena_alloc()) and never freed.
  */
 struct file {
-	struct stat st;
-	struct ul_fileeq_data data;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	nlink_t nlink;
+	struct timespec mtim;
+	struct timespec ctim;		/* for --cache-file only */
+
+	struct ul_fileeq_data *data;
+	char *path;
 
 	struct file *next;
-	struct link {
-		struct link *next;
-		int basename;
-#if __STDC_VERSION__ >= 199901L
-		char path[];
-#elif __GNUC__
-		char path[0];
-#else
-		char path[1];
-#endif
-	} *links;
+	struct link *links;
 };
 
 /**
@@ -128,6 +151,7 @@ enum log_level {
  * @xattr_comparisons: The number of extended attribute comparisons
  * @comparisons: The number of comparisons
  * @saved: The (exaggerated) amount of space saved
+ * @cache_hits: The number of files found in the --cache-file
  * @start_time: The time we started at
  */
 static struct statistics {
@@ -137,6 +161,7 @@ static struct statistics {
 	size_t xattr_comparisons;
 	size_t comparisons;
 	size_t ignored_reflinks;
+	size_t cache_hits;
 	double saved;
 	struct timeval start_time;
 } stats;
@@ -164,12 +189,15 @@ struct hdl_regex {
  * @dry_run: Specifies whether hardlink should not link files (default = FALSE)
  * @min_size: Minimum size of files to consider. (default = 1 byte)
  * @max_size: Maximum size of files to consider, 0 means umlimited. (default = 0 byte)
+ * @njobs: Number of threads walking directories and hashing files (default = 1)
+ * @cache_file: The file to keep checksums between runs (default = none)
  */
 static struct options {
 	struct hdl_regex *include;
 	struct hdl_regex *exclude;
 
 	const char *method;
+	const char *cache_file;
 	signed int verbosity;
 	unsigned int respect_mode:1;
 	unsigned int respect_owner:1;
@@ -184,6 +212,7 @@ static struct options {
 	uintmax_t max_size;
 	size_t io_size;
 	size_t cache_size;
+	size_t njobs;
 } opts = {
 	/* default setting */
 #ifdef USE_FILEEQ_CRYPTOAPI
@@ -197,17 +226,63 @@ static struct options {
 	.respect_xattrs = FALSE,
 	.keep_oldest = FALSE,
 	.min_size = 1,
-	.cache_size = 10*1024*1024
+	.cache_size = 10*1024*1024,
+	.njobs = 1
 };
 
 /*
- * files
+ * struct arena - Memory for the file records, links and directory names
  *
- * A binary tree of files, managed using tsearch(). To see which nodes
- * are considered equal, see compare_nodes()
+ * The records are allocated by arena_alloc() from large chunks and they are
+ * never freed, so there is no per-allocation overhead and the records are
+ * close to each other in the memory.
  */
-static void *files;
-static void *files_by_ino;
+#define ARENA_CHUNKSIZ	(256 * 1024)
+#define ARENA_ALIGN	sizeof(uint64_t)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t used;
+	size_t size;
+	union {
+		uint64_t align;
+		char data[1];
+	} mem;
+};
+
+static struct arena {
+	struct arena_chunk *chunks;
+} arena;
+
+/*
+ * struct file_index - Open addressing hash table of the files
+ *
+ * The by-inode index is used to find the other links of the already known
+ * files, the by-group index keeps the first file (master candidate) of the
+ * files which may be linked together -- the files of the same size on the
+ * same device (and with the same mode, if the mode is respected).
+ */
+struct file_index {
+	struct file **slots;	/* power of two */
+	size_t size;
+	size_t count;
+};
+
+static struct file_index files_by_ino;
+static struct file_index files_by_group;
+
+/*
+ * struct dir_pool - The directory names
+ *
+ * The paths are stored as the directory and the basename; the directory
+ * part is stored only once for all the files in the directory.
+ */
+static struct dir_pool {
+	const char **slots;	/* power of two */
+	size_t size;
+	size_t count;
+	const char *last;	/* the last used directory */
+} dirs;
 
 /*
  * last_signal
@@ -290,60 +365,294 @@ static int match_any_regex(struct hdl_regex *pregs, const char *what)
 }
 
 /**
- * compare_nodes - Node comparison function
- * @_a: The first node (a #struct file)
- * @_b: The second node (a #struct file)
+ * arena_alloc - Allocate zeroed memory from the arena
+ * @size: The number of bytes
+ */
+static void *arena_alloc(size_t size)
+{
+	struct arena_chunk *ch = arena.chunks;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (!ch || ch->size - ch->used < size) {
+		size_t sz = max(size, (size_t) ARENA_CHUNKSIZ);
+
+		ch = xcalloc(1, offsetof(struct arena_chunk, mem) + sz);
+		ch->size = sz;
+		if (arena.chunks && sz > ARENA_CHUNKSIZ) {
+			/* huge allocation, keep the current chunk in use */
+			ch->next = arena.chunks->next;
+			arena.chunks->next = ch;
+		} else {
+			ch->next = arena.chunks;
+			arena.chunks = ch;
+		}
+	}
+
+	p = ch->mem.data + ch->used;
+	ch->used += size;
+	return p;
+}
+
+static char *arena_strndup(const char *str, size_t len)
+{
+	char *p = arena_alloc(len + 1);
+
+	memcpy(p, str, len);
+	return p;
+}
+
+/* FNV-1a */
+static inline uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	if (!h)
+		h = 14695981039346656037ULL;
+	while (len--)
+		h = (h ^ *p++) * 1099511628211ULL;
+	return h;
+}
+
+static inline uint64_t hash_num(uint64_t h, uint64_t num)
+{
+	return hash_bytes(h, &num, sizeof(num));
+}
+
+/**
+ * get_dirname - Get the directory name from the pool
+ * @path: The path
+ * @len:  The length of the directory part of @path
  *
- * Compare the two nodes for the binary tree.
+ * Returns: the pooled copy of the @len bytes of @path
  */
-static int compare_nodes(const void *_a, const void *_b)
+static const char *get_dirname(const char *path, size_t len)
 {
-	const struct file *a = _a;
-	const struct file *b = _b;
-	int diff = 0;
+	struct dir_pool *pool = &dirs;
+	const char *d;
+	size_t i;
+
+	/* nftw() returns all the files from a directory together */
+	if (pool->last && strncmp(pool->last, path, len) == 0
+	    && pool->last[len] == '\0')
+		return pool->last;
+
+	if ((pool->count + 1) * 2 > pool->size) {
+		size_t k, n = pool->size ? pool->size * 2 : 1024;
+		const char **slots = xcalloc(n, sizeof(char *));
+
+		for (k = 0; k < pool->size; k++) {
+			d = pool->slots[k];
+			if (!d)
+				continue;
+			i = hash_bytes(0, d, strlen(d)) & (n - 1);
+			while (slots[i])
+				i = (i + 1) & (n - 1);
+			slots[i] = d;
+		}
+		free(pool->slots);
+		pool->slots = slots;
+		pool->size = n;
+	}
 
-	if (diff == 0)
-		diff = CMP(a->st.st_dev, b->st.st_dev);
-	if (diff == 0)
-		diff = CMP(a->st.st_size, b->st.st_size);
+	i = hash_bytes(0, path, len) & (pool->size - 1);
+	for (; (d = pool->slots[i]) != NULL; i = (i + 1) & (pool->size - 1)) {
+		if (strncmp(d, path, len) == 0 && d[len] == '\0')
+			break;
+	}
+	if (!d) {
+		d = pool->slots[i] = arena_strndup(path, len);
+		pool->count++;
+	}
+	pool->last = d;
+	return d;
+}
 
-	return diff;
+/**
+ * link_path - Compose the path of the link
+ * @l: The link
+ *
+ * Returns: newly allocated path
+ */
+static char *link_path(const struct link *l)
+{
+	size_t dlen = strlen(l->dir), nlen = strlen(l->name);
+	char *path = xmalloc(dlen + nlen + 1);
+
+	memcpy(path, l->dir, dlen);
+	memcpy(path + dlen, l->name, nlen + 1);
+	return path;
 }
 
 /**
- * compare_nodes_ino - Node comparison function
- * @_a: The first node (a #struct file)
- * @_b: The second node (a #struct file)
+ * file_path - Get the path of the file
+ * @f: The file
  *
- * Compare the two nodes for the binary tree.
+ * The path is composed from the first link, and it's kept in the file until
+ * the end of link_group() for the file.
  */
-static int compare_nodes_ino(const void *_a, const void *_b)
+static const char *file_path(struct file *f)
 {
-	const struct file *a = _a;
-	const struct file *b = _b;
-	int diff = 0;
+	if (!f->path)
+		f->path = link_path(f->links);
+	return f->path;
+}
 
-	if (diff == 0)
-		diff = CMP(a->st.st_dev, b->st.st_dev);
-	if (diff == 0)
-		diff = CMP(a->st.st_ino, b->st.st_ino);
+static uint64_t hash_inode(dev_t dev, ino_t ino, const char *name)
+{
+	uint64_t h = hash_num(hash_num(0, dev), ino);
 
 	/* If opts.respect_name is used, we will restrict a struct file to
 	 * contain only links with the same basename to keep the rest simple.
 	 */
-	if (diff == 0 && opts.respect_name)
-		diff = strcmp(a->links->path + a->links->basename,
-			      b->links->path + b->links->basename);
+	if (opts.respect_name)
+		h = hash_bytes(h, name, strlen(name));
+	return h;
+}
+
+static uint64_t hash_file_ino(const struct file *f)
+{
+	return hash_inode(f->dev, f->ino, f->links->name);
+}
+
+static uint64_t hash_file_group(const struct file *f)
+{
+	uint64_t h = hash_num(hash_num(0, f->dev), f->size);
+
+	if (opts.respect_mode)
+		h = hash_num(h, f->mode);
+	return h;
+}
+
+/* Makes space for one more file in the index */
+static void index_reserve(struct file_index *idx,
+			  uint64_t (*hash)(const struct file *))
+{
+	struct file **slots;
+	size_t i, k, n;
+
+	if ((idx->count + 1) * 2 <= idx->size)
+		return;
+
+	n = idx->size ? idx->size * 2 : 1024;
+	slots = xcalloc(n, sizeof(struct file *));
+
+	for (k = 0; k < idx->size; k++) {
+		if (!idx->slots[k])
+			continue;
+		i = hash(idx->slots[k]) & (n - 1);
+		while (slots[i])
+			i = (i + 1) & (n - 1);
+		slots[i] = idx->slots[k];
+	}
+	free(idx->slots);
+	idx->slots = slots;
+	idx->size = n;
+}
+
+static void index_free(struct file_index *idx)
+{
+	free(idx->slots);
+	idx->slots = NULL;
+	idx->size = idx->count = 0;
+}
+
+/**
+ * find_inode - Look up the by-inode index
+ * @dev:  The device
+ * @ino:  The inode
+ * @name: The basename
+ *
+ * Returns: the slot with the already known file, or the empty slot for
+ * the new file
+ */
+static struct file **find_inode(dev_t dev, ino_t ino, const char *name)
+{
+	struct file_index *idx = &files_by_ino;
+	struct file *f;
+	size_t i;
+
+	index_reserve(idx, hash_file_ino);
+
+	i = hash_inode(dev, ino, name) & (idx->size - 1);
+	for (; (f = idx->slots[i]) != NULL; i = (i + 1) & (idx->size - 1)) {
+		if (f->dev == dev && f->ino == ino
+		    && (!opts.respect_name || strcmp(f->links->name, name) == 0))
+			break;
+	}
+	return &idx->slots[i];
+}
+
+/**
+ * find_group - Look up the by-group index
+ * @key: The file to search
+ *
+ * Returns: the slot with the first file of the group, or the empty slot
+ */
+static struct file **find_group(const struct file *key)
+{
+	struct file_index *idx = &files_by_group;
+	struct file *f;
+	size_t i;
+
+	index_reserve(idx, hash_file_group);
 
+	i = hash_file_group(key) & (idx->size - 1);
+	for (; (f = idx->slots[i]) != NULL; i = (i + 1) & (idx->size - 1)) {
+		if (f->dev == key->dev && f->size == key->size
+		    && (!opts.respect_mode || f->mode == key->mode))
+			break;
+	}
+	return &idx->slots[i];
+}
+
+/* Orders the groups by the device and size */
+static int cmp_groups(const void *_a, const void *_b)
+{
+	const struct file *a = *(const struct file * const *) _a;
+	const struct file *b = *(const struct file * const *) _b;
+	int diff;
+
+	diff = CMP(a->dev, b->dev);
+	if (diff == 0)
+		diff = CMP(a->size, b->size);
+	if (diff == 0)
+		diff = CMP(a->mode, b->mode);
 	return diff;
 }
 
+/**
+ * get_groups - Get all the groups from the by-group index
+ * @ngroups: Returns the number of the groups
+ *
+ * Returns: allocated array of the first files of the groups, sorted by the
+ * device and size.
+ */
+static struct file **get_groups(size_t *ngroups)
+{
+	struct file **groups;
+	size_t i, n = 0;
+
+	groups = xmalloc(max(files_by_group.count, (size_t) 1) * sizeof(struct file *));
+	for (i = 0; i < files_by_group.size; i++) {
+		if (files_by_group.slots[i])
+			groups[n++] = files_by_group.slots[i];
+	}
+	qsort(groups, n, sizeof(struct file *), cmp_groups);
+
+	*ngroups = n;
+	return groups;
+}
+
 /**
  * print_stats - Print statistics to stdout
  */
 static void print_stats(void)
 {
 	struct timeval end = { 0, 0 }, delta = { 0, 0 };
+	struct rusage ru;
+	double secs;
 	char *ssz;
 
 	gettime_monotonic(&end);
@@ -361,6 +670,9 @@ static void print_stats(void)
 #endif
 	jlog(JLOG_SUMMARY, _("%-25s %zu files"), _("Compared:"),
 	     stats.comparisons);
+	if (digest_cache)
+		jlog(JLOG_SUMMARY, _("%-25s %zu files"), _("Cached:"),
+		     stats.cache_hits);
 #ifdef USE_REFLINK
 	if (reflinks_skip)
 		jlog(JLOG_SUMMARY, _("%-25s %zu files"), _("Skipped reflinks:"),
@@ -375,6 +687,31 @@ static void print_stats(void)
 
 	jlog(JLOG_SUMMARY, _("%-25s %"PRId64".%06"PRId64" seconds"), _("Duration:"),
 	     (int64_t)delta.tv_sec, (int64_t)delta.tv_usec);
+
+	secs = delta.tv_sec + delta.tv_usec / 1000000.0;
+	jlog(JLOG_SUMMARY, _("%-25s %.0f files/s"), _("Throughput:"),
+	     secs > 0 ? stats.files / secs : 0.0);
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		/* ru_maxrss is in kilobytes */
+		ssz = size_to_human_string(SIZE_SUFFIX_3LETTER |
+					   SIZE_SUFFIX_SPACE |
+					   SIZE_DECIMAL_2DIGITS,
+					   (uint64_t) ru.ru_maxrss * 1024);
+		jlog(JLOG_SUMMARY, "%-25s %s", _("Peak memory:"), ssz);
+		free(ssz);
+	}
+}
+
+/**
+ * is_interrupted - Check for SIGINT and SIGTERM
+ *
+ * Unlike handle_interrupt() it does not reset the signal, so it's usable in
+ * the threads.
+ */
+static inline int is_interrupted(void)
+{
+	return last_signal == SIGINT || last_signal == SIGTERM;
 }
 
 /**
@@ -489,7 +826,7 @@ static const char **get_sorted_xattr_name_table(const char *names, int n)
  *
  * @Returns: %TRUE if and only if extended attributes are equal
  */
-static int file_xattrs_equal(const struct file *a, const struct file *b)
+static int file_xattrs_equal(struct file *a, struct file *b)
 {
 	ssize_t len_a;
 	ssize_t len_b;
@@ -503,17 +840,21 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
 	void *value_b = NULL;
 	int ret = FALSE;
 	int i;
+	const char *path_a, *path_b;
 
 	assert(a->links != NULL);
 	assert(b->links != NULL);
 
-	jlog(JLOG_VERBOSE1, _("Comparing xattrs of %s to %s"), a->links->path,
-	     b->links->path);
+	path_a = file_path(a);
+	path_b = file_path(b);
+
+	jlog(JLOG_VERBOSE1, _("Comparing xattrs of %s to %s"), path_a,
+	     path_b);
 
 	stats.xattr_comparisons++;
 
-	len_a = llistxattr_or_die(a->links->path, NULL, 0);
-	len_b = llistxattr_or_die(b->links->path, NULL, 0);
+	len_a = llistxattr_or_die(path_a, NULL, 0);
+	len_b = llistxattr_or_die(path_b, NULL, 0);
 
 	if (len_a <= 0 && len_b <= 0)
 		return TRUE;	// xattrs not supported or neither file has any
@@ -524,8 +865,8 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
 	names_a = xmalloc(len_a);
 	names_b = xmalloc(len_b);
 
-	len_a = llistxattr_or_die(a->links->path, names_a, len_a);
-	len_b = llistxattr_or_die(b->links->path, names_b, len_b);
+	len_a = llistxattr_or_die(path_a, names_a, len_a);
+	len_b = llistxattr_or_die(path_b, names_b, len_b);
 	assert((len_a > 0) && (len_a == len_b));
 
 	n_a = get_xattr_name_count(names_a, len_a);
@@ -547,9 +888,9 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
 			goto exit;	// names at same slot differ
 
 		len_a =
-		    lgetxattr_or_die(a->links->path, name_ptrs_a[i], NULL, 0);
+		    lgetxattr_or_die(path_a, name_ptrs_a[i], NULL, 0);
 		len_b =
-		    lgetxattr_or_die(b->links->path, name_ptrs_b[i], NULL, 0);
+		    lgetxattr_or_die(path_b, name_ptrs_b[i], NULL, 0);
 
 		if (len_a != len_b)
 			goto exit;	// xattrs with same name, different value lengths
@@ -557,9 +898,9 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
 		value_a = xmalloc(len_a);
 		value_b = xmalloc(len_b);
 
-		len_a = lgetxattr_or_die(a->links->path, name_ptrs_a[i],
+		len_a = lgetxattr_or_die(path_a, name_ptrs_a[i],
 					 value_a, len_a);
-		len_b = lgetxattr_or_die(b->links->path, name_ptrs_b[i],
+		len_b = lgetxattr_or_die(path_b, name_ptrs_b[i],
 					 value_b, len_b);
 		assert((len_a >= 0) && (len_a == len_b));
 
@@ -584,7 +925,7 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
 	return ret;
 }
 #else /* !USE_XATTR */
-static int file_xattrs_equal(const struct file *a, const struct file *b)
+static int file_xattrs_equal(struct file *a, struct file *b)
 {
 	return TRUE;
 }
@@ -598,20 +939,19 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
  * Check whether the two files are considered equal attributes and can be
  * linked. This function does not compare content od the files!
  */
-static int file_may_link_to(const struct file *a, const struct file *b)
+static int file_may_link_to(struct file *a, struct file *b)
 {
-	return (a->st.st_size != 0 &&
-		a->st.st_size == b->st.st_size &&
+	return (a->size != 0 &&
+		a->size == b->size &&
 		a->links != NULL && b->links != NULL &&
-		a->st.st_dev == b->st.st_dev &&
-		a->st.st_ino != b->st.st_ino &&
-		(!opts.respect_mode || a->st.st_mode == b->st.st_mode) &&
-		(!opts.respect_owner || a->st.st_uid == b->st.st_uid) &&
-		(!opts.respect_owner || a->st.st_gid == b->st.st_gid) &&
-		(!opts.respect_time || a->st.st_mtime == b->st.st_mtime) &&
+		a->dev == b->dev &&
+		a->ino != b->ino &&
+		(!opts.respect_mode || a->mode == b->mode) &&
+		(!opts.respect_owner || a->uid == b->uid) &&
+		(!opts.respect_owner || a->gid == b->gid) &&
+		(!opts.respect_time || a->mtim.tv_sec == b->mtim.tv_sec) &&
 		(!opts.respect_name
-		 || strcmp(a->links->path + a->links->basename,
-			   b->links->path + b->links->basename) == 0) &&
+		 || strcmp(a->links->name, b->links->name) == 0) &&
 		(!opts.respect_xattrs || file_xattrs_equal(a, b)));
 }
 
@@ -627,18 +967,18 @@ static int file_may_link_to(const struct file *a, const struct file *b)
 static int file_compare(const struct file *a, const struct file *b)
 {
 	int res = 0;
-	if (a->st.st_dev == b->st.st_dev && a->st.st_ino == b->st.st_ino)
+	if (a->dev == b->dev && a->ino == b->ino)
 		return 0;
 
 	if (res == 0 && opts.maximise)
-		res = CMP(a->st.st_nlink, b->st.st_nlink);
+		res = CMP(a->nlink, b->nlink);
 	if (res == 0 && opts.minimise)
-		res = CMP(b->st.st_nlink, a->st.st_nlink);
+		res = CMP(b->nlink, a->nlink);
 	if (res == 0)
-		res = opts.keep_oldest ? CMP(b->st.st_mtime, a->st.st_mtime)
-		    : CMP(a->st.st_mtime, b->st.st_mtime);
+		res = opts.keep_oldest ? CMP(b->mtim.tv_sec, a->mtim.tv_sec)
+		    : CMP(a->mtim.tv_sec, b->mtim.tv_sec);
 	if (res == 0)
-		res = CMP(b->st.st_ino, a->st.st_ino);
+		res = CMP(b->ino, a->ino);
 
 	return res;
 }
@@ -653,11 +993,11 @@ static inline int do_link(struct file *a, struct file *b,
 		dest = open(new_name, O_CREAT|O_WRONLY|O_TRUNC, 0600);
 		if (dest < 0)
 			goto fallback;
-		if (fchmod(dest, b->st.st_mode) != 0)
+		if (fchmod(dest, b->mode) != 0)
 			goto fallback;
-		if (fchown(dest, b->st.st_uid, b->st.st_gid) != 0)
+		if (fchown(dest, b->uid, b->gid) != 0)
 			goto fallback;
-		src = open(a->links->path, O_RDONLY);
+		src = open(file_path(a), O_RDONLY);
 		if (src < 0)
 			goto fallback;
 		if (ioctl(dest, FICLONE, src) != 0)
@@ -678,7 +1018,7 @@ fallback:
 		jlog(JLOG_VERBOSE2,_("Reflinking failed, fallback to hardlinking"));
 	}
 
-	return link(a->links->path, new_name);
+	return link(file_path(a), new_name);
 }
 #else
 static inline int do_link(struct file *a,
@@ -686,7 +1026,7 @@ static inline int do_link(struct file *a,
 			  const char *new_name,
 			  int reflink __attribute__((__unused__)))
 {
-	return link(a->links->path, new_name);
+	return link(file_path(a), new_name);
 }
 #endif /* USE_REFLINK */
 
@@ -701,19 +1041,22 @@ static inline int do_link(struct file *a,
  */
 static int file_link(struct file *a, struct file *b, int reflink)
 {
+	char *b_path;
 
  file_link:
 	assert(a->links != NULL);
 	assert(b->links != NULL);
 
+	b_path = link_path(b->links);
+
 	if (is_log_enabled(JLOG_INFO)) {
 		char *ssz = size_to_human_string(SIZE_SUFFIX_3LETTER |
 				   SIZE_SUFFIX_SPACE |
-				   SIZE_DECIMAL_2DIGITS, a->st.st_size);
+				   SIZE_DECIMAL_2DIGITS, a->size);
 		jlog(JLOG_INFO, _("%s%sLinking %s to %s (-%s)"),
 		     opts.dry_run ? _("[DryRun] ") : "",
 		     reflink ? "Ref" : "",
-		     a->links->path, b->links->path,
+		     file_path(a), b_path,
 		     ssz);
 		free(ssz);
 	}
@@ -722,31 +1065,34 @@ static int file_link(struct file *a, struct file *b, int reflink)
 		char *new_path;
 		int failed = 1;
 
-		xasprintf(&new_path, "%s.hardlink-temporary", b->links->path);
+		xasprintf(&new_path, "%s.hardlink-temporary", b_path);
 
 		if (do_link(a, b, new_path, reflink) != 0)
-			warn(_("cannot link %s to %s"), a->links->path, new_path);
+			warn(_("cannot link %s to %s"), file_path(a), new_path);
 
-		else if (rename(new_path, b->links->path) != 0) {
-			warn(_("cannot rename %s to %s"), a->links->path, new_path);
+		else if (rename(new_path, b_path) != 0) {
+			warn(_("cannot rename %s to %s"), file_path(a), new_path);
 			unlink(new_path);
 		} else
 			failed = 0;
 
 		free(new_path);
-		if (failed)
+		if (failed) {
+			free(b_path);
 			return FALSE;
+		}
 	}
+	free(b_path);
 
 	/* Update statistics */
 	stats.linked++;
 
 	/* Increase the link count of this file, and set stat() of other file */
-	a->st.st_nlink++;
-	b->st.st_nlink--;
+	a->nlink++;
+	b->nlink--;
 
-	if (b->st.st_nlink == 0)
-		stats.saved += a->st.st_size;
+	if (b->nlink == 0)
+		stats.saved += a->size;
 
 	/* Move the link from file b to a */
 	{
@@ -764,45 +1110,49 @@ static int file_link(struct file *a, struct file *b, int reflink)
 	return TRUE;
 }
 
-static int has_fpath(struct file *node, const char *path)
+static int has_fpath(struct file *node, const char *dir, const char *name)
 {
 	struct link *l;
 
+	/* the directory names are pooled */
 	for (l = node->links; l; l = l->next) {
-		if (strcmp(l->path, path) == 0)
+		if (l->dir == dir && strcmp(l->name, name) == 0)
 			return 1;
 	}
 
 	return 0;
 }
 
+/* The stat() information for ul_fileeq_cache_*() */
+static void file_get_stat(const struct file *f, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = f->dev;
+	st->st_ino = f->ino;
+	st->st_size = f->size;
+	st->st_mode = f->mode;
+	st->st_uid = f->uid;
+	st->st_gid = f->gid;
+	st->st_nlink = f->nlink;
+	st->st_mtim = f->mtim;
+	st->st_ctim = f->ctim;
+}
 
 /**
- * inserter - Callback function for nftw()
- * @fpath: The path of the file being visited
+ * insert_file - Add a regular file to the indexes
+ * @fpath: The path of the file
  * @sb:    The stat information of the file
- * @typeflag: The type flag
- * @ftwbuf:   Contains current level of nesting and offset of basename
- *
- * Called by nftw() for the files. See the manual page for nftw() for
- * further information.
+ * @base:  The offset of the basename in @fpath
  */
-static int inserter(const char *fpath, const struct stat *sb,
-		    int typeflag, struct FTW *ftwbuf)
+static int insert_file(const char *fpath, const struct stat *sb, int base)
 {
-	struct file *fil;
-	struct file **node;
-	size_t pathlen;
+	struct file *fil, **node;
+	struct link *lnk;
+	const char *dir;
+	size_t namesz;
 	int included;
 	int excluded;
 
-	if (handle_interrupt())
-		return 1;
-	if (typeflag == FTW_DNR || typeflag == FTW_NS)
-		warn(_("cannot read %s"), fpath);
-	if (typeflag != FTW_F || !S_ISREG(sb->st_mode))
-		return 0;
-
 	included = match_any_regex(opts.include, fpath);
 	excluded = match_any_regex(opts.exclude, fpath);
 
@@ -828,70 +1178,331 @@ static int inserter(const char *fpath, const struct stat *sb,
 		return 0;
 	}
 
-	pathlen = strlen(fpath) + 1;
-
-	fil = xcalloc(1, sizeof(*fil));
-	fil->links = xcalloc(1, sizeof(struct link) + pathlen);
-
-	fil->st = *sb;
-	fil->links->basename = ftwbuf->base;
-	fil->links->next = NULL;
+	dir = get_dirname(fpath, base);
+	namesz = strlen(fpath + base) + 1;
 
-	memcpy(fil->links->path, fpath, pathlen);
+	node = find_inode(sb->st_dev, sb->st_ino, fpath + base);
 
-	node = tsearch(fil, &files_by_ino, compare_nodes_ino);
-
-	if (node == NULL)
-		goto fail;
-
-	if (*node != fil) {
+	if (*node) {
 		/* Already known inode, add link to inode information */
-		assert((*node)->st.st_dev == sb->st_dev);
-		assert((*node)->st.st_ino == sb->st_ino);
+		fil = *node;
+		assert(fil->dev == sb->st_dev);
+		assert(fil->ino == sb->st_ino);
 
-		if (has_fpath(*node, fpath)) {
+		if (has_fpath(fil, dir, fpath + base)) {
 			jlog(JLOG_VERBOSE1,
 				_("Skipped %s (specified more than once)"), fpath);
-			free(fil->links);
-		} else {
-			fil->links->next = (*node)->links;
-			(*node)->links = fil->links;
+			return 0;
 		}
 
-		free(fil);
+		lnk = arena_alloc(sizeof(struct link) + namesz);
+		lnk->dir = dir;
+		memcpy(lnk->name, fpath + base, namesz);
+		lnk->next = fil->links;
+		fil->links = lnk;
+		return 0;
+	}
+
+	/* New inode */
+	fil = arena_alloc(sizeof(*fil));
+	fil->dev = sb->st_dev;
+	fil->ino = sb->st_ino;
+	fil->size = sb->st_size;
+	fil->mode = sb->st_mode;
+	fil->uid = sb->st_uid;
+	fil->gid = sb->st_gid;
+	fil->nlink = sb->st_nlink;
+	fil->mtim = sb->st_mtim;
+	fil->ctim = sb->st_ctim;
+
+	lnk = arena_alloc(sizeof(struct link) + namesz);
+	lnk->dir = dir;
+	memcpy(lnk->name, fpath + base, namesz);
+	fil->links = lnk;
+
+	*node = fil;
+	files_by_ino.count++;
+
+	/* insert into by-size group */
+	node = find_group(fil);
+
+	if (*node == NULL) {
+		*node = fil;
+		files_by_group.count++;
+
+	} else if (file_compare(fil, *node) >= 0) {
+		fil->next = *node;
+		*node = fil;
 	} else {
-		/* New inode, insert into by-size table */
-		node = tsearch(fil, &files, compare_nodes);
+		struct file *l;
 
-		if (node == NULL)
-			goto fail;
+		for (l = *node; l != NULL; l = l->next) {
+			if (l->next != NULL
+			    && file_compare(fil, l->next) < 0)
+				continue;
 
-		if (*node != fil) {
-			struct file *l;
+			fil->next = l->next;
+			l->next = fil;
 
-			if (file_compare(fil, *node) >= 0) {
-				fil->next = *node;
-				*node = fil;
-			} else {
-				for (l = *node; l != NULL; l = l->next) {
-					if (l->next != NULL
-					    && file_compare(fil, l->next) < 0)
-						continue;
+			break;
+		}
+	}
 
-					fil->next = l->next;
-					l->next = fil;
+	return 0;
+}
 
-					break;
-				}
-			}
+/**
+ * inserter - Callback function for nftw()
+ * @fpath: The path of the file being visited
+ * @sb:    The stat information of the file
+ * @typeflag: The type flag
+ * @ftwbuf:   Contains current level of nesting and offset of basename
+ *
+ * Called by nftw() for the files. See the manual page for nftw() for
+ * further information.
+ */
+static int inserter(const char *fpath, const struct stat *sb,
+		    int typeflag, struct FTW *ftwbuf)
+{
+	if (handle_interrupt())
+		return 1;
+	if (typeflag == FTW_DNR || typeflag == FTW_NS)
+		warn(_("cannot read %s"), fpath);
+	if (typeflag != FTW_F || !S_ISREG(sb->st_mode))
+		return 0;
+
+	return insert_file(fpath, sb, ftwbuf->base);
+}
+
+/*
+ * Parallel directory walking (--jobs)
+ *
+ * The directories are read by opts.njobs threads. The threads take the
+ * directories from a shared stack, stat() the entries, push the subdirectories
+ * back to the stack and collect the regular files to per-thread arrays. The
+ * indexes are not touched by the threads; the files are inserted by
+ * insert_file() in the main thread after the walk, sorted by the path, so the
+ * result does not depend on the number of threads.
+ */
+struct walk_entry {
+	char *path;
+	int base;			/* offset of the basename in the path */
+	size_t argno;			/* command line path index */
+	struct stat st;
+};
+
+struct walk_dir {
+	char *path;
+	size_t argno;
+	struct walk_dir *next;
+};
+
+struct walk_control {
+	struct walk_dir *dirs;		/* not yet read directories */
+	size_t nbusy;			/* number of threads reading a directory */
+	pthread_mutex_t lock;		/* protects @dirs and @nbusy */
+	pthread_cond_t cond;
+};
+
+struct walk_worker {
+	struct walk_control *walk;
+	struct walk_entry *ents;	/* found regular files */
+	size_t nents;
+	size_t nalloc;
+	pthread_t thread;
+};
+
+static void walk_push_dir(struct walk_control *walk, char *path, size_t argno)
+{
+	struct walk_dir *d = xmalloc(sizeof(*d));
+
+	d->path = path;
+	d->argno = argno;
+
+	pthread_mutex_lock(&walk->lock);
+	d->next = walk->dirs;
+	walk->dirs = d;
+	pthread_cond_signal(&walk->cond);
+	pthread_mutex_unlock(&walk->lock);
+}
+
+static void walk_add_file(struct walk_worker *wk, char *path, int base,
+			  size_t argno, const struct stat *st)
+{
+	struct walk_entry *e;
+
+	if (wk->nents == wk->nalloc) {
+		wk->nalloc = wk->nalloc ? wk->nalloc * 2 : 1024;
+		wk->ents = xrealloc(wk->ents, wk->nalloc * sizeof(*wk->ents));
+	}
+	e = &wk->ents[wk->nents++];
+	e->path = path;
+	e->base = base;
+	e->argno = argno;
+	e->st = *st;
+}
+
+static void walk_read_dir(struct walk_worker *wk, struct walk_dir *d)
+{
+	struct dirent *de;
+	DIR *dir;
+	size_t len = strlen(d->path);
+	const char *sep = len && d->path[len - 1] == '/' ? "" : "/";
+
+	dir = opendir(d->path);
+	if (!dir) {
+		warn(_("cannot read %s"), d->path);
+		return;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		struct stat st;
+		char *path;
+
+		if (is_interrupted())
+			break;
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (de->d_type != DT_UNKNOWN && de->d_type != DT_REG
+		    && de->d_type != DT_DIR)
+			continue;
+#endif
+		xasprintf(&path, "%s%s%s", d->path, sep, de->d_name);
+
+		if (fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			warn(_("cannot read %s"), path);
+			free(path);
+		} else if (S_ISDIR(st.st_mode))
+			walk_push_dir(wk->walk, path, d->argno);
+		else if (S_ISREG(st.st_mode))
+			walk_add_file(wk, path, len + strlen(sep), d->argno, &st);
+		else
+			free(path);
+	}
+	closedir(dir);
+}
+
+static void *walk_directories(void *data)
+{
+	struct walk_worker *wk = data;
+	struct walk_control *walk = wk->walk;
+
+	pthread_mutex_lock(&walk->lock);
+	for (;;) {
+		struct walk_dir *d;
+
+		while (!walk->dirs && walk->nbusy && !is_interrupted())
+			pthread_cond_wait(&walk->cond, &walk->lock);
+		if (!walk->dirs || is_interrupted())
+			break;
+
+		d = walk->dirs;
+		walk->dirs = d->next;
+		walk->nbusy++;
+		pthread_mutex_unlock(&walk->lock);
+
+		walk_read_dir(wk, d);
+		free(d->path);
+		free(d);
+
+		pthread_mutex_lock(&walk->lock);
+		walk->nbusy--;
+	}
+	/* wake up the others, there is nothing to do anymore */
+	pthread_cond_broadcast(&walk->cond);
+	pthread_mutex_unlock(&walk->lock);
+
+	return NULL;
+}
+
+static int cmp_walk_entries(const void *a, const void *b)
+{
+	const struct walk_entry *x = a, *y = b;
+
+	if (x->argno != y->argno)
+		return CMP(x->argno, y->argno);
+	return strcmp(x->path, y->path);
+}
+
+/**
+ * walk_paths - Walk the paths by opts.njobs threads
+ * @paths: The canonicalized paths from the command line
+ * @npaths: The number of the paths
+ *
+ * The same as nftw() with inserter() for all the paths, but the order of
+ * the files is not the same.
+ */
+static void walk_paths(char **paths, size_t npaths)
+{
+	struct walk_control walk = { .dirs = NULL };
+	struct walk_worker *workers;
+	struct walk_entry *ents;
+	size_t i, n, nents = 0;
+
+	workers = xcalloc(opts.njobs, sizeof(*workers));
+	pthread_mutex_init(&walk.lock, NULL);
+	pthread_cond_init(&walk.cond, NULL);
+
+	for (i = 0; i < npaths; i++) {
+		struct stat st;
+		char *p;
+
+		if (lstat(paths[i], &st) != 0) {
+			warn(_("cannot process %s"), paths[i]);
+			continue;
 		}
+		p = xstrdup(paths[i]);
+		if (S_ISDIR(st.st_mode))
+			walk_push_dir(&walk, p, i);
+		else if (S_ISREG(st.st_mode)) {
+			char *base = strrchr(p, '/');
+			walk_add_file(&workers[0], p, base ? base - p + 1 : 0, i, &st);
+		} else
+			free(p);
 	}
 
-	return 0;
+	for (i = 0; i < opts.njobs; i++) {
+		workers[i].walk = &walk;
+		errno = pthread_create(&workers[i].thread, NULL,
+				       walk_directories, &workers[i]);
+		if (errno)
+			err(EXIT_FAILURE, _("failed to create thread"));
+	}
+	for (i = 0; i < opts.njobs; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nents += workers[i].nents;
+	}
 
- fail:
-	warn(_("cannot continue"));	/* probably ENOMEM */
-	return 0;
+	/* interrupted */
+	while (walk.dirs) {
+		struct walk_dir *d = walk.dirs;
+
+		walk.dirs = d->next;
+		free(d->path);
+		free(d);
+	}
+	pthread_mutex_destroy(&walk.lock);
+	pthread_cond_destroy(&walk.cond);
+
+	ents = xmalloc(max(nents, (size_t) 1) * sizeof(*ents));
+	for (i = 0, n = 0; i < opts.njobs; i++) {
+		if (workers[i].nents)
+			memcpy(ents + n, workers[i].ents,
+			       workers[i].nents * sizeof(*ents));
+		n += workers[i].nents;
+		free(workers[i].ents);
+	}
+	free(workers);
+
+	qsort(ents, nents, sizeof(*ents), cmp_walk_entries);
+
+	for (i = 0; i < nents; i++) {
+		if (!handle_interrupt())
+			insert_file(ents[i].path, &ents[i].st, ents[i].base);
+		free(ents[i].path);
+	}
+	free(ents);
 }
 
 #ifdef USE_REFLINK
@@ -930,8 +1541,8 @@ static int is_reflink(struct file *xa, struct file *xb)
 	struct fiemap *amap = (struct fiemap *) abuf,
 		      *bmap = (struct fiemap *) bbuf;
 
-	int af = open(xa->links->path, O_RDONLY),
-	    bf = open(xb->links->path, O_RDONLY);
+	int af = open(file_path(xa), O_RDONLY),
+	    bf = open(file_path(xb), O_RDONLY);
 
 	if (af < 0 || bf < 0)
 		goto done;
@@ -996,28 +1607,87 @@ static inline size_t count_nodes(struct file *x)
 }
 
 /**
- * visitor - Callback for twalk()
- * @nodep: Pointer to a pointer to a #struct file
- * @which: At which point this visit is (preorder, postorder, endorder)
- * @depth: The depth of the node in the tree
+ * file_data_init - Prepare file content comparison
+ * @eq: The comparator with sizes set for the file
+ * @f: The file
+ *
+ * Returns: 1 if the intro or checksums have been found in the --cache-file.
+ */
+static int file_data_init(struct ul_fileeq *eq, struct file *f)
+{
+	struct stat st;
+
+	ul_fileeq_data_set_file(f->data, file_path(f));
+	if (!digest_cache)
+		return 0;
+
+	file_get_stat(f, &st);
+	return ul_fileeq_cache_load(digest_cache, eq, f->data, &st);
+}
+
+/**
+ * file_data_deinit - Free file content comparison data
+ * @eq: The comparator with sizes used for the file
+ * @f: The file
+ *
+ * The intro and checksums are saved to the --cache-file.
+ */
+static void file_data_deinit(struct ul_fileeq *eq, struct file *f)
+{
+	if (digest_cache) {
+		struct stat st;
+
+		file_get_stat(f, &st);
+		ul_fileeq_cache_store(digest_cache, eq, f->data, &st);
+	}
+	ul_fileeq_data_deinit(f->data);
+}
+
+/**
+ * group_init - Prepare the files of the group for link_group()
+ * @begin: The first #struct file in the linked list
+ * @nfiles: The number of files in the list
  *
- * Visit the nodes in the binary tree. For each node, call hardlinker()
- * on each #struct file in the linked list of #struct file instances located
- * at that node.
+ * Returns: the comparison data for the files
  */
-static void visitor(const void *nodep, const VISIT which, const int depth)
+static struct ul_fileeq_data *group_init(struct file *begin, size_t nfiles)
 {
-	struct file *master = *(struct file **)nodep;
-	struct file *begin = master;
+	struct ul_fileeq_data *data = xcalloc(nfiles, sizeof(*data));
+	struct file *f;
+	size_t i;
+
+	for (i = 0, f = begin; f != NULL; f = f->next)
+		f->data = &data[i++];
+	return data;
+}
+
+/**
+ * link_group - Compare and link files of the same size
+ * @begin: The first #struct file in the linked list
+ *
+ * Compare each #struct file in the linked list with the following files and
+ * replace the equal files by links.
+ */
+static void link_group(struct file *begin)
+{
+	struct file *master = begin;
 	struct file *other;
+	struct ul_fileeq_data *data = NULL;
+	size_t memsiz, nfiles;
 
-	(void)depth;
+	if (!begin->next)
+		return;		/* nothing to compare */
 
-	if (which != leaf && which != endorder)
-		return;
+	/* per-file cache size; the same for all the group, because the cached
+	 * checksums depend on it */
+	nfiles = count_nodes(begin);
+	memsiz = opts.cache_size / nfiles;
+
+	/* not yet prepared by link_groups_parallel() */
+	if (!begin->data)
+		data = group_init(begin, nfiles);
 
 	for (; master != NULL; master = master->next) {
-		size_t nnodes, memsiz;
 		int may_reflink = 0;
 
 		if (handle_interrupt())
@@ -1025,22 +1695,15 @@ static void visitor(const void *nodep, const VISIT which, const int depth)
 		if (master->links == NULL)
 			continue;
 
-		/* calculate per file max memory use */
-		nnodes = count_nodes(master);
-		if (!nnodes)
-			continue;
-
-		/* per-file cache size */
-		memsiz = opts.cache_size / nnodes;
 		/*                                filesiz,      readsiz,      memsiz */
-		ul_fileeq_set_size(&fileeq, master->st.st_size, opts.io_size, memsiz);
+		ul_fileeq_set_size(&fileeq, master->size, opts.io_size, memsiz);
 
 #ifdef USE_REFLINK
 		if (reflink_mode || reflinks_skip) {
 			may_reflink =
 				reflink_mode == REFLINK_ALWAYS ? 1 :
-				is_reflink_compatible(master->st.st_dev,
-							    master->links->path);
+				is_reflink_compatible(master->dev,
+							    file_path(master));
 		}
 #endif
 		for (other = master->next; other != NULL; other = other->next) {
@@ -1050,7 +1713,7 @@ static void visitor(const void *nodep, const VISIT which, const int depth)
 				exit(EXIT_FAILURE);
 
 			assert(other != other->next);
-			assert(other->st.st_size == master->st.st_size);
+			assert(other->size == master->size);
 
 			if (!other->links)
 				continue;
@@ -1058,53 +1721,400 @@ static void visitor(const void *nodep, const VISIT which, const int depth)
 			/* check file attributes, etc. */
 			if (!file_may_link_to(master, other)) {
 				jlog(JLOG_VERBOSE2,
-				     _("Skipped (attributes mismatch) %s"), other->links->path);
+				     _("Skipped (attributes mismatch) %s"), file_path(other));
 				continue;
 			}
 #ifdef USE_REFLINK
 			if (may_reflink && reflinks_skip && is_reflink(master, other)) {
 				jlog(JLOG_VERBOSE2,
-				     _("Skipped (already reflink) %s"), other->links->path);
+				     _("Skipped (already reflink) %s"), file_path(other));
 				stats.ignored_reflinks++;
 				continue;
 			}
 #endif
 			/* initialize content comparison */
-			if (!ul_fileeq_data_associated(&master->data))
-				ul_fileeq_data_set_file(&master->data, master->links->path);
-			if (!ul_fileeq_data_associated(&other->data))
-				ul_fileeq_data_set_file(&other->data, other->links->path);
+			if (!ul_fileeq_data_associated(master->data))
+				stats.cache_hits += file_data_init(&fileeq, master);
+			if (!ul_fileeq_data_associated(other->data))
+				stats.cache_hits += file_data_init(&fileeq, other);
 
 			/* compare files */
-			eq = ul_fileeq(&fileeq, &master->data, &other->data);
+			eq = ul_fileeq(&fileeq, master->data, other->data);
 
 			/* reduce number of open files, keep only master open */
-			ul_fileeq_data_close_file(&other->data);
+			ul_fileeq_data_close_file(other->data);
 
 			stats.comparisons++;
 
 			if (!eq) {
 				jlog(JLOG_VERBOSE2,
-				     _("Skipped (content mismatch) %s"), other->links->path);
+				     _("Skipped (content mismatch) %s"), file_path(other));
 				continue;
 			}
 
 			/* link files */
 			if (!file_link(master, other, may_reflink) && errno == EMLINK) {
-				ul_fileeq_data_deinit(&master->data);
+				file_data_deinit(&fileeq, master);
 				master = other;
 			}
 		}
 
 		/* don't keep master data in memory */
-		ul_fileeq_data_deinit(&master->data);
+		file_data_deinit(&fileeq, master);
 	}
 
 	/* final cleanup */
 	for (other = begin; other != NULL; other = other->next) {
-		if (ul_fileeq_data_associated(&other->data))
-			ul_fileeq_data_deinit(&other->data);
+		if (ul_fileeq_data_associated(other->data))
+			file_data_deinit(&fileeq, other);
+		other->data = NULL;
+		free(other->path);
+		other->path = NULL;
 	}
+	free(data);
+}
+
+/**
+ * link_groups - Link the files in all the groups
+ */
+static void link_groups(void)
+{
+	struct file **groups;
+	size_t i, ngroups;
+
+	groups = get_groups(&ngroups);
+	index_free(&files_by_group);
+
+	for (i = 0; i < ngroups; i++)
+		link_group(groups[i]);
+	free(groups);
+}
+
+/*
+ * Parallel content hashing (--jobs)
+ *
+ * The size groups (see get_groups()) are listed in the same order as
+ * link_groups() uses and opts.njobs threads prepare them for link_group(). At first the
+ * intros of all files in the group are read. Then only the files with the
+ * same intro and attributes as another file in the group are read to the
+ * ul_fileeq_data checksums cache (and the next one is announced to the kernel
+ * for readahead meanwhile). The main thread waits for the groups in the same
+ * order and links them by link_group(), which finds the checksums in the
+ * cache, so the file system is modified by one thread only and the result
+ * is the same as without threads.
+ *
+ * The threads prepare at most opts.njobs + 1 groups in advance to keep the
+ * memory use bounded by the --cache-size for each of the groups.
+ */
+enum {
+	GROUP_INTRO = 0,		/* reading intros */
+	GROUP_HASH,			/* reading checksums of the candidates */
+	GROUP_DONE			/* ready for link_group() */
+};
+
+struct hash_group {
+	struct file *begin;		/* the linked list from the by-group index */
+	struct ul_fileeq_data *data;	/* comparison data for the files */
+	struct file **files;		/* the same files, the candidates first */
+	size_t nfiles;			/* number of files for the current stage */
+	size_t memsiz;			/* per-file cache size */
+
+	size_t next;			/* the first not yet started file */
+	size_t pending;			/* number of not yet finished files */
+	int stage;
+};
+
+struct hash_control {
+	struct hash_group *groups;
+	size_t ngroups;
+	size_t linking;			/* the group used by link_group() */
+	size_t window;			/* max. number of groups prepared in advance */
+	size_t nprepared;		/* number of groups with allocated data */
+	size_t ndone;			/* number of GROUP_DONE groups */
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct hash_worker {
+	struct hash_control *hash;
+	struct ul_fileeq eq;
+	size_t cache_hits;
+	pthread_t thread;
+};
+
+static struct hash_control hashing;
+
+/* Adds the group to the list for the threads */
+static void add_hash_group(struct file *begin)
+{
+	struct hash_group *g;
+
+	if (!begin->next)
+		return;		/* nothing to compare */
+
+	if ((hashing.ngroups % 1024) == 0)
+		hashing.groups = xrealloc(hashing.groups,
+				(hashing.ngroups + 1024) * sizeof(struct hash_group));
+	g = &hashing.groups[hashing.ngroups++];
+	memset(g, 0, sizeof(*g));
+
+	g->begin = begin;
+}
+
+/*
+ * Prepares the groups up to @end for the threads. It has to be called before
+ * the groups enter the window (see hash_control->linking), because the threads
+ * do not lock the group, and the data are allocated only for the window to
+ * keep the memory use bounded.
+ */
+static void prepare_hash_groups(struct hash_control *hash, size_t end)
+{
+	end = min(end, hash->ngroups);
+
+	for (; hash->nprepared < end; hash->nprepared++) {
+		struct hash_group *g = &hash->groups[hash->nprepared];
+		struct file *f;
+		size_t i;
+
+		g->nfiles = count_nodes(g->begin);
+		g->data = group_init(g->begin, g->nfiles);
+		g->files = xmalloc(g->nfiles * sizeof(struct file *));
+		for (i = 0, f = g->begin; f != NULL; f = f->next) {
+			/* the threads use the paths, compose them in advance */
+			file_path(f);
+			g->files[i++] = f;
+		}
+
+		g->memsiz = opts.cache_size / g->nfiles;
+		g->pending = g->nfiles;
+		g->stage = GROUP_INTRO;
+	}
+}
+
+/* Orders the files to have the possibly equal files side by side */
+static int cmp_hash_candidates(const void *_a, const void *_b)
+{
+	const struct file *a = *(const struct file * const *) _a;
+	const struct file *b = *(const struct file * const *) _b;
+	int diff;
+
+	/* files without intro (unreadable) at the end */
+	diff = CMP(a->data->nblocks == 0, b->data->nblocks == 0);
+	if (diff == 0)
+		diff = memcmp(a->data->intro, b->data->intro, sizeof(a->data->intro));
+	if (diff == 0 && opts.respect_mode)
+		diff = CMP(a->mode, b->mode);
+	if (diff == 0 && opts.respect_owner)
+		diff = CMP(a->uid, b->uid);
+	if (diff == 0 && opts.respect_owner)
+		diff = CMP(a->gid, b->gid);
+	if (diff == 0 && opts.respect_time)
+		diff = CMP(a->mtim.tv_sec, b->mtim.tv_sec);
+	if (diff == 0 && opts.respect_name)
+		diff = strcmp(a->links->name, b->links->name);
+	return diff;
+}
+
+/*
+ * Moves the files which may be linked to another file in the group according
+ * to the intro and attributes to the beginning of g->files[]. Returns the
+ * number of these files.
+ */
+static size_t sort_hash_candidates(struct hash_group *g)
+{
+	struct file **x = g->files, **tmp;
+	size_t i, k, ncands = 0;
+	char *cand;
+
+	qsort(x, g->nfiles, sizeof(struct file *), cmp_hash_candidates);
+
+	cand = xcalloc(g->nfiles, sizeof(char));
+	for (i = 0; i + 1 < g->nfiles; i++) {
+		if (x[i]->data->nblocks && cmp_hash_candidates(&x[i], &x[i + 1]) == 0)
+			cand[i] = cand[i + 1] = 1;
+	}
+	for (i = 0; i < g->nfiles; i++)
+		ncands += cand[i];
+
+	tmp = xmalloc(g->nfiles * sizeof(struct file *));
+	for (i = 0, k = 0; i < g->nfiles; i++) {
+		if (cand[i])
+			tmp[k++] = x[i];
+	}
+	for (i = 0; i < g->nfiles; i++) {
+		if (!cand[i])
+			tmp[k++] = x[i];
+	}
+	memcpy(x, tmp, g->nfiles * sizeof(struct file *));
+
+	free(tmp);
+	free(cand);
+	return ncands;
+}
+
+/* Asks kernel to read the beginning of the file to the page cache */
+static void readahead_file(struct file *f)
+{
+#if defined(POSIX_FADV_WILLNEED) && defined(HAVE_POSIX_FADVISE)
+	int fd = open(f->path, O_RDONLY);
+
+	if (fd < 0)
+		return;
+	ignore_result( posix_fadvise(fd, 0, min((off_t) opts.io_size, f->size),
+				     POSIX_FADV_WILLNEED) );
+	close(fd);
+#else
+	(void) f;
+#endif
+}
+
+static void hash_file(struct hash_worker *wk, struct hash_group *g,
+		      struct file *f, int stage)
+{
+	ul_fileeq_set_size(&wk->eq, f->size, opts.io_size, g->memsiz);
+
+	if (stage == GROUP_INTRO) {
+		wk->cache_hits += file_data_init(&wk->eq, f);
+		ul_fileeq_data_prefetch(&wk->eq, f->data, 0);
+	} else
+		ul_fileeq_data_prefetch(&wk->eq, f->data, SIZE_MAX);
+}
+
+static void *hash_groups(void *data)
+{
+	struct hash_worker *wk = data;
+	struct hash_control *hash = wk->hash;
+
+	pthread_mutex_lock(&hash->lock);
+
+	while (hash->ndone < hash->ngroups && !is_interrupted()) {
+		struct hash_group *g = NULL;
+		struct file *f, *ahead = NULL;
+		size_t i, end = min(hash->ngroups, hash->linking + hash->window);
+		int stage;
+
+		for (i = hash->linking; i < end; i++) {
+			if (hash->groups[i].stage != GROUP_DONE
+			    && hash->groups[i].next < hash->groups[i].nfiles) {
+				g = &hash->groups[i];
+				break;
+			}
+		}
+		if (!g) {
+			pthread_cond_wait(&hash->cond, &hash->lock);
+			continue;
+		}
+
+		f = g->files[g->next++];
+		stage = g->stage;
+		if (stage == GROUP_HASH && g->next < g->nfiles)
+			ahead = g->files[g->next];
+		pthread_mutex_unlock(&hash->lock);
+
+		if (ahead)
+			readahead_file(ahead);
+		hash_file(wk, g, f, stage);
+
+		pthread_mutex_lock(&hash->lock);
+		if (--g->pending)
+			continue;
+
+		/* the last file of the stage */
+		if (stage == GROUP_INTRO) {
+			size_t ncands;
+
+			/* nobody else touches the group now (next == nfiles) */
+			pthread_mutex_unlock(&hash->lock);
+			/* memcmp does not cache anything but the intro */
+			ncands = strcmp(opts.method, "memcmp") == 0 ?
+					0 : sort_hash_candidates(g);
+			pthread_mutex_lock(&hash->lock);
+
+			g->stage = GROUP_HASH;
+			g->nfiles = g->pending = ncands;
+			g->next = 0;
+		}
+		if (g->pending == 0) {
+			g->stage = GROUP_DONE;
+			hash->ndone++;
+		}
+		pthread_cond_broadcast(&hash->cond);
+	}
+
+	pthread_cond_broadcast(&hash->cond);
+	pthread_mutex_unlock(&hash->lock);
+	return NULL;
+}
+
+/**
+ * link_groups_parallel - Link files like link_groups() does
+ *
+ * The files are hashed by opts.njobs threads and linked by the calling
+ * thread.
+ */
+static void link_groups_parallel(void)
+{
+	struct hash_control *hash = &hashing;
+	struct hash_worker *workers;
+	struct file **groups;
+	size_t i, ngroups;
+
+	groups = get_groups(&ngroups);
+	index_free(&files_by_group);
+
+	for (i = 0; i < ngroups; i++)
+		add_hash_group(groups[i]);
+	free(groups);
+	if (!hash->ngroups)
+		return;
+
+	hash->window = opts.njobs + 1;
+	prepare_hash_groups(hash, hash->window);
+	pthread_mutex_init(&hash->lock, NULL);
+	pthread_cond_init(&hash->cond, NULL);
+
+	workers = xcalloc(opts.njobs, sizeof(*workers));
+	for (i = 0; i < opts.njobs; i++) {
+		workers[i].hash = hash;
+		if (ul_fileeq_init(&workers[i].eq, opts.method) != 0)
+			err(EXIT_FAILURE, _("failed to initialize files comparior"));
+		errno = pthread_create(&workers[i].thread, NULL,
+				       hash_groups, &workers[i]);
+		if (errno)
+			err(EXIT_FAILURE, _("failed to create thread"));
+	}
+
+	for (i = 0; i < hash->ngroups; i++) {
+		struct hash_group *g = &hash->groups[i];
+
+		/* the threads see the new groups after the linking update */
+		prepare_hash_groups(hash, i + hash->window);
+
+		pthread_mutex_lock(&hash->lock);
+		hash->linking = i;
+		pthread_cond_broadcast(&hash->cond);
+		while (g->stage != GROUP_DONE && !is_interrupted())
+			pthread_cond_wait(&hash->cond, &hash->lock);
+		pthread_mutex_unlock(&hash->lock);
+
+		if (handle_interrupt())
+			exit(EXIT_FAILURE);
+
+		link_group(g->begin);
+		free(g->files);
+		free(g->data);
+	}
+
+	for (i = 0; i < opts.njobs; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ul_fileeq_deinit(&workers[i].eq);
+		stats.cache_hits += workers[i].cache_hits;
+	}
+	free(workers);
+	free(hash->groups);
+	pthread_mutex_destroy(&hash->lock);
+	pthread_cond_destroy(&hash->cond);
 }
 
 /**
@@ -1151,6 +2161,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -b, --io-size <size>       I/O buffer size for file reading\n"
 	        "                              (speedup, using more RAM)\n"), out);
 	fputs(_(" -r, --cache-size <size>    memory limit for cached file content data\n"), out);
+	fputs(_("     --cache-file <file>    keep content checksums in the file for next runs\n"), out);
+	fputs(_(" -j, --jobs <num>           number of threads reading files (0 for all CPUs)\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(28));
@@ -1168,9 +2180,10 @@ static int parse_options(int argc, char *argv[])
 {
 	enum {
 		OPT_REFLINK = CHAR_MAX + 1,
-		OPT_SKIP_RELINKS
+		OPT_SKIP_RELINKS,
+		OPT_CACHE_FILE
 	};
-	static const char optstr[] = "VhvnfpotXcmMOx:y:i:r:S:s:b:q";
+	static const char optstr[] = "VhvnfpotXcmMOx:y:i:r:S:s:b:qj:";
 	static const struct option long_options[] = {
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
@@ -1197,6 +2210,8 @@ static int parse_options(int argc, char *argv[])
 		{"content", no_argument, NULL, 'c'},
 		{"quiet", no_argument, NULL, 'q'},
 		{"cache-size", required_argument, NULL, 'r'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"cache-file", required_argument, NULL, OPT_CACHE_FILE},
 		{NULL, 0, NULL, 0}
 	};
 	static const ul_excl_t excl[] = {
@@ -1272,6 +2287,16 @@ static int parse_options(int argc, char *argv[])
 		case 'b':
 			opts.io_size = strtosize_or_err(optarg, _("failed to parse I/O size"));
 			break;
+		case OPT_CACHE_FILE:
+			opts.cache_file = optarg;
+			break;
+		case 'j':
+			opts.njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (opts.njobs == 0) {
+				long n = sysconf(_SC_NPROCESSORS_ONLN);
+				opts.njobs = n > 0 ? (size_t) n : 1;
+			}
+			break;
 #ifdef USE_REFLINK
 		case OPT_REFLINK:
 			reflink_mode = REFLINK_AUTO;
@@ -1381,22 +2406,63 @@ int main(int argc, char *argv[])
 			opts.io_size = 1024*1024;
 	}
 
+	if (opts.cache_file) {
+		if (strcmp(opts.method, "memcmp") == 0)
+			warnx(_("%s method does not use checksums, ignore --cache-file"),
+			      opts.method);
+		else {
+			digest_cache = ul_fileeq_cache_open(&fileeq, opts.cache_file);
+			if (!digest_cache)
+				err(EXIT_FAILURE, _("cannot open %s"), opts.cache_file);
+		}
+	}
+
 	stats.started = TRUE;
 
 	jlog(JLOG_VERBOSE2, _("Scanning [device/inode/links]:"));
-	for (; optind < argc; optind++) {
-		char *path = realpath(argv[optind], NULL);
+	if (opts.njobs > 1) {
+		char **paths = xcalloc(argc - optind, sizeof(char *));
+		size_t i, npaths = 0;
+
+		for (; optind < argc; optind++) {
+			paths[npaths] = realpath(argv[optind], NULL);
+			if (!paths[npaths])
+				warn(_("cannot get realpath: %s"), argv[optind]);
+			else
+				npaths++;
+		}
+		walk_paths(paths, npaths);
 
-		if (!path) {
-			warn(_("cannot get realpath: %s"), argv[optind]);
-			continue;
+		for (i = 0; i < npaths; i++)
+			free(paths[i]);
+		free(paths);
+
+		index_free(&files_by_ino);
+		link_groups_parallel();
+	} else {
+		for (; optind < argc; optind++) {
+			char *path = realpath(argv[optind], NULL);
+
+			if (!path) {
+				warn(_("cannot get realpath: %s"), argv[optind]);
+				continue;
+			}
+			if (nftw(path, inserter, 20, FTW_PHYS) == -1)
+				warn(_("cannot process %s"), path);
+			free(path);
 		}
-		if (nftw(path, inserter, 20, FTW_PHYS) == -1)
-			warn(_("cannot process %s"), path);
-		free(path);
+
+		index_free(&files_by_ino);
+		link_groups();
 	}
 
-	twalk(files, visitor);
+	if (digest_cache) {
+		rc = ul_fileeq_cache_close(digest_cache);
+		if (rc != 0) {
+			errno = -rc;
+			warn(_("cannot write %s"), opts.cache_file);
+		}
+	}
 
 	ul_fileeq_deinit(&fileeq);
 	return 0;
@@ -52,6 +52,7 @@
 #include <getopt.h>
 #include <pwd.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/uio.h>
 
 #include "all-io.h"
@@ -64,6 +65,7 @@
 #include "strv.h"
 #include "list.h"
 #include "pwdutils.h"
+#include "monotonic.h"
 
 #define	SYSLOG_NAMES
 #include <syslog.h>
@@ -104,6 +106,32 @@ enum {
 	OPT_OCTET_COUNT
 };
 
+/*
+ * Messages read from stdin are sent in batches by sendmmsg(), the batch is
+ * flushed when it's full or when the first message is older than
+ * LOGGER_BATCH_TIMEOUT and no more input is ready.
+ */
+#define LOGGER_BATCH_MAX	64		/* messages in batch */
+#define LOGGER_BATCH_DATASZ	(64 * 1024)	/* message texts in batch */
+#define LOGGER_BATCH_TIMEOUT	10		/* milliseconds */
+
+struct logger_batch {
+	struct iovec	iov[LOGGER_BATCH_MAX * 4];
+	size_t		niov;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr	msgs[LOGGER_BATCH_MAX];
+#else
+	struct msghdr	msgs[LOGGER_BATCH_MAX];
+#endif
+	size_t		nmsgs;
+
+	char		*data;		/* octet counts and message texts */
+	size_t		datasz;
+	size_t		datamax;
+
+	struct timeval	deadline;
+};
+
 /* rfc5424 structured data */
 struct structured_data {
 	char *id;		/* SD-ID */
@@ -130,6 +158,9 @@ struct logger_ctl {
 
 	void (*syslogfp)(struct logger_ctl *ctl);
 
+	struct logger_batch *batch;	/* stdin messages not sent yet */
+	time_t hdr_time;		/* the header timestamp (seconds) */
+
 	unsigned int
 			unix_socket_errors:1,	/* whether to report or not errors */
 			noact:1,		/* do not write to sockets */
@@ -435,6 +466,23 @@ static char const *rfc3164_current_time(void)
 #define iovec_memcmp(ary, idx, str, len)		\
 		memcmp((ary)[(idx) - 1].iov_base, str, len)
 
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+#ifdef SCM_CREDENTIALS
+/* syslog/journald may follow local socket credentials rather
+ * than in the message PID. If we use --id as root than we can
+ * force kernel to accept another valid PID than the real logger(1)
+ * PID.
+ */
+static int use_credentials(const struct logger_ctl *ctl)
+{
+	return ctl->pid && !ctl->server && ctl->pid != getpid()
+	       && geteuid() == 0 && kill(ctl->pid, 0) == 0;
+}
+#endif
+
 /* writes generated buffer to desired destination. For TCP syslog,
  * we use RFC6587 octet-stuffing (unless octet-counting is selected).
  * This is not great, but doing full blown RFC5425 (TLS) looks like
@@ -482,13 +530,7 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 		message.msg_iovlen = iovlen;
 
 #ifdef SCM_CREDENTIALS
-		/* syslog/journald may follow local socket credentials rather
-		 * than in the message PID. If we use --id as root than we can
-		 * force kernel to accept another valid PID than the real logger(1)
-		 * PID.
-		 */
-		if (ctl->pid && !ctl->server && ctl->pid != getpid()
-		    && geteuid() == 0 && kill(ctl->pid, 0) == 0) {
+		if (use_credentials(ctl)) {
 
 			message.msg_control = cbuf.control;
 			message.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
@@ -511,9 +553,6 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 		 * MSG_NOSIGNAL is POSIX.1-2008 compatible, but it for example
 		 * not supported by apple-darwin15.6.0.
 		 */
-#ifndef MSG_NOSIGNAL
-# define MSG_NOSIGNAL 0
-#endif
 		if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0) {
 			logger_reopen(ctl);
 			if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0)
@@ -532,6 +571,218 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 	free(octet);
 }
 
+static void logger_batch_reset(struct logger_batch *b)
+{
+	b->niov = 0;
+	b->nmsgs = 0;
+	b->datasz = 0;
+}
+
+/* sends messages to a datagram socket, returns number of sent messages */
+static size_t batch_send_datagrams(struct logger_ctl *ctl, size_t from)
+{
+	struct logger_batch *b = ctl->batch;
+	size_t i = from;
+
+#ifdef HAVE_SENDMMSG
+	while (i < b->nmsgs) {
+		int rc = sendmmsg(ctl->fd, b->msgs + i, b->nmsgs - i, MSG_NOSIGNAL);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		i += rc;
+	}
+#else
+	for (; i < b->nmsgs; i++) {
+		if (sendmsg(ctl->fd, &b->msgs[i], MSG_NOSIGNAL) < 0)
+			break;
+	}
+#endif
+	return i - from;
+}
+
+static inline struct msghdr *batch_message(struct logger_batch *b, size_t i)
+{
+#ifdef HAVE_SENDMMSG
+	return &b->msgs[i].msg_hdr;
+#else
+	return &b->msgs[i];
+#endif
+}
+
+/* returns index of the first b->iov[] item after the message @i */
+static inline size_t batch_message_end(struct logger_batch *b, size_t i)
+{
+	struct msghdr *message = batch_message(b, i);
+
+	return (message->msg_iov - b->iov) + message->msg_iovlen;
+}
+
+/*
+ * Writes messages from @*from to a stream socket, returns 0 or -1 on error.
+ * The @*from is updated to the first not completely written message, so the
+ * caller may send the rest to another connection without breaking the
+ * framing. The batch is left intact.
+ */
+static int batch_send_stream(struct logger_ctl *ctl, size_t *from)
+{
+	struct logger_batch *b = ctl->batch;
+	size_t i, skip = 0;	/* b->iov[i] and bytes of it already written */
+
+	if (*from >= b->nmsgs)
+		return 0;
+	i = batch_message(b, *from)->msg_iov - b->iov;
+
+	while (i < b->niov) {
+		struct iovec first = b->iov[i];
+		struct msghdr message = {
+			.msg_iov = b->iov + i,
+			.msg_iovlen = min(b->niov - i, (size_t) IOV_MAX)
+		};
+		ssize_t rc;
+
+		b->iov[i].iov_base = (char *) first.iov_base + skip;
+		b->iov[i].iov_len = first.iov_len - skip;
+		rc = sendmsg(ctl->fd, &message, MSG_NOSIGNAL);
+		b->iov[i] = first;
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		/* skip already written data */
+		skip += rc;
+		while (i < b->niov && skip >= b->iov[i].iov_len) {
+			skip -= b->iov[i].iov_len;
+			i++;
+		}
+		while (*from < b->nmsgs && batch_message_end(b, *from) <= i)
+			(*from)++;
+	}
+	return 0;
+}
+
+/* sends all messages from the batch */
+static void logger_flush(struct logger_ctl *ctl)
+{
+	struct logger_batch *b = ctl->batch;
+
+	if (!b || !b->nmsgs)
+		return;
+
+	/* initial connect failed? */
+	if (!is_connected(ctl))
+		logger_reopen(ctl);
+
+	if (is_connected(ctl)) {
+		if (ctl->socket_type == TYPE_TCP) {
+			size_t n = 0;
+
+			if (batch_send_stream(ctl, &n) != 0) {
+				/* see write_output(); the interrupted message is
+				 * sent again from the beginning */
+				logger_reopen(ctl);
+				if (!is_connected(ctl) || batch_send_stream(ctl, &n) != 0)
+					warn(_("send message failed"));
+			}
+		} else {
+			size_t n = batch_send_datagrams(ctl, 0);
+
+			if (n < b->nmsgs) {
+				logger_reopen(ctl);
+				if (!is_connected(ctl) ||
+				    n + batch_send_datagrams(ctl, n) < b->nmsgs)
+					warn(_("send message failed"));
+			}
+		}
+	}
+	logger_batch_reset(b);
+}
+
+/* adds message to the batch; @msg is copied */
+static void logger_queue(struct logger_ctl *ctl, const char *msg, size_t len)
+{
+	struct logger_batch *b = ctl->batch;
+	size_t hdrlen = strlen(ctl->hdr);
+	struct iovec *iov;
+	size_t need = len + 32;		/* 32 for octet count */
+	struct msghdr *message;
+	char *octet = NULL;
+	int iovlen = 0;
+
+	if (b->nmsgs == LOGGER_BATCH_MAX || b->datasz + need > b->datamax)
+		logger_flush(ctl);
+	if (!b->nmsgs) {
+		gettime_monotonic(&b->deadline);
+		b->deadline.tv_usec += LOGGER_BATCH_TIMEOUT * 1000;
+		if (b->deadline.tv_usec >= 1000000) {
+			b->deadline.tv_sec++;
+			b->deadline.tv_usec -= 1000000;
+		}
+	}
+
+	iov = b->iov + b->niov;
+
+	/* 1) octet count */
+	if (ctl->octet_count) {
+		octet = b->data + b->datasz;
+		iov[iovlen].iov_base = octet;
+		iov[iovlen].iov_len = sprintf(octet, "%zu ", hdrlen + len);
+		b->datasz += iov[iovlen++].iov_len;
+	}
+
+	/* 2) header, shared by all messages in the batch */
+	iov[iovlen].iov_base = ctl->hdr;
+	iov[iovlen++].iov_len = hdrlen;
+
+	/* 3) message */
+	iov[iovlen].iov_base = memcpy(b->data + b->datasz, msg, len);
+	iov[iovlen++].iov_len = len;
+	b->datasz += len;
+
+	if (ctl->stderr_printout) {
+		struct iovec out[4];
+
+		memcpy(out, iov, iovlen * sizeof(*iov));
+		out[iovlen].iov_base = "\n";
+		out[iovlen].iov_len = 1;
+		ignore_result( writev(STDERR_FILENO, out, iovlen + 1) );
+	}
+
+	/* 4) add extra \n to make sure message is terminated */
+	if ((ctl->socket_type == TYPE_TCP) && !ctl->octet_count) {
+		iov[iovlen].iov_base = "\n";
+		iov[iovlen++].iov_len = 1;
+	}
+
+	message = batch_message(b, b->nmsgs);
+	memset(message, 0, sizeof(*message));
+	message->msg_iov = iov;
+	message->msg_iovlen = iovlen;
+
+	b->niov += iovlen;
+	b->nmsgs++;
+
+	if (b->nmsgs == LOGGER_BATCH_MAX)
+		logger_flush(ctl);
+}
+
+/* returns timeout in milliseconds for the first message in the batch */
+static int logger_batch_timeout(const struct logger_batch *b)
+{
+	struct timeval now, diff;
+
+	gettime_monotonic(&now);
+	if (!timercmp(&now, &b->deadline, <))
+		return 0;
+	timersub(&b->deadline, &now, &diff);
+	return diff.tv_sec * 1000 + (diff.tv_usec + 999) / 1000;
+}
+
 #define NILVALUE "-"
 static void syslog_rfc3164_header(struct logger_ctl *const ctl)
 {
@@ -992,12 +1243,66 @@ static void logger_command_line(struct logger_ctl *ctl, char **argv)
 	free(buf);
 }
 
+/* stdin reader; the batch is flushed when no more input is ready */
+struct logger_input {
+	int	fd;
+	size_t	pos;
+	size_t	len;
+	char	buf[BUFSIZ];
+};
+
+static int logger_getchar(struct logger_ctl *ctl, struct logger_input *in)
+{
+	ssize_t rc;
+
+	if (in->pos < in->len)
+		return (unsigned char) in->buf[in->pos++];
+	if (in->fd < 0)
+		return EOF;
+
+	if (ctl->batch && ctl->batch->nmsgs) {
+		struct pollfd pfd = { .fd = in->fd, .events = POLLIN };
+		int timeout = logger_batch_timeout(ctl->batch);
+
+		if (!timeout || poll(&pfd, 1, timeout) == 0)
+			logger_flush(ctl);
+	}
+
+	do {
+		rc = read(in->fd, in->buf, sizeof(in->buf));
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc <= 0) {
+		in->fd = -1;		/* EOF or error */
+		return EOF;
+	}
+	in->pos = 1;
+	in->len = rc;
+	return (unsigned char) in->buf[0];
+}
+
+/* re-generates the header when the timestamp (in seconds) is changed */
+static void logger_update_header(struct logger_ctl *ctl)
+{
+	struct timeval tv;
+
+	logger_gettimeofday(&tv, NULL);
+	if (tv.tv_sec == ctl->hdr_time)
+		return;
+
+	logger_flush(ctl);
+	generate_syslog_header(ctl);
+	ctl->hdr_time = tv.tv_sec;
+}
+
 static void logger_stdin(struct logger_ctl *ctl)
 {
-	/* note: we re-generate the syslog header for each log message to
-	 * update header timestamps and to reflect possible priority changes.
-	 * The initial header is generated by logger_open().
+	/* note: we re-generate the syslog header when the timestamp
+	 * (in seconds) or the priority is changed. The header is shared
+	 * by all messages until then. The initial header is generated by
+	 * logger_open().
 	 */
+	struct logger_input in = { .fd = fileno(stdin) };
 	int default_priority = ctl->pri;
 	int last_pri = default_priority;
 	char *buf = xmalloc(ctl->max_message_size + 2 + 2);
@@ -1005,13 +1310,24 @@ static void logger_stdin(struct logger_ctl *ctl)
 	int c;
 	size_t i;
 
-	c = getchar();
+	if (!ctl->noact
+#ifdef SCM_CREDENTIALS
+	    && !use_credentials(ctl)
+#endif
+	    ) {
+		ctl->batch = xcalloc(1, sizeof(*ctl->batch));
+		ctl->batch->datamax = max((size_t) LOGGER_BATCH_DATASZ,
+					  ctl->max_message_size + 32);
+		ctl->batch->data = xmalloc(ctl->batch->datamax);
+	}
+
+	c = logger_getchar(ctl, &in);
 	while (c != EOF) {
 		i = 0;
 		if (ctl->prio_prefix && c == '<') {
 			pri = 0;
 			buf[i++] = c;
-			while (isdigit(c = getchar()) && pri <= 191) {
+			while (isdigit(c = logger_getchar(ctl, &in)) && pri <= 191) {
 				buf[i++] = c;
 				pri = pri * 10 + c - '0';
 			}
@@ -1027,26 +1343,38 @@ static void logger_stdin(struct logger_ctl *ctl)
 				ctl->pri = default_priority;
 
 			if (ctl->pri != last_pri) {
+				logger_flush(ctl);
 				generate_syslog_header(ctl);
 				last_pri = ctl->pri;
 			}
 			if (c != EOF && c != '\n')
-				c = getchar();
+				c = logger_getchar(ctl, &in);
 		}
 
 		while (c != EOF && c != '\n' && i < ctl->max_message_size) {
 			buf[i++] = c;
-			c = getchar();
+			c = logger_getchar(ctl, &in);
 		}
 		buf[i] = '\0';
 
-		if (i > 0 || !ctl->skip_empty_lines)
-			write_output(ctl, buf);
+		if (i > 0 || !ctl->skip_empty_lines) {
+			logger_update_header(ctl);
+			if (ctl->batch)
+				logger_queue(ctl, buf, i);
+			else
+				write_output(ctl, buf);
+		}
 
 		if (c == '\n')	/* discard line terminator */
-			c = getchar();
+			c = logger_getchar(ctl, &in);
 	}
 
+	if (ctl->batch) {
+		logger_flush(ctl);
+		free(ctl->batch->data);
+		free(ctl->batch);
+		ctl->batch = NULL;
+	}
 	free(buf);
 }
 
@@ -115,12 +115,18 @@ static struct ipc_class *fifo_get_ipc_class(struct file *file __attribute__((__u
 }
 
 static void fifo_initialize_content(struct file *file)
+{
+	struct fifo *fifo = (struct fifo *)file;
+
+	INIT_LIST_HEAD(&fifo->endpoint.endpoints);
+}
+
+static void fifo_attach_ipc(struct file *file)
 {
 	struct fifo *fifo = (struct fifo *)file;
 	struct ipc *ipc;
 	unsigned int hash;
 
-	INIT_LIST_HEAD(&fifo->endpoint.endpoints);
 	ipc = get_ipc(file);
 	if (ipc)
 		goto link;
@@ -145,4 +151,5 @@ const struct file_class fifo_class = {
 	.initialize_content = fifo_initialize_content,
 	.free_content = NULL,
 	.get_ipc_class = fifo_get_ipc_class,
+	.attach_ipc = fifo_attach_ipc,
 };
@@ -21,7 +21,7 @@
 /*
  * Definitions
  */
-#define COL_HEADER_EXTRA_CHARS ":-_%" /* ??? */
+#define COL_HEADER_EXTRA_CHARS ":-_%." /* ??? */
 #define GOT_ERROR(PARSERorFILTER)(*((PARSERorFILTER)->errmsg))
 
 /*
@@ -29,7 +29,7 @@
  */
 
 enum token_type {
-	TOKEN_NAME,		/* [A-Za-z_][-_:%A-Za-z0-9]* */
+	TOKEN_NAME,		/* [A-Za-z_][-_:%.A-Za-z0-9]* */
 	TOKEN_STR,		/* "...", '...' */
 	TOKEN_DEC,		/* [1-9][0-9]+, NOTE: negative value is no dealt. */
 	TOKEN_HEX,		/* 0x[0-9a-f]+ not implemented */
@@ -78,7 +78,11 @@ struct token_class {
 
 struct parameter {
 	struct libscols_column *cl;
+	int col_id;
 	bool has_value;
+	/* fills the cell of the column on demand, see lsfd_filter_apply_lazily() */
+	lsfd_filter_fill_fn fill;
+	void *fill_data;
 	union {
 		const char *str;
 		unsigned long long num;
@@ -139,6 +143,7 @@ struct node_val {
 		bool boolean;
 		regex_t re;
 	} val;
+	char *re_src;		/* the source of NODE_RE */
 };
 
 struct node_op1 {
@@ -159,11 +164,90 @@ struct node_class {
 	void (*dump)(struct node *, struct parameter*, int, FILE *);
 };
 
+/*
+ * Compiled filter
+ *
+ * The AST is compiled to a flat code for a small stack machine. The
+ * comparisons are the leaves of the code; the values of the columns and
+ * the results of the leaves are kept in struct lsfd_filter_cache for the
+ * current line, so filters sharing the cache (e.g. the counters of
+ * --summary) don't fetch the same column or evaluate the same comparison
+ * more than once for a line. The numbers are converted only once too.
+ */
+enum insn_type {
+	INSN_PUSH,		/* push arg (0 or 1) */
+	INSN_LEAF,		/* push the result of leaves[arg] */
+	INSN_NOT,
+	INSN_EQ,		/* compare two booleans on the top of the stack */
+	INSN_NE,
+	INSN_JFALSE,		/* jump to arg if the top is false, otherwise pop */
+	INSN_JTRUE,		/* jump to arg if the top is true, otherwise pop */
+};
+
+struct insn {
+	enum insn_type type;
+	int arg;
+};
+
+#define LEAF_BOOL -1		/* a boolean column rather than OP2_* */
+
+struct operand {
+	int col_id;		/* or -1 for a literal */
+	union {
+		const char *str;
+		unsigned long long num;
+		bool boolean;
+	} val;
+};
+
+struct leaf {
+	int op;			/* enum op2_type or LEAF_BOOL */
+	enum node_type type;	/* type of the operands */
+	struct operand args[2];
+	regex_t *re;		/* for OP2_RE_MATCH and OP2_RE_UNMATCH */
+	size_t slot;		/* index in lsfd_filter_cache->leaves */
+};
+
+struct cache_column {
+	unsigned int generation;
+	bool null;		/* no data in the cell */
+	union {
+		const char *str;
+		unsigned long long num;
+		bool boolean;
+	} val;
+};
+
+struct cache_leaf {
+	char *key;		/* the comparison in text form */
+	unsigned int generation;
+	bool result;
+};
+
+struct lsfd_filter_cache {
+	int refcount;
+	unsigned int generation;	/* incremented for every line */
+	int ncols;
+	struct cache_column *columns;	/* indexed by column ID */
+	struct cache_leaf *leaves;
+	size_t nleaves;
+};
+
 struct lsfd_filter {
 	struct libscols_table *table;
 	struct node  *node;
 	struct parameter *parameters;
 	int nparams;
+
+	struct insn *code;
+	size_t ncode;
+	struct leaf *leaves;
+	size_t nleaves;
+	bool *stack;
+	size_t stacksz;
+	struct lsfd_filter_cache *cache;
+	bool private_cache;
+
 	char errmsg[ERRMSG_LEN];
 };
 
@@ -649,10 +733,21 @@ static struct token *parser_read(struct parser *parser)
 	return t;
 }
 
-static void parameter_init(struct parameter *param, struct libscols_column *cl)
+static void parameter_init(struct parameter *param, struct libscols_column *cl, int col_id)
 {
 	param->cl = cl;
+	param->col_id = col_id;
 	param->has_value = false;
+	param->fill = NULL;
+}
+
+static const char *parameter_get_data(struct parameter *param, struct libscols_line *ln)
+{
+	if (param->fill) {
+		param->fill(ln, param->col_id, param->fill_data);
+		param->fill = NULL;
+	}
+	return scols_line_get_column_data(ln, param->cl);
 }
 
 static struct libscols_column *search_column(struct libscols_table *tb, const char *name)
@@ -741,7 +836,7 @@ static struct node *dparser_compile1(struct parser *parser, struct node *last)
 			}
 			scols_column_set_flags(cl, SCOLS_FL_HIDDEN);
 		}
-		parameter_init(parser->parameters + col_id, cl);
+		parameter_init(parser->parameters + col_id, cl, col_id);
 
 		int jtype = scols_column_get_json_type(cl);
 		int ntype;
@@ -958,7 +1053,7 @@ static bool node_apply(struct node *node, struct parameter *params, struct libsc
 			return VAL(node,boolean);
 
 		if (!params[PINDEX(node)].has_value) {
-			const char *data = scols_line_get_column_data(ln, params[PINDEX(node)].cl);
+			const char *data = parameter_get_data(params + PINDEX(node), ln);
 			if (data == NULL)
 				return false;
 			params[PINDEX(node)].val.boolean = !*data ? false :
@@ -1044,6 +1139,7 @@ static void node_str_free(struct node *node)
 static void node_re_free(struct node *node)
 {
 	regfree(&VAL(node,re));
+	free(((struct node_val *)node)->re_src);
 }
 
 static void node_op1_free(struct node *node)
@@ -1084,7 +1180,7 @@ static bool op1_check_type_bool_or_op(struct parser* parser, struct op1_class *o
 	else {								\
 		struct parameter *p = params + pindex;			\
 		if (!p->has_value) {					\
-			p->val.str = scols_line_get_column_data(ln, p->cl); \
+			p->val.str = parameter_get_data(p, ln);		\
 			if (p->val.str == NULL) return false;		\
 			p->has_value = true;				\
 		}							\
@@ -1099,7 +1195,7 @@ static bool op1_check_type_bool_or_op(struct parser* parser, struct op1_class *o
 	else {								\
 		struct parameter *p = params + pindex;			\
 		if (!p->has_value) {					\
-			const char *tmp = scols_line_get_column_data(ln, p->cl); \
+			const char *tmp = parameter_get_data(p, ln);	\
 			if (tmp == NULL) return false;			\
 			p->val.num = strtoull(tmp, NULL, 10);		\
 			p->has_value = true;				\
@@ -1284,15 +1380,492 @@ static bool op2_check_type_re(struct parser* parser, struct op2_class *op2_class
 		return false;
 	}
 	right->type = NODE_RE;
-	free(regex);
+	((struct node_val *)right)->re_src = regex;
 	return true;
 }
 
+/*
+ * Compiler
+ */
+struct lsfd_filter_cache *lsfd_filter_cache_new(int ncols)
+{
+	struct lsfd_filter_cache *cache = xcalloc(1, sizeof(*cache));
+
+	cache->refcount = 1;
+	cache->generation = 1;
+	cache->ncols = ncols;
+	cache->columns = xcalloc(ncols, sizeof(struct cache_column));
+	return cache;
+}
+
+static void lsfd_filter_cache_ref(struct lsfd_filter_cache *cache)
+{
+	cache->refcount++;
+}
+
+void lsfd_filter_cache_unref(struct lsfd_filter_cache *cache)
+{
+	size_t i;
+
+	if (!cache || --cache->refcount > 0)
+		return;
+
+	for (i = 0; i < cache->nleaves; i++)
+		free(cache->leaves[i].key);
+	free(cache->leaves);
+	free(cache->columns);
+	free(cache);
+}
+
+void lsfd_filter_cache_reset(struct lsfd_filter_cache *cache)
+{
+	if (!cache)
+		return;
+
+	/* zero is never used, so the new entries (calloc) are invalid */
+	if (++cache->generation == 0)
+		cache->generation = 1;
+}
+
+static size_t cache_intern_leaf(struct lsfd_filter_cache *cache, char *key)
+{
+	size_t i;
+
+	for (i = 0; i < cache->nleaves; i++) {
+		if (strcmp(cache->leaves[i].key, key) == 0) {
+			free(key);
+			return i;
+		}
+	}
+	cache->leaves = xrealloc(cache->leaves,
+				 (cache->nleaves + 1) * sizeof(struct cache_leaf));
+	cache->leaves[cache->nleaves] = (struct cache_leaf) { .key = key };
+	return cache->nleaves++;
+}
+
+static void operand_init(struct operand *opr, struct node *node)
+{
+	opr->col_id = PINDEX(node);
+	if (opr->col_id >= 0)
+		return;
+
+	switch (node->type) {
+	case NODE_STR:
+		opr->val.str = VAL(node, str);
+		break;
+	case NODE_NUM:
+		opr->val.num = VAL(node, num);
+		break;
+	case NODE_BOOL:
+		opr->val.boolean = VAL(node, boolean);
+		break;
+	default:
+		break;
+	}
+}
+
+static void operand_append_key(char **key, struct operand *opr, enum node_type type)
+{
+	char *str = NULL;
+
+	if (opr->col_id >= 0)
+		xasprintf(&str, " #%d", opr->col_id);
+	else if (type == NODE_STR)
+		xasprintf(&str, " s%zu:%s", strlen(opr->val.str), opr->val.str);
+	else if (type == NODE_NUM)
+		xasprintf(&str, " n%llu", opr->val.num);
+	else
+		xasprintf(&str, " b%d", opr->val.boolean);
+
+	if (strappend(key, str) < 0)
+		errx(EXIT_FAILURE, _("failed to allocate memory"));
+	free(str);
+}
+
+/* Returns the column value; NULL if the cell is empty. */
+static struct cache_column *fetch_column(struct lsfd_filter *filter, int col_id,
+					 enum node_type type, struct libscols_line *ln)
+{
+	struct lsfd_filter_cache *cache = filter->cache;
+	struct cache_column *c = cache->columns + col_id;
+
+	if (c->generation != cache->generation) {
+		const char *data = parameter_get_data(filter->parameters + col_id, ln);
+
+		c->generation = cache->generation;
+		c->null = data == NULL;
+		if (data) {
+			switch (type) {
+			case NODE_NUM:
+				c->val.num = strtoull(data, NULL, 10);
+				break;
+			case NODE_BOOL:
+				c->val.boolean = !*data ? false :
+					*data == '0' ? false :
+					*data == 'N' || *data == 'n' ? false : true;
+				break;
+			default:
+				c->val.str = data;
+				break;
+			}
+		}
+	}
+	return c->null ? NULL : c;
+}
+
+static bool leaf_compute(struct lsfd_filter *filter, struct leaf *leaf,
+			 struct libscols_line *ln)
+{
+	struct operand v[2];
+	int i, n = leaf->op == LEAF_BOOL || leaf->re ? 1 : 2;
+
+	for (i = 0; i < n; i++) {
+		v[i] = leaf->args[i];
+		if (v[i].col_id >= 0) {
+			struct cache_column *c = fetch_column(filter, v[i].col_id,
+							      leaf->type, ln);
+			if (!c)
+				return false;
+			memcpy(&v[i].val, &c->val, sizeof(v[i].val));
+		}
+	}
+
+	switch (leaf->op) {
+	case LEAF_BOOL:
+		return v[0].val.boolean;
+	case OP2_RE_MATCH:
+		return regexec(leaf->re, v[0].val.str, 0, NULL, 0) == 0;
+	case OP2_RE_UNMATCH:
+		return regexec(leaf->re, v[0].val.str, 0, NULL, 0) != 0;
+	case OP2_EQ:
+	case OP2_NE:
+	{
+		bool eq = leaf->type == NODE_STR ? strcmp(v[0].val.str, v[1].val.str) == 0 :
+			  leaf->type == NODE_NUM ? v[0].val.num == v[1].val.num :
+						   v[0].val.boolean == v[1].val.boolean;
+		return leaf->op == OP2_EQ ? eq : !eq;
+	}
+	case OP2_LT:
+		return v[0].val.num < v[1].val.num;
+	case OP2_LE:
+		return v[0].val.num <= v[1].val.num;
+	case OP2_GT:
+		return v[0].val.num > v[1].val.num;
+	case OP2_GE:
+		return v[0].val.num >= v[1].val.num;
+	}
+	return false;
+}
+
+static bool leaf_eval(struct lsfd_filter *filter, struct leaf *leaf,
+		      struct libscols_line *ln)
+{
+	struct cache_leaf *cl = filter->cache->leaves + leaf->slot;
+
+	if (cl->generation != filter->cache->generation) {
+		cl->result = leaf_compute(filter, leaf, ln);
+		cl->generation = filter->cache->generation;
+	}
+	return cl->result;
+}
+
+static int op2_type_of(struct node *node)
+{
+	return ((struct node_op2 *)node)->opclass - op2_classes;
+}
+
+/* Returns true if @node is compiled to a leaf rather than to code. */
+static bool node_is_leaf(struct node *node)
+{
+	if (node->type == NODE_BOOL)
+		return true;
+	if (node->type == NODE_OP2) {
+		struct node *left = ((struct node_op2 *)node)->args[0];
+
+		switch (op2_type_of(node)) {
+		case OP2_AND:
+		case OP2_OR:
+			return false;
+		case OP2_EQ:
+		case OP2_NE:
+			return left->type == NODE_STR || left->type == NODE_NUM;
+		default:
+			return true;
+		}
+	}
+	return false;
+}
+
+static void leaf_init(struct leaf *leaf, struct node *node)
+{
+	memset(leaf, 0, sizeof(*leaf));
+
+	if (node->type == NODE_BOOL) {
+		leaf->op = LEAF_BOOL;
+		leaf->type = NODE_BOOL;
+		operand_init(&leaf->args[0], node);
+		return;
+	}
+
+	leaf->op = op2_type_of(node);
+	leaf->type = ((struct node_op2 *)node)->args[0]->type;
+	operand_init(&leaf->args[0], ((struct node_op2 *)node)->args[0]);
+	if (leaf->op == OP2_RE_MATCH || leaf->op == OP2_RE_UNMATCH)
+		leaf->re = &VAL(((struct node_op2 *)node)->args[1], re);
+	else
+		operand_init(&leaf->args[1], ((struct node_op2 *)node)->args[1]);
+}
+
+static bool leaf_is_constant(struct leaf *leaf)
+{
+	return leaf->args[0].col_id < 0
+		&& (leaf->op == LEAF_BOOL || leaf->re || leaf->args[1].col_id < 0);
+}
+
+enum {
+	FOLD_FALSE = 0,
+	FOLD_TRUE = 1,
+	FOLD_NONE = -1,
+};
+
+/* Returns FOLD_TRUE or FOLD_FALSE if the result of @node does not depend on
+ * the line, or FOLD_NONE. */
+static int node_fold(struct lsfd_filter *filter, struct node *node)
+{
+	int l, r;
+
+	if (node_is_leaf(node)) {
+		struct leaf leaf;
+
+		leaf_init(&leaf, node);
+		if (!leaf_is_constant(&leaf))
+			return FOLD_NONE;
+		return leaf_compute(filter, &leaf, NULL);
+	}
+
+	if (node->type == NODE_OP1) {
+		l = node_fold(filter, ((struct node_op1 *)node)->arg);
+		return l == FOLD_NONE ? l : !l;
+	}
+
+	l = node_fold(filter, ((struct node_op2 *)node)->args[0]);
+	r = node_fold(filter, ((struct node_op2 *)node)->args[1]);
+
+	switch (op2_type_of(node)) {
+	case OP2_AND:
+		if (l == FOLD_FALSE || r == FOLD_FALSE)
+			return FOLD_FALSE;
+		return l == FOLD_TRUE && r == FOLD_TRUE ? FOLD_TRUE : FOLD_NONE;
+	case OP2_OR:
+		if (l == FOLD_TRUE || r == FOLD_TRUE)
+			return FOLD_TRUE;
+		return l == FOLD_FALSE && r == FOLD_FALSE ? FOLD_FALSE : FOLD_NONE;
+	case OP2_EQ:
+		return l == FOLD_NONE || r == FOLD_NONE ? FOLD_NONE : l == r;
+	case OP2_NE:
+		return l == FOLD_NONE || r == FOLD_NONE ? FOLD_NONE : l != r;
+	}
+	return FOLD_NONE;
+}
+
+struct compiler {
+	struct lsfd_filter *filter;
+	size_t depth;
+};
+
+static size_t emit(struct compiler *cc, enum insn_type type, int arg)
+{
+	struct lsfd_filter *filter = cc->filter;
+
+	filter->code = xrealloc(filter->code, (filter->ncode + 1) * sizeof(struct insn));
+	filter->code[filter->ncode] = (struct insn) { .type = type, .arg = arg };
+
+	switch (type) {
+	case INSN_PUSH:
+	case INSN_LEAF:
+		cc->depth++;
+		break;
+	case INSN_EQ:
+	case INSN_NE:
+		cc->depth--;
+		break;
+	default:
+		break;
+	}
+	if (cc->depth > filter->stacksz)
+		filter->stacksz = cc->depth;
+
+	return filter->ncode++;
+}
+
+static void emit_leaf(struct compiler *cc, struct node *node)
+{
+	struct lsfd_filter *filter = cc->filter;
+	struct leaf *leaf;
+	char *key = NULL;
+	int i;
+
+	filter->leaves = xrealloc(filter->leaves,
+				  (filter->nleaves + 1) * sizeof(struct leaf));
+	leaf = filter->leaves + filter->nleaves;
+	leaf_init(leaf, node);
+
+	xasprintf(&key, "%s", leaf->op == LEAF_BOOL ? "bool" : op2_classes[leaf->op].name);
+	for (i = 0; i < (leaf->op == LEAF_BOOL ? 1 : 2); i++) {
+		if (i == 1 && leaf->re)
+			/* the regex is compiled from the string literal */
+			operand_append_key(&key, &(struct operand) {
+						.col_id = -1,
+						.val.str = ((struct node_val *)((struct node_op2 *)node)->args[1])->re_src },
+					   NODE_STR);
+		else
+			operand_append_key(&key, &leaf->args[i], leaf->type);
+	}
+	leaf->slot = cache_intern_leaf(filter->cache, key);
+
+	emit(cc, INSN_LEAF, filter->nleaves++);
+}
+
+static void compile_node(struct compiler *cc, struct node *node)
+{
+	int f = node_fold(cc->filter, node);
+	size_t j;
+
+	if (f != FOLD_NONE) {
+		emit(cc, INSN_PUSH, f);
+		return;
+	}
+
+	if (node_is_leaf(node)) {
+		emit_leaf(cc, node);
+		return;
+	}
+
+	if (node->type == NODE_OP1) {
+		compile_node(cc, ((struct node_op1 *)node)->arg);
+		emit(cc, INSN_NOT, 0);
+		return;
+	}
+
+	struct node *left = ((struct node_op2 *)node)->args[0];
+	struct node *right = ((struct node_op2 *)node)->args[1];
+	int op = op2_type_of(node);
+
+	switch (op) {
+	case OP2_AND:
+	case OP2_OR:
+		/* one of the operands may be constant (true for AND, false
+		 * for OR) which does not affect the result */
+		if (node_fold(cc->filter, left) != FOLD_NONE) {
+			compile_node(cc, right);
+			return;
+		}
+		if (node_fold(cc->filter, right) != FOLD_NONE) {
+			compile_node(cc, left);
+			return;
+		}
+		compile_node(cc, left);
+		j = emit(cc, op == OP2_AND ? INSN_JFALSE : INSN_JTRUE, 0);
+		cc->depth--;
+		compile_node(cc, right);
+		cc->filter->code[j].arg = cc->filter->ncode;
+		break;
+	case OP2_EQ:
+	case OP2_NE:
+		compile_node(cc, left);
+		compile_node(cc, right);
+		emit(cc, op == OP2_EQ ? INSN_EQ : INSN_NE, 0);
+		break;
+	}
+}
+
+static void filter_compile(struct lsfd_filter *filter)
+{
+	struct compiler cc = { .filter = filter };
+
+	if (filter->node)
+		compile_node(&cc, filter->node);
+	else
+		emit(&cc, INSN_PUSH, 1);
+
+	filter->stack = xcalloc(filter->stacksz, sizeof(bool));
+}
+
+static bool filter_run(struct lsfd_filter *filter, struct libscols_line *ln)
+{
+	bool *sp = filter->stack;
+	size_t pc;
+
+	for (pc = 0; pc < filter->ncode; pc++) {
+		struct insn *insn = filter->code + pc;
+
+		switch (insn->type) {
+		case INSN_PUSH:
+			*sp++ = insn->arg;
+			break;
+		case INSN_LEAF:
+			*sp++ = leaf_eval(filter, filter->leaves + insn->arg, ln);
+			break;
+		case INSN_NOT:
+			sp[-1] = !sp[-1];
+			break;
+		case INSN_EQ:
+			sp--;
+			sp[-1] = sp[-1] == sp[0];
+			break;
+		case INSN_NE:
+			sp--;
+			sp[-1] = sp[-1] != sp[0];
+			break;
+		case INSN_JFALSE:
+			if (!sp[-1])
+				pc = insn->arg - 1;
+			else
+				sp--;
+			break;
+		case INSN_JTRUE:
+			if (sp[-1])
+				pc = insn->arg - 1;
+			else
+				sp--;
+			break;
+		}
+	}
+	return sp[-1];
+}
+
+static void filter_dump_code(struct lsfd_filter *filter, FILE *stream)
+{
+	static const char *names[] = {
+		[INSN_PUSH]   = "PUSH",
+		[INSN_LEAF]   = "LEAF",
+		[INSN_NOT]    = "NOT",
+		[INSN_EQ]     = "EQ",
+		[INSN_NE]     = "NE",
+		[INSN_JFALSE] = "JFALSE",
+		[INSN_JTRUE]  = "JTRUE",
+	};
+	size_t i;
+
+	for (i = 0; i < filter->ncode; i++) {
+		struct insn *insn = filter->code + i;
+
+		if (insn->type == INSN_LEAF)
+			fprintf(stream, "%04zu %-6s %d: %s\n", i, names[insn->type], insn->arg,
+				filter->cache->leaves[filter->leaves[insn->arg].slot].key);
+		else if (insn->type != INSN_NOT && insn->type != INSN_EQ && insn->type != INSN_NE)
+			fprintf(stream, "%04zu %-6s %d\n", i, names[insn->type], insn->arg);
+		else
+			fprintf(stream, "%04zu %s\n", i, names[insn->type]);
+	}
+}
+
 struct lsfd_filter *lsfd_filter_new(const char *const expr, struct libscols_table *tb,
 				      int ncols,
 				      int (*column_name_to_id)(const char *, void *),
 				      struct libscols_column *(*add_column_by_id)(struct libscols_table *, int, void*),
-				      void *data)
+				      void *data,
+				      struct lsfd_filter_cache *cache)
 {
 	struct parser parser;
 	int i;
@@ -1306,8 +1879,8 @@ struct lsfd_filter *lsfd_filter_new(const char *const expr, struct libscols_tabl
 
 	node = dparser_compile(&parser);
 
-	filter = xmalloc(sizeof(struct lsfd_filter));
-	filter->errmsg[0] = '\0';
+	filter = xcalloc(1, sizeof(struct lsfd_filter));
+	filter->parameters = parser.parameters;
 	if (GOT_ERROR(&parser)) {
 		strcpy(filter->errmsg, parser.errmsg);
 		return filter;
@@ -1333,12 +1906,21 @@ struct lsfd_filter *lsfd_filter_new(const char *const expr, struct libscols_tabl
 	filter->table = tb;
 	scols_ref_table(filter->table);
 	filter->node = node;
-	filter->parameters = parser.parameters;
 	filter->nparams = ncols;
 	for (i = 0; i < filter->nparams; i++) {
 		if (filter->parameters[i].cl)
 			scols_ref_column(filter->parameters[i].cl);
 	}
+
+	if (cache)
+		lsfd_filter_cache_ref(cache);
+	else {
+		cache = lsfd_filter_cache_new(ncols);
+		filter->private_cache = true;
+	}
+	filter->cache = cache;
+	filter_compile(filter);
+
 	return filter;
 }
 
@@ -1363,6 +1945,8 @@ void lsfd_filter_dump(struct lsfd_filter *filter, FILE *stream)
 	}
 
 	node_dump(filter->node, filter->parameters, 0, stream);
+	fputs("CODE:\n", stream);
+	filter_dump_code(filter, stream);
 }
 
 void lsfd_filter_free(struct lsfd_filter *filter)
@@ -1379,12 +1963,17 @@ void lsfd_filter_free(struct lsfd_filter *filter)
 		}
 		scols_unref_table(filter->table);
 		node_free(filter->node);
+		free(filter->code);
+		free(filter->leaves);
+		free(filter->stack);
+		lsfd_filter_cache_unref(filter->cache);
 	}
 	free(filter->parameters);
 	free(filter);
 }
 
-bool lsfd_filter_apply(struct lsfd_filter *filter, struct libscols_line * ln)
+bool lsfd_filter_apply_lazily(struct lsfd_filter *filter, struct libscols_line *ln,
+			      lsfd_filter_fill_fn fill, void *data)
 {
 	int i;
 
@@ -1394,8 +1983,390 @@ bool lsfd_filter_apply(struct lsfd_filter *filter, struct libscols_line * ln)
 	if (GOT_ERROR(filter))
 		return false;
 
-	for (i = 0; i < filter->nparams; i++)
+	for (i = 0; i < filter->nparams; i++) {
 		filter->parameters[i].has_value = false;
+		filter->parameters[i].fill = fill;
+		filter->parameters[i].fill_data = data;
+	}
+
+	if (filter->private_cache)
+		lsfd_filter_cache_reset(filter->cache);
+
+	return filter_run(filter, ln);
+}
+
+bool lsfd_filter_apply(struct lsfd_filter *filter, struct libscols_line * ln)
+{
+	return lsfd_filter_apply_lazily(filter, ln, NULL, NULL);
+}
+
+/*
+ * Kleene's three-valued logic for lsfd_filter_may_accept(). A node is
+ * UNKNOWN if it depends on a column without a hint.
+ */
+enum guess {
+	GUESS_FALSE,
+	GUESS_TRUE,
+	GUESS_UNKNOWN,
+};
+
+static bool node_is_known(struct node *node, const bool *known)
+{
+	switch (node->type) {
+	case NODE_OP1:
+		return node_is_known(((struct node_op1 *)node)->arg, known);
+	case NODE_OP2:
+		return node_is_known(((struct node_op2 *)node)->args[0], known)
+			&& node_is_known(((struct node_op2 *)node)->args[1], known);
+	case NODE_RE:
+		return true;
+	default:
+		return PINDEX(node) < 0 || known[PINDEX(node)];
+	}
+}
+
+static enum guess node_guess(struct node *node, struct parameter *params,
+			     struct libscols_line *ln, const bool *known)
+{
+	enum guess l, r;
+
+	if (node->type == NODE_OP1
+	    && ((struct node_op1 *)node)->opclass == &op1_classes[OP1_NOT]) {
+		l = node_guess(((struct node_op1 *)node)->arg, params, ln, known);
+		return l == GUESS_UNKNOWN ? l : l == GUESS_TRUE ? GUESS_FALSE : GUESS_TRUE;
+	}
+
+	if (node->type == NODE_OP2
+	    && (((struct node_op2 *)node)->opclass == &op2_classes[OP2_AND]
+		|| ((struct node_op2 *)node)->opclass == &op2_classes[OP2_OR])) {
+		bool and = ((struct node_op2 *)node)->opclass == &op2_classes[OP2_AND];
+
+		l = node_guess(((struct node_op2 *)node)->args[0], params, ln, known);
+		r = node_guess(((struct node_op2 *)node)->args[1], params, ln, known);
+		if (and) {
+			if (l == GUESS_FALSE || r == GUESS_FALSE)
+				return GUESS_FALSE;
+			return l == GUESS_TRUE && r == GUESS_TRUE ? GUESS_TRUE : GUESS_UNKNOWN;
+		}
+		if (l == GUESS_TRUE || r == GUESS_TRUE)
+			return GUESS_TRUE;
+		return l == GUESS_FALSE && r == GUESS_FALSE ? GUESS_FALSE : GUESS_UNKNOWN;
+	}
+
+	if (!node_is_known(node, known))
+		return GUESS_UNKNOWN;
+
+	return node_apply(node, params, ln) ? GUESS_TRUE : GUESS_FALSE;
+}
 
+bool lsfd_filter_may_accept(struct lsfd_filter *filter,
+			    const struct lsfd_filter_hint *hints, size_t nhints)
+{
+	struct libscols_line *ln;
+	bool *known;
+	enum guess res;
+	size_t i;
+
+	if (!filter)
+		return true;
+
+	if (GOT_ERROR(filter))
+		return false;
+
+	ln = scols_new_line();
+	if (!ln || scols_line_alloc_cells(ln, scols_table_get_ncols(filter->table)) != 0)
+		errx(EXIT_FAILURE, _("failed to allocate memory"));
+
+	known = xcalloc(filter->nparams, sizeof(bool));
+	for (i = 0; i < nhints; i++) {
+		struct parameter *p;
+
+		if (hints[i].col_id < 0 || hints[i].col_id >= filter->nparams)
+			continue;
+		p = filter->parameters + hints[i].col_id;
+		if (!p->cl)
+			continue;
+		if (hints[i].data
+		    && scols_line_set_column_data(ln, p->cl, hints[i].data) != 0)
+			errx(EXIT_FAILURE, _("failed to allocate memory"));
+		known[hints[i].col_id] = true;
+	}
+
+	for (i = 0; i < (size_t) filter->nparams; i++) {
+		filter->parameters[i].has_value = false;
+		filter->parameters[i].fill = NULL;
+	}
+
+	res = node_guess(filter->node, filter->parameters, ln, known);
+
+	free(known);
+	scols_unref_line(ln);
+
+	return res != GUESS_FALSE;
+}
+
+#ifdef TEST_LSFD_FILTER
+/*
+ * Filter microbenchmark and self-test. The filters (modeled after the
+ * default --summary counters) are evaluated for generated lines with
+ * the compiled code and with the AST interpreter; the results have to be
+ * the same.
+ */
+#include <getopt.h>
+#include <time.h>
+
+enum {
+	TCOL_ASSOC,
+	TCOL_FD,
+	TCOL_KTHREAD,
+	TCOL_MODE,
+	TCOL_NAME,
+	TCOL_PID,
+	TCOL_TYPE,
+	TCOL_UID,
+	TEST_N_COLS
+};
+
+static const struct {
+	const char *name;
+	int json_type;
+} test_columns[] = {
+	[TCOL_ASSOC]   = { "ASSOC",   SCOLS_JSON_STRING },
+	[TCOL_FD]      = { "FD",      SCOLS_JSON_NUMBER },
+	[TCOL_KTHREAD] = { "KTHREAD", SCOLS_JSON_BOOLEAN },
+	[TCOL_MODE]    = { "MODE",    SCOLS_JSON_STRING },
+	[TCOL_NAME]    = { "NAME",    SCOLS_JSON_STRING },
+	[TCOL_PID]     = { "PID",     SCOLS_JSON_NUMBER },
+	[TCOL_TYPE]    = { "TYPE",    SCOLS_JSON_STRING },
+	[TCOL_UID]     = { "UID",     SCOLS_JSON_NUMBER },
+};
+
+static const char *test_exprs[] = {
+	"PID == 1",
+	"ASSOC == 'cwd'",
+	"(ASSOC == 'cwd') && (UID == 0)",
+	"(ASSOC == 'cwd') && KTHREAD",
+	"FD >= 0",
+	"(FD >= 0) && (MODE == 'r--')",
+	"(FD >= 0) && (MODE == '-w-')",
+	"(FD >= 0) && (TYPE == 'REG')",
+	"(FD >= 0) && (TYPE == 'DIR')",
+	"(FD >= 0) && (TYPE == 'SOCK')",
+	"ASSOC == 'shm'",
+	"(ASSOC == 'shm') and (MODE == 'r--')",
+	"(ASSOC == 'shm') and (MODE == '-w-')",
+	"NAME =~ '^/usr/lib'",
+	"(NAME !~ 'lib') or (FD < 3)",
+	"not ((PID > 100) and (PID <= 1000)) and (1 < 2)",
+	"(KTHREAD == false) != (UID == 0)",
+	"(false or (FD == 3)) and (true or (PID == 5))",
+};
+
+static int test_column_name_to_id(const char *name, void *data __attribute__((__unused__)))
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(test_columns); i++)
+		if (strcmp(name, test_columns[i].name) == 0)
+			return i;
+	return LSFD_FILTER_UNKNOWN_COL_ID;
+}
+
+static struct libscols_column *test_add_column_by_id(struct libscols_table *tb, int id,
+						      void *data __attribute__((__unused__)))
+{
+	struct libscols_column *cl = scols_table_new_column(tb, test_columns[id].name, 0, 0);
+
+	if (cl)
+		scols_column_set_json_type(cl, test_columns[id].json_type);
+	return cl;
+}
+
+static unsigned int test_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+static void test_fill_line(struct libscols_table *tb, struct libscols_line *ln, unsigned int *seed)
+{
+	static const char *assocs[] = { "cwd", "rtd", "exe", "mem", "shm" };
+	static const char *modes[] = { "r--", "-w-", "rw-", "---" };
+	static const char *types[] = { "REG", "DIR", "SOCK", "FIFO", "CHR" };
+	static const char *names[] = { "/usr/lib/libc.so.6", "/", "/dev/null", "socket:[1]", "/etc/passwd" };
+	char buf[32];
+	int fd = test_random(seed) % 40 - 10;
+	size_t i;
+
+	for (i = 0; i < scols_table_get_ncols(tb); i++) {
+		struct libscols_column *cl = scols_table_get_column(tb, i);
+		int id = test_column_name_to_id(scols_column_get_name(cl), NULL);
+		const char *data = NULL;
+
+		switch (id) {
+		case TCOL_ASSOC:
+			if (fd >= 0) {
+				snprintf(buf, sizeof(buf), "%d", fd);
+				data = buf;
+			} else
+				data = assocs[-fd % ARRAY_SIZE(assocs)];
+			break;
+		case TCOL_FD:
+			if (fd >= 0) {
+				snprintf(buf, sizeof(buf), "%d", fd);
+				data = buf;
+			}
+			break;
+		case TCOL_KTHREAD:
+			data = test_random(seed) % 10 ? "0" : "1";
+			break;
+		case TCOL_MODE:
+			data = modes[test_random(seed) % ARRAY_SIZE(modes)];
+			break;
+		case TCOL_NAME:
+			data = names[test_random(seed) % ARRAY_SIZE(names)];
+			break;
+		case TCOL_PID:
+			snprintf(buf, sizeof(buf), "%u", test_random(seed) % 2000);
+			data = buf;
+			break;
+		case TCOL_TYPE:
+			data = types[test_random(seed) % ARRAY_SIZE(types)];
+			break;
+		case TCOL_UID:
+			snprintf(buf, sizeof(buf), "%u", test_random(seed) % 3 ? 1000 : 0);
+			data = buf;
+			break;
+		}
+		if (data && scols_line_set_data(ln, i, data))
+			err(EXIT_FAILURE, "failed to add output data");
+	}
+}
+
+/* The reference evaluation by the AST interpreter. */
+static bool test_apply_ast(struct lsfd_filter *filter, struct libscols_line *ln)
+{
+	int i;
+
+	for (i = 0; i < filter->nparams; i++) {
+		filter->parameters[i].has_value = false;
+		filter->parameters[i].fill = NULL;
+	}
 	return node_apply(filter->node, filter->parameters, ln);
 }
+
+static double test_seconds(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1E9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libscols_table *tb = scols_new_table();
+	struct lsfd_filter_cache *cache = lsfd_filter_cache_new(TEST_N_COLS);
+	struct lsfd_filter *filters[ARRAY_SIZE(test_exprs)];
+	struct libscols_line **lines;
+	size_t counts[ARRAY_SIZE(test_exprs)] = { 0 };
+	unsigned int seed = 42, nlines = 10000, nloops = 0, l, n;
+	size_t i, nerrs = 0;
+	int c;
+
+	static const struct option longopts[] = {
+		{ "lines", required_argument, NULL, 'l' },
+		{ "bench", required_argument, NULL, 'b' },
+		{ "help",  no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	while ((c = getopt_long(argc, argv, "l:b:h", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'l':
+			nlines = strtou32_or_err(optarg, "failed to parse number of lines");
+			break;
+		case 'b':
+			nloops = strtou32_or_err(optarg, "failed to parse number of loops");
+			break;
+		case 'h':
+			printf(" %s [--lines <num>] [--bench <loops>]\n", program_invocation_short_name);
+			return EXIT_SUCCESS;
+		default:
+			fprintf(stderr, "try --help\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!tb)
+		err(EXIT_FAILURE, "failed to allocate table");
+
+	for (i = 0; i < ARRAY_SIZE(test_exprs); i++) {
+		filters[i] = lsfd_filter_new(test_exprs[i], tb, TEST_N_COLS,
+					     test_column_name_to_id,
+					     test_add_column_by_id, NULL, cache);
+		if (lsfd_filter_get_errmsg(filters[i]))
+			errx(EXIT_FAILURE, "%s: %s", test_exprs[i],
+			     lsfd_filter_get_errmsg(filters[i]));
+	}
+
+	lines = xcalloc(nlines, sizeof(struct libscols_line *));
+	for (l = 0; l < nlines; l++) {
+		lines[l] = scols_table_new_line(tb, NULL);
+		if (!lines[l])
+			err(EXIT_FAILURE, "failed to allocate output line");
+		test_fill_line(tb, lines[l], &seed);
+	}
+
+	for (l = 0; l < nlines; l++) {
+		lsfd_filter_cache_reset(cache);
+		for (i = 0; i < ARRAY_SIZE(test_exprs); i++) {
+			bool res = lsfd_filter_apply(filters[i], lines[l]);
+
+			if (res != test_apply_ast(filters[i], lines[l])) {
+				warnx("line %u: %s: unexpected result", l, test_exprs[i]);
+				nerrs++;
+			}
+			counts[i] += res;
+		}
+	}
+	for (i = 0; i < ARRAY_SIZE(test_exprs); i++)
+		printf("%6zu %s\n", counts[i], test_exprs[i]);
+
+	if (nloops) {
+		struct timespec start;
+		double ast, code;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (n = 0; n < nloops; n++)
+			for (l = 0; l < nlines; l++)
+				for (i = 0; i < ARRAY_SIZE(test_exprs); i++)
+					test_apply_ast(filters[i], lines[l]);
+		ast = test_seconds(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (n = 0; n < nloops; n++)
+			for (l = 0; l < nlines; l++) {
+				lsfd_filter_cache_reset(cache);
+				for (i = 0; i < ARRAY_SIZE(test_exprs); i++)
+					lsfd_filter_apply(filters[i], lines[l]);
+			}
+		code = test_seconds(&start);
+
+		printf("filters:        %zu\n", ARRAY_SIZE(test_exprs));
+		printf("lines:          %u x %u\n", nlines, nloops);
+		printf("AST:            %.3f sec (%.0f lines/sec)\n", ast,
+		       ast > 0 ? (double) nlines * nloops / ast : 0.0);
+		printf("compiled:       %.3f sec (%.0f lines/sec)\n", code,
+		       code > 0 ? (double) nlines * nloops / code : 0.0);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(test_exprs); i++)
+		lsfd_filter_free(filters[i]);
+	lsfd_filter_cache_unref(cache);
+	free(lines);
+	scols_unref_table(tb);
+
+	return nerrs ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif /* TEST_LSFD_FILTER */
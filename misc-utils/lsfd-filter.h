@@ -18,8 +18,21 @@
 
 struct lsfd_filter;
 
+/*
+ * The column values and the results of comparisons for the current line,
+ * shared by more filters to evaluate every comparison only once for a line.
+ * Call lsfd_filter_cache_reset() before the filters are applied to a new
+ * line.
+ */
+struct lsfd_filter_cache;
+
+struct lsfd_filter_cache *lsfd_filter_cache_new(int ncols);
+void lsfd_filter_cache_unref(struct lsfd_filter_cache *cache);
+void lsfd_filter_cache_reset(struct lsfd_filter_cache *cache);
+
 /*
  * @column_name_to_id: a function converting a column name to its id.
+ * @cache: shared cache or NULL for a private one
  *
  * @column_name_to_id should return LSFD_FILTER_UNKNOWN_COL_ID if
  * an unknown column name is given.
@@ -28,7 +41,8 @@ struct lsfd_filter *lsfd_filter_new(const char *const expr, struct libscols_tabl
 				      int ncols,
 				      int (*column_name_to_id)(const char *, void *),
 				      struct libscols_column *(*add_column_by_id)(struct libscols_table *, int, void*),
-				      void *data);
+				      void *data,
+				      struct lsfd_filter_cache *cache);
 
 /* Call lsfd_filter_get_errmsg() after lsfd_filter_new() to detect
  * whether lsfd_filter_new() is failed or not. Returning NULL means,
@@ -37,6 +51,35 @@ const char *lsfd_filter_get_errmsg(struct lsfd_filter *filter);
 void lsfd_filter_free(struct lsfd_filter *filter);
 bool lsfd_filter_apply(struct lsfd_filter *filter, struct libscols_line *ln);
 
+/*
+ * @fill: a function filling the cell of the column @col_id in @ln.
+ *
+ * The same as lsfd_filter_apply() but the cells are not expected to be
+ * filled in advance. @fill is called (at most once for each column) when
+ * the filter needs the value of a column. The filter evaluation is
+ * short-circuited, so the columns which don't affect the result are not
+ * filled at all.
+ */
+typedef void (*lsfd_filter_fill_fn)(struct libscols_line *ln, int col_id, void *data);
+bool lsfd_filter_apply_lazily(struct lsfd_filter *filter, struct libscols_line *ln,
+			      lsfd_filter_fill_fn fill, void *data);
+
+/*
+ * A column value known in advance, @data is NULL for an empty cell.
+ */
+struct lsfd_filter_hint {
+	int col_id;
+	const char *data;
+};
+
+/*
+ * Returns false if the filter rejects all lines with the column values
+ * described by @hints, whatever the values of the other columns are.
+ * It's used to skip collecting data which would be filtered out anyway.
+ */
+bool lsfd_filter_may_accept(struct lsfd_filter *filter,
+			    const struct lsfd_filter_hint *hints, size_t nhints);
+
 /* Dumping AST. */
 void lsfd_filter_dump(struct lsfd_filter *filter, FILE *stream);
 
@@ -0,0 +1,384 @@
+/*
+ * lsfd-sock-diag.c - read socket details by NETLINK_SOCK_DIAG
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * All sockets of a network namespace are dumped by a few netlink requests
+ * when the first socket from the namespace is looked up, and kept in an
+ * inode keyed hash table. It's much cheaper than parsing /proc/net/ files
+ * for every socket.
+ *
+ * The netlink socket has to be created in the namespace to be dumped, so
+ * setns(2) is used for namespaces other than the namespace of lsfd itself.
+ * It requires CAP_SYS_ADMIN; the sockets from such namespaces have no
+ * details for unprivileged users.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/unix_diag.h>
+
+#include "c.h"
+#include "list.h"
+#include "nls.h"
+#include "xalloc.h"
+
+#include "lsfd-sock.h"
+
+#define SOCK_DIAG_BUFSIZ	32768
+#define SOCK_DIAG_MINBUCKETS	64
+
+struct sock_netns {
+	ino_t ino;
+	size_t nents;
+	size_t nbuckets;		/* power of two */
+	struct sock_diag **buckets;
+	struct list_head netns;
+};
+
+static struct list_head netns_list;
+static ino_t self_netns;
+
+static size_t inode_hash(ino_t ino)
+{
+	return (size_t) (((uint64_t) ino * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static void netns_rehash(struct sock_netns *ns)
+{
+	size_t nbuckets = ns->nbuckets ? ns->nbuckets * 2 : SOCK_DIAG_MINBUCKETS;
+	struct sock_diag **buckets = xcalloc(nbuckets, sizeof(struct sock_diag *));
+	size_t i;
+
+	for (i = 0; i < ns->nbuckets; i++) {
+		struct sock_diag *d = ns->buckets[i];
+
+		while (d) {
+			struct sock_diag *next = d->next;
+			size_t b = inode_hash(d->inode) & (nbuckets - 1);
+
+			d->next = buckets[b];
+			buckets[b] = d;
+			d = next;
+		}
+	}
+	free(ns->buckets);
+	ns->buckets = buckets;
+	ns->nbuckets = nbuckets;
+}
+
+static struct sock_diag *netns_add(struct sock_netns *ns, ino_t inode)
+{
+	struct sock_diag *d;
+	size_t b;
+
+	if (ns->nents >= ns->nbuckets)
+		netns_rehash(ns);
+
+	d = xcalloc(1, sizeof(*d));
+	d->inode = inode;
+	d->netns = ns->ino;
+
+	b = inode_hash(inode) & (ns->nbuckets - 1);
+	d->next = ns->buckets[b];
+	ns->buckets[b] = d;
+	ns->nents++;
+	return d;
+}
+
+static struct sock_diag *netns_lookup(struct sock_netns *ns, ino_t inode)
+{
+	struct sock_diag *d;
+
+	if (!ns->nbuckets)
+		return NULL;
+
+	for (d = ns->buckets[inode_hash(inode) & (ns->nbuckets - 1)]; d; d = d->next) {
+		if (d->inode == inode)
+			return d;
+	}
+	return NULL;
+}
+
+static void free_netns(struct sock_netns *ns)
+{
+	size_t i;
+
+	for (i = 0; i < ns->nbuckets; i++) {
+		struct sock_diag *d = ns->buckets[i];
+
+		while (d) {
+			struct sock_diag *next = d->next;
+
+			if (d->family == AF_UNIX)
+				free(d->un.path);
+			free(d);
+			d = next;
+		}
+	}
+	free(ns->buckets);
+	free(ns);
+}
+
+static void inet_addr_copy(struct sock_addr *a, int family, const __be32 *addr, __be16 port)
+{
+	memcpy(a->addr, addr, family == AF_INET ? 4 : 16);
+	a->port = ntohs(port);
+}
+
+static void add_inet_sock(struct sock_netns *ns, int protocol, struct inet_diag_msg *msg)
+{
+	struct sock_diag *d;
+
+	if (!msg->idiag_inode || netns_lookup(ns, msg->idiag_inode))
+		return;
+
+	d = netns_add(ns, msg->idiag_inode);
+	d->family = msg->idiag_family;
+	d->protocol = protocol;
+	d->state = msg->idiag_state;
+	d->rqueue = msg->idiag_rqueue;
+	d->wqueue = msg->idiag_wqueue;
+	inet_addr_copy(&d->in.local, d->family, msg->id.idiag_src, msg->id.idiag_sport);
+	inet_addr_copy(&d->in.remote, d->family, msg->id.idiag_dst, msg->id.idiag_dport);
+}
+
+static void add_unix_sock(struct sock_netns *ns, struct unix_diag_msg *msg, size_t len)
+{
+	struct rtattr *attr = (struct rtattr *) (msg + 1);
+	struct sock_diag *d;
+
+	if (netns_lookup(ns, msg->udiag_ino))
+		return;
+
+	d = netns_add(ns, msg->udiag_ino);
+	d->family = AF_UNIX;
+	d->protocol = msg->udiag_type;
+	d->state = msg->udiag_state;
+
+	for (; RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		switch (attr->rta_type) {
+		case UNIX_DIAG_NAME: {
+			size_t sz = RTA_PAYLOAD(attr);
+			char *name = RTA_DATA(attr);
+
+			if (!sz)
+				break;
+			d->un.path = xmalloc(sz + 1);
+			memcpy(d->un.path, name, sz);
+			d->un.path[sz] = '\0';
+			if (*name == '\0')
+				d->un.path[0] = '@';
+			break;
+		}
+		case UNIX_DIAG_PEER:
+			if (RTA_PAYLOAD(attr) >= sizeof(uint32_t))
+				d->un.peer = *(uint32_t *) RTA_DATA(attr);
+			break;
+		case UNIX_DIAG_RQLEN:
+			if (RTA_PAYLOAD(attr) >= sizeof(struct unix_diag_rqlen)) {
+				struct unix_diag_rqlen *rq = RTA_DATA(attr);
+
+				d->rqueue = rq->udiag_rqueue;
+				d->wqueue = rq->udiag_wqueue;
+			}
+			break;
+		}
+	}
+}
+
+/*
+ * Sends the request @req and reads all the replies. Returns 0 on success
+ * or -1 (e.g. the protocol is not supported by the kernel).
+ */
+static int sock_diag_dump(int fd, struct sock_netns *ns, int protocol,
+			  void *req, size_t reqsz, char *buf)
+{
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	struct nlmsghdr nlh = {
+		.nlmsg_len = NLMSG_LENGTH(reqsz),
+		.nlmsg_type = SOCK_DIAG_BY_FAMILY,
+		.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &nlh, .iov_len = sizeof(nlh) },
+		{ .iov_base = req,  .iov_len = reqsz },
+	};
+	struct msghdr msg = {
+		.msg_name = &nladdr,
+		.msg_namelen = sizeof(nladdr),
+		.msg_iov = iov,
+		.msg_iovlen = 2,
+	};
+
+	if (sendmsg(fd, &msg, 0) < 0)
+		return -1;
+
+	while (1) {
+		struct nlmsghdr *h = (struct nlmsghdr *) buf;
+		ssize_t len = recv(fd, buf, SOCK_DIAG_BUFSIZ, 0);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (len == 0)
+			return 0;
+
+		for (; NLMSG_OK(h, (size_t) len); h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (h->nlmsg_type == NLMSG_ERROR)
+				return -1;
+			if (h->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+				continue;
+
+			if (((struct sock_diag_req *) req)->sdiag_family == AF_UNIX) {
+				if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct unix_diag_msg)))
+					continue;
+				add_unix_sock(ns, NLMSG_DATA(h),
+					      h->nlmsg_len - NLMSG_LENGTH(sizeof(struct unix_diag_msg)));
+			} else {
+				if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct inet_diag_msg)))
+					continue;
+				add_inet_sock(ns, protocol, NLMSG_DATA(h));
+			}
+		}
+	}
+}
+
+static void load_netns(int fd, struct sock_netns *ns)
+{
+	const int families[] = { AF_INET, AF_INET6 };
+	const int protocols[] = { IPPROTO_TCP, IPPROTO_UDP, IPPROTO_UDPLITE };
+	char *buf = xmalloc(SOCK_DIAG_BUFSIZ);
+	struct unix_diag_req ureq = {
+		.sdiag_family = AF_UNIX,
+		.udiag_states = ~0U,
+		.udiag_show = UDIAG_SHOW_NAME | UDIAG_SHOW_PEER | UDIAG_SHOW_RQLEN,
+	};
+	size_t i, j;
+
+	sock_diag_dump(fd, ns, 0, &ureq, sizeof(ureq), buf);
+
+	for (i = 0; i < ARRAY_SIZE(families); i++) {
+		for (j = 0; j < ARRAY_SIZE(protocols); j++) {
+			struct inet_diag_req_v2 ireq = {
+				.sdiag_family = families[i],
+				.sdiag_protocol = protocols[j],
+				.idiag_states = ~0U,
+			};
+			sock_diag_dump(fd, ns, protocols[j], &ireq, sizeof(ireq), buf);
+		}
+	}
+	free(buf);
+}
+
+/* Returns a NETLINK_SOCK_DIAG socket in the network namespace of @pid. */
+static int open_sock_diag(pid_t pid, ino_t netns)
+{
+	int fd, nsfd = -1, selffd = -1;
+	struct stat sb;
+	char path[sizeof("/proc//ns/net") + sizeof(stringify_value(INT_MAX))];
+
+	if (netns != self_netns) {
+		snprintf(path, sizeof(path), "/proc/%d/ns/net", (int) pid);
+		nsfd = open(path, O_RDONLY | O_CLOEXEC);
+		if (nsfd < 0)
+			return -1;
+
+		/* the process may be gone and the PID reused */
+		if (fstat(nsfd, &sb) != 0 || sb.st_ino != netns) {
+			close(nsfd);
+			return -1;
+		}
+		selffd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+		if (selffd < 0 || setns(nsfd, CLONE_NEWNET) < 0) {
+			if (selffd >= 0)
+				close(selffd);
+			close(nsfd);
+			return -1;
+		}
+	}
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+
+	if (nsfd >= 0) {
+		if (setns(selffd, CLONE_NEWNET) < 0)
+			err(EXIT_FAILURE, _("failed to restore network namespace"));
+		close(selffd);
+		close(nsfd);
+	}
+	return fd;
+}
+
+void initialize_sock_diag(void)
+{
+	struct stat sb;
+
+	INIT_LIST_HEAD(&netns_list);
+	if (stat("/proc/self/ns/net", &sb) == 0)
+		self_netns = sb.st_ino;
+}
+
+void finalize_sock_diag(void)
+{
+	list_free(&netns_list, struct sock_netns, netns, free_netns);
+}
+
+/*
+ * Returns details about the socket @inode from the network namespace
+ * @netns, or NULL. The namespace is dumped on the first call; @pid is
+ * a process in the namespace.
+ */
+const struct sock_diag *get_sock_diag(pid_t pid, ino_t netns, ino_t inode)
+{
+	struct sock_netns *ns = NULL;
+	struct list_head *p;
+
+	if (!netns)
+		return NULL;
+
+	list_for_each(p, &netns_list) {
+		struct sock_netns *x = list_entry(p, struct sock_netns, netns);
+		if (x->ino == netns) {
+			ns = x;
+			break;
+		}
+	}
+
+	if (!ns) {
+		int fd;
+
+		ns = xcalloc(1, sizeof(*ns));
+		ns->ino = netns;
+		INIT_LIST_HEAD(&ns->netns);
+		list_add_tail(&ns->netns, &netns_list);
+
+		fd = open_sock_diag(pid, netns);
+		if (fd >= 0) {
+			load_netns(fd, ns);
+			close(fd);
+		}
+	}
+
+	return netns_lookup(ns, inode);
+}
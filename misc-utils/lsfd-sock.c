@@ -21,19 +21,140 @@
 
 #include <sys/types.h>
 #include <sys/xattr.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "xalloc.h"
 #include "nls.h"
 #include "libsmartcols.h"
 
 #include "lsfd.h"
+#include "lsfd-sock.h"
 
 struct sock {
 	struct file file;
 	char *protoname;
+	const struct sock_diag *diag;
+	unsigned int diag_done : 1;
 };
 
-static bool sock_fill_column(struct proc *proc __attribute__((__unused__)),
+static bool is_sockfs_socket(struct file *file)
+{
+	return major(file->stat.st_dev) == 0
+		&& file->name && strncmp(file->name, "socket:", 7) == 0;
+}
+
+/* The details are read on demand, so only the processes with sockets in
+ * the output need the namespace dump. */
+static const struct sock_diag *sock_get_diag(struct proc *proc, struct sock *sock)
+{
+	if (!sock->diag_done) {
+		if (is_sockfs_socket(&sock->file))
+			sock->diag = get_sock_diag(proc->pid, proc->ns_net,
+						   sock->file.stat.st_ino);
+		sock->diag_done = 1;
+	}
+	return sock->diag;
+}
+
+static const char *sock_state_name(const struct sock_diag *diag)
+{
+	static const char *tcp_states[] = {
+		[TCP_ESTABLISHED] = "established",
+		[TCP_SYN_SENT]    = "syn-sent",
+		[TCP_SYN_RECV]    = "syn-recv",
+		[TCP_FIN_WAIT1]   = "fin-wait1",
+		[TCP_FIN_WAIT2]   = "fin-wait2",
+		[TCP_TIME_WAIT]   = "time-wait",
+		[TCP_CLOSE]       = "close",
+		[TCP_CLOSE_WAIT]  = "close-wait",
+		[TCP_LAST_ACK]    = "last-ack",
+		[TCP_LISTEN]      = "listen",
+		[TCP_CLOSING]     = "closing",
+	};
+
+	/* connectionless and UNIX sockets reuse the TCP states */
+	if (diag->family == AF_UNIX || diag->protocol != IPPROTO_TCP) {
+		switch (diag->state) {
+		case TCP_ESTABLISHED:
+			return "connected";
+		case TCP_CLOSE:
+			return "unconnected";
+		case TCP_LISTEN:
+			return "listen";
+		}
+	}
+	if (diag->state < ARRAY_SIZE(tcp_states) && tcp_states[diag->state])
+		return tcp_states[diag->state];
+	return NULL;
+}
+
+static char *sock_addr_string(const struct sock_diag *diag, const struct sock_addr *a)
+{
+	char buf[INET6_ADDRSTRLEN];
+	char *str = NULL;
+
+	if (!inet_ntop(diag->family, a->addr, buf, sizeof(buf)))
+		return NULL;
+	if (diag->family == AF_INET6)
+		xasprintf(&str, "[%s]:%"PRIu16, buf, a->port);
+	else
+		xasprintf(&str, "%s:%"PRIu16, buf, a->port);
+	return str;
+}
+
+static bool sock_fill_diag_column(struct proc *proc,
+				  struct sock *sock,
+				  int column_id,
+				  char **str)
+{
+	const struct sock_diag *diag = sock_get_diag(proc, sock);
+	const char *s;
+
+	if (!diag)
+		return false;
+
+	switch(column_id) {
+	case COL_SOCK_NETNS:
+		xasprintf(str, "%"PRIu64, (uint64_t) diag->netns);
+		return true;
+	case COL_SOCK_STATE:
+		s = sock_state_name(diag);
+		if (!s)
+			return false;
+		*str = xstrdup(s);
+		return true;
+	case COL_SOCK_RQLEN:
+		xasprintf(str, "%"PRIu32, diag->rqueue);
+		return true;
+	case COL_SOCK_WQLEN:
+		xasprintf(str, "%"PRIu32, diag->wqueue);
+		return true;
+	case COL_SOCK_LADDR:
+		if (diag->family == AF_UNIX) {
+			if (!diag->un.path)
+				return false;
+			*str = xstrdup(diag->un.path);
+		} else
+			*str = sock_addr_string(diag, &diag->in.local);
+		return true;
+	case COL_SOCK_RADDR:
+		if (diag->family == AF_UNIX)
+			return false;
+		*str = sock_addr_string(diag, &diag->in.remote);
+		return true;
+	case COL_UNIX_PEER:
+		if (diag->family != AF_UNIX || !diag->un.peer)
+			return false;
+		xasprintf(str, "%"PRIu64, (uint64_t) diag->un.peer);
+		return true;
+	}
+	return false;
+}
+
+static bool sock_fill_column(struct proc *proc,
 			     struct file *file,
 			     struct libscols_line *ln,
 			     int column_id,
@@ -52,19 +173,27 @@ static bool sock_fill_column(struct proc *proc __attribute__((__unused__)),
 				err(EXIT_FAILURE, _("failed to add output data"));
 		return true;
 	case COL_NAME:
-		if (sock->protoname
-		    && file->name && strncmp(file->name, "socket:", 7) == 0) {
+		if (sock->protoname && is_sockfs_socket(file)) {
 			xasprintf(&str, "%s:%s", sock->protoname, file->name + 7);
 			break;
 		}
 		return false;
 	case COL_SOURCE:
-		if (major(file->stat.st_dev) == 0
-		    && strncmp(file->name, "socket:", 7) == 0) {
+		if (is_sockfs_socket(file)) {
 			str = strdup("sockfs");
 			break;
 		}
 		return false;
+	case COL_SOCK_LADDR:
+	case COL_SOCK_NETNS:
+	case COL_SOCK_RADDR:
+	case COL_SOCK_RQLEN:
+	case COL_SOCK_STATE:
+	case COL_SOCK_WQLEN:
+	case COL_UNIX_PEER:
+		if (!sock_fill_diag_column(proc, sock, column_id, &str))
+			return false;
+		break;
 	default:
 		return false;
 	}
@@ -120,6 +249,8 @@ static void free_sock_content(struct file *file)
 const struct file_class sock_class = {
 	.super = &file_class,
 	.size = sizeof(struct sock),
+	.initialize_class = initialize_sock_diag,
+	.finalize_class = finalize_sock_diag,
 	.fill_column = sock_fill_column,
 	.initialize_content = init_sock_content,
 	.free_content = free_sock_content,
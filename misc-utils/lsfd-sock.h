@@ -0,0 +1,56 @@
+/*
+ * lsfd-sock.h - socket details shared by lsfd-sock.c and lsfd-sock-diag.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef UTIL_LINUX_LSFD_SOCK_H
+#define UTIL_LINUX_LSFD_SOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Socket details dumped by NETLINK_SOCK_DIAG (see lsfd-sock-diag.c)
+ */
+struct sock_addr {
+	uint8_t addr[16];		/* in network byte order */
+	uint16_t port;			/* in host byte order */
+};
+
+struct sock_diag {
+	ino_t inode;
+	ino_t netns;
+	int family;			/* AF_UNIX, AF_INET or AF_INET6 */
+	int protocol;			/* IPPROTO_* for AF_INET{,6}, socket type for AF_UNIX */
+	uint8_t state;			/* TCP_* from <netinet/tcp.h> */
+	uint32_t rqueue;
+	uint32_t wqueue;
+
+	union {
+		struct {
+			struct sock_addr local;
+			struct sock_addr remote;
+		} in;
+		struct {
+			char *path;	/* abstract names start with '@' */
+			ino_t peer;
+		} un;
+	};
+
+	struct sock_diag *next;		/* hash chain */
+};
+
+void initialize_sock_diag(void);
+void finalize_sock_diag(void);
+const struct sock_diag *get_sock_diag(pid_t pid, ino_t netns, ino_t inode);
+
+#endif /* UTIL_LINUX_LSFD_SOCK_H */
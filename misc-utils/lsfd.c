@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <linux/sched.h>
 #include <sys/syscall.h>
@@ -76,6 +77,9 @@ struct nodev_table {
 };
 static struct nodev_table nodev_table;
 
+/* protects nodev_table and mnt_namespaces when /proc is scanned by more threads */
+static pthread_mutex_t nodevs_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct name_manager {
 	struct idcache *cache;
 	unsigned long next_id;
@@ -173,6 +177,18 @@ static struct colinfo infos[] = {
 		N_("device ID (if special file)") },
 	[COL_SIZE]    = { "SIZE",     4, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
 		N_("file size"), },
+	[COL_SOCK_LADDR]={ "SOCK.LADDR",0.2, SCOLS_FL_TRUNC, SCOLS_JSON_STRING,
+		N_("local socket address") },
+	[COL_SOCK_NETNS]={ "SOCK.NETNS",0, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
+		N_("inode identifying network namespace where the socket belongs to") },
+	[COL_SOCK_RADDR]={ "SOCK.RADDR",0.2, SCOLS_FL_TRUNC, SCOLS_JSON_STRING,
+		N_("remote socket address") },
+	[COL_SOCK_RQLEN]={ "SOCK.RQLEN",0, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
+		N_("receive queue length") },
+	[COL_SOCK_STATE]={ "SOCK.STATE",0, SCOLS_FL_RIGHT, SCOLS_JSON_STRING,
+		N_("state of socket") },
+	[COL_SOCK_WQLEN]={ "SOCK.WQLEN",0, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
+		N_("send queue length") },
 	[COL_SOURCE] = { "SOURCE",  0, SCOLS_FL_RIGHT, SCOLS_JSON_STRING,
 		N_("file system, partition, or device containing file") },
 	[COL_TID]    = { "TID",       5, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
@@ -181,6 +197,8 @@ static struct colinfo infos[] = {
 		N_("file type") },
 	[COL_UID]     = { "UID",      0, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
 		N_("user ID number of the process") },
+	[COL_UNIX_PEER]={ "UNIX.PEER",0, SCOLS_FL_RIGHT, SCOLS_JSON_NUMBER,
+		N_("inode of the peer of UNIX domain socket") },
 	[COL_USER]    = { "USER",     0, SCOLS_FL_RIGHT, SCOLS_JSON_STRING,
 		N_("user of the process") },
 };
@@ -294,6 +312,7 @@ static struct counter_spec default_counter_specs[] = {
 struct lsfd_control {
 	struct libscols_table *tb;		/* output */
 	struct list_head procs;			/* list of all processes */
+	size_t njobs;				/* number of /proc scanning threads */
 
 	unsigned int	noheadings : 1,
 			raw : 1,
@@ -301,10 +320,12 @@ struct lsfd_control {
 			notrunc : 1,
 			threads : 1,
 			show_main : 1,		/* print main table */
-			show_summary : 1;	/* print summary/counters */
+			show_summary : 1,	/* print summary/counters */
+			skip_maps : 1;		/* the filter rejects all mappings */
 
 	struct lsfd_filter *filter;
 	struct lsfd_counter **counters;		/* NULL terminated array. */
+	struct lsfd_filter_cache *filter_cache;	/* shared by filter and counters */
 };
 
 static int column_name_to_id(const char *name, size_t namesz)
@@ -573,6 +594,9 @@ static struct file *collect_file_symlink(struct path_cxt *pc,
 	if (is_association(f, NS_MNT))
 		proc->ns_mnt = f->stat.st_ino;
 
+	else if (is_association(f, NS_NET))
+		proc->ns_net = f->stat.st_ino;
+
 	else if (assoc >= 0) {
 		/* file-descriptor based association */
 		FILE *fdinfo;
@@ -913,20 +937,57 @@ static void fill_column(struct proc *proc,
 	}
 }
 
+struct fill_cxt {
+	struct proc *proc;
+	struct file *file;
+	ssize_t *index;		/* column id -> column index, or -1 */
+	bool *filled;		/* column index -> already filled */
+};
+
+/* Called by the filter when it needs a column value. */
+static void fill_column_lazily(struct libscols_line *ln, int column_id, void *data)
+{
+	struct fill_cxt *cxt = data;
+	ssize_t i = cxt->index[column_id];
+
+	if (i < 0 || cxt->filled[i])
+		return;
+	fill_column(cxt->proc, cxt->file, ln, column_id, i);
+	cxt->filled[i] = true;
+}
+
 static void convert_file(struct proc *proc,
 		     struct file *file,
-		     struct libscols_line *ln)
+		     struct libscols_line *ln,
+		     const bool *filled)
 
 {
 	size_t i;
 
-	for (i = 0; i < ncolumns; i++)
+	for (i = 0; i < ncolumns; i++) {
+		if (filled && filled[i])
+			continue;
 		fill_column(proc, file, ln, get_column_id(i), i);
+	}
 }
 
 static void convert(struct list_head *procs, struct lsfd_control *ctl)
 {
 	struct list_head *p;
+	struct fill_cxt cxt = { .filled = NULL };
+	size_t i;
+
+	/* The filter is evaluated before the line is converted; only the
+	 * columns the filter really needs are filled in advance, and the rest
+	 * only for the accepted lines. */
+	if (ctl->filter) {
+		cxt.index = xmalloc(LSFD_N_COLS * sizeof(ssize_t));
+		for (i = 0; i < LSFD_N_COLS; i++)
+			cxt.index[i] = -1;
+		for (i = ncolumns; i > 0; i--)
+			cxt.index[get_column_id(i - 1)] = i - 1;
+		cxt.filled = xcalloc(ncolumns, sizeof(bool));
+	}
 
 	list_for_each (p, procs) {
 		struct proc *proc = list_entry(p, struct proc, procs);
@@ -940,13 +1001,22 @@ static void convert(struct list_head *procs, struct lsfd_control *ctl)
 			if (!ln)
 				err(EXIT_FAILURE, _("failed to allocate output line"));
 
-			convert_file(proc, file, ln);
+			lsfd_filter_cache_reset(ctl->filter_cache);
 
-			if (!lsfd_filter_apply(ctl->filter, ln)) {
-				scols_table_remove_line(ctl->tb, ln);
-				continue;
+			if (ctl->filter) {
+				cxt.proc = proc;
+				cxt.file = file;
+				memset(cxt.filled, 0, ncolumns * sizeof(bool));
+
+				if (!lsfd_filter_apply_lazily(ctl->filter, ln,
+							      fill_column_lazily, &cxt)) {
+					scols_table_remove_line(ctl->tb, ln);
+					continue;
+				}
 			}
 
+			convert_file(proc, file, ln, cxt.filled);
+
 			if (!ctl->counters)
 				continue;
 
@@ -954,6 +1024,11 @@ static void convert(struct list_head *procs, struct lsfd_control *ctl)
 				lsfd_counter_accumulate(*counter, ln);
 		}
 	}
+
+	if (ctl->filter) {
+		free(cxt.index);
+		free(cxt.filled);
+	}
 }
 
 static void delete(struct list_head *procs, struct lsfd_control *ctl)
@@ -968,6 +1043,7 @@ static void delete(struct list_head *procs, struct lsfd_control *ctl)
 			lsfd_counter_free(*counter);
 		free(ctl->counters);
 	}
+	lsfd_filter_cache_unref(ctl->filter_cache);
 }
 
 static void emit(struct lsfd_control *ctl)
@@ -1166,7 +1242,7 @@ unsigned long add_name(struct name_manager *nm, const char *name)
 }
 
 static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
-			 pid_t pid, struct proc *leader)
+			 pid_t pid, struct proc *leader, struct list_head *procs)
 {
 	char buf[BUFSIZ];
 	struct proc *proc;
@@ -1206,6 +1282,7 @@ static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
 
 	collect_namespace_files(pc, proc);
 
+	pthread_mutex_lock(&nodevs_lock);
 	if (proc->ns_mnt == 0 || !has_mnt_ns(proc->ns_mnt)) {
 		FILE *mnt = ul_path_fopen(pc, "r", "mountinfo");
 		if (mnt) {
@@ -1215,21 +1292,23 @@ static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
 			fclose(mnt);
 		}
 	}
+	pthread_mutex_unlock(&nodevs_lock);
 
 	/* If kcmp is not available,
 	 * there is no way to no whether threads share resources.
 	 * In such cases, we must pay the costs: call collect_mem_files()
 	 * and collect_fd_files().
 	 */
-	if (proc->pid == proc->leader->pid
-	    || kcmp(proc->leader->pid, proc->pid, KCMP_VM, 0, 0) != 0)
+	if (!ctl->skip_maps
+	    && (proc->pid == proc->leader->pid
+		|| kcmp(proc->leader->pid, proc->pid, KCMP_VM, 0, 0) != 0))
 		collect_mem_files(pc, proc);
 
 	if (proc->pid == proc->leader->pid
 	    || kcmp(proc->leader->pid, proc->pid, KCMP_FILES, 0, 0) != 0)
 		collect_fd_files(pc, proc);
 
-	list_add_tail(&proc->procs, &ctl->procs);
+	list_add_tail(&proc->procs, procs);
 
 	/* The tasks collecting overwrites @pc by /proc/<task-pid>/. Keep it as
 	 * the last path based operation in read_process()
@@ -1241,7 +1320,7 @@ static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
 		while (procfs_process_next_tid(pc, &sub, &tid) == 0) {
 			if (tid == pid)
 				continue;
-			read_process(ctl, pc, tid, proc);
+			read_process(ctl, pc, tid, proc, procs);
 		}
 	}
 
@@ -1300,15 +1379,85 @@ static bool member_pids(const pid_t pid, const pid_t pids[], const int count)
 	return bsearch(&pid, pids, count, sizeof(pid_t), pidcmp)? true: false;
 }
 
+/*
+ * The processes are read by ctl->njobs threads. Every thread takes the next
+ * not yet read PID from the list of all PIDs and reads the process (and its
+ * threads) to the per-PID list of processes, so the threads don't share
+ * anything but the list position, nodev_table and mnt_namespaces. The per-PID
+ * lists are merged in the /proc order after all threads finished, so the
+ * output is the same as when the processes are read one by one.
+ */
+struct scan_item {
+	pid_t pid;
+	struct list_head procs;		/* the process and its threads */
+};
+
+struct scan_control {
+	struct lsfd_control *ctl;
+
+	struct scan_item *items;
+	size_t nitems;
+	size_t next;			/* the first not yet read item */
+	pthread_mutex_t lock;		/* protects @next */
+};
+
+struct scan_worker {
+	struct scan_control *scan;
+	struct path_cxt *pc;
+	pthread_t thread;
+};
+
+static struct scan_item *next_scan_item(struct scan_control *scan)
+{
+	struct scan_item *item = NULL;
+
+	pthread_mutex_lock(&scan->lock);
+	if (scan->next < scan->nitems)
+		item = &scan->items[scan->next++];
+	pthread_mutex_unlock(&scan->lock);
+
+	return item;
+}
+
+static void *scan_processes(void *data)
+{
+	struct scan_worker *wk = data;
+	struct scan_item *item;
+
+	while ((item = next_scan_item(wk->scan)))
+		read_process(wk->scan->ctl, wk->pc, item->pid, NULL, &item->procs);
+
+	return NULL;
+}
+
+static void attach_ipcs(struct list_head *procs)
+{
+	struct list_head *p, *f;
+
+	list_for_each (p, procs) {
+		struct proc *proc = list_entry(p, struct proc, procs);
+
+		list_for_each (f, &proc->files) {
+			struct file *file = list_entry(f, struct file, files);
+			const struct file_class *class = file->class;
+
+			for (; class; class = class->super) {
+				if (class->attach_ipc) {
+					class->attach_ipc(file);
+					break;
+				}
+			}
+		}
+	}
+}
+
 static void collect_processes(struct lsfd_control *ctl, const pid_t pids[], int n_pids)
 {
 	DIR *dir;
 	struct dirent *d;
-	struct path_cxt *pc = NULL;
-
-	pc = ul_new_path(NULL);
-	if (!pc)
-		err(EXIT_FAILURE, _("failed to alloc procfs handler"));
+	struct scan_control scan = { .ctl = ctl };
+	struct scan_worker *workers;
+	size_t i, nworkers, nalloc = 0;
 
 	dir = opendir(_PATH_PROC);
 	if (!dir)
@@ -1319,12 +1468,52 @@ static void collect_processes(struct lsfd_control *ctl, const pid_t pids[], int
 
 		if (procfs_dirent_get_pid(d, &pid) != 0)
 			continue;
-		if (n_pids == 0 || member_pids(pid, pids, n_pids))
-			read_process(ctl, pc, pid, 0);
+		if (n_pids != 0 && !member_pids(pid, pids, n_pids))
+			continue;
+		if (scan.nitems == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 256;
+			scan.items = xrealloc(scan.items, nalloc * sizeof(*scan.items));
+		}
+		scan.items[scan.nitems].pid = pid;
+		INIT_LIST_HEAD(&scan.items[scan.nitems].procs);
+		scan.nitems++;
 	}
-
 	closedir(dir);
-	ul_unref_path(pc);
+
+	nworkers = max(min(ctl->njobs, scan.nitems), (size_t) 1);
+	workers = xcalloc(nworkers, sizeof(*workers));
+	pthread_mutex_init(&scan.lock, NULL);
+
+	for (i = 0; i < nworkers; i++) {
+		workers[i].scan = &scan;
+		workers[i].pc = ul_new_path(NULL);
+		if (!workers[i].pc)
+			err(EXIT_FAILURE, _("failed to alloc procfs handler"));
+	}
+
+	if (nworkers == 1)
+		scan_processes(&workers[0]);
+	else {
+		for (i = 0; i < nworkers; i++) {
+			errno = pthread_create(&workers[i].thread, NULL,
+					       scan_processes, &workers[i]);
+			if (errno)
+				err(EXIT_FAILURE, _("failed to create thread"));
+		}
+		for (i = 0; i < nworkers; i++)
+			pthread_join(workers[i].thread, NULL);
+	}
+
+	for (i = 0; i < nworkers; i++)
+		ul_unref_path(workers[i].pc);
+	free(workers);
+	pthread_mutex_destroy(&scan.lock);
+
+	for (i = 0; i < scan.nitems; i++)
+		list_splice(&scan.items[i].procs, ctl->procs.prev);	/* append */
+	free(scan.items);
+
+	attach_ipcs(&ctl->procs);
 }
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -1343,6 +1532,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -r, --raw             use raw output format\n"), out);
 	fputs(_(" -u, --notruncate      don't truncate text in columns\n"), out);
 	fputs(_(" -p, --pid  <pid(s)>   collect information only specified processes\n"), out);
+	fputs(_(" -j, --jobs <num>      number of threads reading /proc (0 for all CPUs)\n"), out);
 	fputs(_(" -Q, --filter <expr>   apply display filter\n"), out);
 	fputs(_("     --debug-filter    dump the internal data structure of filter and exit\n"), out);
 	fputs(_(" -C, --counter <name>:<expr>\n"
@@ -1396,7 +1586,8 @@ static struct lsfd_filter *new_filter(const char *expr, bool debug, const char *
 	filter = lsfd_filter_new(expr, ctl->tb,
 				 LSFD_N_COLS,
 				 column_name_to_id_cb,
-				 add_column_by_id_cb, ctl);
+				 add_column_by_id_cb, ctl,
+				 ctl->filter_cache);
 	errmsg = lsfd_filter_get_errmsg(filter);
 	if (errmsg)
 		errx(EXIT_FAILURE, "%s%s", err_prefix, errmsg);
@@ -1408,6 +1599,26 @@ static struct lsfd_filter *new_filter(const char *expr, bool debug, const char *
 	return filter;
 }
 
+/*
+ * Returns true if the filter rejects all the files from /proc/#/maps, so
+ * reading (and stat()ing) them is useless.
+ */
+static bool filter_rejects_maps(struct lsfd_filter *filter)
+{
+	const char *assocs[] = { "mem", "shm" };
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(assocs); i++) {
+		struct lsfd_filter_hint hints[] = {
+			{ .col_id = COL_ASSOC, .data = assocs[i] },
+			{ .col_id = COL_FD,    .data = NULL },
+		};
+		if (lsfd_filter_may_accept(filter, hints, ARRAY_SIZE(hints)))
+			return false;
+	}
+	return true;
+}
+
 static struct counter_spec *new_counter_spec(const char *spec_str)
 {
 	char *sep;
@@ -1591,7 +1802,8 @@ int main(int argc, char *argv[])
 	struct list_head counter_specs;
 
 	struct lsfd_control ctl = {
-		.show_main = 1
+		.show_main = 1,
+		.njobs = 1
 	};
 
 	INIT_LIST_HEAD(&counter_specs);
@@ -1611,6 +1823,7 @@ int main(int argc, char *argv[])
 		{ "threads",    no_argument, NULL, 'l' },
 		{ "notruncate", no_argument, NULL, 'u' },
 		{ "pid",        required_argument, NULL, 'p' },
+		{ "jobs",       required_argument, NULL, 'j' },
 		{ "filter",     required_argument, NULL, 'Q' },
 		{ "debug-filter",no_argument, NULL, OPT_DEBUG_FILTER },
 		{ "summary",    optional_argument, NULL,  OPT_SUMMARY },
@@ -1624,7 +1837,7 @@ int main(int argc, char *argv[])
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "no:JrVhluQ:p:C:s", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "no:JrVhluQ:p:j:C:s", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'n':
 			ctl.noheadings = 1;
@@ -1647,6 +1860,13 @@ int main(int argc, char *argv[])
 		case 'p':
 			parse_pids(optarg, &pids, &n_pids);
 			break;
+		case 'j':
+			ctl.njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (ctl.njobs == 0) {
+				long n = sysconf(_SC_NPROCESSORS_ONLN);
+				ctl.njobs = n > 0 ? (size_t) n : 1;
+			}
+			break;
 		case 'Q':
 			append_filter_expr(&filter_expr, optarg, true);
 			break;
@@ -1727,10 +1947,13 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	ctl.filter_cache = lsfd_filter_cache_new(LSFD_N_COLS);
+
 	/* make fitler */
 	if (filter_expr) {
 		ctl.filter = new_filter(filter_expr, debug_filter, "", &ctl);
 		free(filter_expr);
+		ctl.skip_maps = filter_rejects_maps(ctl.filter);
 	}
 
 	if (dump_counters) {
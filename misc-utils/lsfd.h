@@ -61,10 +61,17 @@ enum {
 	COL_PROTONAME,
 	COL_RDEV,
 	COL_SIZE,
+	COL_SOCK_LADDR,
+	COL_SOCK_NETNS,
+	COL_SOCK_RADDR,
+	COL_SOCK_RQLEN,
+	COL_SOCK_STATE,
+	COL_SOCK_WQLEN,
 	COL_SOURCE,
 	COL_TID,
 	COL_TYPE,
 	COL_UID,		/* process */
+	COL_UNIX_PEER,
 	COL_USER,		/* process */
 	COL_FUID,		/* file */
 	COL_OWNER,		/* file */
@@ -99,6 +106,7 @@ struct proc {
 	char *command;
 	uid_t uid;
 	ino_t ns_mnt;
+	ino_t ns_net;
 	struct list_head procs;
 	struct list_head files;
 	unsigned int kthread: 1;
@@ -140,6 +148,8 @@ struct file_class {
 	void (*initialize_content)(struct file *file);
 	void (*free_content)(struct file *file);
 	struct ipc_class *(*get_ipc_class)(struct file *file);
+	/* called after all processes are collected, in the output order */
+	void (*attach_ipc)(struct file *file);
 };
 
 extern const struct file_class file_class, cdev_class, bdev_class, sock_class, unkn_class, fifo_class;
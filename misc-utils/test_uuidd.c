@@ -22,17 +22,28 @@
  * to overwrite the built-in default then use:
  *
  *	make uuidd uuidgen runstatedir=/var/run
+ *
+ * The load-test mode (-L) talks to the uuidd socket directly. Every thread
+ * is one client which sends the requests one by one, each by a new connection,
+ * the latency percentiles and UUIDs per second are reported at the end:
+ *
+ *	test_uuidd -L /run/uuidd/request -t 64 -o 1000 -b 10
  */
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/shm.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 
 #include "uuid.h"
+#include "uuidd.h"
+#include "all-io.h"
 #include "c.h"
 #include "xalloc.h"
 #include "strutils.h"
@@ -44,6 +55,8 @@ static size_t nprocesses = 4;
 static size_t nthreads = 4;
 static size_t nobjects = 4096;
 static size_t loglev = 1;
+static const char *load_socket;		/* load-test mode */
+static size_t load_bulk;
 
 struct processentry {
 	pid_t		pid;
@@ -81,6 +94,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	printf("  -t <num>     number of nthreads (default:%zu)\n", nthreads);
 	printf("  -o <num>     number of nobjects (default:%zu)\n", nobjects);
 	printf("  -l <level>   log level (default:%zu)\n", loglev);
+	printf("  -L <socket>  load-test uuidd; <num> of threads and objects\n"
+	       "               are clients and requests per client\n");
+	printf("  -b <num>     UUIDs per request in load-test (default: 1)\n");
 	printf("  -h           display help\n");
 
 	exit(EXIT_SUCCESS);
@@ -264,6 +280,165 @@ static void object_dump(size_t idx, object_t *obj)
 	fprintf(stderr, "}\n");
 }
 
+struct loadentry {
+	pthread_t	tid;
+	uuid_t		*uuids;		/* the first UUID from each reply */
+	uint64_t	*latencies;	/* nanoseconds */
+	size_t		nuuids;		/* total number of UUIDs */
+	size_t		nfailed;
+};
+typedef struct loadentry load_t;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Sends one request to uuidd, returns number of UUIDs or -1 on error */
+static int load_request(const struct sockaddr_un *addr, uuid_t uu)
+{
+	char buf[sizeof(uint8_t) + sizeof(int32_t)];
+	uint8_t op = load_bulk > 1 ? UUIDD_OP_BULK_TIME_UUID :
+				     UUIDD_OP_TIME_UUID;
+	int32_t num = load_bulk;
+	size_t sz = sizeof(op);
+	int32_t reply_len = 0;
+	int fd, rc = -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (const struct sockaddr *) addr, sizeof(*addr)) < 0)
+		goto done;
+
+	memcpy(buf, &op, sizeof(op));
+	if (op == UUIDD_OP_BULK_TIME_UUID) {
+		memcpy(buf + sz, &num, sizeof(num));
+		sz += sizeof(num);
+	}
+	if (write_all(fd, buf, sz) != 0)
+		goto done;
+	if (read_all(fd, (char *) &reply_len, sizeof(reply_len)) != sizeof(reply_len)
+	    || reply_len < (int32_t) sizeof(uuid_t))
+		goto done;
+	if (read_all(fd, (char *) uu, sizeof(uuid_t)) != sizeof(uuid_t))
+		goto done;
+	num = 1;
+	if (op == UUIDD_OP_BULK_TIME_UUID
+	    && read_all(fd, (char *) &num, sizeof(num)) != sizeof(num))
+		goto done;
+	rc = num;
+done:
+	close(fd);
+	return rc;
+}
+
+static void *load_body(void *arg)
+{
+	load_t *ld = (load_t *) arg;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	size_t i;
+
+	xstrncpy(addr.sun_path, load_socket, sizeof(addr.sun_path));
+
+	for (i = 0; i < nobjects; i++) {
+		uint64_t start = now_ns();
+		int n = load_request(&addr, ld->uuids[i]);
+
+		ld->latencies[i] = now_ns() - start;
+		if (n < 0) {
+			LOG(2, (stderr, "request #%zu failed\n", i));
+			ld->nfailed++;
+		} else
+			ld->nuuids += n;
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_uuid(const void *a, const void *b)
+{
+	return uuid_compare(*(const uuid_t *) a, *(const uuid_t *) b);
+}
+
+static int load_test(void)
+{
+	size_t i, total = nthreads * nobjects, nuuids = 0, nfailed = 0, ndups = 0;
+	load_t *clients;
+	uuid_t *uuids;
+	uint64_t *latencies, start, usec;
+	int rc;
+
+	clients = xcalloc(nthreads, sizeof(load_t));
+	uuids = xcalloc(total, sizeof(uuid_t));
+	latencies = xcalloc(total, sizeof(uint64_t));
+
+	if (loglev >= 1)
+		fprintf(stderr, "requested: %zu clients, %zu requests per client, %zu UUIDs per request\n",
+				nthreads, nobjects, load_bulk ? load_bulk : 1);
+
+	start = now_ns();
+	for (i = 0; i < nthreads; i++) {
+		load_t *ld = &clients[i];
+
+		ld->uuids = uuids + i * nobjects;
+		ld->latencies = latencies + i * nobjects;
+		rc = pthread_create(&ld->tid, NULL, &load_body, ld);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, "pthread_create failed");
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		rc = pthread_join(clients[i].tid, NULL);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, "pthread_join failed");
+		}
+		nuuids += clients[i].nuuids;
+		nfailed += clients[i].nfailed;
+	}
+	usec = (now_ns() - start) / 1000;
+	if (!usec)
+		usec = 1;
+
+	qsort(latencies, total, sizeof(uint64_t), cmp_u64);
+	qsort(uuids, total, sizeof(uuid_t), cmp_uuid);
+	for (i = 0; i + 1 < total; i++) {
+		if (uuid_is_null(uuids[i]))
+			continue;
+		if (uuid_compare(uuids[i], uuids[i + 1]) == 0)
+			ndups++;
+	}
+
+	printf("requests:  %zu (%zu failed)\n", total, nfailed);
+	printf("uuids:     %zu\n", nuuids);
+	printf("time:      %ju.%06ju sec\n", (uintmax_t) usec / 1000000,
+					      (uintmax_t) usec % 1000000);
+	printf("uuids/sec: %ju\n", (uintmax_t) (nuuids * 1000000 / usec));
+	printf("latency:   p50 %ju us, p99 %ju us, max %ju us\n",
+			(uintmax_t) latencies[total / 2] / 1000,
+			(uintmax_t) latencies[total * 99 / 100] / 1000,
+			(uintmax_t) latencies[total - 1] / 1000);
+
+	free(latencies);
+	free(uuids);
+	free(clients);
+
+	if (ndups)
+		printf("test failed (found %zu duplicate UUIDs)\n", ndups);
+	return nfailed || ndups ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 #define MSG_TRY_HELP "Try '-h' for help."
 
 int main(int argc, char *argv[])
@@ -271,7 +446,7 @@ int main(int argc, char *argv[])
 	size_t i, nfailed = 0, nignored = 0;
 	int c;
 
-	while (((c = getopt(argc, argv, "p:t:o:l:h")) != -1)) {
+	while (((c = getopt(argc, argv, "p:t:o:l:L:b:h")) != -1)) {
 		switch (c) {
 		case 'p':
 			nprocesses = strtou32_or_err(optarg, "invalid nprocesses number argument");
@@ -285,6 +460,12 @@ int main(int argc, char *argv[])
 		case 'l':
 			loglev = strtou32_or_err(optarg, "invalid log level argument");
 			break;
+		case 'L':
+			load_socket = optarg;
+			break;
+		case 'b':
+			load_bulk = strtou32_or_err(optarg, "invalid bulk number argument");
+			break;
 		case 'h':
 			usage();
 			break;
@@ -297,6 +478,12 @@ int main(int argc, char *argv[])
 	if (optind != argc)
 		errx(EXIT_FAILURE, "bad usage\n" MSG_TRY_HELP);
 
+	if (load_socket) {
+		if (!nthreads || !nobjects)
+			errx(EXIT_FAILURE, "bad usage\n" MSG_TRY_HELP);
+		return load_test();
+	}
+
 	if (loglev == 1)
 		fprintf(stderr, "requested: %zu processes, %zu threads, %zu objects per thread (%zu objects = %zu bytes)\n",
 				nprocesses, nthreads, nobjects,
@@ -40,7 +40,8 @@
 #include <string.h>
 #include <getopt.h>
 #include <sys/signalfd.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <time.h>
 
 #include "uuid.h"
 #include "uuidd.h"
@@ -51,6 +52,7 @@
 #include "optutils.h"
 #include "monotonic.h"
 #include "timer.h"
+#include "xalloc.h"
 
 #ifdef HAVE_LIBSYSTEMD
 # include <systemd/sd-daemon.h>
@@ -67,15 +69,65 @@ enum {
 	UUIDD_PROT_BUFSZ = ((sizeof(uuidd_prot_num_t)) + (sizeof(uuid_t) * 63))
 };
 
+/* maximal number of clients served at the same time */
+#define UUIDD_MAX_CLIENTS	1024
+
+/*
+ * Pre-generated time-based UUIDs. The ranges are reserved by
+ * __uuid_generate_time() after the requests are served, so the next requests
+ * do not wait for the clock counter lock.
+ */
+#define UUIDD_RING_SIZE		8	/* number of ranges */
+#define UUIDD_RANGE_SIZE	100000	/* UUIDs per range (10 ms of timestamps) */
+
+struct uuidd_range {
+	uuid_t		next;		/* the first not yet used UUID */
+	int		num;		/* number of remaining UUIDs */
+	time_t		time;		/* time of the reservation */
+};
+
+struct uuidd_ring {
+	struct uuidd_range ranges[UUIDD_RING_SIZE];
+	size_t		head;
+	size_t		count;
+	unsigned int	used : 1;	/* refill needed */
+};
+
+/* epoll event source */
+enum {
+	UUIDD_CONN_SIGNAL = 0,
+	UUIDD_CONN_LISTEN,
+	UUIDD_CONN_CLIENT
+};
+
+struct uuidd_conn {
+	int		type;
+	int		fd;
+
+	/* client request and reply */
+	char		req[sizeof(uuidd_prot_op_t) + sizeof(uuidd_prot_num_t)];
+	size_t		reqsz;
+	char		reply[sizeof(int32_t) + UUIDD_PROT_BUFSZ];
+	size_t		replysz;
+	size_t		replyoff;
+};
+
 /* server loop control structure */
 struct uuidd_cxt_t {
 	const char	*cleanup_pidfile;
 	const char	*cleanup_socket;
 	uint32_t	timeout;
+
+	int		efd;		/* epoll */
+	struct uuidd_conn listener;
+	size_t		nclients;
+	struct uuidd_ring ring;
+
 	unsigned int	debug: 1,
 			quiet: 1,
 			no_fork: 1,
-			no_sock: 1;
+			no_sock: 1,
+			listening: 1;	/* listener in epoll */
 };
 
 struct uuidd_options_t {
@@ -337,28 +389,343 @@ static void timeout_handler(int sig __attribute__((__unused__)),
 		errx(EXIT_FAILURE, _("timed out"));
 }
 
+/* Adds @n to the timestamp of the time-based UUID */
+static void uuid_time_add(uuid_t uu, uint32_t n)
+{
+	uint64_t t;
+
+	t = ((uint64_t) (uu[6] & 0x0F) << 56) | ((uint64_t) uu[7] << 48) |
+	    ((uint64_t) uu[4] << 40) | ((uint64_t) uu[5] << 32) |
+	    ((uint64_t) uu[0] << 24) | ((uint64_t) uu[1] << 16) |
+	    ((uint64_t) uu[2] << 8) | (uint64_t) uu[3];
+	t += n;
+
+	uu[0] = t >> 24;
+	uu[1] = t >> 16;
+	uu[2] = t >> 8;
+	uu[3] = t;
+	uu[4] = t >> 40;
+	uu[5] = t >> 32;
+	uu[6] = (uu[6] & 0xF0) | ((t >> 56) & 0x0F);
+	uu[7] = t >> 48;
+}
+
+static void ring_pop(struct uuidd_ring *ring)
+{
+	ring->head = (ring->head + 1) % UUIDD_RING_SIZE;
+	ring->count--;
+	ring->used = 1;
+}
+
+/* Reserves the missing ranges */
+static void ring_refill(struct uuidd_cxt_t *uuidd_cxt)
+{
+	struct uuidd_ring *ring = &uuidd_cxt->ring;
+
+	while (ring->count < UUIDD_RING_SIZE) {
+		struct uuidd_range *r = &ring->ranges[
+				(ring->head + ring->count) % UUIDD_RING_SIZE];
+
+		r->num = UUIDD_RANGE_SIZE;
+		if (__uuid_generate_time(r->next, &r->num) < 0 && !uuidd_cxt->quiet)
+			warnx(_("failed to open/lock clock counter"));
+		r->time = time(NULL);
+		ring->count++;
+	}
+	ring->used = 0;
+}
+
+/*
+ * Generates @num time-based UUIDs, the first one is stored to @out. The UUIDs
+ * are taken from the pre-generated ranges if possible.
+ */
+static void get_time_uuids(struct uuidd_cxt_t *uuidd_cxt, uuid_t out,
+			   uuidd_prot_num_t *num)
+{
+	struct uuidd_ring *ring = &uuidd_cxt->ring;
+	struct uuidd_range *r;
+	time_t now = time(NULL);
+
+	/* don't use too old timestamps (the same as libuuid cache) */
+	while (ring->count && ring->ranges[ring->head].time + 1 < now)
+		ring_pop(ring);
+
+	if (*num < 1)
+		*num = 1;
+	if (ring->count && ring->ranges[ring->head].num < *num
+	    && *num <= UUIDD_RANGE_SIZE)
+		ring_pop(ring);
+
+	if (!ring->count || ring->ranges[ring->head].num < *num) {
+		ring->used = 1;
+		if (__uuid_generate_time(out, num) < 0 && !uuidd_cxt->quiet)
+			warnx(_("failed to open/lock clock counter"));
+		return;
+	}
+
+	r = &ring->ranges[ring->head];
+	uuid_copy(out, r->next);
+	uuid_time_add(r->next, *num);
+	r->num -= *num;
+	if (!r->num)
+		ring_pop(ring);
+}
+
+/*
+ * Generates reply for the request to @reply_buf.
+ *
+ * Returns: reply length or -1 for invalid operation.
+ */
+static int32_t process_request(struct uuidd_cxt_t *uuidd_cxt,
+			       uuidd_prot_op_t op, uuidd_prot_num_t num,
+			       char *reply_buf, size_t bufsz)
+{
+	int32_t		reply_len = 0;
+	uuid_t		uu;
+	char		str[UUID_STR_LEN], *cp;
+	int		i;
+
+	switch (op) {
+	case UUIDD_OP_GETPID:
+		snprintf(reply_buf, bufsz, "%d", getpid());
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_GET_MAXOP:
+		snprintf(reply_buf, bufsz, "%d", UUIDD_MAX_OP);
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_TIME_UUID:
+		num = 1;
+		get_time_uuids(uuidd_cxt, uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated time UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_RANDOM_UUID:
+		num = 1;
+		if (__uuid_generate_time(uu, &num) < 0 && !uuidd_cxt->quiet)
+			warnx(_("failed to open/lock clock counter"));
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_BULK_TIME_UUID:
+		get_time_uuids(uuidd_cxt, uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, P_("Generated time UUID %s "
+					   "and %d following\n",
+					   "Generated time UUID %s "
+					   "and %d following\n", num - 1),
+			       str, num - 1);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		memcpy(reply_buf + reply_len, &num, sizeof(num));
+		reply_len += sizeof(num);
+		break;
+	case UUIDD_OP_BULK_RANDOM_UUID:
+		if (num < 0)
+			num = 1;
+		if ((bufsz - sizeof(num)) < (size_t) (sizeof(uu) * num))
+			num = (bufsz - sizeof(num)) / sizeof(uu);
+		__uuid_generate_random((unsigned char *) reply_buf +
+				      sizeof(num), &num);
+		reply_len = sizeof(num) + (sizeof(uu) * num);
+		memcpy(reply_buf, &num, sizeof(num));
+		if (uuidd_cxt->debug) {
+			fprintf(stderr, P_("Generated %d UUID:\n",
+					   "Generated %d UUIDs:\n", num), num);
+			cp = reply_buf + sizeof(num);
+			for (i = 0; i < num; i++) {
+				uuid_unparse((unsigned char *)cp, str);
+				fprintf(stderr, "\t%s\n", str);
+				cp += sizeof(uu);
+			}
+		}
+		break;
+	default:
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), op);
+		return -1;
+	}
+	return reply_len;
+}
+
+static void listener_enable(struct uuidd_cxt_t *uuidd_cxt, int enable)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	if (uuidd_cxt->listening == !!enable)
+		return;
+
+	ev.data.ptr = &uuidd_cxt->listener;
+	if (epoll_ctl(uuidd_cxt->efd, enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+		      uuidd_cxt->listener.fd, &ev) < 0)
+		err(EXIT_FAILURE, _("cannot add socket to epoll"));
+	uuidd_cxt->listening = enable ? 1 : 0;
+}
+
+static void close_client(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cl)
+{
+	close(cl->fd);		/* removes the fd from epoll */
+	free(cl);
+
+	uuidd_cxt->nclients--;
+	listener_enable(uuidd_cxt, 1);
+}
+
+static void accept_clients(struct uuidd_cxt_t *uuidd_cxt)
+{
+	while (uuidd_cxt->nclients < UUIDD_MAX_CLIENTS) {
+		struct epoll_event ev = { .events = EPOLLIN };
+		struct uuidd_conn *cl;
+		int ns;
+
+		ns = accept4(uuidd_cxt->listener.fd, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (ns < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK
+			    || errno == EINTR || errno == ECONNABORTED)
+				return;
+			if (errno == EMFILE || errno == ENFILE) {
+				/* try again after a client is closed */
+				if (uuidd_cxt->nclients)
+					listener_enable(uuidd_cxt, 0);
+				return;
+			}
+			err(EXIT_FAILURE, "accept");
+		}
+
+		cl = xcalloc(1, sizeof(*cl));
+		cl->type = UUIDD_CONN_CLIENT;
+		cl->fd = ns;
+
+		ev.data.ptr = cl;
+		if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_ADD, ns, &ev) < 0) {
+			warn(_("cannot add socket to epoll"));
+			close(ns);
+			free(cl);
+			continue;
+		}
+		uuidd_cxt->nclients++;
+	}
+
+	/* too many clients, accept the others later */
+	listener_enable(uuidd_cxt, 0);
+}
+
+/* Returns 0 if the reply is sent, 1 if not yet, or <0 on error. */
+static int write_reply(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cl)
+{
+	while (cl->replyoff < cl->replysz) {
+		ssize_t ret = send(cl->fd, cl->reply + cl->replyoff,
+				   cl->replysz - cl->replyoff, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				struct epoll_event ev = {
+					.events = EPOLLOUT,
+					.data.ptr = cl
+				};
+				if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_MOD,
+					      cl->fd, &ev) < 0)
+					return -errno;
+				return 1;
+			}
+			return -errno;
+		}
+		cl->replyoff += ret;
+	}
+	return 0;
+}
+
+/* Returns the expected request size according to already read data */
+static size_t request_size(const struct uuidd_conn *cl)
+{
+	uuidd_prot_op_t op;
+
+	if (cl->reqsz < sizeof(op))
+		return sizeof(op);
+
+	memcpy(&op, cl->req, sizeof(op));
+	if ((op == UUIDD_OP_BULK_TIME_UUID) ||
+	    (op == UUIDD_OP_BULK_RANDOM_UUID))
+		return sizeof(op) + sizeof(uuidd_prot_num_t);
+	return sizeof(op);
+}
+
+static void handle_client(struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cl)
+{
+	uuidd_prot_op_t op;
+	uuidd_prot_num_t num = 0;
+	int32_t reply_len;
+	size_t need;
+	ssize_t len;
+
+	if (cl->replysz)
+		goto write;
+
+	/* read the request; the clients usually send it by one write() */
+	while (cl->reqsz < (need = request_size(cl))) {
+		len = read(cl->fd, cl->req + cl->reqsz, sizeof(cl->req) - cl->reqsz);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			warn(_("read failed"));
+			goto done;
+		}
+		if (len == 0) {
+			if (!cl->reqsz)
+				warnx(_("error reading from client, len = %d"), 0);
+			goto done;
+		}
+		cl->reqsz += len;
+	}
+	memcpy(&op, cl->req, sizeof(op));
+
+	if (need > sizeof(op)) {
+		memcpy(&num, cl->req + sizeof(op), sizeof(num));
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("operation %d, incoming num = %d\n"),
+			       op, num);
+	} else if (uuidd_cxt->debug)
+		fprintf(stderr, _("operation %d\n"), op);
+
+	reply_len = process_request(uuidd_cxt, op, num,
+				    cl->reply + sizeof(reply_len),
+				    sizeof(cl->reply) - sizeof(reply_len));
+	if (reply_len < 0)
+		goto done;
+	memcpy(cl->reply, &reply_len, sizeof(reply_len));
+	cl->replysz = sizeof(reply_len) + reply_len;
+write:
+	if (write_reply(uuidd_cxt, cl) > 0)
+		return;		/* wait for EPOLLOUT */
+done:
+	close_client(uuidd_cxt, cl);
+}
+
 static void server_loop(const char *socket_path, const char *pidfile_path,
 			struct uuidd_cxt_t *uuidd_cxt)
 {
-	struct sockaddr_un	from_addr;
-	socklen_t		fromlen;
-	int32_t			reply_len = 0;
-	uuid_t			uu;
-	char			reply_buf[UUIDD_PROT_BUFSZ], *cp;
-	uuidd_prot_op_t 	op;
-	char			str[UUID_STR_LEN];
-	int			i, ns, len;
-	uuidd_prot_num_t	num;		/* intentionally uninitialized */
+	char			reply_buf[UUIDD_PROT_BUFSZ];
 	int			s = 0;
 	int			fd_pidfile = -1;
 	int			ret;
-	struct pollfd		pfd[2];
+	struct epoll_event	ev, events[64];
+	struct uuidd_conn	sigconn = { .type = UUIDD_CONN_SIGNAL };
 	sigset_t		sigmask;
 	int			sigfd;
-	enum {
-				POLLFD_SIGNAL = 0,
-				POLLFD_SOCKET
-	};
 
 #ifdef HAVE_LIBSYSTEMD
 	if (!uuidd_cxt->no_sock)	/* no_sock implies no_fork and no_pid */
@@ -434,131 +801,58 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 	if ((sigfd = signalfd(-1, &sigmask, 0)) < 0)
 		err(EXIT_FAILURE, _("cannot set signal handler"));
 
-	pfd[POLLFD_SIGNAL].fd = sigfd;
-	pfd[POLLFD_SOCKET].fd = s;
-	pfd[POLLFD_SIGNAL].events = pfd[POLLFD_SOCKET].events = POLLIN | POLLERR | POLLHUP;
+	uuidd_cxt->efd = epoll_create1(EPOLL_CLOEXEC);
+	if (uuidd_cxt->efd < 0)
+		err(EXIT_FAILURE, _("cannot create epoll"));
+
+	sigconn.fd = sigfd;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &sigconn;
+	if (epoll_ctl(uuidd_cxt->efd, EPOLL_CTL_ADD, sigfd, &ev) < 0)
+		err(EXIT_FAILURE, _("cannot add signal fd to epoll"));
+
+	if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) < 0)
+		err(EXIT_FAILURE, _("cannot set non-blocking mode"));
+	uuidd_cxt->listener.type = UUIDD_CONN_LISTEN;
+	uuidd_cxt->listener.fd = s;
+	listener_enable(uuidd_cxt, 1);
 
 	while (1) {
-		ret = poll(pfd, ARRAY_SIZE(pfd),
+		int i;
+
+		ret = epoll_wait(uuidd_cxt->efd, events, ARRAY_SIZE(events),
 				uuidd_cxt->timeout ?
 					(int) uuidd_cxt->timeout * 1000 : -1);
 		if (ret < 0) {
-			if (errno == EAGAIN)
+			if (errno == EAGAIN || errno == EINTR)
 				continue;
-			warn(_("poll failed"));
+			warn(_("epoll failed"));
 			all_done(uuidd_cxt, EXIT_FAILURE);
 		}
-		if (ret == 0) {		/* true when poll() times out */
+		if (ret == 0) {		/* true when epoll_wait() times out */
 			if (uuidd_cxt->debug)
 				fprintf(stderr, _("timeout [%d sec]\n"), uuidd_cxt->timeout);
 			all_done(uuidd_cxt, EXIT_SUCCESS);
 		}
-		if (pfd[POLLFD_SIGNAL].revents != 0)
-			handle_signal(uuidd_cxt, sigfd);
-		if (pfd[POLLFD_SOCKET].revents == 0)
-			continue;
-		fromlen = sizeof(from_addr);
-		ns = accept(s, (struct sockaddr *) &from_addr, &fromlen);
-		if (ns < 0) {
-			if ((errno == EAGAIN) || (errno == EINTR))
-				continue;
-			err(EXIT_FAILURE, "accept");
-		}
-		len = read(ns, &op, sizeof(op));
-		if (len != sizeof(op)) {
-			if (len < 0)
-				warn(_("read failed"));
-			else
-				warnx(_("error reading from client, len = %d"),
-						len);
-			goto shutdown_socket;
-		}
-		if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-		    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
-			if (read_all(ns, (char *) &num, sizeof(num)) != sizeof(num))
-				goto shutdown_socket;
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("operation %d, incoming num = %d\n"),
-				       op, num);
-		} else if (uuidd_cxt->debug)
-			fprintf(stderr, _("operation %d\n"), op);
-
-		switch (op) {
-		case UUIDD_OP_GETPID:
-			snprintf(reply_buf, sizeof(reply_buf), "%d", getpid());
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_GET_MAXOP:
-			snprintf(reply_buf, sizeof(reply_buf), "%d", UUIDD_MAX_OP);
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_TIME_UUID:
-			num = 1;
-			if (__uuid_generate_time(uu, &num) < 0 && !uuidd_cxt->quiet)
-				warnx(_("failed to open/lock clock counter"));
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated time UUID: %s\n"), str);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_RANDOM_UUID:
-			num = 1;
-			if (__uuid_generate_time(uu, &num) < 0 && !uuidd_cxt->quiet)
-				warnx(_("failed to open/lock clock counter"));
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		for (i = 0; i < ret; i++) {
+			struct uuidd_conn *conn = events[i].data.ptr;
+
+			switch (conn->type) {
+			case UUIDD_CONN_SIGNAL:
+				handle_signal(uuidd_cxt, sigfd);
+				break;
+			case UUIDD_CONN_LISTEN:
+				accept_clients(uuidd_cxt);
+				break;
+			case UUIDD_CONN_CLIENT:
+				handle_client(uuidd_cxt, conn);
+				break;
 			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_BULK_TIME_UUID:
-			if (__uuid_generate_time(uu, &num) < 0 && !uuidd_cxt->quiet)
-				warnx(_("failed to open/lock clock counter"));
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, P_("Generated time UUID %s "
-						   "and %d following\n",
-						   "Generated time UUID %s "
-						   "and %d following\n", num - 1),
-				       str, num - 1);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			memcpy(reply_buf + reply_len, &num, sizeof(num));
-			reply_len += sizeof(num);
-			break;
-		case UUIDD_OP_BULK_RANDOM_UUID:
-			if (num < 0)
-				num = 1;
-			if ((sizeof(reply_buf) - sizeof(num)) < (size_t) (sizeof(uu) * num))
-				num = (sizeof(reply_buf) - sizeof(num)) / sizeof(uu);
-			__uuid_generate_random((unsigned char *) reply_buf +
-					      sizeof(num), &num);
-			reply_len = sizeof(num) + (sizeof(uu) * num);
-			memcpy(reply_buf, &num, sizeof(num));
-			if (uuidd_cxt->debug) {
-				fprintf(stderr, P_("Generated %d UUID:\n",
-						   "Generated %d UUIDs:\n", num), num);
-				cp = reply_buf + sizeof(num);
-				for (i = 0; i < num; i++) {
-					uuid_unparse((unsigned char *)cp, str);
-					fprintf(stderr, "\t%s\n", str);
-					cp += sizeof(uu);
-				}
-			}
-			break;
-		default:
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("Invalid operation %d\n"), op);
-			goto shutdown_socket;
 		}
-		write_all(ns, (char *) &reply_len, sizeof(num));
-		write_all(ns, reply_buf, reply_len);
-	shutdown_socket:
-		close(ns);
+
+		/* prepare the time-based UUIDs for the next requests */
+		if (uuidd_cxt->ring.used)
+			ring_refill(uuidd_cxt);
 	}
 }
 
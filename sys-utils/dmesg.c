@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include "c.h"
 #include "colors.h"
@@ -162,13 +163,50 @@ enum {
 };
 #define is_timefmt(c, f) ((c)->time_fmt == (DMESG_TIMEFTM_ ##f))
 
+/* number of facility and level combinations (parse_faclev() allows
+ * facility == ARRAY_SIZE(facility_names)) */
+#define DMESG_NPRIVALS	((ARRAY_SIZE(facility_names) + 1) << 3)
+
+/*
+ * Sparse index of the --file records. The first record behind every
+ * DMESG_INDEX_STEP bytes is sampled. Kernel timestamps are monotonic,
+ * so --since and --until records are found by binary search.
+ */
+#define DMESG_INDEX_STEP	(64 * 1024)
+#define DMESG_INDEX_MAGIC	"DMESGIX1"
+
+struct dmesg_index_entry {
+	uint64_t	offset;		/* record begin in the file */
+	int64_t		sec;		/* record timestamp */
+	int64_t		usec;
+};
+
+/* --file-index header, followed by entries */
+struct dmesg_index_header {
+	char		magic[8];
+	uint64_t	file_size;	/* the indexed file */
+	int64_t		file_mtime;
+	uint64_t	step;
+	uint64_t	nents;
+};
+
+struct dmesg_index {
+	struct dmesg_index_entry *ents;
+	size_t		nents;
+	size_t		step;
+};
+
 struct dmesg_control {
 	/* bit arrays -- see include/bitops.h */
 	char levels[ARRAY_SIZE(level_names) / NBBY + 1];
 	char facilities[ARRAY_SIZE(facility_names) / NBBY + 1];
+	char privals[DMESG_NPRIVALS / NBBY + 1];	/* levels & facilities */
 
 	struct timeval	lasttime;	/* last printed timestamp */
 	struct tm	lasttm;		/* last localtime */
+	time_t		cache_time;	/* cached localtime and ctime */
+	struct tm	cache_tm;
+	char		cache_ctime[128];
 	struct timeval	boot_time;	/* system boot time */
 	time_t		suspended_time;	/* time spent in suspended state */
 
@@ -180,6 +218,8 @@ struct dmesg_control {
 	int		kmsg;		/* /dev/kmsg file descriptor */
 	ssize_t		kmsg_first_read;/* initial read() return code */
 	char		kmsg_buf[BUFSIZ];/* buffer to read kmsg data */
+	uint64_t	kmsg_seq;	/* expected sequence number */
+	char		*kmsg_outbuf;	/* stdout buffer in follow mode */
 
 	time_t		since;		/* filter records by time */
 	time_t		until;		/* filter records by time */
@@ -192,6 +232,8 @@ struct dmesg_control {
 	char		*filename;
 	char		*mmap_buff;
 	size_t		pagesize;
+	char		*indexname;	/* --file-index */
+	struct dmesg_index index;
 	unsigned int	time_fmt;	/* time format */
 
 	struct ul_jsonwrt jfmt;		/* -J formatting */
@@ -206,8 +248,11 @@ struct dmesg_control {
 			pager:1,	/* pipe output into a pager */
 			color:1,	/* colorize messages */
 			json:1,		/* JSON output */
-			force_prefix:1;	/* force timestamp and decode prefix
+			force_prefix:1,	/* force timestamp and decode prefix
 					   on each line */
+			cache_valid:1,	/* cache_tm is valid */
+			cache_ctime_valid:1, /* cache_ctime is valid */
+			kmsg_seq_valid:1; /* kmsg_seq is valid */
 	int		indent;		/* due to timestamps if newline */
 };
 
@@ -218,6 +263,7 @@ struct dmesg_record {
 	int		level;
 	int		facility;
 	struct timeval  tv;
+	uint64_t	seq;		/* kmsg sequence number */
 
 	const char	*next;		/* buffer with next unparsed record */
 	size_t		next_size;	/* size of the next buffer */
@@ -230,6 +276,7 @@ struct dmesg_record {
 		(_r)->level = -1; \
 		(_r)->tv.tv_sec = 0; \
 		(_r)->tv.tv_usec = 0; \
+		(_r)->seq = 0; \
 	} while (0)
 
 static int read_kmsg(struct dmesg_control *ctl);
@@ -284,6 +331,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -D, --console-off           disable printing messages to console\n"), out);
 	fputs(_(" -E, --console-on            enable printing messages to console\n"), out);
 	fputs(_(" -F, --file <file>           use the file instead of the kernel log buffer\n"), out);
+	fputs(_("     --file-index <file>     keep index of the --file timestamps in the file\n"), out);
 	fputs(_(" -f, --facility <list>       restrict output to defined facilities\n"), out);
 	fputs(_(" -H, --human                 human readable output\n"), out);
 	fputs(_(" -J, --json                  use JSON output format\n"), out);
@@ -624,11 +672,20 @@ static int fwrite_hex(const char *buf, size_t size, FILE *out)
 	return 0;
 }
 
+static void __attribute__((__noreturn__)) write_failed(void)
+{
+	if (errno != EPIPE)
+		err(EXIT_FAILURE, _("write failed"));
+	exit(EXIT_SUCCESS);
+}
+
 /*
  * Prints to 'out' and non-printable chars are replaced with \x<hex> sequences.
+ * The printable chars are written by one fwrite() call.
  */
 static void safe_fwrite(struct dmesg_control *ctl, const char *buf, size_t size, int indent, FILE *out)
 {
+	const char *run = buf;		/* not yet written printable chars */
 	size_t i;
 #ifdef HAVE_WIDECHAR
 	mbstate_t s;
@@ -648,8 +705,10 @@ static void safe_fwrite(struct dmesg_control *ctl, const char *buf, size_t size,
 #ifdef HAVE_WIDECHAR
 			len = mbrtowc(&wc, p, size - i, &s);
 
-			if (len == 0)				/* L'\0' */
-				return;
+			if (len == 0) {				/* L'\0' */
+				size = p - buf;
+				break;
+			}
 
 			if (len == (size_t)-1 || len == (size_t)-2) {		/* invalid sequence */
 				memset(&s, 0, sizeof (s));
@@ -670,21 +729,26 @@ static void safe_fwrite(struct dmesg_control *ctl, const char *buf, size_t size,
 		}
 
 doprint:
+		if (!hex && !(*p == '\n' && *(p + 1) && indent))
+			continue;	/* print later with the others */
+
+		if (p > run && fwrite(run, 1, p - run, out) != (size_t) (p - run))
+			write_failed();
 		if (hex)
 			rc = fwrite_hex(p, len, out);
-		else if (*p == '\n' && *(p + 1) && indent) {
+		else {
 		        rc = fwrite(p, 1, len, out) != len;
 			if (fprintf(out, "%*s", indent, "") != indent)
 				rc |= 1;
-		} else
-			rc = fwrite(p, 1, len, out) != len;
-
-		if (rc != 0) {
-			if (errno != EPIPE)
-				err(EXIT_FAILURE, _("write failed"));
-			exit(EXIT_SUCCESS);
 		}
+		if (rc != 0)
+			write_failed();
+		run = p + len;
 	}
+
+	if (buf + size > run &&
+	    fwrite(run, 1, buf + size - run, out) != (size_t) (buf + size - run))
+		write_failed();
 }
 
 static const char *skip_item(const char *begin, const char *end, const char *sep)
@@ -789,14 +853,30 @@ static time_t record_time(struct dmesg_control *ctl, struct dmesg_record *rec)
 	return ctl->boot_time.tv_sec + ctl->suspended_time + rec->tv.tv_sec;
 }
 
-static int accept_record(struct dmesg_control *ctl, struct dmesg_record *rec)
+/*
+ * Merges levels[] and facilities[] to one bit array, so the records
+ * are filtered by one lookup.
+ */
+static void init_privals(struct dmesg_control *ctl)
 {
-	if (ctl->fltr_lev && (rec->facility < 0 ||
-			      !isset(ctl->levels, rec->level)))
-		return 0;
+	size_t fac, lev;
+
+	for (fac = 0; fac <= ARRAY_SIZE(facility_names); fac++) {
+		if (ctl->fltr_fac && !isset(ctl->facilities, fac))
+			continue;
+		for (lev = 0; lev < 8; lev++) {
+			if (ctl->fltr_lev && !isset(ctl->levels, lev))
+				continue;
+			setbit(ctl->privals, (fac << 3) | lev);
+		}
+	}
+}
 
-	if (ctl->fltr_fac && (rec->facility < 0 ||
-			      !isset(ctl->facilities, rec->facility)))
+static int accept_record(struct dmesg_control *ctl, struct dmesg_record *rec)
+{
+	if ((ctl->fltr_lev || ctl->fltr_fac) &&
+	    (rec->facility < 0 || rec->level < 0 ||
+	     !isset(ctl->privals, (rec->facility << 3) | rec->level)))
 		return 0;
 
 	if (ctl->since && ctl->since >= record_time(ctl, rec))
@@ -838,12 +918,23 @@ static void raw_print(struct dmesg_control *ctl, const char *buf, size_t size)
 		putchar('\n');
 }
 
+/* localtime() is expensive, the result is cached for the last second */
 static struct tm *record_localtime(struct dmesg_control *ctl,
 				   struct dmesg_record *rec,
 				   struct tm *tm)
 {
 	time_t t = record_time(ctl, rec);
-	return localtime_r(&t, tm);
+
+	if (!ctl->cache_valid || ctl->cache_time != t) {
+		ctl->cache_ctime_valid = 0;
+		ctl->cache_valid = 0;
+		if (!localtime_r(&t, &ctl->cache_tm))
+			return NULL;
+		ctl->cache_time = t;
+		ctl->cache_valid = 1;
+	}
+	*tm = ctl->cache_tm;
+	return tm;
 }
 
 static char *record_ctime(struct dmesg_control *ctl,
@@ -852,14 +943,21 @@ static char *record_ctime(struct dmesg_control *ctl,
 {
 	struct tm tm;
 
-	record_localtime(ctl, rec, &tm);
-
-	/* TRANSLATORS: dmesg uses strftime() fo generate date-time string
-	   where %a is abbreviated name of the day, %b is abbreviated month
-	   name and %e is day of the month as a decimal number. Please, set
-	   proper month/day order here */
-	if (strftime(buf, bufsiz, _("%a %b %e %H:%M:%S %Y"), &tm) == 0)
+	if (!record_localtime(ctl, rec, &tm)) {
 		*buf = '\0';
+		return buf;
+	}
+	if (!ctl->cache_ctime_valid) {
+		/* TRANSLATORS: dmesg uses strftime() fo generate date-time string
+		   where %a is abbreviated name of the day, %b is abbreviated month
+		   name and %e is day of the month as a decimal number. Please, set
+		   proper month/day order here */
+		if (strftime(ctl->cache_ctime, sizeof(ctl->cache_ctime),
+			     _("%a %b %e %H:%M:%S %Y"), &tm) == 0)
+			*ctl->cache_ctime = '\0';
+		ctl->cache_ctime_valid = 1;
+	}
+	xstrncpy(buf, ctl->cache_ctime, bufsiz);
 	return buf;
 }
 
@@ -1132,6 +1230,254 @@ done:
 		putchar('\n');
 }
 
+/*
+ * Returns the first record behind @off or NULL.
+ */
+static const char *next_record_begin(const char *buf, size_t size, size_t off)
+{
+	const char *p;
+
+	if (off == 0)
+		return size && *buf == '<' ? buf : next_record_begin(buf, size, 1);
+
+	p = memmem(buf + off - 1, size - off + 1, "\n<", 2);
+	return p ? p + 1 : NULL;
+}
+
+/*
+ * Parses timestamp of the record at @begin. Returns 0 on success.
+ */
+static int parse_record_timestamp(const char *buf, size_t size,
+				  const char *begin, struct timeval *tv)
+{
+	const char *p, *end;
+
+	end = memchr(begin, ']', buf + size - begin);
+	p = end ? memchr(begin, '>', end - begin) : NULL;
+	if (!end || !p || *(p + 1) != '['
+	    || parse_syslog_timestamp(p + 2, tv) != end + 1)
+		return -1;
+	return 0;
+}
+
+/*
+ * Samples the records; returns -1 when the file is not usable for the index
+ * (no timestamps or not monotonic timestamps). All the records are checked,
+ * a backward jump between the samples would break the binary search.
+ */
+static int build_index(struct dmesg_index *idx, const char *buf, size_t size)
+{
+	const char *begin;
+	size_t max = 0, next = 0;	/* next sample offset */
+	struct timeval last = { 0 };
+
+	idx->nents = 0;
+	for (begin = next_record_begin(buf, size, 0); begin;
+	     begin = next_record_begin(buf, size, begin - buf + 1)) {
+		struct dmesg_index_entry *e;
+		struct timeval tv = { 0 };
+		size_t off = begin - buf;
+
+		if (parse_record_timestamp(buf, size, begin, &tv) != 0
+		    || timercmp(&tv, &last, <))
+			return -1;
+		last = tv;
+		if (off < next)
+			continue;
+
+		if (idx->nents == max) {
+			max = max ? max * 2 : 64;
+			idx->ents = xrealloc(idx->ents, max * sizeof(*e));
+		}
+		e = &idx->ents[idx->nents++];
+		e->offset = off;
+		e->sec = tv.tv_sec;
+		e->usec = tv.tv_usec;
+
+		next = (off / idx->step + 1) * idx->step;
+	}
+	return 0;
+}
+
+/*
+ * Verifies the index read from --file-index; every entry has to point to a
+ * record with the same timestamp, and the entries have to be sorted.
+ */
+static int check_index(struct dmesg_index *idx, const char *buf, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < idx->nents; i++) {
+		struct dmesg_index_entry *e = &idx->ents[i];
+		struct timeval tv = { 0 };
+
+		if (e->offset >= size
+		    || (e->offset && buf[e->offset - 1] != '\n')
+		    || buf[e->offset] != '<'
+		    || parse_record_timestamp(buf, size, buf + e->offset, &tv) != 0
+		    || tv.tv_sec != e->sec || tv.tv_usec != e->usec)
+			return -1;
+		if (i && (e[-1].offset >= e->offset || e[-1].sec > e->sec ||
+		    (e[-1].sec == e->sec && e[-1].usec > e->usec)))
+			return -1;
+	}
+	return 0;
+}
+
+static int read_index(struct dmesg_control *ctl, const struct stat *st)
+{
+	struct dmesg_index *idx = &ctl->index;
+	struct dmesg_index_header hdr;
+	size_t sz;
+	int fd, rc = -1;
+
+	fd = open(ctl->indexname, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (read_all(fd, (char *) &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || memcmp(hdr.magic, DMESG_INDEX_MAGIC, sizeof(hdr.magic)) != 0
+	    || hdr.file_size != (uint64_t) st->st_size
+	    || hdr.file_mtime != (int64_t) st->st_mtime
+	    || hdr.step != idx->step
+	    || hdr.nents > (uint64_t) st->st_size / idx->step + 1)
+		goto done;
+
+	sz = hdr.nents * sizeof(struct dmesg_index_entry);
+	idx->ents = xmalloc(sz ? sz : 1);
+	if (read_all(fd, (char *) idx->ents, sz) != (ssize_t) sz) {
+		free(idx->ents);
+		idx->ents = NULL;
+		goto done;
+	}
+	idx->nents = hdr.nents;
+	rc = 0;
+done:
+	close(fd);
+	return rc;
+}
+
+static void write_index(struct dmesg_control *ctl, const struct stat *st)
+{
+	struct dmesg_index *idx = &ctl->index;
+	struct dmesg_index_header hdr = {
+		.magic = DMESG_INDEX_MAGIC,
+		.file_size = st->st_size,
+		.file_mtime = st->st_mtime,
+		.step = idx->step,
+		.nents = idx->nents
+	};
+	int fd;
+
+	fd = open(ctl->indexname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		warn(_("cannot open %s"), ctl->indexname);
+		return;
+	}
+	if (write_all(fd, &hdr, sizeof(hdr)) != 0
+	    || write_all(fd, idx->ents, idx->nents * sizeof(*idx->ents)) != 0)
+		warn(_("write failed: %s"), ctl->indexname);
+	if (close(fd) != 0)
+		warn(_("write failed: %s"), ctl->indexname);
+}
+
+/*
+ * Loads the index from --file-index or builds it. Returns 0 if the index
+ * is usable.
+ */
+static int init_index(struct dmesg_control *ctl, const char *buf, size_t size)
+{
+	struct dmesg_index *idx = &ctl->index;
+	struct stat st;
+
+	idx->step = DMESG_INDEX_STEP;
+#ifdef TEST_DMESG
+	if (getenv("DMESG_TEST_INDEX_STEP"))
+		idx->step = strtou32_or_err(getenv("DMESG_TEST_INDEX_STEP"),
+					    "invalid DMESG_TEST_INDEX_STEP");
+	if (!idx->step)
+		idx->step = DMESG_INDEX_STEP;
+#endif
+	if (stat(ctl->filename, &st) != 0)
+		return -1;
+
+	if (ctl->indexname && read_index(ctl, &st) == 0) {
+		if (check_index(idx, buf, size) == 0)
+			return 0;
+		free(idx->ents);
+		idx->ents = NULL;
+		idx->nents = 0;
+	}
+
+	if (build_index(idx, buf, size) != 0) {
+		free(idx->ents);
+		idx->ents = NULL;
+		idx->nents = 0;
+		return -1;
+	}
+	if (ctl->indexname)
+		write_index(ctl, &st);
+	return 0;
+}
+
+/* Returns time of the index entry (see record_time()) */
+static time_t index_time(struct dmesg_control *ctl, struct dmesg_index_entry *e)
+{
+	struct dmesg_record rec = { .tv = { .tv_sec = e->sec } };
+
+	return record_time(ctl, &rec);
+}
+
+/*
+ * Narrows the buffer to the records between --since and --until.
+ */
+static void seek_index(struct dmesg_control *ctl, const char **buf, size_t *size)
+{
+	struct dmesg_index *idx = &ctl->index;
+	size_t lo, hi, begin = 0, end = *size;
+
+	if (ctl->since) {
+		/* the last sampled record accepted by accept_record() */
+		lo = 0, hi = idx->nents;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+
+			if (ctl->since >= index_time(ctl, &idx->ents[mid]))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo)
+			begin = idx->ents[lo - 1].offset;
+	}
+	if (ctl->until) {
+		/* the first sampled record not accepted by accept_record() */
+		lo = 0, hi = idx->nents;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+
+			if (ctl->until > index_time(ctl, &idx->ents[mid]))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < idx->nents)
+			end = idx->ents[lo].offset;
+	}
+	if (end < begin)
+		end = begin;
+
+	/* unmap the skipped pages */
+	if (ctl->mmap_buff && begin >= ctl->pagesize) {
+		size_t sz = begin / ctl->pagesize * ctl->pagesize;
+
+		munmap(ctl->mmap_buff, sz);
+		ctl->mmap_buff += sz;
+	}
+
+	*buf += begin;
+	*size = end - begin;
+}
+
 /*
  * Prints the 'buf' kernel ring buffer; the messages are filtered out according
  * to 'levels' and 'facilities' bitarrays.
@@ -1139,13 +1485,21 @@ done:
 static void print_buffer(struct dmesg_control *ctl,
 			const char *buf, size_t size)
 {
-	struct dmesg_record rec = { .next = buf, .next_size = size };
+	struct dmesg_record rec;
 
 	if (ctl->raw) {
 		raw_print(ctl, buf, size);
 		return;
 	}
 
+	if (ctl->method == DMESG_METHOD_MMAP
+	    && (ctl->since || ctl->until || ctl->indexname)
+	    && init_index(ctl, buf, size) == 0)
+		seek_index(ctl, &buf, &size);
+
+	rec.next = buf;
+	rec.next_size = size;
+
 	while (get_next_syslog_record(ctl, &rec) == 0)
 		print_record(ctl, &rec);
 }
@@ -1163,16 +1517,17 @@ static ssize_t read_kmsg_one(struct dmesg_control *ctl)
 	return size;
 }
 
+/* output buffer size for --follow */
+#define DMESG_FOLLOW_BUFSZ	(256 * 1024)
+
 static int init_kmsg(struct dmesg_control *ctl)
 {
-	int mode = O_RDONLY;
-
-	if (!ctl->follow)
-		mode |= O_NONBLOCK;
-	else
-		setlinebuf(stdout);
-
-	ctl->kmsg = open("/dev/kmsg", mode);
+	/*
+	 * The follow mode drains all available records by non-blocking reads,
+	 * the output is buffered and written when no more records are
+	 * available (see read_kmsg()).
+	 */
+	ctl->kmsg = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
 	if (ctl->kmsg < 0)
 		return -1;
 
@@ -1192,12 +1547,18 @@ static int init_kmsg(struct dmesg_control *ctl)
 	 * read_kmsg().
 	 */
 	ctl->kmsg_first_read = read_kmsg_one(ctl);
+	if (ctl->kmsg_first_read < 0 && ctl->follow && errno == EAGAIN)
+		ctl->kmsg_first_read = 0;	/* no record yet */
 	if (ctl->kmsg_first_read < 0) {
 		close(ctl->kmsg);
 		ctl->kmsg = -1;
 		return -1;
 	}
 
+	if (ctl->follow) {
+		ctl->kmsg_outbuf = xmalloc(DMESG_FOLLOW_BUFSZ);
+		setvbuf(stdout, ctl->kmsg_outbuf, _IOFBF, DMESG_FOLLOW_BUFSZ);
+	}
 	return 0;
 }
 
@@ -1240,6 +1601,10 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 		goto mesg;
 
 	/* B) sequence number */
+	errno = 0;
+	rec->seq = strtoumax(p, NULL, 10);
+	if (errno)
+		rec->seq = 0;
 	p = skip_item(p, end, ",;");
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
@@ -1288,6 +1653,38 @@ mesg:
 	return 0;
 }
 
+/*
+ * Reports records overwritten in the kernel buffer before they have been read.
+ */
+static void check_kmsg_seq(struct dmesg_control *ctl, struct dmesg_record *rec)
+{
+	if (ctl->kmsg_seq_valid && rec->seq > ctl->kmsg_seq) {
+		uintmax_t n = rec->seq - ctl->kmsg_seq;
+
+		fflush(stdout);
+		warnx(P_("%ju message dropped", "%ju messages dropped", n), n);
+	}
+	ctl->kmsg_seq = rec->seq + 1;
+	ctl->kmsg_seq_valid = 1;
+}
+
+/*
+ * Waits for new records; the output is flushed before.
+ */
+static int wait_kmsg(struct dmesg_control *ctl)
+{
+	struct pollfd pfd = { .fd = ctl->kmsg, .events = POLLIN };
+	int rc;
+
+	if (fflush(stdout) != 0)
+		write_failed();
+	do {
+		rc = poll(&pfd, 1, -1);
+	} while (rc < 0 && errno == EINTR);
+
+	return rc < 0 ? -1 : 0;
+}
+
 /*
  * Note that each read() call for /dev/kmsg returns always one record. It means
  * that we don't have to read whole message buffer before the records parsing.
@@ -1295,6 +1692,9 @@ mesg:
  * So this function does not compose one huge buffer (like read_syslog_buffer())
  * and print_buffer() is unnecessary. All is done in this function.
  *
+ * In the follow mode all the available records are read and printed to the
+ * stdout buffer, the buffer is written when we have to wait for more records.
+ *
  * Returns 0 on success, -1 on error.
  */
 static int read_kmsg(struct dmesg_control *ctl)
@@ -1312,13 +1712,22 @@ static int read_kmsg(struct dmesg_control *ctl)
 	 */
 	sz = ctl->kmsg_first_read;
 
-	while (sz > 0) {
-		*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
+	while (1) {
+		while (sz > 0) {
+			*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
 
-		if (parse_kmsg_record(ctl, &rec,
-				      ctl->kmsg_buf, (size_t) sz) == 0)
-			print_record(ctl, &rec);
+			if (parse_kmsg_record(ctl, &rec,
+					      ctl->kmsg_buf, (size_t) sz) == 0) {
+				check_kmsg_seq(ctl, &rec);
+				print_record(ctl, &rec);
+			}
 
+			sz = read_kmsg_one(ctl);
+		}
+		if (!ctl->follow || (sz < 0 && errno != EAGAIN))
+			break;
+		if (wait_kmsg(ctl) != 0)
+			break;
 		sz = read_kmsg_one(ctl);
 	}
 
@@ -1387,7 +1796,8 @@ int main(int argc, char *argv[])
 		OPT_TIME_FORMAT = CHAR_MAX + 1,
 		OPT_NOESC,
 		OPT_SINCE,
-		OPT_UNTIL
+		OPT_UNTIL,
+		OPT_FILE_INDEX
 	};
 
 	static const struct option longopts[] = {
@@ -1399,6 +1809,7 @@ int main(int argc, char *argv[])
 		{ "console-on",    no_argument,       NULL, 'E' },
 		{ "decode",        no_argument,	      NULL, 'x' },
 		{ "file",          required_argument, NULL, 'F' },
+		{ "file-index",    required_argument, NULL, OPT_FILE_INDEX },
 		{ "facility",      required_argument, NULL, 'f' },
 		{ "follow",        no_argument,       NULL, 'w' },
 		{ "follow-new",    no_argument,       NULL, 'W' },
@@ -1551,6 +1962,9 @@ int main(int argc, char *argv[])
 		case OPT_NOESC:
 			ctl.noesc = 1;
 			break;
+		case OPT_FILE_INDEX:
+			ctl.indexname = optarg;
+			break;
 		case OPT_SINCE:
 		{
 			usec_t p;
@@ -1581,6 +1995,11 @@ int main(int argc, char *argv[])
 		errtryhelp(EXIT_FAILURE);
 	}
 
+	if (ctl.indexname && !ctl.filename)
+		errx(EXIT_FAILURE, _("--file-index requires --file"));
+	if (ctl.fltr_lev || ctl.fltr_fac)
+		init_privals(&ctl);
+
 	if (ctl.json) {
 		ctl.time_fmt = DMESG_TIMEFTM_TIME;
 		delta = 0;
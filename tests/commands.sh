@@ -26,6 +26,7 @@ TS_HELPER_PYLIBMOUNT_CONTEXT="$top_srcdir/libmount/python/test_mount_context.py"
 TS_HELPER_PYLIBMOUNT_TAB="$top_srcdir/libmount/python/test_mount_tab.py"
 TS_HELPER_PYLIBMOUNT_UPDATE="$top_srcdir/libmount/python/test_mount_tab_update.py"
 TS_HELPER_LOGGER="${ts_helpersdir}test_logger"
+TS_HELPER_LSFD_FILTER="${ts_helpersdir}test_lsfd_filter"
 TS_HELPER_LOGINDEFS="${ts_helpersdir}test_logindefs"
 TS_HELPER_MD5="${ts_helpersdir}test_md5"
 TS_HELPER_SHA1="${ts_helpersdir}test_sha1"
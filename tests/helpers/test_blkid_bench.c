@@ -0,0 +1,105 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Probing speed benchmark -- probes all specified images (e.g. the
+ * uncompressed tests/ts/blkid/images-fs/ corpus) in a loop and reports
+ * number of probes per second. To compare two libblkid versions run the
+ * same binary with LD_LIBRARY_PATH pointing to the another library.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <blkid.h>
+
+#include "c.h"
+#include "strutils.h"
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	fprintf(stdout, " %s [options] <image> ...\n\n",
+			program_invocation_short_name);
+	fputs(" -l, --loops <num>   number of probing loops (default 100)\n", stdout);
+	fputs(" -s, --safe          use blkid_do_safeprobe() rather than blkid_do_probe()\n", stdout);
+	fputs(" -h, --help          display this help\n", stdout);
+	exit(EXIT_SUCCESS);
+}
+
+static int probe_image(const char *filename, int safe)
+{
+	blkid_probe pr;
+	int rc;
+
+	pr = blkid_new_probe_from_filename(filename);
+	if (!pr)
+		return -1;
+
+	blkid_probe_enable_superblocks(pr, 1);
+	blkid_probe_set_superblocks_flags(pr, BLKID_SUBLKS_LABEL |
+			BLKID_SUBLKS_UUID | BLKID_SUBLKS_TYPE);
+	blkid_probe_enable_partitions(pr, 1);
+
+	rc = safe ? blkid_do_safeprobe(pr) : blkid_do_probe(pr);
+
+	blkid_free_probe(pr);
+	return rc < 0 ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start, end;
+	unsigned int nloops = 100, i;
+	uint64_t nprobes = 0, nerrs = 0;
+	double sec;
+	int c, safe = 0;
+
+	static const struct option longopts[] = {
+		{ "loops", required_argument, NULL, 'l' },
+		{ "safe",  no_argument,       NULL, 's' },
+		{ "help",  no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	while ((c = getopt_long(argc, argv, "l:sh", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'l':
+			nloops = strtou32_or_err(optarg, "failed to parse loops");
+			break;
+		case 's':
+			safe = 1;
+			break;
+		case 'h':
+			usage();
+		default:
+			fprintf(stderr, "try --help\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc)
+		usage();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < nloops; i++) {
+		int n;
+
+		for (n = optind; n < argc; n++) {
+			if (probe_image(argv[n], safe) != 0)
+				nerrs++;
+			nprobes++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1E9;
+
+	printf("probes:      %"PRIu64" (%"PRIu64" failed)\n", nprobes, nerrs);
+	printf("time:        %.3f sec\n", sec);
+	printf("probes/sec:  %.1f\n", sec > 0 ? nprobes / sec : 0.0);
+
+	return nerrs ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -22,10 +22,12 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <netinet/in.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <arpa/inet.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -483,6 +485,73 @@ static void make_socketpair(const struct factory *factory, struct fdesc fdescs[]
 	}
 }
 
+static int tcp_socket(const char *what, unsigned short port)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int one = 1;
+	int sd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (sd < 0)
+		err(EXIT_FAILURE, "failed to make a tcp socket for %s", what);
+	if (setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0)
+		err(EXIT_FAILURE, "failed to setsockopt(SO_REUSEADDR) for %s", what);
+	if (bind(sd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+		err(EXIT_FAILURE, "failed to bind %s to 127.0.0.1:%hu", what, port);
+	return sd;
+}
+
+static void make_tcp(const struct factory *factory, struct fdesc fdescs[], pid_t * child _U_,
+		     int argc, char ** argv)
+{
+	struct arg server_port = decode_arg("server-port", factory->params, argc, argv);
+	struct arg client_port = decode_arg("client-port", factory->params, argc, argv);
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(ARG_INTEGER(server_port)),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int sd[3];
+
+	sd[0] = tcp_socket("listening socket", ARG_INTEGER(server_port));
+	if (listen(sd[0], 1) < 0)
+		err(EXIT_FAILURE, "failed to listen");
+
+	sd[1] = tcp_socket("client socket", ARG_INTEGER(client_port));
+	if (connect(sd[1], (struct sockaddr *)&sin, sizeof(sin)) < 0)
+		err(EXIT_FAILURE, "failed to connect");
+
+	sd[2] = accept(sd[0], NULL, NULL);
+	if (sd[2] < 0)
+		err(EXIT_FAILURE, "failed to accept");
+
+	free_arg(&server_port);
+	free_arg(&client_port);
+
+	for (int i = 0; i < 3; i++) {
+		if (sd[i] != fdescs[i].fd) {
+			if (dup2(sd[i], fdescs[i].fd) < 0) {
+				int e = errno;
+				close(sd[0]);
+				close(sd[1]);
+				close(sd[2]);
+				errno = e;
+				err(EXIT_FAILURE, "failed to dup %d -> %d",
+				    sd[i], fdescs[i].fd);
+			}
+			close(sd[i]);
+		}
+		fdescs[i] = (struct fdesc){
+			.fd    = fdescs[i].fd,
+			.close = close_fdesc,
+			.data  = NULL
+		};
+	}
+}
+
 static void open_with_opath(const struct factory *factory, struct fdesc fdescs[], pid_t * child _U_,
 			    int argc, char ** argv)
 {
@@ -651,6 +720,30 @@ static const struct factory factories[] = {
 			PARAM_END
 		},
 	},
+	{
+		.name = "tcp",
+		.desc = "TCP sockets: listening, client, and accepted connected to 127.0.0.1",
+		.priv = false,
+		.N    = 3,
+		.EX_N = 0,
+		.fork = false,
+		.make = make_tcp,
+		.params = (struct parameter []) {
+			{
+				.name = "server-port",
+				.type = PTYPE_INTEGER,
+				.desc = "TCP port the server listens on",
+				.defv.integer = 12345,
+			},
+			{
+				.name = "client-port",
+				.type = PTYPE_INTEGER,
+				.desc = "TCP port the client binds to",
+				.defv.integer = 23456,
+			},
+			PARAM_END
+		},
+	},
 	{
 		.name = "symlink",
 		.desc = "symbolic link itself opened with O_PATH",
@@ -0,0 +1,141 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Time-based UUID generation benchmark -- generates UUIDs by the specified
+ * number of threads and reports number of UUIDs per second. The UUIDs are
+ * checked for duplicates at the end. To compare two libuuid versions run the
+ * same binary with LD_LIBRARY_PATH pointing to the another library.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <uuid.h>
+
+#include "c.h"
+#include "strutils.h"
+
+struct bench_thread {
+	pthread_t	thread;
+	uuid_t		*uuids;
+	size_t		count;
+	size_t		bulk;		/* 0 for uuid_generate_time_safe() */
+	size_t		unsafe;		/* number of not safely generated UUIDs */
+};
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	fprintf(stdout, " %s [options]\n\n", program_invocation_short_name);
+	fputs(" -n, --count <num>     number of UUIDs per thread (default 1000000)\n", stdout);
+	fputs(" -t, --threads <num>   number of threads (default 1)\n", stdout);
+	fputs(" -b, --bulk <num>      use uuid_generate_time_bulk() for <num> UUIDs\n", stdout);
+	fputs(" -h, --help            display this help\n", stdout);
+	exit(EXIT_SUCCESS);
+}
+
+static void *generate(void *data)
+{
+	struct bench_thread *th = data;
+	size_t i, n;
+
+	for (i = 0; i < th->count; i += n) {
+		if (th->bulk) {
+			n = min(th->bulk, th->count - i);
+			if (uuid_generate_time_bulk(th->uuids + i, n) != 0)
+				th->unsafe += n;
+		} else {
+			n = 1;
+			if (uuid_generate_time_safe(th->uuids[i]) != 0)
+				th->unsafe++;
+		}
+	}
+	return NULL;
+}
+
+static int cmp_uuids(const void *a, const void *b)
+{
+	return uuid_compare(*(const uuid_t *) a, *(const uuid_t *) b);
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start, end;
+	struct bench_thread *threads;
+	uuid_t *uuids;
+	size_t count = 1000000, nthreads = 1, bulk = 0, i, total, unsafe = 0, dups = 0;
+	double sec;
+	int c;
+
+	static const struct option longopts[] = {
+		{ "count",   required_argument, NULL, 'n' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "bulk",    required_argument, NULL, 'b' },
+		{ "help",    no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	while ((c = getopt_long(argc, argv, "n:t:b:h", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			count = strtou32_or_err(optarg, "failed to parse count");
+			break;
+		case 't':
+			nthreads = strtou32_or_err(optarg, "failed to parse threads");
+			break;
+		case 'b':
+			bulk = strtou32_or_err(optarg, "failed to parse bulk");
+			break;
+		case 'h':
+			usage();
+		default:
+			fprintf(stderr, "try --help\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if (!nthreads || !count)
+		usage();
+
+	total = count * nthreads;
+	uuids = malloc(total * sizeof(uuid_t));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!uuids || !threads)
+		err(EXIT_FAILURE, "cannot allocate memory");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < nthreads; i++) {
+		threads[i].uuids = uuids + i * count;
+		threads[i].count = count;
+		threads[i].bulk = bulk;
+		errno = pthread_create(&threads[i].thread, NULL, generate, &threads[i]);
+		if (errno)
+			err(EXIT_FAILURE, "cannot create thread");
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		unsafe += threads[i].unsafe;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1E9;
+
+	qsort(uuids, total, sizeof(uuid_t), cmp_uuids);
+	for (i = 1; i < total; i++) {
+		if (uuid_compare(uuids[i - 1], uuids[i]) == 0)
+			dups++;
+	}
+
+	printf("uuids:       %zu (%zu unsafe, %zu duplicates)\n", total, unsafe, dups);
+	printf("time:        %.3f sec\n", sec);
+	printf("uuids/sec:   %.1f\n", sec > 0 ? total / sec : 0.0);
+
+	free(threads);
+	free(uuids);
+	return dups ? EXIT_FAILURE : EXIT_SUCCESS;
+}
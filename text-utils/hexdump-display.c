@@ -32,11 +32,14 @@
  */
 
 #include <sys/param.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
 #include <ctype.h>
+#include <setjmp.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,6 +57,299 @@ enum _vflag vflag = FIRST;
 static off_t address;			/* address/offset in stream */
 static off_t eaddress;			/* end address */
 
+/*
+ * The common formats (-C, -b, -x, the default one, ...) use only text,
+ * addresses, unsigned integers and %_p. Such formats are compiled to
+ * a list of line operations, and all full blocks are rendered by
+ * print_line() without printf(). The last (partial) block and all other
+ * formats go through print().
+ */
+struct hexdump_op {
+	char *text;		/* literal text before the conversion */
+	size_t textlen;
+	unsigned int flags;	/* F_TEXT, F_ADDRESS, F_UINT or F_P */
+	int offset;		/* offset of the data in the block */
+	int bcnt;		/* byte count */
+	int base;		/* 8, 10 or 16 */
+	int upper;		/* use upper-case hex digits */
+	int zero;		/* '0' flag */
+	int width;		/* field width */
+	int prec;		/* precision, or -1 */
+};
+
+#define LINEBUF_SIZE	(64 * 1024)
+
+static struct hexdump_op *lineops;
+static size_t nlineops;
+static char *linebuf;		/* lines not written to stdout yet */
+static size_t linebufsz, linebufpos, linemax;
+static char printable[256];
+
+static int parse_op(struct hexdump_op *op, struct hexdump_pr *pr, size_t len)
+{
+	char *fmt = pr->fmt;
+	const char *p, *conv;
+
+	op->flags = pr->flags;
+	op->bcnt = pr->bcnt;
+	op->prec = -1;
+
+	if (pr->flags == F_TEXT) {
+		op->text = fmt;
+		op->textlen = len;
+		return 0;
+	}
+
+	p = strchr(fmt, '%');
+	if (!p)
+		return -1;
+	op->text = fmt;
+	op->textlen = p - fmt;
+
+	/* only the '0' flag, field width and precision are supported */
+	if (*++p == '0') {
+		op->zero = 1;
+		p++;
+	}
+	while (isdigit((unsigned char) *p))
+		op->width = op->width * 10 + (*p++ - '0');
+	if (*p == '.') {
+		op->prec = 0;
+		while (isdigit((unsigned char) *++p))
+			op->prec = op->prec * 10 + (*p - '0');
+	}
+	if (p != pr->cchar)
+		return -1;
+
+	conv = pr->cchar;
+	switch (pr->flags) {
+	case F_P:
+		return op->width || op->prec >= 0 || strcmp(conv, "c") ? -1 : 0;
+	case F_ADDRESS:
+		if (!strcmp(conv, "lld"))
+			op->base = 10;
+		else if (!strcmp(conv, "llo"))
+			op->base = 8;
+		else if (!strcmp(conv, "llx"))
+			op->base = 16;
+		else
+			return -1;
+		return 0;
+	case F_UINT:
+		if (!strcmp(conv, "llu"))
+			op->base = 10;
+		else if (!strcmp(conv, "llo"))
+			op->base = 8;
+		else if (!strcmp(conv, "llx"))
+			op->base = 16;
+		else if (!strcmp(conv, "llX")) {
+			op->base = 16;
+			op->upper = 1;
+		} else
+			return -1;
+		return 0;
+	}
+	return -1;
+}
+
+static void flush_lines(void)
+{
+	if (linebufpos)
+		fwrite(linebuf, 1, linebufpos, stdout);
+	linebufpos = 0;
+}
+
+static void free_line(void)
+{
+	size_t i;
+
+	flush_lines();
+	for (i = 0; i < nlineops; i++)
+		free(lineops[i].text);
+	free(lineops);
+	free(linebuf);
+	lineops = NULL;
+	linebuf = NULL;
+	nlineops = 0;
+	linemax = 0;
+}
+
+/* returns 1 if the block can be printed by print_line() */
+static int compile_line(struct hexdump *hex)
+{
+	struct list_head *p, *q, *r;
+	char *text = NULL;		/* text not followed by conversion yet */
+	size_t len, textlen = 0, i;
+	int cnt, offset;
+
+	if (colors_wanted())
+		return 0;
+
+	list_for_each(p, &hex->fshead) {
+		struct hexdump_fs *fs = list_entry(p, struct hexdump_fs, fslist);
+
+		offset = 0;
+		list_for_each(q, &fs->fulist) {
+			struct hexdump_fu *fu = list_entry(q, struct hexdump_fu, fulist);
+
+			if (fu->flags & F_IGNORE)
+				break;
+
+			for (cnt = fu->reps; cnt; cnt--) {
+				list_for_each(r, &fu->prlist) {
+					struct hexdump_pr *pr = list_entry(r, struct hexdump_pr, prlist);
+					struct hexdump_op op = { .text = NULL };
+
+					if (pr->colorlist)
+						goto fail;
+
+					len = strlen(pr->fmt);
+					if (cnt == 1 && pr->nospace)
+						len = pr->nospace - pr->fmt;
+					if (parse_op(&op, pr, len) != 0)
+						goto fail;
+
+					op.offset = offset;
+					offset += pr->bcnt;
+					if (offset > hex->blocksize)
+						goto fail;
+
+					/* merge all text to the next conversion */
+					text = xrealloc(text, textlen + op.textlen + 1);
+					memcpy(text + textlen, op.text, op.textlen);
+					textlen += op.textlen;
+					if (op.flags == F_TEXT)
+						continue;
+
+					op.text = text;
+					op.textlen = textlen;
+					text = NULL;
+					textlen = 0;
+
+					lineops = xrealloc(lineops, (nlineops + 1) * sizeof(op));
+					lineops[nlineops++] = op;
+				}
+			}
+		}
+	}
+	if (textlen) {
+		struct hexdump_op op = { .text = text, .textlen = textlen, .flags = F_TEXT };
+
+		lineops = xrealloc(lineops, (nlineops + 1) * sizeof(op));
+		lineops[nlineops++] = op;
+		text = NULL;
+	}
+	free(text);
+
+	for (i = 0; i < nlineops; i++) {
+		/* 22 digits of 64-bit octal number */
+		linemax += lineops[i].textlen +
+			   max(max(lineops[i].width, lineops[i].prec), 22);
+	}
+	for (i = 0; i < 256; i++)
+		printable[i] = isprint(i) ? i : '.';
+	linebufsz = max(linemax, (size_t) LINEBUF_SIZE);
+	linebuf = xmalloc(linebufsz);
+	return 1;
+fail:
+	free(text);
+	free_line();
+	return 0;
+}
+
+static char *print_number(char *p, const struct hexdump_op *op,
+			  unsigned long long val)
+{
+	const char *digits = op->upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char tmp[22], *t = tmp + sizeof(tmp);
+	int ndigits, nzeros = 0;
+
+	if (op->base == 16) {
+		for (; val; val >>= 4)
+			*--t = digits[val & 0xf];
+	} else if (op->base == 8) {
+		for (; val; val >>= 3)
+			*--t = digits[val & 0x7];
+	} else {
+		for (; val; val /= 10)
+			*--t = digits[val % 10];
+	}
+	ndigits = tmp + sizeof(tmp) - t;
+
+	/* the same rules as printf(3) */
+	if (op->prec >= 0) {
+		if (ndigits < op->prec)
+			nzeros = op->prec - ndigits;
+	} else if (!ndigits)
+		nzeros = 1;
+	if (op->zero && op->prec < 0 && ndigits + nzeros < op->width)
+		nzeros = op->width - ndigits;
+
+	for (; ndigits + nzeros < op->width; ndigits++)
+		*p++ = ' ';
+	for (; nzeros > 0; nzeros--)
+		*p++ = '0';
+	while (t < tmp + sizeof(tmp))
+		*p++ = *t++;
+	return p;
+}
+
+static void print_line(const unsigned char *bp)
+{
+	const struct hexdump_op *op;
+	char *p;
+	size_t i, j;
+
+	if (linebufpos + linemax > linebufsz)
+		flush_lines();
+	p = linebuf + linebufpos;
+
+	for (i = 0; i < nlineops; i++) {
+		const unsigned char *data;
+
+		op = &lineops[i];
+		data = bp + op->offset;
+
+		for (j = 0; j < op->textlen; j++)
+			*p++ = op->text[j];
+
+		switch (op->flags) {
+		case F_ADDRESS:
+			p = print_number(p, op, address + op->offset);
+			break;
+		case F_P:
+			*p++ = printable[*data];
+			break;
+		case F_UINT:
+		    {
+			unsigned short sval;	/* u_int16_t */
+			unsigned int ival;	/* u_int32_t */
+			unsigned long long Lval;/* u_int64_t */
+
+			switch (op->bcnt) {
+			case 1:
+				p = print_number(p, op, *data);
+				break;
+			case 2:
+				memcpy(&sval, data, sizeof(sval));
+				p = print_number(p, op, sval);
+				break;
+			case 4:
+				memcpy(&ival, data, sizeof(ival));
+				p = print_number(p, op, ival);
+				break;
+			case 8:
+				memcpy(&Lval, data, sizeof(Lval));
+				p = print_number(p, op, Lval);
+				break;
+			}
+			break;
+		    }
+		}
+	}
+	linebufpos = p - linebuf;
+}
+
 static const char *color_cond(struct hexdump_pr *pr, unsigned char *bp, int bcnt)
 {
 	register struct list_head *p;
@@ -248,8 +544,15 @@ void display(struct hexdump *hex)
 	off_t saveaddress;
 	unsigned char savech = 0, *savebp;
 	struct list_head *p, *q, *r;
+	int fast = compile_line(hex);
 
 	while ((bp = get(hex)) != NULL) {
+		/* the last partial block needs padding, see bpad() */
+		if (fast && !eaddress) {
+			print_line(bp);
+			continue;
+		}
+		flush_lines();
 		fs = &hex->fshead; savebp = bp; saveaddress = address;
 
 		list_for_each(p, fs) {
@@ -289,6 +592,8 @@ void display(struct hexdump *hex)
 			address = saveaddress;
 		}
 	}
+	free_line();
+
 	if (endfu) {
 		/*
 		 * if eaddress not set, error or file size was multiple of
@@ -324,21 +629,255 @@ void display(struct hexdump *hex)
 
 static char **_argv;
 
+/*
+ * Regular files are mmap()ed, and runs of duplicate blocks are skipped in bulk.
+ * The mapping covers the file size from the time of opening. The rest of the
+ * file (appended data) and files truncated meanwhile (SIGBUS) are read by
+ * stdio from the current mapping position.
+ */
+static u_char *mapbuf;			/* mapped input file */
+static size_t mapsize;			/* size of the mapping */
+static size_t mappos;			/* current offset in the mapping */
+static size_t mapchecked;		/* file size verified up to this offset */
+static size_t mappage;			/* page size */
+
+static sigjmp_buf map_jmp;
+static volatile sig_atomic_t map_guarded;	/* map_jmp is valid */
+static struct sigaction map_oldact;
+
+static void map_sigbus(int sig)
+{
+	if (map_guarded)
+		siglongjmp(map_jmp, 1);
+
+	/* not our fault, the default action on return */
+	signal(sig, SIG_DFL);
+}
+
+static void map_input(void)
+{
+	struct sigaction act;
+	struct stat st;
+	off_t pos;
+	void *p;
+
+	if (fstat(fileno(stdin), &st) != 0 || !S_ISREG(st.st_mode) ||
+	    (uintmax_t) st.st_size > SIZE_MAX)
+		return;
+	pos = ftello(stdin);
+	if (pos < 0 || pos >= st.st_size)
+		return;
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(stdin), 0);
+	if (p == MAP_FAILED)
+		return;
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = map_sigbus;
+	if (sigaction(SIGBUS, &act, &map_oldact) != 0) {
+		munmap(p, st.st_size);
+		return;
+	}
+	mapbuf = p;
+	mapsize = st.st_size;
+	mappos = pos;
+	mapchecked = 0;
+	mappage = getpagesize();
+}
+
+static void unmap_input(void)
+{
+	if (!mapbuf)
+		return;
+	munmap(mapbuf, mapsize);
+	sigaction(SIGBUS, &map_oldact, NULL);
+	mapbuf = NULL;
+	mapsize = mappos = 0;
+}
+
+/* the file is shorter than the mapping now */
+static int map_truncated(void)
+{
+	struct stat st;
+
+	return fstat(fileno(stdin), &st) != 0 || (uintmax_t) st.st_size < mapsize;
+}
+
+/* continue by stdio at the current position */
+static void unmap_input_at_pos(void)
+{
+	off_t pos = mappos;
+
+	unmap_input();
+	if (fseeko(stdin, pos, SEEK_SET) != 0)
+		warn("%s", _argv[-1]);
+}
+
+/* number of bytes we may use from the mapping */
+static size_t mapped_avail(struct hexdump *hex)
+{
+	size_t avail = mapsize - mappos;
+
+	if (hex->length != -1 && (size_t) hex->length < avail)
+		avail = hex->length;
+	return avail;
+}
+
+static void map_consume(struct hexdump *hex, size_t n)
+{
+	mappos += n;
+	if (hex->length != -1)
+		hex->length -= n;
+}
+
+/* returns offset of the first nonzero byte, or @len */
+static size_t first_nonzero(const u_char *buf, size_t len)
+{
+	typedef uintptr_t word;
+	size_t i = 0;
+
+	for (; i < len && ((uintptr_t) (buf + i) % sizeof(word)); i++) {
+		if (buf[i])
+			return i;
+	}
+	for (; i + 4 * sizeof(word) <= len; i += 4 * sizeof(word)) {
+		const word *wp = (const word *) (buf + i);
+
+		if (wp[0] | wp[1] | wp[2] | wp[3])
+			break;
+	}
+	for (; i < len; i++) {
+		if (buf[i])
+			return i;
+	}
+	return len;
+}
+
+/* returns offset of the first nonzero byte in the mapping, or @end */
+static size_t skip_zeros(size_t pos, size_t end)
+{
+	int fd = fileno(stdin);
+
+	while (pos < end) {
+		off_t data, hole;
+
+		/* holes are zeros, don't read them at all */
+		data = lseek(fd, pos, SEEK_DATA);
+		if (data < 0 && errno == ENXIO) {
+			struct stat st;
+
+			/* no data up to EOF, but the file may be truncated */
+			if (fstat(fd, &st) == 0 && (uintmax_t) st.st_size < end)
+				return max(pos, (size_t) st.st_size);
+			return end;
+		}
+		if (data < 0) {
+			data = pos;
+			hole = end;
+		} else {
+			hole = lseek(fd, data, SEEK_HOLE);
+			if (hole < 0)
+				hole = end;
+		}
+		if ((size_t) data >= end)
+			return end;
+		if ((size_t) hole > end)
+			hole = end;
+
+		pos = data + first_nonzero(mapbuf + data, hole - data);
+		if (pos < (size_t) hole)
+			break;
+	}
+	return pos;
+}
+
+/*
+ * Copies up to @need bytes from the mapping to @buf, returns number of copied
+ * bytes. Returns 0 at the end of the mapping or if the file has been
+ * truncated.
+ */
+static size_t map_read(struct hexdump *hex, u_char *buf, size_t need)
+{
+	size_t n = min(need, mapped_avail(hex));
+
+	/* the rest of the page after a new EOF is not SIGBUS, but zeros */
+	if (mappos + n > mapchecked) {
+		if (map_truncated())
+			return 0;
+		mapchecked = (mappos + n + mappage - 1) / mappage * mappage;
+	}
+
+	if (sigsetjmp(map_jmp, 1)) {
+		map_guarded = 0;
+		return 0;
+	}
+	map_guarded = 1;
+	memcpy(buf, mapbuf + mappos, n);
+	map_guarded = 0;
+
+	mappos += n;
+	return n;
+}
+
+/* returns end of the full blocks equal to @ref in the mapping */
+static size_t find_dups_end(struct hexdump *hex, const u_char *ref)
+{
+	size_t bs = hex->blocksize, end = mappos + mapped_avail(hex);
+	size_t pos = mappos;
+
+	if (first_nonzero(ref, bs) == bs)
+		pos = skip_zeros(pos, end);
+	else {
+		while (pos + bs <= end && !memcmp(mapbuf + pos, ref, bs))
+			pos += bs;
+	}
+	return pos;
+}
+
+/*
+ * Skips all full blocks equal to @ref in the mapping, returns number of
+ * skipped bytes.
+ */
+static size_t skip_dups(struct hexdump *hex, const u_char *ref)
+{
+	size_t n;
+
+	/* truncated file, map_read() will fail too */
+	if (map_truncated())
+		return 0;
+	if (sigsetjmp(map_jmp, 1)) {
+		map_guarded = 0;
+		return 0;
+	}
+	map_guarded = 1;
+	n = find_dups_end(hex, ref) - mappos;
+	map_guarded = 0;
+
+	n = n / hex->blocksize * hex->blocksize;
+	map_consume(hex, n);
+	return n;
+}
+
 static u_char *
 get(struct hexdump *hex)
 {
 	static int ateof = 1;
-	static u_char *curp, *savp;
+	static u_char *curp, *savp, *lastp;
 	ssize_t n, need, nread;
 	u_char *tmpp;
 
 	if (!curp) {
 		curp = xcalloc(1, hex->blocksize);
 		savp = xcalloc(1, hex->blocksize);
+		lastp = savp;
 	} else {
-		tmpp = curp;
-		curp = savp;
-		savp = tmpp;
+		/* keep the last block for comparison */
+		if (lastp == curp) {
+			tmpp = curp;
+			curp = savp;
+			savp = tmpp;
+			lastp = savp;
+		}
 		address += hex->blocksize;
 	}
 	need = hex->blocksize, nread = 0;
@@ -352,7 +891,8 @@ get(struct hexdump *hex)
 			if (need == hex->blocksize)
 				goto retnul;
 			if (!need && vflag != ALL &&
-			    !memcmp(curp, savp, nread)) {
+			    !memcmp(curp, lastp, nread)) {
+				flush_lines();
 				if (vflag != DUP)
 					printf("*\n");
 				goto retnul;
@@ -366,28 +906,41 @@ get(struct hexdump *hex)
 			warnx(_("all input file arguments failed"));
 			goto retnul;
 		}
-		n = fread((char *)curp + nread, sizeof(unsigned char),
-		    hex->length == -1 ? need : min(hex->length, need), stdin);
-		if (!n) {
-			if (ferror(stdin))
-				warn("%s", _argv[-1]);
-			ateof = 1;
-			continue;
+		if (mapbuf) {
+			n = map_read(hex, curp + nread, need);
+			if (!n) {
+				unmap_input_at_pos();
+				continue;
+			}
+		} else {
+			n = fread((char *)curp + nread, sizeof(unsigned char),
+			    hex->length == -1 ? need : min(hex->length, need), stdin);
+			if (!n) {
+				if (ferror(stdin))
+					warn("%s", _argv[-1]);
+				ateof = 1;
+				continue;
+			}
 		}
 		ateof = 0;
 		if (hex->length != -1)
 			hex->length -= n;
 		if (!(need -= n)) {
 			if (vflag == ALL || vflag == FIRST ||
-			    memcmp(curp, savp, hex->blocksize) != 0) {
+			    memcmp(curp, lastp, hex->blocksize) != 0) {
 				if (vflag == DUP || vflag == FIRST)
 					vflag = WAIT;
+				lastp = curp;
 				return(curp);
 			}
-			if (vflag == WAIT)
+			if (vflag == WAIT) {
+				flush_lines();
 				printf("*\n");
+			}
 			vflag = DUP;
 			address += hex->blocksize;
+			if (mapbuf)
+				address += skip_dups(hex, lastp);
 			need = hex->blocksize;
 			nread = 0;
 		}
@@ -395,6 +948,7 @@ get(struct hexdump *hex)
 			nread += n;
 	}
 retnul:
+	unmap_input();
 	free (curp);
 	free (savp);
 	return NULL;
@@ -427,8 +981,10 @@ int next(char **argv, struct hexdump *hex)
 			doskip(statok ? *_argv : "stdin", statok, hex);
 		if (*_argv)
 			++_argv;
-		if (!hex->skip)
+		if (!hex->skip) {
+			map_input();
 			return(1);
+		}
 	}
 	/* NOTREACHED */
 }